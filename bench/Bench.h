@@ -0,0 +1,81 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/*
+Minimal benchmark registry, the counterpart of tests/Test.h. BENCH(Name) defines a benchmark and
+registers it with the runner in BenchMain.cpp. With --quick every benchmark runs once on small
+inputs, which is how ctest checks that they still work; numbers only mean something in a Release
+build run by hand.
+*/
+struct BenchOptions {
+    bool m_quick = false;
+
+    // Picks the full or the quick size of an input.
+    size_t Scale(size_t full, size_t quick) const { return m_quick ? quick : full; }
+};
+
+struct Benchmark {
+    const char* m_name;
+    void (*m_pFunc)(const BenchOptions&);
+};
+
+inline std::vector<Benchmark>& GetBenchmarks()
+{
+    static std::vector<Benchmark> benchmarks;
+    return benchmarks;
+}
+
+struct BenchRegistration {
+    BenchRegistration(const char* name, void (*pFunc)(const BenchOptions&)) {
+        GetBenchmarks().push_back(Benchmark{ name, pFunc });
+    }
+};
+
+#define BENCH(name) \
+    static void name(const BenchOptions& options); \
+    static BenchRegistration name##Registration(#name, name); \
+    static void name([[maybe_unused]] const BenchOptions& options)
+
+// Fails the benchmark, e.g. when the implementations it compares disagree.
+#define BENCH_CHECK(condition) \
+    do { \
+        if (!(condition)) \
+            throw std::runtime_error(std::string(__FILE__) + ":" + std::to_string(__LINE__) + ": BENCH_CHECK(" #condition ") failed"); \
+    } while (0)
+
+// Best of several runs of func, in seconds. Runs once in quick mode.
+template<typename Func>
+double MeasureSeconds(const BenchOptions& options, Func&& func)
+{
+    int runs = options.m_quick ? 1 : 5;
+    double best = 1e300;
+    for (int i = 0; i < runs; i++) {
+        auto start = std::chrono::steady_clock::now();
+        func();
+        best = (std::min)(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+// Prints millions of items per second, and the speedup over a baseline time if one is given.
+inline void ReportThroughput(const std::string& label, double seconds, double items, const char* unit, double baselineSeconds = 0.0)
+{
+    if (baselineSeconds > 0.0)
+        printf("  %-48s %10.2f M%s/s  x%.2f\n", label.c_str(), items / seconds / 1e6, unit, baselineSeconds / seconds);
+    else
+        printf("  %-48s %10.2f M%s/s\n", label.c_str(), items / seconds / 1e6, unit);
+}
+
+// Keeps the compiler from dropping work whose result is otherwise unused.
+inline void KeepResult(uint64_t value)
+{
+    static volatile uint64_t sink = 0;
+    sink = sink + value;
+}
@@ -0,0 +1,33 @@
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include "Bench.h"
+
+// etl_lens_bench [--quick] [filter]: runs every benchmark, or those whose name contains filter.
+int main(int argc, char** argv)
+{
+    BenchOptions options;
+    const char* filter = "";
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--quick") == 0)
+            options.m_quick = true;
+        else
+            filter = argv[i];
+    }
+
+    size_t failed = 0;
+    for (const Benchmark& benchmark : GetBenchmarks()) {
+        if (strstr(benchmark.m_name, filter) == nullptr)
+            continue;
+        printf("%s\n", benchmark.m_name);
+        fflush(stdout);
+        try {
+            benchmark.m_pFunc(options);
+        }
+        catch (const std::exception& e) {
+            failed++;
+            printf("FAILED %s\n  %s\n", benchmark.m_name, e.what());
+        }
+    }
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,141 @@
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <ETL/DecodePlan.h>
+#include "Bench.h"
+
+namespace {
+
+EtlPropertyDesc Property(uint16_t inType, uint16_t length = 0, uint32_t flags = 0, uint16_t count = 1)
+{
+    return EtlPropertyDesc{ inType, ETL_OUTTYPE_NULL, flags, length, count, false };
+}
+
+template<typename T>
+void Put(std::vector<uint8_t>& payload, T value)
+{
+    payload.resize(payload.size() + sizeof(T));
+    memcpy(payload.data() + payload.size() - sizeof(T), &value, sizeof(T));
+}
+
+void PutUtf16(std::vector<uint8_t>& payload, size_t length)
+{
+    for (size_t i = 0; i < length; i++)
+        Put(payload, static_cast<uint16_t>('a' + i % 26));
+    Put(payload, uint16_t(0));
+}
+
+// Schema and payloads of one kind of event.
+struct PlanCase {
+    const char* m_name;
+    std::vector<EtlPropertyDesc> m_properties;
+    std::vector<std::vector<uint8_t>> m_payloads;
+};
+
+/*
+Three typical layouts: every offset fixed, nul-terminated strings that make later offsets depend
+on the data, and lengths and counts taken from earlier properties.
+*/
+std::vector<PlanCase> MakeCases(size_t payloadCount)
+{
+    std::vector<PlanCase> cases(3);
+
+    PlanCase& fixed = cases[0];
+    fixed.m_name = "fixed offsets (10 scalars)";
+    fixed.m_properties = { Property(ETL_INTYPE_UINT32), Property(ETL_INTYPE_UINT32), Property(ETL_INTYPE_UINT64), Property(ETL_INTYPE_POINTER),
+        Property(ETL_INTYPE_GUID), Property(ETL_INTYPE_FILETIME), Property(ETL_INTYPE_INT16), Property(ETL_INTYPE_UINT8),
+        Property(ETL_INTYPE_DOUBLE), Property(ETL_INTYPE_BOOLEAN) };
+
+    PlanCase& strings = cases[1];
+    strings.m_name = "strings (UTF-16, ANSI, 2 scalars)";
+    strings.m_properties = { Property(ETL_INTYPE_UINT32), Property(ETL_INTYPE_UNICODESTRING), Property(ETL_INTYPE_ANSISTRING), Property(ETL_INTYPE_UINT64) };
+
+    PlanCase& references = cases[2];
+    references.m_name = "param length and count";
+    references.m_properties = { Property(ETL_INTYPE_UINT16), Property(ETL_INTYPE_BINARY, 0, ETL_PROPERTY_PARAM_LENGTH),
+        Property(ETL_INTYPE_UINT32), Property(ETL_INTYPE_UINT32, 0, ETL_PROPERTY_PARAM_COUNT, 2), Property(ETL_INTYPE_POINTER) };
+
+    for (size_t i = 0; i < payloadCount; i++) {
+        std::vector<uint8_t> payload;
+        Put(payload, uint32_t(i));
+        Put(payload, uint32_t(i * 3));
+        Put(payload, uint64_t(i) << 20);
+        Put(payload, uint64_t(0x7ff612340000 + i));
+        for (int b = 0; b < 16; b++)
+            Put(payload, static_cast<uint8_t>(i + b));
+        Put(payload, uint64_t(133000000000000000 + i));
+        Put(payload, int16_t(-static_cast<int16_t>(i % 1000)));
+        Put(payload, uint8_t(i));
+        Put(payload, double(i) * 0.5);
+        Put(payload, uint32_t(i & 1));
+        fixed.m_payloads.push_back(std::move(payload));
+
+        payload.clear();
+        Put(payload, uint32_t(i));
+        PutUtf16(payload, 8 + i % 48);
+        for (size_t c = 0; c < 4 + i % 24; c++)
+            Put(payload, static_cast<char>('A' + c % 26));
+        Put(payload, char(0));
+        Put(payload, uint64_t(i));
+        strings.m_payloads.push_back(std::move(payload));
+
+        payload.clear();
+        uint16_t length = static_cast<uint16_t>(4 + i % 28);
+        Put(payload, length);
+        payload.insert(payload.end(), length, static_cast<uint8_t>(i));
+        uint32_t count = static_cast<uint32_t>(1 + i % 8);
+        Put(payload, count);
+        for (uint32_t e = 0; e < count; e++)
+            Put(payload, e);
+        Put(payload, uint64_t(i));
+        references.m_payloads.push_back(std::move(payload));
+    }
+    return cases;
+}
+
+}
+
+/*
+Throughput of DecodePlan::Execute over synthetic payloads of three layouts, in events and in
+properties per second. Every payload has to decode completely.
+*/
+BENCH(DecodePlanExecute)
+{
+    std::vector<PlanCase> cases = MakeCases(options.Scale(4096, 64));
+    size_t rounds = options.Scale(200, 1);
+    for (const PlanCase& planCase : cases) {
+        DecodePlan plan = DecodePlan::Compile(planCase.m_properties);
+        BENCH_CHECK(plan.IsValid());
+
+        std::vector<EtlValue> values;
+        for (const auto& payload : planCase.m_payloads) {
+            uint32_t consumed = plan.Execute(payload.data(), static_cast<uint32_t>(payload.size()), 8, values);
+            BENCH_CHECK(consumed == payload.size());
+            for (const EtlValue& value : values)
+                BENCH_CHECK(value.m_kind != EtlValueKind::Missing);
+        }
+
+        double seconds = MeasureSeconds(options, [&]() {
+            uint64_t sum = 0;
+            for (size_t round = 0; round < rounds; round++) {
+                for (const auto& payload : planCase.m_payloads) {
+                    sum += plan.Execute(payload.data(), static_cast<uint32_t>(payload.size()), 8, values);
+                    sum += values.back().m_uint;
+                }
+            }
+            KeepResult(sum);
+        });
+        double events = static_cast<double>(rounds * planCase.m_payloads.size());
+        ReportThroughput(planCase.m_name, seconds, events, "events");
+        ReportThroughput(std::string(planCase.m_name) + ", properties", seconds, events * static_cast<double>(plan.StepCount()), "props");
+    }
+
+    double seconds = MeasureSeconds(options, [&]() {
+        for (size_t round = 0; round < rounds; round++) {
+            for (const PlanCase& planCase : cases)
+                KeepResult(DecodePlan::Compile(planCase.m_properties).StepCount());
+        }
+    });
+    ReportThroughput("Compile", seconds, static_cast<double>(rounds * cases.size()), "plans");
+}
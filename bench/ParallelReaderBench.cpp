@@ -0,0 +1,119 @@
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <ETL/EtlFile.h>
+#include <ETL/EtlParallelReader.h>
+#include <utils/ThreadPool.h>
+#include "Bench.h"
+#include "SyntheticEtl.h"
+
+namespace {
+
+constexpr unsigned PROCESSOR_COUNT = 8;
+
+/*
+Writes a trace of full 64 KB buffers from PROCESSOR_COUNT processors whose events interleave in
+time, as in a real multi-processor trace, so the merge has to pick from every run. Returns the
+number of events.
+*/
+size_t WriteInterleavedTrace(const std::filesystem::path& path, size_t bufferCount)
+{
+    constexpr EtlGuid provider = { 0x0badf00d, 0x1, 0x2, { 3, 4, 5, 6, 7, 8, 9, 10 } };
+    std::vector<uint8_t> payload(48);
+    for (size_t i = 0; i < payload.size(); i++)
+        payload[i] = static_cast<uint8_t>(i * 7);
+
+    SyntheticEtl etl;
+    size_t eventCount = 0;
+    for (size_t buffer = 0; buffer < bufferCount; buffer++) {
+        uint8_t processor = static_cast<uint8_t>(buffer % PROCESSOR_COUNT);
+        int64_t begin = static_cast<int64_t>(buffer / PROCESSOR_COUNT) * 1000000;
+        etl.BeginBuffer(processor, begin);
+        EtlRawEventHeader header = {};
+        header.HeaderType = ETL_HEADER_TYPE_EVENT_HEADER64;
+        header.ProviderId = provider;
+        for (int64_t i = 0;; i++) {
+            header.TimeStamp = begin + i * PROCESSOR_COUNT + processor;
+            header.Id = static_cast<uint16_t>(i % 16);
+            if (!etl.Add(SyntheticEtl::EventRecord(header, payload)))
+                break;
+            eventCount++;
+        }
+    }
+    etl.Write(path);
+    return eventCount;
+}
+
+// Thread counts to measure: powers of two up to the pool size, and the pool size itself.
+std::vector<unsigned> ThreadCounts()
+{
+    unsigned slots = ThreadPool::Shared().SlotCount();
+    std::vector<unsigned> counts;
+    for (unsigned count = 1; count < slots; count *= 2)
+        counts.push_back(count);
+    counts.push_back(slots);
+    return counts;
+}
+
+}
+
+/*
+Throughput of EtlParallelReader against thread count: a pass touching every payload byte, and
+CollectOrdered, which adds the k-way merge into timestamp order. The merged order has to be the
+same whatever the thread count.
+*/
+BENCH(ParallelReaderScaling)
+{
+    TempFile temp("bench_interleaved.etl");
+    size_t eventCount = WriteInterleavedTrace(temp.GetPath(), options.Scale(1024, 32));
+    EtlFile file(temp.GetPath());
+    printf("  %zu buffers, %zu events, %u pool slots\n", file.GetBufferCount(), eventCount, ThreadPool::Shared().SlotCount());
+
+    double serialSeconds = MeasureSeconds(options, [&]() {
+        uint64_t sum = 0;
+        file.ForEachEvent([&sum](const EtlEventView& view) {
+            for (uint16_t i = 0; i < view.m_userDataLength; i++)
+                sum += view.m_pUserData[i];
+            return true;
+        });
+        KeepResult(sum);
+    });
+    ReportThroughput("EtlFile::ForEachEvent (serial)", serialSeconds, static_cast<double>(eventCount), "events");
+
+    std::vector<EtlEventLocation> expected;
+    double collectBaseline = 0.0;
+    for (unsigned threadCount : ThreadCounts()) {
+        EtlParallelReader reader(file, threadCount);
+        std::vector<uint64_t> sums(reader.GetThreadCount());
+        double seconds = MeasureSeconds(options, [&]() {
+            reader.ForEachEvent([&sums](unsigned threadIndex, const EtlEventView& view) {
+                uint64_t sum = 0;
+                for (uint16_t i = 0; i < view.m_userDataLength; i++)
+                    sum += view.m_pUserData[i];
+                sums[threadIndex] += sum;
+            });
+        });
+        for (uint64_t sum : sums)
+            KeepResult(sum);
+        ReportThroughput("ForEachEvent, " + std::to_string(threadCount) + " threads", seconds, static_cast<double>(eventCount), "events", serialSeconds);
+
+        std::vector<EtlEventLocation> locations;
+        seconds = MeasureSeconds(options, [&]() {
+            locations = reader.CollectOrdered([](const EtlEventView&) { return true; });
+        });
+        if (collectBaseline == 0.0)
+            collectBaseline = seconds;
+        ReportThroughput("CollectOrdered, " + std::to_string(threadCount) + " threads", seconds, static_cast<double>(eventCount), "events", collectBaseline);
+
+        BENCH_CHECK(locations.size() == eventCount);
+        BENCH_CHECK(std::is_sorted(locations.begin(), locations.end(), EtlLocationLess));
+        if (expected.empty())
+            expected = std::move(locations);
+        else
+            BENCH_CHECK(std::equal(locations.begin(), locations.end(), expected.begin(), [](const EtlEventLocation& a, const EtlEventLocation& b) {
+                return a.m_bufferIndex == b.m_bufferIndex && a.m_bufferOffset == b.m_bufferOffset;
+            }));
+    }
+}
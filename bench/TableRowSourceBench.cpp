@@ -0,0 +1,96 @@
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <utils/TableRowSource.h>
+#include "Bench.h"
+
+namespace {
+
+constexpr size_t COLUMN_COUNT = 8;
+constexpr size_t VISIBLE_ROWS = 45;
+
+// Rows formatted on demand from their index, the way the instance table formats a row once it is read.
+class GeneratedRows : public TableRowSource
+{
+public:
+    explicit GeneratedRows(size_t rowCount) : m_rowCount(rowCount) {
+
+    }
+
+    size_t RowCount() const override { return m_rowCount; }
+    size_t ColumnCount() const override { return COLUMN_COUNT; }
+
+    const char* GetLabel(size_t row) override
+    {
+        char* p = std::to_chars(m_label, m_label + 24, row).ptr;
+        *p++ = '#';
+        *p++ = '#';
+        *p++ = '#';
+        *std::to_chars(p, m_label + sizeof(m_label) - 1, row).ptr = '\0';
+        return m_label;
+    }
+
+    std::string_view GetCell(size_t row, size_t column) override
+    {
+        char* p = std::to_chars(m_cell, m_cell + sizeof(m_cell), row * 2654435761u + column, 16).ptr;
+        return std::string_view(m_cell, static_cast<size_t>(p - m_cell));
+    }
+
+private:
+    size_t m_rowCount;
+    char m_label[64];
+    char m_cell[32];
+};
+
+// Reads what DrawTableRows reads for a range of rows; returns the number of text bytes.
+uint64_t DrawRows(TableRowSource& source, size_t firstRow, size_t endRow)
+{
+    uint64_t bytes = 0;
+    VisitTableRows(source, firstRow, endRow, [&](size_t row, bool ready) {
+        if (!ready)
+            return;
+        bytes += static_cast<uint8_t>(source.GetLabel(row)[0]);
+        for (size_t column = 1; column < source.ColumnCount(); column++)
+            bytes += source.GetCell(row, column).size();
+    });
+    return bytes;
+}
+
+}
+
+/*
+Frames per second of drawing a scrolling table through VisitTableRows, which only reads the
+visible rows, against walking every row each frame as the tables did before. The visible cost
+has to stay flat as the table grows.
+*/
+BENCH(TableRowSourceFrames)
+{
+    size_t frames = options.Scale(20000, 10);
+    for (size_t rowCount : { size_t(1000), size_t(100000), options.Scale(10000000, 10000) }) {
+        GeneratedRows rows(rowCount);
+        double seconds = MeasureSeconds(options, [&]() {
+            uint64_t bytes = 0;
+            for (size_t frame = 0; frame < frames; frame++) {
+                size_t first = (frame * 997) % (rowCount - VISIBLE_ROWS);
+                bytes += DrawRows(rows, first, first + VISIBLE_ROWS);
+            }
+            KeepResult(bytes);
+        });
+        printf("  %-48s %12.0f frames/s\n", (std::to_string(rowCount) + " rows, visible rows only").c_str(), frames / seconds);
+
+        // Walking every row is too slow to measure for many frames on large tables.
+        if (rowCount > 100000)
+            continue;
+        size_t fullFrames = (std::max)(size_t(1), frames * VISIBLE_ROWS / rowCount);
+        double fullSeconds = MeasureSeconds(options, [&]() {
+            uint64_t bytes = 0;
+            for (size_t frame = 0; frame < fullFrames; frame++)
+                bytes += DrawRows(rows, 0, rowCount);
+            KeepResult(bytes);
+        });
+        printf("  %-48s %12.0f frames/s\n", (std::to_string(rowCount) + " rows, every row").c_str(), fullFrames / fullSeconds);
+    }
+}
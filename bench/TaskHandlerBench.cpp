@@ -0,0 +1,197 @@
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+#include <utils/TaskHandler.h>
+#include "Bench.h"
+
+namespace {
+
+/*
+The TaskHandler this replaced, with SRWLOCK/CONDITION_VARIABLE swapped for their std
+equivalents so it runs everywhere: one thread, unbounded std::queues behind one lock each,
+PushInput/PushOutput copying their message and PopInput copying the front element. It only
+stops when threadFunc returns true, so callers push a sentinel message.
+*/
+template<typename inType, typename outType>
+class LegacyTaskHandler
+{
+public:
+    explicit LegacyTaskHandler(std::function<bool(inType&&, LegacyTaskHandler<inType, outType>*)> threadFunc)
+    {
+        m_thread = std::thread([this, threadFunc]() {
+            inType msg;
+            while (PopInput(&msg, true)) {
+                if (threadFunc(std::move(msg), this))
+                    break;
+            }
+        });
+    }
+
+    void Join() { m_thread.join(); }
+
+    void PushInput(inType&& message)
+    {
+        {
+            std::lock_guard lock(m_inLock);
+            m_inputQueue.emplace(message);
+        }
+        m_inCV.notify_all();
+    }
+
+    void PushOutput(outType&& message)
+    {
+        {
+            std::lock_guard lock(m_outLock);
+            m_outputQueue.emplace(message);
+        }
+        m_outCV.notify_all();
+    }
+
+    bool PopInput(inType* pIn, bool wait = true)
+    {
+        std::unique_lock lock(m_inLock);
+        if (m_inputQueue.empty() && !wait)
+            return false;
+        m_inCV.wait(lock, [this]() { return !m_inputQueue.empty(); });
+        *pIn = m_inputQueue.front();
+        m_inputQueue.pop();
+        return true;
+    }
+
+    bool PopOutput(outType* pOut, bool wait = true)
+    {
+        std::unique_lock lock(m_outLock);
+        if (m_outputQueue.empty() && !wait)
+            return false;
+        m_outCV.wait(lock, [this]() { return !m_outputQueue.empty(); });
+        *pOut = std::move(m_outputQueue.front());
+        m_outputQueue.pop();
+        return true;
+    }
+
+private:
+    std::queue<inType> m_inputQueue;
+    std::queue<outType> m_outputQueue;
+    std::mutex m_inLock;
+    std::condition_variable m_inCV;
+    std::mutex m_outLock;
+    std::condition_variable m_outCV;
+    std::thread m_thread;
+};
+
+constexpr uint64_t SENTINEL_ID = UINT64_MAX;
+
+// A request carrying a payload, like the decoded rows the handlers pass around.
+struct Message {
+    uint64_t m_id = 0;
+    std::vector<uint8_t> m_payload;
+};
+
+Message MakeMessage(uint64_t id, size_t payloadBytes)
+{
+    Message message;
+    message.m_id = id;
+    message.m_payload.assign(payloadBytes, static_cast<uint8_t>(id));
+    return message;
+}
+
+// The work of a task: reads the payload and hands the message back.
+template<typename Handler>
+bool Process(Message&& message, Handler* pHandler)
+{
+    if (message.m_id == SENTINEL_ID)
+        return true;
+    uint64_t sum = 0;
+    for (uint8_t byte : message.m_payload)
+        sum += byte;
+    message.m_id += sum & 1;
+    pHandler->PushOutput(std::move(message));
+    return false;
+}
+
+// Pushes count messages while another thread drains the results. Returns the seconds taken.
+template<typename Handler>
+double RunThroughput(Handler& handler, size_t count, size_t payloadBytes)
+{
+    auto start = std::chrono::steady_clock::now();
+    std::thread consumer([&]() {
+        Message result;
+        uint64_t sum = 0;
+        for (size_t i = 0; i < count; i++) {
+            handler.PopOutput(&result, true);
+            sum += result.m_id;
+        }
+        KeepResult(sum);
+    });
+    for (size_t i = 0; i < count; i++)
+        handler.PushInput(MakeMessage(i, payloadBytes));
+    consumer.join();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Average round trip of one message at a time, in microseconds.
+template<typename Handler>
+double RunLatency(Handler& handler, size_t count)
+{
+    auto start = std::chrono::steady_clock::now();
+    Message result;
+    for (size_t i = 0; i < count; i++) {
+        handler.PushInput(MakeMessage(i, 64));
+        handler.PopOutput(&result, true);
+    }
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / static_cast<double>(count);
+}
+
+using Legacy = LegacyTaskHandler<Message, Message>;
+using Current = TaskHandler<Message, Message>;
+
+}
+
+/*
+TaskHandler against the implementation it replaced: throughput of messages with small and large
+payloads pushed by one thread and drained by another, for 1 to 4 workers, and the round trip of
+a single message.
+*/
+BENCH(TaskHandlerVsLegacy)
+{
+    size_t count = options.Scale(200000, 1000);
+    for (size_t payloadBytes : { size_t(64), size_t(4096) }) {
+        std::string size = std::to_string(payloadBytes) + " B payloads";
+        double legacySeconds = 0.0;
+        {
+            Legacy handler(Process<Legacy>);
+            legacySeconds = RunThroughput(handler, count, payloadBytes);
+            handler.PushInput(MakeMessage(SENTINEL_ID, 0));
+            handler.Join();
+        }
+        ReportThroughput(size + ", legacy", legacySeconds, static_cast<double>(count), "msgs");
+        for (unsigned workers : { 1u, 2u, 4u }) {
+            Current handler(Process<Current>, workers);
+            double seconds = RunThroughput(handler, count, payloadBytes);
+            ReportThroughput(size + ", " + std::to_string(workers) + (workers == 1 ? " worker" : " workers"), seconds, static_cast<double>(count), "msgs", legacySeconds);
+        }
+    }
+
+    size_t roundTrips = options.Scale(20000, 100);
+    double legacyMicroseconds = 0.0;
+    {
+        Legacy handler(Process<Legacy>);
+        legacyMicroseconds = RunLatency(handler, roundTrips);
+        handler.PushInput(MakeMessage(SENTINEL_ID, 0));
+        handler.Join();
+    }
+    double microseconds = 0.0;
+    {
+        Current handler(Process<Current>);
+        microseconds = RunLatency(handler, roundTrips);
+    }
+    printf("  %-48s %10.2f us\n", "round trip, legacy", legacyMicroseconds);
+    printf("  %-48s %10.2f us\n", "round trip, 1 worker", microseconds);
+}
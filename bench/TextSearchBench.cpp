@@ -0,0 +1,109 @@
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <ETL/EtlFile.h>
+#include <ETL/EtlParallelReader.h>
+#include <ETL/EtlTrigramIndex.h>
+#include "Bench.h"
+#include "SyntheticEtl.h"
+
+namespace {
+
+constexpr size_t BATCH_DOCUMENTS = 1 << 16;
+
+// Lowered text like the string properties of file and registry events, with a few values each.
+std::vector<std::vector<std::string>> MakeDocuments(size_t count)
+{
+    static constexpr std::string_view DIRECTORIES[] = { "\\device\\harddiskvolume3\\windows\\system32\\", "\\device\\harddiskvolume3\\program files\\",
+        "\\registry\\machine\\software\\microsoft\\", "c:\\users\\bench\\appdata\\local\\temp\\" };
+    std::mt19937 random(17);
+    std::vector<std::vector<std::string>> documents(count);
+    for (size_t doc = 0; doc < count; doc++) {
+        std::string path(DIRECTORIES[random() % 4]);
+        path += "file_" + std::to_string(random() % 50000) + (random() % 2 == 0 ? ".dll" : ".tmp");
+        documents[doc] = { path, "process_" + std::to_string(doc % 300) + ".exe" };
+    }
+    return documents;
+}
+
+EtlTrigramIndex BuildIndex(const std::vector<std::vector<std::string>>& documents, const EtlParallelReader& reader)
+{
+    EtlTrigramIndex index;
+    index.AddType(EventIdentifier({ 1, 2, 3, { 4 } }, 1, 0), documents.size());
+    std::vector<EtlTrigramIndex::Partial> partials(reader.GetThreadCount());
+    for (size_t begin = 0; begin < documents.size(); begin += BATCH_DOCUMENTS) {
+        size_t end = (std::min)(begin + BATCH_DOCUMENTS, documents.size());
+        reader.ParallelFor(partials.size(), [&](unsigned, size_t chunk) {
+            for (size_t doc = begin + (end - begin) * chunk / partials.size(); doc < begin + (end - begin) * (chunk + 1) / partials.size(); doc++) {
+                for (const std::string& text : documents[doc])
+                    partials[chunk].AddText(text);
+                partials[chunk].EndDocument(static_cast<uint32_t>(doc));
+            }
+        });
+        index.Merge(partials, reader);
+    }
+    index.Finish(reader);
+    return index;
+}
+
+}
+
+/*
+Bytes per second of EtlFindText against std::string_view::find, over text that contains neither
+needle but often their first byte, and documents per second of a search: the candidates of the
+trigram index, then their verification with EtlFindText, against verifying every document.
+*/
+BENCH(TextSearch)
+{
+    TempFile etlFile("bench_text_search.etl");
+    SyntheticEtl etl(4096);
+    etl.BeginBuffer(0, 0);
+    etl.Write(etlFile.GetPath());
+    EtlFile file(etlFile.GetPath());
+    EtlParallelReader reader(file);
+
+    std::string text;
+    for (const auto& document : MakeDocuments(options.Scale(400000, 4000)))
+        text += document[0];
+    for (std::string_view needle : { std::string_view("\\windows\\system64"), std::string_view("\\file_99999") }) {
+        size_t scalar = 0;
+        double scalarSeconds = MeasureSeconds(options, [&]() { scalar = std::string_view(text).find(needle); });
+        size_t found = 0;
+        double seconds = MeasureSeconds(options, [&]() { found = EtlFindText(text, needle); });
+        BENCH_CHECK(found == scalar);
+        KeepResult(found);
+        ReportThroughput("EtlFindText '" + std::string(needle) + "'", seconds, static_cast<double>(text.size()), "B", scalarSeconds);
+    }
+
+    std::vector<std::vector<std::string>> documents = MakeDocuments(options.Scale(2000000, 20000));
+    EtlTrigramIndex index;
+    double buildSeconds = MeasureSeconds(options, [&]() { index = BuildIndex(documents, reader); });
+    ReportThroughput("Index build", buildSeconds, static_cast<double>(documents.size()), "docs");
+
+    // A rare file name, a common extension, and a needle made of common trigrams that narrow each other down.
+    for (std::string_view needle : { std::string_view("file_4242.dll"), std::string_view(".tmp"), std::string_view("system32\\file_1") }) {
+        uint64_t scanMatches = 0;
+        double scanSeconds = MeasureSeconds(options, [&]() {
+            scanMatches = 0;
+            for (const auto& document : documents)
+                scanMatches += std::any_of(document.begin(), document.end(), [&](const std::string& value) { return EtlFindText(value, needle) != std::string_view::npos; });
+        });
+        uint64_t matches = 0;
+        std::vector<uint32_t> candidates;
+        double seconds = MeasureSeconds(options, [&]() {
+            index.FindCandidates(needle, candidates);
+            matches = 0;
+            for (uint32_t doc : candidates) {
+                const auto& document = documents[doc];
+                matches += std::any_of(document.begin(), document.end(), [&](const std::string& value) { return EtlFindText(value, needle) != std::string_view::npos; });
+            }
+        });
+        BENCH_CHECK(matches == scanMatches);
+        KeepResult(matches);
+        ReportThroughput("Search '" + std::string(needle) + "', " + std::to_string(candidates.size()) + " candidates", seconds,
+            static_cast<double>(documents.size()), "docs", scanSeconds);
+    }
+}
@@ -0,0 +1,136 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <future>
+#include <string>
+#include <vector>
+#include <utils/ThreadPool.h>
+#include "Bench.h"
+
+namespace {
+
+// Thread counts to measure: powers of two up to the pool size, and the pool size itself.
+std::vector<unsigned> ThreadCounts()
+{
+    unsigned slots = ThreadPool::Shared().SlotCount();
+    std::vector<unsigned> counts;
+    for (unsigned count = 1; count < slots; count *= 2)
+        counts.push_back(count);
+    counts.push_back(slots);
+    return counts;
+}
+
+// A few hundred nanoseconds of arithmetic, about the cost of decoding one event.
+uint64_t Work(uint64_t seed)
+{
+    uint64_t x = seed | 1;
+    for (int i = 0; i < 64; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+    }
+    return x;
+}
+
+// Splits [begin, end) in TaskGroups down to leaves of leafSize items, like recursive fork-join ingest.
+uint64_t ForkJoin(ThreadPool& pool, size_t begin, size_t end, size_t leafSize)
+{
+    if (end - begin <= leafSize) {
+        uint64_t sum = 0;
+        for (size_t i = begin; i < end; i++)
+            sum += Work(i);
+        return sum;
+    }
+    size_t middle = begin + (end - begin) / 2;
+    uint64_t left = 0;
+    TaskGroup group(pool);
+    group.Run([&]() { left = ForkJoin(pool, begin, middle, leafSize); });
+    uint64_t right = ForkJoin(pool, middle, end, leafSize);
+    group.Wait();
+    return left + right;
+}
+
+}
+
+/*
+Scaling of the shared pool against thread count: ParallelFor over chunks of small items, and
+fork-join recursion through nested TaskGroups, both against a serial loop. Then the overhead of
+one task posted through a TaskGroup, Submit or ParallelFor on an otherwise idle pool.
+*/
+BENCH(ThreadPoolScaling)
+{
+    ThreadPool& pool = ThreadPool::Shared();
+    size_t count = options.Scale(2000000, 20000);
+    printf("  %zu items, %u pool slots\n", count, pool.SlotCount());
+
+    uint64_t expected = 0;
+    double serialSeconds = MeasureSeconds(options, [&]() {
+        uint64_t sum = 0;
+        for (size_t i = 0; i < count; i++)
+            sum += Work(i);
+        expected = sum;
+    });
+    KeepResult(expected);
+    ReportThroughput("serial loop", serialSeconds, static_cast<double>(count), "items");
+
+    // Each index is a chunk of items, as the readers hand out whole buffers.
+    constexpr size_t CHUNK_ITEMS = 256;
+    size_t chunkCount = (count + CHUNK_ITEMS - 1) / CHUNK_ITEMS;
+    for (unsigned threadCount : ThreadCounts()) {
+        std::vector<uint64_t> sums(threadCount);
+        double seconds = MeasureSeconds(options, [&]() {
+            std::fill(sums.begin(), sums.end(), 0);
+            pool.ParallelFor(chunkCount, [&](unsigned slot, size_t chunk) {
+                size_t end = (std::min)(count, (chunk + 1) * CHUNK_ITEMS);
+                uint64_t sum = 0;
+                for (size_t i = chunk * CHUNK_ITEMS; i < end; i++)
+                    sum += Work(i);
+                sums[slot] += sum;
+            }, threadCount);
+        });
+        uint64_t sum = 0;
+        for (uint64_t slotSum : sums)
+            sum += slotSum;
+        BENCH_CHECK(sum == expected);
+        ReportThroughput("ParallelFor, " + std::to_string(threadCount) + " threads", seconds, static_cast<double>(count), "items", serialSeconds);
+    }
+
+    // Fork-join only scales with the whole pool, so vary the leaf size instead of the thread count.
+    for (size_t leafSize : { size_t(16), size_t(256), size_t(4096) }) {
+        uint64_t sum = 0;
+        double seconds = MeasureSeconds(options, [&]() { sum = ForkJoin(pool, 0, count, leafSize); });
+        BENCH_CHECK(sum == expected);
+        ReportThroughput("TaskGroup fork-join, " + std::to_string(leafSize) + " item leaves", seconds, static_cast<double>(count), "items", serialSeconds);
+    }
+
+    size_t tasks = options.Scale(200000, 1000);
+    double groupSeconds = MeasureSeconds(options, [&]() {
+        std::atomic<uint64_t> ran = 0;
+        TaskGroup group(pool);
+        for (size_t i = 0; i < tasks; i++)
+            group.Run([&ran]() { ran.fetch_add(1, std::memory_order_relaxed); });
+        group.Wait();
+        KeepResult(ran);
+    });
+    double submitSeconds = MeasureSeconds(options, [&]() {
+        std::vector<std::future<size_t>> futures;
+        futures.reserve(tasks);
+        for (size_t i = 0; i < tasks; i++)
+            futures.push_back(pool.Submit([i]() { return i; }));
+        uint64_t sum = 0;
+        for (auto& future : futures)
+            sum += future.get();
+        KeepResult(sum);
+    });
+    size_t loops = options.Scale(20000, 100);
+    double parallelForSeconds = MeasureSeconds(options, [&]() {
+        std::atomic<uint64_t> ran = 0;
+        for (size_t i = 0; i < loops; i++)
+            pool.ParallelFor(pool.SlotCount(), [&ran](unsigned, size_t) { ran.fetch_add(1, std::memory_order_relaxed); });
+        KeepResult(ran);
+    });
+    printf("  %-48s %10.0f ns\n", "per task, TaskGroup::Run", groupSeconds * 1e9 / static_cast<double>(tasks));
+    printf("  %-48s %10.0f ns\n", "per task, Submit + future", submitSeconds * 1e9 / static_cast<double>(tasks));
+    printf("  %-48s %10.0f ns\n", "per empty ParallelFor over every slot", parallelForSeconds * 1e9 / static_cast<double>(loops));
+}
@@ -0,0 +1,89 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+#include <ETL/EtlTraceDatabase.h>
+#include <ETL/EtlTraceSource.h>
+#include "Bench.h"
+#include "SyntheticEtl.h"
+
+namespace {
+
+constexpr size_t BATCH_ROWS = 16384;
+
+// Batches of a type with columnCount columns cycling through every column type, like the decoded tables ingest receives.
+std::vector<std::shared_ptr<const EtlColumnTable>> MakeBatches(size_t rowCount, size_t columnCount)
+{
+    std::vector<std::string> names;
+    std::vector<EtlColumnType> types;
+    for (size_t i = 0; i < columnCount; i++) {
+        names.push_back("Column" + std::to_string(i));
+        types.push_back(static_cast<EtlColumnType>(i % 4));
+    }
+    std::vector<std::shared_ptr<const EtlColumnTable>> batches;
+    std::vector<std::string> values(columnCount);
+    for (size_t first = 0; first < rowCount; first += BATCH_ROWS) {
+        auto pBatch = std::make_shared<EtlColumnTable>(names, types);
+        std::vector<char> scratch;
+        for (size_t row = first; row < (std::min)(rowCount, first + BATCH_ROWS); row++) {
+            std::vector<EtlValue> rowValues(columnCount);
+            for (size_t i = 0; i < columnCount; i++) {
+                EtlValue& value = rowValues[i];
+                value.m_size = 8;
+                switch (types[i]) {
+                case EtlColumnType::Int64: value.m_kind = EtlValueKind::Int; value.m_int = -static_cast<int64_t>(row * 7 + i); break;
+                case EtlColumnType::UInt64: value.m_kind = EtlValueKind::UInt; value.m_uint = row * 0x9E3779B97F4A7C15ull; break;
+                case EtlColumnType::Double: value.m_kind = EtlValueKind::Double; value.m_double = row / 3.0; break;
+                case EtlColumnType::String:
+                    values[i] = "process_" + std::to_string(row % 512) + ".exe";
+                    value.m_kind = EtlValueKind::AnsiString;
+                    value.m_inType = ETL_INTYPE_ANSISTRING;
+                    value.m_pData = reinterpret_cast<const uint8_t*>(values[i].data());
+                    value.m_size = static_cast<uint32_t>(values[i].size());
+                    break;
+                }
+            }
+            pBatch->AppendRow(static_cast<int64_t>(row * 100), rowValues, scratch);
+        }
+        batches.push_back(std::move(pBatch));
+    }
+    return batches;
+}
+
+}
+
+/*
+Rows per second of writing decoded tables to a trace database, from the first Write to the end
+of Finish, which builds the timestamp indexes and checkpoints the WAL. Narrow and wide types show
+how the per-row cost of the multi-row inserts grows with the column count.
+*/
+BENCH(TraceDatabaseIngest)
+{
+    TempFile etlFile("bench_database.etl");
+    SyntheticEtl etl(4096);
+    etl.BeginBuffer(0, 0);
+    etl.Write(etlFile.GetPath());
+    EtlTraceSource source = EtlTraceSource::Of(etlFile.GetPath());
+    TempFile databaseFile("bench_database.etl.sqlite");
+    TempFile walFile("bench_database.etl.sqlite-wal");
+    TempFile shmFile("bench_database.etl.sqlite-shm");
+
+    size_t rowCount = options.Scale(2000000, 20000);
+    for (size_t columnCount : { size_t(1), size_t(4), size_t(16) }) {
+        std::vector<std::shared_ptr<const EtlColumnTable>> batches = MakeBatches(rowCount, columnCount);
+        double seconds = MeasureSeconds(options, [&]() {
+            EtlTraceDatabase database(databaseFile.GetPath(), source);
+            auto pType = std::make_shared<EtlDatabaseEventType>();
+            for (size_t i = 0; i < columnCount; i++)
+                pType->m_properties.emplace_back("Column" + std::to_string(i), "");
+            database.AddEventType(1, pType);
+            for (const auto& pBatch : batches)
+                database.Write(1, pBatch);
+            BENCH_CHECK(database.Finish());
+            BENCH_CHECK(database.GetRowsWritten() == rowCount);
+        });
+        ReportThroughput(std::to_string(columnCount) + " columns", seconds, static_cast<double>(rowCount), "rows");
+    }
+}
@@ -0,0 +1,173 @@
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <utils/Utf16ToUtf8.h>
+#include "Bench.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+namespace {
+
+/*
+The conversion the UI did per cell before the cache: one pass to size the output, a new[]
+buffer, a second pass into it, a copy into the std::string and delete[]. On Windows both passes
+are WideCharToMultiByte as before; elsewhere they are a plain scalar encoder.
+*/
+#ifdef _WIN32
+void LegacyConvert(const std::u16string& text, std::string* pStr)
+{
+    const wchar_t* pText = reinterpret_cast<const wchar_t*>(text.c_str());
+    int byteCount = WideCharToMultiByte(CP_UTF8, 0, pText, -1, NULL, 0, nullptr, nullptr);
+    char* pBuffer = new char[byteCount];
+    WideCharToMultiByte(CP_UTF8, 0, pText, -1, pBuffer, byteCount, nullptr, nullptr);
+    *pStr = pBuffer;
+    delete[] pBuffer;
+}
+#else
+// Encodes a nul-terminated UTF-16 string; with a null pDst only counts the bytes, terminator included.
+size_t ScalarEncode(const char16_t* pText, char* pDst)
+{
+    size_t bytes = 0;
+    auto put = [&](uint32_t byte) {
+        if (pDst)
+            pDst[bytes] = static_cast<char>(byte);
+        bytes++;
+    };
+    for (const char16_t* p = pText;; p++) {
+        uint32_t c = *p;
+        if (c >= 0xD800 && c <= 0xDFFF) {
+            if (c <= 0xDBFF && p[1] >= 0xDC00 && p[1] <= 0xDFFF)
+                c = 0x10000 + ((c - 0xD800) << 10) + (*++p - 0xDC00);
+            else
+                c = 0xFFFD;
+        }
+        if (c < 0x80) {
+            put(c);
+            if (c == 0)
+                return bytes;
+        }
+        else if (c < 0x800) {
+            put(0xC0 | (c >> 6));
+            put(0x80 | (c & 0x3F));
+        }
+        else if (c < 0x10000) {
+            put(0xE0 | (c >> 12));
+            put(0x80 | ((c >> 6) & 0x3F));
+            put(0x80 | (c & 0x3F));
+        }
+        else {
+            put(0xF0 | (c >> 18));
+            put(0x80 | ((c >> 12) & 0x3F));
+            put(0x80 | ((c >> 6) & 0x3F));
+            put(0x80 | (c & 0x3F));
+        }
+    }
+}
+
+void LegacyConvert(const std::u16string& text, std::string* pStr)
+{
+    size_t byteCount = ScalarEncode(text.c_str(), nullptr);
+    char* pBuffer = new char[byteCount];
+    ScalarEncode(text.c_str(), pBuffer);
+    *pStr = pBuffer;
+    delete[] pBuffer;
+}
+#endif
+
+// Cell texts of one kind: ASCII names, long ASCII paths, or text with accents, CJK and emoji.
+std::vector<std::u16string> MakeTexts(size_t count, int kind)
+{
+    static const char16_t* const MIXED[] = { u"\u00E9", u"\u4E2D\u6587", u"\u00DF", u"\u03A9", u"\U0001F600", u"-" };
+    std::vector<std::u16string> texts(count);
+    for (size_t i = 0; i < count; i++) {
+        std::u16string& text = texts[i];
+        if (kind == 0) {
+            text = u"Microsoft-Windows-Kernel-";
+            for (size_t c = 0; c < i % 16; c++)
+                text += static_cast<char16_t>('A' + (i + c) % 26);
+        }
+        else if (kind == 1) {
+            text = u"C:\\Windows\\System32\\DriverStore\\FileRepository\\";
+            for (size_t c = 0; c < 16 + i % 64; c++)
+                text += static_cast<char16_t>('a' + (i * 7 + c) % 26);
+            text += u".dll";
+        }
+        else {
+            for (size_t c = 0; c < 8 + i % 24; c++) {
+                text += static_cast<char16_t>('a' + c % 26);
+                text += MIXED[(i + c) % 6];
+            }
+        }
+    }
+    return texts;
+}
+
+}
+
+/*
+Utf16ToUtf8 against the per-cell conversion it replaced, for ASCII names, long ASCII paths and
+mixed non-ASCII text. Both must produce the same bytes.
+*/
+BENCH(Utf16ToUtf8VsLegacy)
+{
+    static const char* const KINDS[] = { "names", "paths", "mixed" };
+    size_t count = options.Scale(8192, 64);
+    size_t rounds = options.Scale(20, 1);
+    for (int kind = 0; kind < 3; kind++) {
+        std::vector<std::u16string> texts = MakeTexts(count, kind);
+        size_t units = 0;
+        std::string legacy;
+        std::vector<char> buffer;
+        for (const std::u16string& text : texts) {
+            units += text.size();
+            LegacyConvert(text, &legacy);
+            buffer.resize(Utf16ToUtf8MaxBytes(text.size()));
+            size_t written = Utf16ToUtf8(text.data(), text.size(), buffer.data());
+            BENCH_CHECK(legacy == std::string_view(buffer.data(), written));
+        }
+
+        double legacySeconds = MeasureSeconds(options, [&]() {
+            uint64_t sum = 0;
+            for (size_t round = 0; round < rounds; round++) {
+                for (const std::u16string& text : texts) {
+                    LegacyConvert(text, &legacy);
+                    sum += legacy.size();
+                }
+            }
+            KeepResult(sum);
+        });
+        // Into a reused std::string, as when filling the display cache.
+        std::string converted;
+        double stringSeconds = MeasureSeconds(options, [&]() {
+            uint64_t sum = 0;
+            for (size_t round = 0; round < rounds; round++) {
+                for (const std::u16string& text : texts) {
+                    converted.resize(Utf16ToUtf8MaxBytes(text.size()));
+                    converted.resize(Utf16ToUtf8(text.data(), text.size(), converted.data()));
+                    sum += converted.size();
+                }
+            }
+            KeepResult(sum);
+        });
+        // Into a fixed buffer, as the formatter does.
+        buffer.resize(4096);
+        double bufferSeconds = MeasureSeconds(options, [&]() {
+            uint64_t sum = 0;
+            for (size_t round = 0; round < rounds; round++) {
+                for (const std::u16string& text : texts)
+                    sum += Utf16ToUtf8(text.data(), text.size(), buffer.data());
+            }
+            KeepResult(sum);
+        });
+
+        double totalUnits = static_cast<double>(rounds * units);
+        std::string name = KINDS[kind];
+        ReportThroughput(name + ", legacy (2 passes + new[])", legacySeconds, totalUnits, "chars");
+        ReportThroughput(name + ", Utf16ToUtf8 into std::string", stringSeconds, totalUnits, "chars", legacySeconds);
+        ReportThroughput(name + ", Utf16ToUtf8 into buffer", bufferSeconds, totalUnits, "chars", legacySeconds);
+    }
+}
@@ -0,0 +1,134 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+#include <ETL/DecodePlan.h>
+#include <ETL/EtlValueFormatter.h>
+#include "Bench.h"
+
+namespace {
+
+// One property type with the payloads to format, built by a generator from the value index.
+struct FormatCase {
+    const char* m_name;
+    uint16_t m_inType;
+    uint16_t m_outType;
+    std::function<void(std::vector<uint8_t>&, uint32_t)> m_generate;
+};
+
+template<typename T>
+void Put(std::vector<uint8_t>& payload, T value)
+{
+    payload.resize(payload.size() + sizeof(T));
+    memcpy(payload.data() + payload.size() - sizeof(T), &value, sizeof(T));
+}
+
+std::vector<FormatCase> MakeCases()
+{
+    return {
+        { "INT32", ETL_INTYPE_INT32, ETL_OUTTYPE_NULL, [](auto& p, uint32_t i) { Put(p, static_cast<int32_t>(i * 2654435761u)); } },
+        { "UINT64", ETL_INTYPE_UINT64, ETL_OUTTYPE_NULL, [](auto& p, uint32_t i) { Put(p, uint64_t(i) * 0x9E3779B97F4A7C15ull); } },
+        { "UINT32 as PID", ETL_INTYPE_UINT32, ETL_OUTTYPE_PID, [](auto& p, uint32_t i) { Put(p, 4 + i % 60000); } },
+        { "HEXINT32", ETL_INTYPE_HEXINT32, ETL_OUTTYPE_NULL, [](auto& p, uint32_t i) { Put(p, i * 2654435761u); } },
+        { "HEXINT64", ETL_INTYPE_HEXINT64, ETL_OUTTYPE_NULL, [](auto& p, uint32_t i) { Put(p, uint64_t(i) * 0x9E3779B97F4A7C15ull); } },
+        { "POINTER", ETL_INTYPE_POINTER, ETL_OUTTYPE_NULL, [](auto& p, uint32_t i) { Put(p, 0xFFFFF80000000000ull + uint64_t(i) * 4096); } },
+        { "FLOAT", ETL_INTYPE_FLOAT, ETL_OUTTYPE_NULL, [](auto& p, uint32_t i) { Put(p, static_cast<float>(i) / 7.0f); } },
+        { "DOUBLE", ETL_INTYPE_DOUBLE, ETL_OUTTYPE_NULL, [](auto& p, uint32_t i) { Put(p, static_cast<double>(i) / 7.0); } },
+        { "BOOLEAN", ETL_INTYPE_BOOLEAN, ETL_OUTTYPE_NULL, [](auto& p, uint32_t i) { Put(p, i & 1); } },
+        { "GUID", ETL_INTYPE_GUID, ETL_OUTTYPE_NULL, [](auto& p, uint32_t i) {
+            for (uint32_t b = 0; b < 16; b++)
+                Put(p, static_cast<uint8_t>(i * 31 + b * 17));
+        } },
+        { "FILETIME", ETL_INTYPE_FILETIME, ETL_OUTTYPE_NULL, [](auto& p, uint32_t i) { Put(p, 133500000000000000ull + uint64_t(i) * 1234567891); } },
+        { "SYSTEMTIME", ETL_INTYPE_SYSTEMTIME, ETL_OUTTYPE_NULL, [](auto& p, uint32_t i) {
+            uint16_t fields[8] = { static_cast<uint16_t>(2000 + i % 30), static_cast<uint16_t>(1 + i % 12), 0, static_cast<uint16_t>(1 + i % 28),
+                static_cast<uint16_t>(i % 24), static_cast<uint16_t>(i % 60), static_cast<uint16_t>(i % 59), static_cast<uint16_t>(i % 1000) };
+            for (uint16_t field : fields)
+                Put(p, field);
+        } },
+        { "SID", ETL_INTYPE_SID, ETL_OUTTYPE_NULL, [](auto& p, uint32_t i) {
+            uint8_t header[8] = { 1, 5, 0, 0, 0, 0, 0, 5 };
+            for (uint8_t byte : header)
+                Put(p, byte);
+            uint32_t subAuthorities[5] = { 21, 1004336348 + i, 1177238915, 682003330, 1000 + i % 100 };
+            for (uint32_t subAuthority : subAuthorities)
+                Put(p, subAuthority);
+        } },
+        { "UNICODESTRING (8-64 chars)", ETL_INTYPE_UNICODESTRING, ETL_OUTTYPE_NULL, [](auto& p, uint32_t i) {
+            for (uint32_t c = 0; c < 8 + i % 57; c++)
+                Put(p, static_cast<uint16_t>('a' + (i + c) % 26));
+            Put(p, uint16_t(0));
+        } },
+        { "UNICODESTRING, non-ASCII", ETL_INTYPE_UNICODESTRING, ETL_OUTTYPE_NULL, [](auto& p, uint32_t i) {
+            for (uint32_t c = 0; c < 8 + i % 57; c++)
+                Put(p, static_cast<uint16_t>(c % 4 == 0 ? 0x00E9 : c % 4 == 1 ? 0x4E2D : 'a' + c % 26));
+            Put(p, uint16_t(0));
+        } },
+        { "ANSISTRING (8-64 chars)", ETL_INTYPE_ANSISTRING, ETL_OUTTYPE_NULL, [](auto& p, uint32_t i) {
+            for (uint32_t c = 0; c < 8 + i % 57; c++)
+                Put(p, static_cast<char>('a' + (i + c) % 26));
+            Put(p, char(0));
+        } },
+        { "COUNTEDSTRING", ETL_INTYPE_COUNTEDSTRING, ETL_OUTTYPE_NULL, [](auto& p, uint32_t i) {
+            uint16_t bytes = static_cast<uint16_t>(2 * (8 + i % 57));
+            Put(p, bytes);
+            for (uint32_t c = 0; c < bytes / 2u; c++)
+                Put(p, static_cast<uint16_t>('A' + c % 26));
+        } },
+        { "HEXDUMP (32 bytes)", ETL_INTYPE_HEXDUMP, ETL_OUTTYPE_NULL, [](auto& p, uint32_t i) {
+            Put(p, uint32_t(32));
+            for (uint32_t b = 0; b < 32; b++)
+                Put(p, static_cast<uint8_t>(i + b));
+        } },
+    };
+}
+
+}
+
+/*
+Throughput of EtlFormatValue for each property type it formats natively, over values decoded by
+a DecodePlan from synthetic payloads, in values and output bytes per second.
+*/
+BENCH(ValueFormatterPerType)
+{
+    uint32_t valueCount = static_cast<uint32_t>(options.Scale(4096, 32));
+    size_t rounds = options.Scale(100, 1);
+    for (const FormatCase& formatCase : MakeCases()) {
+        std::vector<std::vector<uint8_t>> payloads(valueCount);
+        std::vector<EtlValue> values(valueCount);
+        DecodePlan plan = DecodePlan::Compile({ EtlPropertyDesc{ formatCase.m_inType, formatCase.m_outType, 0, 0, 1, false } });
+        BENCH_CHECK(plan.IsValid());
+        std::vector<EtlValue> decoded;
+        for (uint32_t i = 0; i < valueCount; i++) {
+            formatCase.m_generate(payloads[i], i);
+            plan.Execute(payloads[i].data(), static_cast<uint32_t>(payloads[i].size()), 8, decoded);
+            BENCH_CHECK(decoded[0].m_kind != EtlValueKind::Missing);
+            values[i] = decoded[0];
+        }
+
+        std::vector<char> buffer(4096);
+        size_t outputBytes = 0;
+        for (const EtlValue& value : values) {
+            size_t written = 0;
+            BENCH_CHECK(EtlFormatValue(value, buffer.data(), buffer.size(), &written) == EtlFormatResult::Ok);
+            outputBytes += written;
+        }
+
+        double seconds = MeasureSeconds(options, [&]() {
+            uint64_t sum = 0;
+            for (size_t round = 0; round < rounds; round++) {
+                for (const EtlValue& value : values) {
+                    size_t written = 0;
+                    EtlFormatValue(value, buffer.data(), buffer.size(), &written);
+                    sum += written + static_cast<uint8_t>(buffer[0]);
+                }
+            }
+            KeepResult(sum);
+        });
+        double formatted = static_cast<double>(rounds * valueCount);
+        ReportThroughput(formatCase.m_name, seconds, formatted, "values");
+        ReportThroughput(std::string(formatCase.m_name) + ", output", seconds, static_cast<double>(rounds * outputBytes), "B");
+    }
+}
@@ -0,0 +1,639 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <ETL/EtlTypes.h>
+
+/*
+Compiled decode plans.
+A schema's top-level properties are compiled once into a flat list of steps. Each step knows its
+in-type, where its length and array count come from (a constant or an earlier integer property) and,
+while every earlier property has a constant size, its fixed offset in the payload. Running the plan
+over an event's UserData yields one typed EtlValue per property without going through TDH.
+*/
+
+// Mirrors _TDH_IN_TYPE (see tdh.h).
+enum EtlInType : uint16_t {
+    ETL_INTYPE_NULL = 0,
+    ETL_INTYPE_UNICODESTRING = 1,
+    ETL_INTYPE_ANSISTRING = 2,
+    ETL_INTYPE_INT8 = 3,
+    ETL_INTYPE_UINT8 = 4,
+    ETL_INTYPE_INT16 = 5,
+    ETL_INTYPE_UINT16 = 6,
+    ETL_INTYPE_INT32 = 7,
+    ETL_INTYPE_UINT32 = 8,
+    ETL_INTYPE_INT64 = 9,
+    ETL_INTYPE_UINT64 = 10,
+    ETL_INTYPE_FLOAT = 11,
+    ETL_INTYPE_DOUBLE = 12,
+    ETL_INTYPE_BOOLEAN = 13,
+    ETL_INTYPE_BINARY = 14,
+    ETL_INTYPE_GUID = 15,
+    ETL_INTYPE_POINTER = 16,
+    ETL_INTYPE_FILETIME = 17,
+    ETL_INTYPE_SYSTEMTIME = 18,
+    ETL_INTYPE_SID = 19,
+    ETL_INTYPE_HEXINT32 = 20,
+    ETL_INTYPE_HEXINT64 = 21,
+    ETL_INTYPE_MANIFEST_COUNTEDSTRING = 22,
+    ETL_INTYPE_MANIFEST_COUNTEDANSISTRING = 23,
+    ETL_INTYPE_RESERVED24 = 24,
+    ETL_INTYPE_MANIFEST_COUNTEDBINARY = 25,
+    ETL_INTYPE_COUNTEDSTRING = 300,
+    ETL_INTYPE_COUNTEDANSISTRING = 301,
+    ETL_INTYPE_REVERSEDCOUNTEDSTRING = 302,
+    ETL_INTYPE_REVERSEDCOUNTEDANSISTRING = 303,
+    ETL_INTYPE_NONNULLTERMINATEDSTRING = 304,
+    ETL_INTYPE_NONNULLTERMINATEDANSISTRING = 305,
+    ETL_INTYPE_UNICODECHAR = 306,
+    ETL_INTYPE_ANSICHAR = 307,
+    ETL_INTYPE_SIZET = 308,
+    ETL_INTYPE_HEXDUMP = 309,
+    ETL_INTYPE_WBEMSID = 310,
+};
+
+// Mirrors _TDH_OUT_TYPE values the plan and formatter care about.
+constexpr uint16_t ETL_OUTTYPE_NULL = 0;
+constexpr uint16_t ETL_OUTTYPE_NOPRINT = 301;
+constexpr uint16_t ETL_OUTTYPE_IPV6 = 24;
+
+// Mirrors PROPERTY_FLAGS.
+constexpr uint32_t ETL_PROPERTY_STRUCT = 0x1;
+constexpr uint32_t ETL_PROPERTY_PARAM_LENGTH = 0x2;
+constexpr uint32_t ETL_PROPERTY_PARAM_COUNT = 0x4;
+constexpr uint32_t ETL_PROPERTY_PARAM_FIXED_LENGTH = 0x10;
+constexpr uint32_t ETL_PROPERTY_PARAM_FIXED_COUNT = 0x20;
+
+enum class EtlValueKind : uint8_t {
+    Null,
+    Int,         // m_int
+    UInt,        // m_uint, also pointers and hex integers
+    Double,      // m_double
+    Bool,        // m_uint is 0 or 1
+    Guid,        // 16 bytes at m_pData
+    FileTime,    // m_uint
+    SystemTime,  // 16 bytes at m_pData
+    Sid,         // m_size bytes at m_pData
+    UnicodeString, // m_size bytes of UTF-16 at m_pData, without terminator
+    AnsiString,    // m_size bytes at m_pData, without terminator
+    Binary,        // m_size bytes at m_pData
+    Array,       // m_uint elements spanning m_size bytes at m_pData
+    Missing,     // Payload ended before the property.
+};
+
+struct EtlValue {
+    EtlValueKind m_kind;
+    uint16_t m_inType;
+    uint16_t m_outType;
+    union {
+        int64_t m_int;
+        uint64_t m_uint;
+        double m_double;
+    };
+    const uint8_t* m_pData; // Value bytes inside the payload, after any length prefix.
+    uint32_t m_size;
+    uint32_t m_offset;      // Payload offset where the property starts.
+};
+
+// Portable description of one property, filled from EVENT_PROPERTY_INFO on Windows.
+struct EtlPropertyDesc {
+    uint16_t m_inType;
+    uint16_t m_outType;
+    uint32_t m_flags;
+    uint16_t m_length;              // Or the index of the length property with ETL_PROPERTY_PARAM_LENGTH.
+    uint16_t m_count;               // Or the index of the count property with ETL_PROPERTY_PARAM_COUNT.
+    bool m_hasMap;
+};
+
+/*
+Readers for a single element of each in-type, selected at compile time.
+Read returns false if the payload is too short; on success p is advanced past the element.
+*/
+struct EtlReadContext {
+    const uint8_t* m_pEnd;
+    uint32_t m_pointerSize;
+};
+
+template<uint16_t InType>
+struct EtlInTypeReader;
+
+template<typename T, EtlValueKind Kind>
+struct EtlFixedReader {
+    static constexpr uint32_t SIZE = sizeof(T);
+
+    static bool Read(const uint8_t*& p, uint16_t, const EtlReadContext& ctx, EtlValue& value) {
+        if (static_cast<size_t>(ctx.m_pEnd - p) < sizeof(T))
+            return false;
+        T raw = EtlRead<T>(p);
+        value.m_kind = Kind;
+        if constexpr (Kind == EtlValueKind::Double)
+            value.m_double = static_cast<double>(raw);
+        else if constexpr (Kind == EtlValueKind::Int)
+            value.m_int = static_cast<int64_t>(raw);
+        else
+            value.m_uint = static_cast<uint64_t>(raw);
+        value.m_pData = p;
+        value.m_size = sizeof(T);
+        p += sizeof(T);
+        return true;
+    }
+};
+
+template<EtlValueKind Kind, uint32_t Size>
+struct EtlBlobReader {
+    static constexpr uint32_t SIZE = Size;
+
+    static bool Read(const uint8_t*& p, uint16_t, const EtlReadContext& ctx, EtlValue& value) {
+        if (static_cast<size_t>(ctx.m_pEnd - p) < Size)
+            return false;
+        value.m_kind = Kind;
+        value.m_uint = 0;
+        value.m_pData = p;
+        value.m_size = Size;
+        p += Size;
+        return true;
+    }
+};
+
+// Strings with an explicit length in characters, or nul-terminated when length is 0.
+template<typename Char, EtlValueKind Kind>
+struct EtlStringReader {
+    static constexpr uint32_t SIZE = 0;
+
+    static bool Read(const uint8_t*& p, uint16_t length, const EtlReadContext& ctx, EtlValue& value) {
+        size_t available = static_cast<size_t>(ctx.m_pEnd - p) / sizeof(Char);
+        value.m_kind = Kind;
+        value.m_pData = p;
+        if (length != 0) {
+            if (available < length)
+                return false;
+            value.m_size = static_cast<uint32_t>(length * sizeof(Char));
+            // Trim trailing nuls, the same way TdhFormatProperty displays the string.
+            size_t chars = length;
+            while (chars > 0 && EtlRead<Char>(p + (chars - 1) * sizeof(Char)) == 0)
+                chars--;
+            value.m_size = static_cast<uint32_t>(chars * sizeof(Char));
+            p += length * sizeof(Char);
+            return true;
+        }
+
+        size_t chars = 0;
+        while (chars < available && EtlRead<Char>(p + chars * sizeof(Char)) != 0)
+            chars++;
+        value.m_size = static_cast<uint32_t>(chars * sizeof(Char));
+        p += (chars < available ? chars + 1 : chars) * sizeof(Char); // Consume the terminator.
+        return true;
+    }
+};
+
+// Strings and blobs prefixed with a 16 bit byte count (big endian for the reversed variants).
+template<EtlValueKind Kind, bool Reversed>
+struct EtlCountedReader {
+    static constexpr uint32_t SIZE = 0;
+
+    static bool Read(const uint8_t*& p, uint16_t, const EtlReadContext& ctx, EtlValue& value) {
+        if (ctx.m_pEnd - p < 2)
+            return false;
+        uint16_t bytes = EtlRead<uint16_t>(p);
+        if constexpr (Reversed)
+            bytes = static_cast<uint16_t>((bytes >> 8) | (bytes << 8));
+        if (static_cast<size_t>(ctx.m_pEnd - p - 2) < bytes)
+            return false;
+        value.m_kind = Kind;
+        value.m_pData = p + 2;
+        value.m_size = bytes;
+        p += 2 + bytes;
+        return true;
+    }
+};
+
+template<> struct EtlInTypeReader<ETL_INTYPE_NULL> : EtlBlobReader<EtlValueKind::Null, 0> {};
+template<> struct EtlInTypeReader<ETL_INTYPE_UNICODESTRING> : EtlStringReader<uint16_t, EtlValueKind::UnicodeString> {};
+template<> struct EtlInTypeReader<ETL_INTYPE_ANSISTRING> : EtlStringReader<uint8_t, EtlValueKind::AnsiString> {};
+template<> struct EtlInTypeReader<ETL_INTYPE_INT8> : EtlFixedReader<int8_t, EtlValueKind::Int> {};
+template<> struct EtlInTypeReader<ETL_INTYPE_UINT8> : EtlFixedReader<uint8_t, EtlValueKind::UInt> {};
+template<> struct EtlInTypeReader<ETL_INTYPE_INT16> : EtlFixedReader<int16_t, EtlValueKind::Int> {};
+template<> struct EtlInTypeReader<ETL_INTYPE_UINT16> : EtlFixedReader<uint16_t, EtlValueKind::UInt> {};
+template<> struct EtlInTypeReader<ETL_INTYPE_INT32> : EtlFixedReader<int32_t, EtlValueKind::Int> {};
+template<> struct EtlInTypeReader<ETL_INTYPE_UINT32> : EtlFixedReader<uint32_t, EtlValueKind::UInt> {};
+template<> struct EtlInTypeReader<ETL_INTYPE_INT64> : EtlFixedReader<int64_t, EtlValueKind::Int> {};
+template<> struct EtlInTypeReader<ETL_INTYPE_UINT64> : EtlFixedReader<uint64_t, EtlValueKind::UInt> {};
+template<> struct EtlInTypeReader<ETL_INTYPE_FLOAT> : EtlFixedReader<float, EtlValueKind::Double> {};
+template<> struct EtlInTypeReader<ETL_INTYPE_DOUBLE> : EtlFixedReader<double, EtlValueKind::Double> {};
+template<> struct EtlInTypeReader<ETL_INTYPE_BOOLEAN> : EtlFixedReader<uint32_t, EtlValueKind::Bool> {};
+template<> struct EtlInTypeReader<ETL_INTYPE_GUID> : EtlBlobReader<EtlValueKind::Guid, 16> {};
+template<> struct EtlInTypeReader<ETL_INTYPE_FILETIME> : EtlFixedReader<uint64_t, EtlValueKind::FileTime> {};
+template<> struct EtlInTypeReader<ETL_INTYPE_SYSTEMTIME> : EtlBlobReader<EtlValueKind::SystemTime, 16> {};
+template<> struct EtlInTypeReader<ETL_INTYPE_HEXINT32> : EtlFixedReader<uint32_t, EtlValueKind::UInt> {};
+template<> struct EtlInTypeReader<ETL_INTYPE_HEXINT64> : EtlFixedReader<uint64_t, EtlValueKind::UInt> {};
+template<> struct EtlInTypeReader<ETL_INTYPE_MANIFEST_COUNTEDSTRING> : EtlCountedReader<EtlValueKind::UnicodeString, false> {};
+template<> struct EtlInTypeReader<ETL_INTYPE_MANIFEST_COUNTEDANSISTRING> : EtlCountedReader<EtlValueKind::AnsiString, false> {};
+template<> struct EtlInTypeReader<ETL_INTYPE_MANIFEST_COUNTEDBINARY> : EtlCountedReader<EtlValueKind::Binary, false> {};
+template<> struct EtlInTypeReader<ETL_INTYPE_COUNTEDSTRING> : EtlCountedReader<EtlValueKind::UnicodeString, false> {};
+template<> struct EtlInTypeReader<ETL_INTYPE_COUNTEDANSISTRING> : EtlCountedReader<EtlValueKind::AnsiString, false> {};
+template<> struct EtlInTypeReader<ETL_INTYPE_REVERSEDCOUNTEDSTRING> : EtlCountedReader<EtlValueKind::UnicodeString, true> {};
+template<> struct EtlInTypeReader<ETL_INTYPE_REVERSEDCOUNTEDANSISTRING> : EtlCountedReader<EtlValueKind::AnsiString, true> {};
+template<> struct EtlInTypeReader<ETL_INTYPE_UNICODECHAR> : EtlFixedReader<uint16_t, EtlValueKind::UInt> {};
+template<> struct EtlInTypeReader<ETL_INTYPE_ANSICHAR> : EtlFixedReader<uint8_t, EtlValueKind::UInt> {};
+
+template<>
+struct EtlInTypeReader<ETL_INTYPE_BINARY> {
+    static constexpr uint32_t SIZE = 0;
+
+    static bool Read(const uint8_t*& p, uint16_t length, const EtlReadContext& ctx, EtlValue& value) {
+        if (static_cast<size_t>(ctx.m_pEnd - p) < length)
+            return false;
+        value.m_kind = EtlValueKind::Binary;
+        value.m_pData = p;
+        value.m_size = length;
+        p += length;
+        return true;
+    }
+};
+
+template<>
+struct EtlInTypeReader<ETL_INTYPE_POINTER> {
+    static constexpr uint32_t SIZE = 0; // Depends on the event's pointer size.
+
+    static bool Read(const uint8_t*& p, uint16_t, const EtlReadContext& ctx, EtlValue& value) {
+        if (static_cast<size_t>(ctx.m_pEnd - p) < ctx.m_pointerSize)
+            return false;
+        value.m_kind = EtlValueKind::UInt;
+        value.m_uint = ctx.m_pointerSize == 4 ? EtlRead<uint32_t>(p) : EtlRead<uint64_t>(p);
+        value.m_pData = p;
+        value.m_size = ctx.m_pointerSize;
+        p += ctx.m_pointerSize;
+        return true;
+    }
+};
+
+template<> struct EtlInTypeReader<ETL_INTYPE_SIZET> : EtlInTypeReader<ETL_INTYPE_POINTER> {};
+
+template<>
+struct EtlInTypeReader<ETL_INTYPE_SID> {
+    static constexpr uint32_t SIZE = 0;
+
+    static bool Read(const uint8_t*& p, uint16_t, const EtlReadContext& ctx, EtlValue& value) {
+        // SID: Revision, SubAuthorityCount, 6 byte IdentifierAuthority, then 4 bytes per sub authority.
+        if (ctx.m_pEnd - p < 8)
+            return false;
+        uint32_t size = 8 + 4u * p[1];
+        if (static_cast<size_t>(ctx.m_pEnd - p) < size)
+            return false;
+        value.m_kind = EtlValueKind::Sid;
+        value.m_pData = p;
+        value.m_size = size;
+        p += size;
+        return true;
+    }
+};
+
+template<>
+struct EtlInTypeReader<ETL_INTYPE_WBEMSID> {
+    static constexpr uint32_t SIZE = 0;
+
+    static bool Read(const uint8_t*& p, uint16_t length, const EtlReadContext& ctx, EtlValue& value) {
+        // A TOKEN_USER (two pointers) followed by the SID itself.
+        uint32_t skip = 2 * ctx.m_pointerSize;
+        if (static_cast<size_t>(ctx.m_pEnd - p) < skip)
+            return false;
+        const uint8_t* pSid = p + skip;
+        if (!EtlInTypeReader<ETL_INTYPE_SID>::Read(pSid, length, ctx, value))
+            return false;
+        p = pSid;
+        return true;
+    }
+};
+
+template<>
+struct EtlInTypeReader<ETL_INTYPE_HEXDUMP> {
+    static constexpr uint32_t SIZE = 0;
+
+    static bool Read(const uint8_t*& p, uint16_t, const EtlReadContext& ctx, EtlValue& value) {
+        if (ctx.m_pEnd - p < 4)
+            return false;
+        uint32_t bytes = EtlRead<uint32_t>(p);
+        if (static_cast<size_t>(ctx.m_pEnd - p - 4) < bytes)
+            return false;
+        value.m_kind = EtlValueKind::Binary;
+        value.m_pData = p + 4;
+        value.m_size = bytes;
+        p += 4 + bytes;
+        return true;
+    }
+};
+
+// Strings that run to the end of the payload.
+template<EtlValueKind Kind>
+struct EtlRemainderReader {
+    static constexpr uint32_t SIZE = 0;
+
+    static bool Read(const uint8_t*& p, uint16_t, const EtlReadContext& ctx, EtlValue& value) {
+        value.m_kind = Kind;
+        value.m_pData = p;
+        value.m_size = static_cast<uint32_t>(ctx.m_pEnd - p);
+        if (Kind == EtlValueKind::UnicodeString)
+            value.m_size &= ~1u;
+        p += value.m_size;
+        return true;
+    }
+};
+
+template<> struct EtlInTypeReader<ETL_INTYPE_NONNULLTERMINATEDSTRING> : EtlRemainderReader<EtlValueKind::UnicodeString> {};
+template<> struct EtlInTypeReader<ETL_INTYPE_NONNULLTERMINATEDANSISTRING> : EtlRemainderReader<EtlValueKind::AnsiString> {};
+
+using EtlReadFunc = bool (*)(const uint8_t*& p, uint16_t length, const EtlReadContext& ctx, EtlValue& value);
+
+struct EtlInTypeInfo {
+    EtlReadFunc m_read;
+    uint32_t m_fixedSize; // 0 when the size depends on the data, the length or the pointer size.
+};
+
+// Maps a run-time in-type to its reader. Returns a null reader for in-types a plan cannot decode.
+inline EtlInTypeInfo EtlGetInTypeInfo(uint16_t inType)
+{
+#define ETL_INTYPE_CASE(type) case type: return { &EtlInTypeReader<type>::Read, EtlInTypeReader<type>::SIZE }
+    switch (inType) {
+    ETL_INTYPE_CASE(ETL_INTYPE_NULL);
+    ETL_INTYPE_CASE(ETL_INTYPE_UNICODESTRING);
+    ETL_INTYPE_CASE(ETL_INTYPE_ANSISTRING);
+    ETL_INTYPE_CASE(ETL_INTYPE_INT8);
+    ETL_INTYPE_CASE(ETL_INTYPE_UINT8);
+    ETL_INTYPE_CASE(ETL_INTYPE_INT16);
+    ETL_INTYPE_CASE(ETL_INTYPE_UINT16);
+    ETL_INTYPE_CASE(ETL_INTYPE_INT32);
+    ETL_INTYPE_CASE(ETL_INTYPE_UINT32);
+    ETL_INTYPE_CASE(ETL_INTYPE_INT64);
+    ETL_INTYPE_CASE(ETL_INTYPE_UINT64);
+    ETL_INTYPE_CASE(ETL_INTYPE_FLOAT);
+    ETL_INTYPE_CASE(ETL_INTYPE_DOUBLE);
+    ETL_INTYPE_CASE(ETL_INTYPE_BOOLEAN);
+    ETL_INTYPE_CASE(ETL_INTYPE_BINARY);
+    ETL_INTYPE_CASE(ETL_INTYPE_GUID);
+    ETL_INTYPE_CASE(ETL_INTYPE_POINTER);
+    ETL_INTYPE_CASE(ETL_INTYPE_FILETIME);
+    ETL_INTYPE_CASE(ETL_INTYPE_SYSTEMTIME);
+    ETL_INTYPE_CASE(ETL_INTYPE_SID);
+    ETL_INTYPE_CASE(ETL_INTYPE_HEXINT32);
+    ETL_INTYPE_CASE(ETL_INTYPE_HEXINT64);
+    ETL_INTYPE_CASE(ETL_INTYPE_MANIFEST_COUNTEDSTRING);
+    ETL_INTYPE_CASE(ETL_INTYPE_MANIFEST_COUNTEDANSISTRING);
+    ETL_INTYPE_CASE(ETL_INTYPE_MANIFEST_COUNTEDBINARY);
+    ETL_INTYPE_CASE(ETL_INTYPE_COUNTEDSTRING);
+    ETL_INTYPE_CASE(ETL_INTYPE_COUNTEDANSISTRING);
+    ETL_INTYPE_CASE(ETL_INTYPE_REVERSEDCOUNTEDSTRING);
+    ETL_INTYPE_CASE(ETL_INTYPE_REVERSEDCOUNTEDANSISTRING);
+    ETL_INTYPE_CASE(ETL_INTYPE_NONNULLTERMINATEDSTRING);
+    ETL_INTYPE_CASE(ETL_INTYPE_NONNULLTERMINATEDANSISTRING);
+    ETL_INTYPE_CASE(ETL_INTYPE_UNICODECHAR);
+    ETL_INTYPE_CASE(ETL_INTYPE_ANSICHAR);
+    ETL_INTYPE_CASE(ETL_INTYPE_SIZET);
+    ETL_INTYPE_CASE(ETL_INTYPE_HEXDUMP);
+    ETL_INTYPE_CASE(ETL_INTYPE_WBEMSID);
+    default: return { nullptr, 0 };
+    }
+#undef ETL_INTYPE_CASE
+}
+
+class DecodePlan
+{
+public:
+    static constexpr uint16_t NO_REFERENCE = 0xFFFF;
+    static constexpr uint32_t NO_FIXED_OFFSET = 0xFFFFFFFF;
+
+    struct Step {
+        EtlReadFunc m_read;
+        uint16_t m_inType;
+        uint16_t m_outType;
+        uint16_t m_length;          // Constant length, used when m_lengthRef is NO_REFERENCE.
+        uint16_t m_lengthRef;       // Index of the integer property holding the length.
+        uint16_t m_count;           // Constant array count, used when m_countRef is NO_REFERENCE.
+        uint16_t m_countRef;        // Index of the integer property holding the count.
+        uint32_t m_elementSize;     // Size of one element when constant, else 0.
+        uint32_t m_fixedOffset;     // Offset in the payload when every previous step has a constant size.
+        bool m_isArray;
+        bool m_explicitLength;      // A zero length means an empty string rather than a nul-terminated one.
+        bool m_recordsInteger;      // Value is needed by a later length or count.
+        bool m_hasMap;
+    };
+
+    DecodePlan() = default;
+
+    /*
+    Compiles the top-level properties of a schema. Returns an invalid plan if any property
+    needs more than the plan supports (structures, unknown in-types); callers then fall back to TDH.
+    */
+    static DecodePlan Compile(const std::vector<EtlPropertyDesc>& properties)
+    {
+        DecodePlan plan;
+        plan.m_steps.reserve(properties.size());
+        uint32_t offset = 0;
+        bool offsetKnown = true;
+
+        for (size_t i = 0; i < properties.size(); i++) {
+            const EtlPropertyDesc& desc = properties[i];
+            if (desc.m_flags & ETL_PROPERTY_STRUCT)
+                return DecodePlan{};
+            EtlInTypeInfo info = EtlGetInTypeInfo(desc.m_inType);
+            if (info.m_read == nullptr)
+                return DecodePlan{};
+
+            Step step = {};
+            step.m_read = info.m_read;
+            step.m_inType = desc.m_inType;
+            step.m_outType = desc.m_outType == ETL_OUTTYPE_NOPRINT ? ETL_OUTTYPE_NULL : desc.m_outType;
+            step.m_hasMap = desc.m_hasMap;
+            step.m_lengthRef = NO_REFERENCE;
+            step.m_countRef = NO_REFERENCE;
+
+            // Same length rules as DecoderContext::PrintProperties.
+            if (desc.m_outType == ETL_OUTTYPE_IPV6 && desc.m_inType == ETL_INTYPE_BINARY && desc.m_length == 0 &&
+                (desc.m_flags & (ETL_PROPERTY_PARAM_LENGTH | ETL_PROPERTY_PARAM_FIXED_LENGTH)) == 0)
+                step.m_length = 16; // Incorrectly defined IPv6 addresses.
+            else if (desc.m_flags & ETL_PROPERTY_PARAM_LENGTH)
+                step.m_lengthRef = desc.m_length;
+            else
+                step.m_length = desc.m_length;
+
+            step.m_explicitLength = (desc.m_flags & (ETL_PROPERTY_PARAM_LENGTH | ETL_PROPERTY_PARAM_FIXED_LENGTH)) != 0;
+
+            if (desc.m_flags & ETL_PROPERTY_PARAM_COUNT)
+                step.m_countRef = desc.m_count;
+            else
+                step.m_count = desc.m_count;
+            step.m_isArray = step.m_countRef != NO_REFERENCE || step.m_count != 1 || (desc.m_flags & ETL_PROPERTY_PARAM_FIXED_COUNT) != 0;
+
+            if (step.m_lengthRef != NO_REFERENCE && (step.m_lengthRef >= i || !plan.MarkReference(step.m_lengthRef)))
+                return DecodePlan{};
+            if (step.m_countRef != NO_REFERENCE && (step.m_countRef >= i || !plan.MarkReference(step.m_countRef)))
+                return DecodePlan{};
+
+            step.m_elementSize = info.m_fixedSize;
+            if (step.m_elementSize == 0 && step.m_lengthRef == NO_REFERENCE &&
+                (desc.m_inType == ETL_INTYPE_BINARY ||
+                 (step.m_length != 0 && (desc.m_inType == ETL_INTYPE_UNICODESTRING || desc.m_inType == ETL_INTYPE_ANSISTRING))))
+                step.m_elementSize = desc.m_inType == ETL_INTYPE_UNICODESTRING ? step.m_length * 2u : step.m_length;
+            if (desc.m_inType == ETL_INTYPE_NULL)
+                step.m_elementSize = 0;
+
+            step.m_fixedOffset = offsetKnown ? offset : NO_FIXED_OFFSET;
+            bool sizeKnown = step.m_countRef == NO_REFERENCE &&
+                (step.m_elementSize != 0 || desc.m_inType == ETL_INTYPE_NULL);
+            if (offsetKnown && sizeKnown)
+                offset += step.m_elementSize * step.m_count;
+            else
+                offsetKnown = false;
+
+            plan.m_steps.push_back(step);
+        }
+
+        plan.m_referenceSlot.resize(plan.m_steps.size(), NO_REFERENCE_SLOT);
+        plan.m_valid = true;
+        return plan;
+    }
+
+    bool IsValid() const { return m_valid; }
+    size_t StepCount() const { return m_steps.size(); }
+    const Step& GetStep(size_t index) const { return m_steps[index]; }
+
+    /*
+    Runs the plan over a payload. values receives one entry per property; properties past the
+    end of a short payload are EtlValueKind::Missing. Returns the number of payload bytes consumed.
+    */
+    uint32_t Execute(const uint8_t* pData, uint32_t size, uint32_t pointerSize, std::vector<EtlValue>& values) const
+    {
+        values.resize(m_steps.size());
+        uint16_t integers[MAX_REFERENCED] = {};
+        EtlReadContext ctx{ pData + size, pointerSize };
+        const uint8_t* p = pData;
+
+        size_t i = 0;
+        for (; i < m_steps.size(); i++) {
+            const Step& step = m_steps[i];
+            EtlValue& value = values[i];
+            value = EtlValue{};
+            value.m_inType = step.m_inType;
+            value.m_outType = step.m_outType;
+            value.m_kind = EtlValueKind::Missing;
+            value.m_pData = p;
+            value.m_offset = static_cast<uint32_t>(p - pData);
+
+            uint16_t length = step.m_lengthRef == NO_REFERENCE ? step.m_length : integers[m_referenceSlot[step.m_lengthRef]];
+            uint16_t count = step.m_countRef == NO_REFERENCE ? step.m_count : integers[m_referenceSlot[step.m_countRef]];
+
+            if (step.m_isArray) {
+                const uint8_t* pStart = p;
+                bool complete = true;
+                if (step.m_elementSize != 0 && step.m_lengthRef == NO_REFERENCE) {
+                    size_t bytes = static_cast<size_t>(step.m_elementSize) * count;
+                    if (static_cast<size_t>(ctx.m_pEnd - p) < bytes)
+                        complete = false;
+                    else
+                        p += bytes;
+                }
+                else {
+                    EtlValue element;
+                    for (uint16_t e = 0; e < count && complete; e++)
+                        complete = step.m_read(p, length, ctx, element);
+                }
+                if (!complete)
+                    break;
+                value.m_kind = EtlValueKind::Array;
+                value.m_uint = count;
+                value.m_pData = pStart;
+                value.m_size = static_cast<uint32_t>(p - pStart);
+                continue;
+            }
+
+            if (step.m_inType == ETL_INTYPE_NULL) {
+                value.m_kind = EtlValueKind::Null;
+                value.m_size = 0;
+                continue;
+            }
+            if (length == 0 && step.m_explicitLength &&
+                (step.m_inType == ETL_INTYPE_UNICODESTRING || step.m_inType == ETL_INTYPE_ANSISTRING)) {
+                value.m_kind = step.m_inType == ETL_INTYPE_UNICODESTRING ? EtlValueKind::UnicodeString : EtlValueKind::AnsiString;
+                value.m_size = 0;
+                continue;
+            }
+            if (!step.m_read(p, length, ctx, value))
+                break;
+
+            if (m_referenceSlot[i] != NO_REFERENCE_SLOT)
+                integers[m_referenceSlot[i]] = ClampReference(value);
+        }
+
+        // The property that did not fit and every later one are missing, whatever a reader or an earlier call left in them.
+        uint32_t end = static_cast<uint32_t>(p - pData);
+        for (; i < m_steps.size(); i++) {
+            EtlValue& value = values[i];
+            value = EtlValue{};
+            value.m_inType = m_steps[i].m_inType;
+            value.m_outType = m_steps[i].m_outType;
+            value.m_kind = EtlValueKind::Missing;
+            value.m_pData = p;
+            value.m_offset = end;
+        }
+        return end;
+    }
+
+    /*
+    Returns the length in effect for a step after Execute filled values, for callers that hand
+    the raw bytes of a property to another formatter.
+    */
+    uint16_t ResolveLength(size_t stepIndex, const std::vector<EtlValue>& values) const
+    {
+        const Step& step = m_steps[stepIndex];
+        if (step.m_lengthRef == NO_REFERENCE)
+            return step.m_length;
+        return ClampReference(values[step.m_lengthRef]);
+    }
+
+private:
+    static constexpr size_t MAX_REFERENCED = 32;
+    static constexpr uint8_t NO_REFERENCE_SLOT = 0xFF;
+
+    // Same clamping as DecoderContext::m_integerValues.
+    static uint16_t ClampReference(const EtlValue& value)
+    {
+        if (value.m_kind != EtlValueKind::Int && value.m_kind != EtlValueKind::UInt)
+            return 0;
+        uint64_t raw = value.m_kind == EtlValueKind::Int ? static_cast<uint64_t>(value.m_int) : value.m_uint;
+        if (value.m_size == 4)
+            raw = raw > 0xffffu ? 0xffffu : raw;
+        return static_cast<uint16_t>(raw);
+    }
+
+    // Integer properties used as lengths or counts get a slot in Execute's small integer table.
+    bool MarkReference(uint16_t propertyIndex)
+    {
+        if (m_referenceSlot.size() <= propertyIndex)
+            m_referenceSlot.resize(propertyIndex + 1, NO_REFERENCE_SLOT);
+        if (m_referenceSlot[propertyIndex] != NO_REFERENCE_SLOT)
+            return true;
+        switch (m_steps[propertyIndex].m_inType) {
+        case ETL_INTYPE_INT8:
+        case ETL_INTYPE_UINT8:
+        case ETL_INTYPE_INT16:
+        case ETL_INTYPE_UINT16:
+        case ETL_INTYPE_INT32:
+        case ETL_INTYPE_UINT32:
+        case ETL_INTYPE_HEXINT32:
+            break;
+        default:
+            return false;
+        }
+        if (m_steps[propertyIndex].m_isArray || m_referenceCount == MAX_REFERENCED)
+            return false;
+        m_steps[propertyIndex].m_recordsInteger = true;
+        m_referenceSlot[propertyIndex] = m_referenceCount++;
+        return true;
+    }
+
+    std::vector<Step> m_steps;
+    std::vector<uint8_t> m_referenceSlot;
+    uint8_t m_referenceCount = 0;
+    bool m_valid = false;
+};
@@ -0,0 +1,432 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <ETL/DecodePlan.h>
+#include <ETL/EtlValueFormatter.h>
+#include <utils/StringDictionary.h>
+
+enum class EtlColumnType : uint8_t {
+    Int64,
+    UInt64,
+    Double,
+    String, // Ids into the StringDictionary of the column.
+};
+
+// One bit per row; a cleared bit marks a missing value.
+class EtlValidityBitmap
+{
+public:
+    void Append(bool valid)
+    {
+        if (m_size % 64 == 0)
+            m_words.push_back(0);
+        if (valid)
+            m_words.back() |= 1ull << (m_size % 64);
+        m_size++;
+    }
+
+    bool Get(size_t row) const { return (m_words[row / 64] >> (row % 64)) & 1; }
+    size_t Size() const { return m_size; }
+    size_t ByteSize() const { return m_words.capacity() * sizeof(uint64_t); }
+
+private:
+    std::vector<uint64_t> m_words;
+    size_t m_size = 0;
+};
+
+/*
+Collation ranks of the strings of a dictionary that only grows, such as the dictionary of a column
+whose table streams in. Strings added since the last Update are sorted on their own and merged into
+the sorted order, so each string is compared as text in one sort only.
+*/
+class EtlStringRanks
+{
+public:
+    /*
+    Ranks the strings added to the dictionary since the last call. Returns true if the ranks of
+    strings ranked before have changed (or none were), so keys built from them must be rebuilt.
+    */
+    bool Update(const StringDictionary& dictionary)
+    {
+        size_t oldCount = m_byText.size();
+        size_t count = dictionary.Size();
+        if (count < oldCount) {
+            m_byText.clear(); // Another dictionary.
+            oldCount = 0;
+        }
+        if (count == oldCount)
+            return false;
+
+        auto less = [&dictionary](StringDictionary::Id lhs, StringDictionary::Id rhs) { return dictionary.Get(lhs) < dictionary.Get(rhs); };
+        for (size_t id = oldCount; id < count; id++)
+            m_byText.push_back(static_cast<StringDictionary::Id>(id));
+        std::sort(m_byText.begin() + oldCount, m_byText.end(), less);
+        // Ranks of the old strings only stay put if every new string sorts after them.
+        bool shifted = oldCount == 0 || less(m_byText[oldCount], m_byText[oldCount - 1]);
+        if (shifted)
+            std::inplace_merge(m_byText.begin(), m_byText.begin() + oldCount, m_byText.end(), less);
+        m_ranks.resize(count);
+        for (size_t i = shifted ? 0 : oldCount; i < count; i++)
+            m_ranks[m_byText[i]] = static_cast<uint32_t>(i);
+        return shifted;
+    }
+
+    uint32_t GetRank(StringDictionary::Id id) const { return m_ranks[id]; }
+
+private:
+    std::vector<StringDictionary::Id> m_byText;
+    std::vector<uint32_t> m_ranks; // By id.
+};
+
+/*
+A typed column. Numbers are kept as 8 byte slots (int64, uint64 or the bits of a double);
+strings as ids into a dictionary owned by the column, so repeated values are stored once and
+every value is freed with the table.
+*/
+class EtlColumn
+{
+public:
+    EtlColumn(std::string name, EtlColumnType type) : m_name(std::move(name)), m_type(type) {
+
+    }
+
+    const std::string& GetName() const { return m_name; }
+    EtlColumnType GetType() const { return m_type; }
+    size_t Size() const { return m_validity.Size(); }
+
+    void AppendInt(int64_t value) { m_numbers.push_back(static_cast<uint64_t>(value)); m_validity.Append(true); }
+    void AppendUInt(uint64_t value) { m_numbers.push_back(value); m_validity.Append(true); }
+    void AppendDouble(double value) { m_numbers.push_back(std::bit_cast<uint64_t>(value)); m_validity.Append(true); }
+    void AppendString(std::string_view value) { m_ids.push_back(m_dictionary.Intern(value)); m_validity.Append(true); }
+
+    void AppendNull()
+    {
+        if (m_type == EtlColumnType::String)
+            m_ids.push_back(StringDictionary::EMPTY_ID);
+        else
+            m_numbers.push_back(0);
+        m_validity.Append(false);
+    }
+
+    bool IsValid(size_t row) const { return m_validity.Get(row); }
+    int64_t GetInt(size_t row) const { return static_cast<int64_t>(m_numbers[row]); }
+    uint64_t GetUInt(size_t row) const { return m_numbers[row]; }
+    double GetDouble(size_t row) const { return std::bit_cast<double>(m_numbers[row]); }
+    StringDictionary::Id GetStringId(size_t row) const { return m_ids[row]; }
+    const StringDictionary& GetDictionary() const { return m_dictionary; }
+    std::string_view GetString(size_t row) const { return m_dictionary.Get(m_ids[row]); }
+
+    /*
+    Turns a number column into a String column of the formatted numbers, so values of another kind
+    can be stored in it as text instead of being dropped.
+    */
+    void ConvertToString()
+    {
+        if (m_type == EtlColumnType::String)
+            return;
+        char text[NUMBER_TEXT_CAPACITY];
+        m_ids.reserve(m_numbers.size());
+        for (size_t row = 0; row < m_numbers.size(); row++)
+            m_ids.push_back(IsValid(row) ? m_dictionary.Intern(FormatNumber(row, text)) : StringDictionary::EMPTY_ID);
+        m_numbers = std::vector<uint64_t>();
+        m_type = EtlColumnType::String;
+    }
+
+    /*
+    Appends every row of another column. Its strings are added to this dictionary. If the types
+    differ, this column becomes a String column and the numbers of the other are appended as text.
+    */
+    void Append(const EtlColumn& other)
+    {
+        if (other.m_type != m_type) {
+            ConvertToString();
+            if (other.m_type != EtlColumnType::String) {
+                char text[NUMBER_TEXT_CAPACITY];
+                for (size_t row = 0; row < other.Size(); row++) {
+                    m_ids.push_back(other.IsValid(row) ? m_dictionary.Intern(other.FormatNumber(row, text)) : StringDictionary::EMPTY_ID);
+                    m_validity.Append(other.IsValid(row));
+                }
+                return;
+            }
+        }
+        m_numbers.insert(m_numbers.end(), other.m_numbers.begin(), other.m_numbers.end());
+        if (!other.m_ids.empty()) {
+            std::vector<StringDictionary::Id> remap(other.m_dictionary.Size());
+            for (StringDictionary::Id id = 0; id < remap.size(); id++)
+                remap[id] = m_dictionary.Intern(other.m_dictionary.Get(id));
+            m_ids.reserve(m_ids.size() + other.m_ids.size());
+            for (StringDictionary::Id id : other.m_ids)
+                m_ids.push_back(remap[id]);
+        }
+        for (size_t row = 0; row < other.Size(); row++)
+            m_validity.Append(other.IsValid(row));
+    }
+
+    /*
+    Unsigned keys that order the rows like their values: signed and floating point numbers are
+    mapped to order-preserving bit patterns and strings to collation ranks. Missing values sort first:
+    they get key 0 and every value is one above its pattern, so the largest pattern shares its key
+    with the one below it rather than the smallest one (a far more common value, such as 0) sharing
+    the key of a missing value. Keys before firstRow are assumed current. ranks carries the collation of a string column from
+    one call to the next; when new strings shift the ranks (without changing the order of the
+    existing ones), every string key is rebuilt.
+    */
+    void GetSortKeys(std::vector<uint64_t>& keys, size_t firstRow, EtlStringRanks& ranks) const
+    {
+        keys.resize(Size());
+        if (m_type == EtlColumnType::String) {
+            if (ranks.Update(m_dictionary))
+                firstRow = 0;
+            for (size_t row = firstRow; row < keys.size(); row++)
+                keys[row] = IsValid(row) ? ranks.GetRank(m_ids[row]) + 1ull : 0;
+            return;
+        }
+        for (size_t row = firstRow; row < keys.size(); row++) {
+            if (!IsValid(row)) {
+                keys[row] = 0;
+                continue;
+            }
+            uint64_t key;
+            if (m_type == EtlColumnType::Int64)
+                key = m_numbers[row] ^ (1ull << 63);
+            else if (m_type == EtlColumnType::Double)
+                key = (m_numbers[row] >> 63) ? ~m_numbers[row] : m_numbers[row] | (1ull << 63);
+            else
+                key = m_numbers[row];
+            keys[row] = key == ~0ull ? key : key + 1;
+        }
+    }
+
+    void GetSortKeys(std::vector<uint64_t>& keys) const
+    {
+        EtlStringRanks ranks;
+        GetSortKeys(keys, 0, ranks);
+    }
+
+    void Reserve(size_t rows)
+    {
+        if (m_type == EtlColumnType::String)
+            m_ids.reserve(rows);
+        else
+            m_numbers.reserve(rows);
+    }
+
+    void ShrinkToFit()
+    {
+        m_numbers.shrink_to_fit();
+        m_ids.shrink_to_fit();
+        m_dictionary.ShrinkToFit();
+    }
+
+    size_t ByteSize() const
+    {
+        return m_numbers.capacity() * sizeof(uint64_t) + m_ids.capacity() * sizeof(StringDictionary::Id) + m_validity.ByteSize() + m_dictionary.ByteSize();
+    }
+
+private:
+    static constexpr size_t NUMBER_TEXT_CAPACITY = 32;
+
+    std::string_view FormatNumber(size_t row, char (&text)[NUMBER_TEXT_CAPACITY]) const
+    {
+        char* pEnd;
+        if (m_type == EtlColumnType::Int64)
+            pEnd = std::to_chars(text, text + sizeof(text), GetInt(row)).ptr;
+        else if (m_type == EtlColumnType::Double)
+            pEnd = std::to_chars(text, text + sizeof(text), GetDouble(row)).ptr;
+        else
+            pEnd = std::to_chars(text, text + sizeof(text), GetUInt(row)).ptr;
+        return std::string_view(text, static_cast<size_t>(pEnd - text));
+    }
+
+    std::string m_name;
+    EtlColumnType m_type;
+    std::vector<uint64_t> m_numbers;
+    std::vector<StringDictionary::Id> m_ids;
+    EtlValidityBitmap m_validity;
+    StringDictionary m_dictionary;
+};
+
+/*
+Columnar storage for the instances of one event type: a timestamp column plus one typed column
+per top-level property. Rows are appended from DecodePlan output, or as preformatted text for
+schemas a plan cannot decode. Tables built in parallel chunks are joined with Append.
+*/
+class EtlColumnTable
+{
+public:
+    EtlColumnTable() = default;
+
+    EtlColumnTable(const std::vector<std::string>& names, const std::vector<EtlColumnType>& types)
+    {
+        m_columns.reserve(names.size());
+        for (size_t i = 0; i < names.size(); i++)
+            m_columns.emplace_back(names[i], types[i]);
+    }
+
+    // Column type used for values of an in-type.
+    static EtlColumnType ColumnTypeFor(uint16_t inType)
+    {
+        switch (inType) {
+        case ETL_INTYPE_INT8:
+        case ETL_INTYPE_INT16:
+        case ETL_INTYPE_INT32:
+        case ETL_INTYPE_INT64:
+            return EtlColumnType::Int64;
+        case ETL_INTYPE_UINT8:
+        case ETL_INTYPE_UINT16:
+        case ETL_INTYPE_UINT32:
+        case ETL_INTYPE_UINT64:
+        case ETL_INTYPE_HEXINT32:
+        case ETL_INTYPE_HEXINT64:
+        case ETL_INTYPE_POINTER:
+        case ETL_INTYPE_SIZET:
+        case ETL_INTYPE_BOOLEAN:
+        case ETL_INTYPE_FILETIME:
+            return EtlColumnType::UInt64;
+        case ETL_INTYPE_FLOAT:
+        case ETL_INTYPE_DOUBLE:
+            return EtlColumnType::Double;
+        default:
+            return EtlColumnType::String;
+        }
+    }
+
+    static std::vector<EtlColumnType> ColumnTypesFor(const DecodePlan& plan)
+    {
+        std::vector<EtlColumnType> types(plan.StepCount());
+        for (size_t i = 0; i < types.size(); i++)
+            types[i] = plan.GetStep(i).m_isArray ? EtlColumnType::String : ColumnTypeFor(plan.GetStep(i).m_inType);
+        return types;
+    }
+
+    size_t RowCount() const { return m_timestamps.size(); }
+    size_t ColumnCount() const { return m_columns.size(); }
+    const EtlColumn& GetColumn(size_t index) const { return m_columns[index]; }
+    int64_t GetTimestamp(size_t row) const { return m_timestamps[row]; }
+    const std::vector<int64_t>& GetTimestamps() const { return m_timestamps; }
+
+    void GetTimestampSortKeys(std::vector<uint64_t>& keys, size_t firstRow = 0) const
+    {
+        keys.resize(m_timestamps.size());
+        for (size_t row = firstRow; row < keys.size(); row++)
+            keys[row] = static_cast<uint64_t>(m_timestamps[row]) ^ (1ull << 63);
+    }
+
+    void Reserve(size_t rows)
+    {
+        m_timestamps.reserve(rows);
+        for (auto& column : m_columns)
+            column.Reserve(rows);
+    }
+
+    /*
+    Appends a row of DecodePlan values. A value whose kind does not fit a number column (events of
+    the same type decoded by a different schema, like classic events sharing an identifier across
+    opcodes) turns the column into a String column, so it is kept as text. Values the payload ended
+    before are stored as missing. scratch holds formatted text.
+    */
+    void AppendRow(int64_t timestamp, const std::vector<EtlValue>& values, std::vector<char>& scratch)
+    {
+        m_timestamps.push_back(timestamp);
+        for (size_t i = 0; i < m_columns.size(); i++) {
+            EtlColumn& column = m_columns[i];
+            if (i >= values.size()) {
+                column.AppendNull();
+                continue;
+            }
+
+            const EtlValue& value = values[i];
+            bool isUInt = value.m_kind == EtlValueKind::UInt || value.m_kind == EtlValueKind::Bool || value.m_kind == EtlValueKind::FileTime;
+            if (column.GetType() == EtlColumnType::Int64 && value.m_kind == EtlValueKind::Int)
+                column.AppendInt(value.m_int);
+            else if (column.GetType() == EtlColumnType::UInt64 && isUInt)
+                column.AppendUInt(value.m_uint);
+            else if (column.GetType() == EtlColumnType::Double && value.m_kind == EtlValueKind::Double)
+                column.AppendDouble(value.m_double);
+            else if (column.GetType() != EtlColumnType::String && (value.m_kind == EtlValueKind::Missing || value.m_kind == EtlValueKind::Null))
+                column.AppendNull();
+            else {
+                column.ConvertToString();
+                AppendText(column, value, scratch);
+            }
+        }
+    }
+
+    // Appends a row of preformatted UTF-8 values, for schemas without a DecodePlan. Number columns become String columns.
+    void AppendTextRow(int64_t timestamp, const std::vector<std::string>& values)
+    {
+        m_timestamps.push_back(timestamp);
+        for (size_t i = 0; i < m_columns.size(); i++) {
+            if (i < values.size()) {
+                m_columns[i].ConvertToString();
+                m_columns[i].AppendString(values[i]);
+            }
+            else {
+                m_columns[i].AppendNull();
+            }
+        }
+    }
+
+    // Appends every row of a table with the same columns; a column whose type differs becomes a String column.
+    void Append(const EtlColumnTable& other)
+    {
+        m_timestamps.insert(m_timestamps.end(), other.m_timestamps.begin(), other.m_timestamps.end());
+        for (size_t i = 0; i < m_columns.size(); i++)
+            m_columns[i].Append(other.m_columns[i]);
+    }
+
+    // Releases the slack of a table that is complete.
+    void ShrinkToFit()
+    {
+        m_timestamps.shrink_to_fit();
+        for (auto& column : m_columns)
+            column.ShrinkToFit();
+    }
+
+    // Includes the strings, which the table owns.
+    size_t ByteSize() const
+    {
+        size_t bytes = m_timestamps.capacity() * sizeof(int64_t);
+        for (const auto& column : m_columns)
+            bytes += column.ByteSize();
+        return bytes;
+    }
+
+private:
+    static void AppendText(EtlColumn& column, const EtlValue& value, std::vector<char>& scratch)
+    {
+        switch (value.m_kind) {
+        case EtlValueKind::Missing:
+            column.AppendNull();
+            return;
+        case EtlValueKind::Null:
+            column.AppendString({});
+            return;
+        case EtlValueKind::Array: {
+            std::string text = "Array[" + std::to_string(value.m_uint) + "]";
+            column.AppendString(text);
+            return;
+        }
+        default:
+            break;
+        }
+
+        size_t bound = EtlFormatBound(value);
+        if (scratch.size() < bound)
+            scratch.resize(bound);
+        size_t written = 0;
+        if (EtlFormatValue(value, scratch.data(), scratch.size(), &written) == EtlFormatResult::Ok)
+            column.AppendString(std::string_view(scratch.data(), written));
+        else
+            column.AppendNull(); // Needs TDH to format.
+    }
+
+    std::vector<int64_t> m_timestamps;
+    std::vector<EtlColumn> m_columns;
+};
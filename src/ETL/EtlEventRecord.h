@@ -0,0 +1,65 @@
+#pragma once
+
+#include <Windows.h>
+#include <evntcons.h>
+#include <ETL/EtlFile.h>
+
+/*
+Adapts an EtlEventView to the EVENT_RECORD layout TDH expects.
+Only the header is copied; UserData and the extended data items keep pointing into the mapped file.
+*/
+struct EtlEventRecord
+{
+    EVENT_RECORD m_record;
+    EVENT_HEADER_EXTENDED_DATA_ITEM m_extendedData[ETL_MAX_EXTENDED_DATA];
+
+    explicit EtlEventRecord(const EtlEventView& view, void* userContext = nullptr)
+    {
+        ZeroMemory(&m_record, sizeof(m_record));
+        EVENT_HEADER& header = m_record.EventHeader;
+        header.Size = sizeof(EVENT_HEADER);
+        header.HeaderType = view.m_headerType;
+        header.Flags = view.m_flags;
+        header.EventProperty = view.m_eventProperty;
+        header.ThreadId = view.m_threadId;
+        header.ProcessId = view.m_processId;
+        header.TimeStamp.QuadPart = view.m_timestamp;
+        header.ProviderId = view.m_providerId;
+        header.EventDescriptor.Id = view.m_id;
+        header.EventDescriptor.Version = view.m_version;
+        header.EventDescriptor.Channel = view.m_channel;
+        header.EventDescriptor.Level = view.m_level;
+        header.EventDescriptor.Opcode = view.m_opcode;
+        header.EventDescriptor.Task = view.m_task;
+        header.EventDescriptor.Keyword = view.m_keyword;
+        header.KernelTime = view.m_kernelTime;
+        header.UserTime = view.m_userTime;
+        header.ActivityId = view.m_activityId;
+
+        m_record.BufferContext.ProcessorNumber = static_cast<UCHAR>(view.m_processorIndex);
+        m_record.BufferContext.LoggerId = view.m_loggerId;
+
+        for (USHORT i = 0; i < view.m_extendedDataCount; i++) {
+            m_extendedData[i].Reserved1 = 0;
+            m_extendedData[i].ExtType = view.m_extendedData[i].m_extType;
+            m_extendedData[i].Linkage = i + 1 < view.m_extendedDataCount ? 1 : 0;
+            m_extendedData[i].Reserved2 = 0;
+            m_extendedData[i].DataSize = view.m_extendedData[i].m_dataSize;
+            m_extendedData[i].DataPtr = reinterpret_cast<ULONGLONG>(view.m_extendedData[i].m_pData);
+        }
+        m_record.ExtendedDataCount = view.m_extendedDataCount;
+        m_record.ExtendedData = view.m_extendedDataCount ? m_extendedData : nullptr;
+        if (view.m_extendedDataCount == 0)
+            header.Flags &= ~EVENT_HEADER_FLAG_EXTENDED_INFO;
+
+        m_record.UserDataLength = view.m_userDataLength;
+        m_record.UserData = const_cast<uint8_t*>(view.m_pUserData);
+        m_record.UserContext = userContext;
+    }
+
+    EtlEventRecord(const EtlEventRecord& other) = delete;
+
+    EtlEventRecord& operator=(const EtlEventRecord& other) = delete;
+
+    EVENT_RECORD* Get() { return &m_record; }
+};
@@ -0,0 +1,650 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <span>
+#include <stdexcept>
+#include <vector>
+#include <ETL/EtlTypes.h>
+#include <utils/MappedFile.h>
+
+/*
+Native reader for .etl files.
+The file is memory mapped and the WMI buffer headers and event headers are walked directly,
+so no OpenTrace/ProcessTrace round trip (or Windows) is needed to enumerate events. Every event
+is exposed as an EtlEventView whose payload points straight into the mapping.
+
+Layouts below follow the WMI_BUFFER_HEADER, SYSTEM_TRACE_HEADER, PERFINFO_TRACE_HEADER,
+EVENT_TRACE_HEADER, EVENT_HEADER and MESSAGE_TRACE_HEADER records written by the kernel logger.
+*/
+
+constexpr size_t ETL_MAX_EXTENDED_DATA = 8;
+
+// Values of the HeaderType byte that prefixes every event in a buffer.
+enum EtlHeaderType : uint8_t {
+    ETL_HEADER_TYPE_SYSTEM32 = 0x01,
+    ETL_HEADER_TYPE_SYSTEM64 = 0x02,
+    ETL_HEADER_TYPE_COMPACT32 = 0x03,
+    ETL_HEADER_TYPE_COMPACT64 = 0x04,
+    ETL_HEADER_TYPE_FULL_HEADER32 = 0x0A,
+    ETL_HEADER_TYPE_INSTANCE32 = 0x0B,
+    ETL_HEADER_TYPE_TIMED = 0x0C,
+    ETL_HEADER_TYPE_ERROR = 0x0D,
+    ETL_HEADER_TYPE_WNODE_HEADER = 0x0E,
+    ETL_HEADER_TYPE_MESSAGE = 0x0F,
+    ETL_HEADER_TYPE_PERFINFO32 = 0x10,
+    ETL_HEADER_TYPE_PERFINFO64 = 0x11,
+    ETL_HEADER_TYPE_EVENT_HEADER32 = 0x12,
+    ETL_HEADER_TYPE_EVENT_HEADER64 = 0x13,
+    ETL_HEADER_TYPE_FULL_HEADER64 = 0x14,
+    ETL_HEADER_TYPE_INSTANCE64 = 0x15,
+};
+
+#pragma pack(push, 1)
+struct EtlRawBufferHeader {
+    uint32_t BufferSize;
+    uint32_t SavedOffset;
+    uint32_t CurrentOffset;
+    int32_t ReferenceCount;
+    int64_t TimeStamp;
+    int64_t SequenceNumber;
+    uint64_t Clock;
+    uint8_t ProcessorNumber;
+    uint8_t Alignment;
+    uint16_t LoggerId;
+    uint32_t State;
+    uint32_t Offset;
+    uint16_t BufferFlag;
+    uint16_t BufferType;
+    uint8_t ReferenceTime[16];
+};
+
+struct EtlRawEventHeader {
+    uint16_t Size;
+    uint8_t HeaderType;
+    uint8_t MarkerFlags;
+    uint16_t Flags;
+    uint16_t EventProperty;
+    uint32_t ThreadId;
+    uint32_t ProcessId;
+    int64_t TimeStamp;
+    EtlGuid ProviderId;
+    uint16_t Id;
+    uint8_t Version;
+    uint8_t Channel;
+    uint8_t Level;
+    uint8_t Opcode;
+    uint16_t Task;
+    uint64_t Keyword;
+    uint32_t KernelTime;
+    uint32_t UserTime;
+    EtlGuid ActivityId;
+};
+
+struct EtlRawSystemHeader {
+    uint16_t Version;
+    uint8_t HeaderType;
+    uint8_t Flags;
+    uint16_t Size;
+    uint8_t Type;
+    uint8_t Group;
+    uint32_t ThreadId;
+    uint32_t ProcessId;
+    int64_t SystemTime;
+    uint32_t KernelTime; // Not present in compact headers.
+    uint32_t UserTime;
+};
+
+struct EtlRawPerfInfoHeader {
+    uint16_t Version;
+    uint8_t HeaderType;
+    uint8_t Flags;
+    uint16_t Size;
+    uint8_t Type;
+    uint8_t Group;
+    int64_t SystemTime;
+};
+
+struct EtlRawFullHeader {
+    uint16_t Size;
+    uint8_t HeaderType;
+    uint8_t MarkerFlags;
+    uint8_t Type;
+    uint8_t Level;
+    uint16_t Version;
+    uint32_t ThreadId;
+    uint32_t ProcessId;
+    int64_t TimeStamp;
+    EtlGuid Guid;
+    uint32_t KernelTime;
+    uint32_t UserTime;
+};
+#pragma pack(pop)
+
+static_assert(sizeof(EtlRawBufferHeader) == 0x48, "Unexpected WMI_BUFFER_HEADER size");
+static_assert(sizeof(EtlRawEventHeader) == 80, "Unexpected EVENT_HEADER size");
+static_assert(sizeof(EtlRawSystemHeader) == 32, "Unexpected SYSTEM_TRACE_HEADER size");
+static_assert(sizeof(EtlRawPerfInfoHeader) == 16, "Unexpected PERFINFO_TRACE_HEADER size");
+static_assert(sizeof(EtlRawFullHeader) == 48, "Unexpected EVENT_TRACE_HEADER size");
+
+constexpr uint32_t ETL_COMPACT_SYSTEM_HEADER_SIZE = 24;
+constexpr uint32_t ETL_EXTENDED_ITEM_HEADER_SIZE = 8;
+
+struct EtlExtendedDataItem {
+    uint16_t m_extType;
+    uint16_t m_dataSize;
+    const uint8_t* m_pData;
+};
+
+/*
+EVENT_RECORD equivalent for a single event.
+Header fields are copied out of the buffer, the payload and extended data point into the mapping.
+*/
+struct EtlEventView {
+    EtlGuid m_providerId;
+    EtlGuid m_activityId;
+    int64_t m_timestamp;
+    uint64_t m_keyword;
+    uint32_t m_threadId;
+    uint32_t m_processId;
+    uint32_t m_kernelTime;
+    uint32_t m_userTime;
+    uint16_t m_id;
+    uint8_t m_version;
+    uint8_t m_channel;
+    uint8_t m_level;
+    uint8_t m_opcode;
+    uint16_t m_task;
+    uint16_t m_flags;
+    uint16_t m_eventProperty;
+    uint16_t m_processorIndex;
+    uint16_t m_loggerId;
+    uint8_t m_headerType;
+    uint16_t m_userDataLength;
+    const uint8_t* m_pUserData;
+    uint16_t m_extendedDataCount;
+    EtlExtendedDataItem m_extendedData[ETL_MAX_EXTENDED_DATA];
+    // Location of the event inside the file, usable with EtlFile::ReadEventAt.
+    uint32_t m_bufferIndex;
+    uint32_t m_bufferOffset;
+};
+
+struct EtlBufferInfo {
+    uint64_t m_fileOffset;
+    uint32_t m_bufferSize;
+    uint32_t m_filledBytes;
+    int64_t m_timestamp;
+    uint16_t m_processorIndex;
+    uint16_t m_loggerId;
+    uint16_t m_bufferType;
+};
+
+// Subset of TRACE_LOGFILE_HEADER, read from the first event of the file.
+struct EtlLogFileInfo {
+    uint32_t m_bufferSize = 0;
+    uint32_t m_version = 0;
+    uint32_t m_numberOfProcessors = 0;
+    uint32_t m_timerResolution = 0;
+    uint32_t m_logFileMode = 0;
+    uint32_t m_buffersWritten = 0;
+    uint32_t m_pointerSize = sizeof(void*);
+    uint32_t m_eventsLost = 0;
+    uint32_t m_cpuSpeedMHz = 0;
+    uint32_t m_clockType = 0; // 1 for QPC, 2 for system time, 3 for CPU cycles.
+    uint32_t m_buffersLost = 0;
+    int64_t m_endTime = 0;
+    int64_t m_bootTime = 0;
+    int64_t m_perfFreq = 0;
+    int64_t m_startTime = 0;      // FILETIME of the start of the session.
+    int64_t m_startTimestamp = 0; // Raw timestamp of the trace header event, taken as logged at m_startTime.
+};
+
+class EtlFile
+{
+public:
+    enum class DecodeResult {
+        Event,   // A view was produced.
+        Skipped, // The record is valid but not an event we can expose (e.g. instance headers).
+        End      // No more records in this buffer.
+    };
+
+    explicit EtlFile(const std::filesystem::path& path)
+        : m_file(path)
+    {
+        IndexBuffers();
+        ReadLogFileInfo();
+    }
+
+    /*
+    Opens a file whose buffers were indexed before (e.g. stored in a sidecar index), which saves
+    touching every buffer header of a large file. The buffers are indexed again if they do not fit the file.
+    */
+    EtlFile(const std::filesystem::path& path, std::span<const EtlBufferInfo> buffers)
+        : m_file(path), m_buffers(buffers.begin(), buffers.end())
+    {
+        if (m_buffers.empty() || m_buffers.back().m_fileOffset + m_buffers.back().m_bufferSize > m_file.Size()) {
+            m_buffers.clear();
+            IndexBuffers();
+        }
+        ReadLogFileInfo();
+    }
+
+    EtlFile(const EtlFile& other) = delete;
+
+    EtlFile& operator=(const EtlFile& other) = delete;
+
+    const EtlLogFileInfo& GetLogFileInfo() const { return m_logFileInfo; }
+    size_t GetBufferCount() const { return m_buffers.size(); }
+    const EtlBufferInfo& GetBuffer(size_t index) const { return m_buffers[index]; }
+    const std::vector<EtlBufferInfo>& GetBuffers() const { return m_buffers; }
+    const uint8_t* GetData() const { return m_file.Data(); }
+    size_t GetSize() const { return m_file.Size(); }
+
+    /*
+    Decodes the event at a known location (as recorded in EtlEventView::m_bufferIndex/m_bufferOffset).
+    */
+    bool ReadEventAt(uint32_t bufferIndex, uint32_t bufferOffset, EtlEventView* pView) const
+    {
+        if (bufferIndex >= m_buffers.size())
+            return false;
+        uint32_t next = 0;
+        return DecodeEventAt(bufferIndex, bufferOffset, pView, &next) == DecodeResult::Event;
+    }
+
+    /*
+    Calls func(const EtlEventView&) for every event in a buffer, in buffer order.
+    Returns false if func asked to stop by returning false.
+    */
+    template<typename Func>
+    bool ForEachEventInBuffer(size_t bufferIndex, Func&& func) const
+    {
+        EtlEventView view;
+        uint32_t offset = sizeof(EtlRawBufferHeader);
+        for (;;) {
+            uint32_t next = 0;
+            DecodeResult result = DecodeEventAt(static_cast<uint32_t>(bufferIndex), offset, &view, &next);
+            if (result == DecodeResult::End)
+                return true;
+            if (result == DecodeResult::Event && !func(static_cast<const EtlEventView&>(view)))
+                return false;
+            offset = next;
+        }
+    }
+
+    /*
+    Calls func(const EtlEventView&) for every event in the file, in file order.
+    Events are ordered by time within a buffer but buffers from different processors interleave.
+    */
+    template<typename Func>
+    bool ForEachEvent(Func&& func) const
+    {
+        for (size_t i = 0; i < m_buffers.size(); i++) {
+            if (!ForEachEventInBuffer(i, func))
+                return false;
+        }
+        return true;
+    }
+
+    DecodeResult DecodeEventAt(uint32_t bufferIndex, uint32_t offset, EtlEventView* pView, uint32_t* pNextOffset) const
+    {
+        const EtlBufferInfo& buffer = m_buffers[bufferIndex];
+        const uint8_t* pBuffer = m_file.Data() + buffer.m_fileOffset;
+        uint32_t end = buffer.m_filledBytes;
+        if (offset < sizeof(EtlRawBufferHeader) || end < offset || end - offset < sizeof(uint32_t))
+            return DecodeResult::End;
+
+        const uint8_t* pEvent = pBuffer + offset;
+        uint32_t marker = EtlRead<uint32_t>(pEvent);
+        if (marker == 0xFFFFFFFF || marker == 0)
+            return DecodeResult::End; // Padding at the end of the buffer.
+
+        uint32_t available = end - offset;
+        uint8_t headerType = pEvent[2];
+        uint32_t size = 0;
+        switch (headerType) {
+        case ETL_HEADER_TYPE_SYSTEM32:
+        case ETL_HEADER_TYPE_SYSTEM64:
+        case ETL_HEADER_TYPE_COMPACT32:
+        case ETL_HEADER_TYPE_COMPACT64:
+        case ETL_HEADER_TYPE_PERFINFO32:
+        case ETL_HEADER_TYPE_PERFINFO64:
+            if (available < 8)
+                return DecodeResult::End;
+            size = EtlRead<uint16_t>(pEvent + 4);
+            break;
+        default:
+            size = EtlRead<uint16_t>(pEvent);
+            break;
+        }
+        if (size < sizeof(uint32_t) || size > available)
+            return DecodeResult::End; // Corrupt or truncated record, nothing after it can be trusted.
+
+        *pNextOffset = offset + ((size + 7u) & ~7u);
+
+        memset(pView, 0, sizeof(EtlEventView));
+        pView->m_headerType = headerType;
+        pView->m_processorIndex = buffer.m_processorIndex;
+        pView->m_loggerId = buffer.m_loggerId;
+        pView->m_bufferIndex = bufferIndex;
+        pView->m_bufferOffset = offset;
+
+        bool decoded = false;
+        switch (headerType) {
+        case ETL_HEADER_TYPE_EVENT_HEADER32:
+        case ETL_HEADER_TYPE_EVENT_HEADER64:
+            decoded = DecodeEventHeader(pEvent, size, pView);
+            break;
+        case ETL_HEADER_TYPE_SYSTEM32:
+        case ETL_HEADER_TYPE_SYSTEM64:
+        case ETL_HEADER_TYPE_COMPACT32:
+        case ETL_HEADER_TYPE_COMPACT64:
+            decoded = DecodeSystemHeader(pEvent, size, pView);
+            break;
+        case ETL_HEADER_TYPE_PERFINFO32:
+        case ETL_HEADER_TYPE_PERFINFO64:
+            decoded = DecodePerfInfoHeader(pEvent, size, pView);
+            break;
+        case ETL_HEADER_TYPE_FULL_HEADER32:
+        case ETL_HEADER_TYPE_FULL_HEADER64:
+            decoded = DecodeFullHeader(pEvent, size, pView);
+            break;
+        case ETL_HEADER_TYPE_MESSAGE:
+            decoded = DecodeMessageHeader(pEvent, size, pView);
+            break;
+        default:
+            break; // Instance, timed and error records carry no usable provider id.
+        }
+        return decoded ? DecodeResult::Event : DecodeResult::Skipped;
+    }
+
+    /*
+    Maps a classic kernel event group (the high byte of the hook id) to the MOF class guid
+    that ProcessTrace reports as the provider id.
+    */
+    static EtlGuid KernelGroupGuid(uint8_t group)
+    {
+        switch (group) {
+        case 0x00: return ETL_EVENT_TRACE_GUID;
+        case 0x01: return { 0x3d6fa8d4, 0xfe05, 0x11d0, { 0x9d, 0xda, 0x00, 0xc0, 0x4f, 0xd7, 0xba, 0x7c } }; // DiskIo
+        case 0x02: return { 0x3d6fa8d3, 0xfe05, 0x11d0, { 0x9d, 0xda, 0x00, 0xc0, 0x4f, 0xd7, 0xba, 0x7c } }; // PageFault
+        case 0x03: return { 0x3d6fa8d0, 0xfe05, 0x11d0, { 0x9d, 0xda, 0x00, 0xc0, 0x4f, 0xd7, 0xba, 0x7c } }; // Process
+        case 0x04: return { 0x90cbdc39, 0x4a3e, 0x11d1, { 0x84, 0xf4, 0x00, 0x00, 0xf8, 0x04, 0x64, 0xe3 } }; // FileIo
+        case 0x05: return { 0x3d6fa8d1, 0xfe05, 0x11d0, { 0x9d, 0xda, 0x00, 0xc0, 0x4f, 0xd7, 0xba, 0x7c } }; // Thread
+        case 0x06: return { 0x9a280ac0, 0xc8e0, 0x11d1, { 0x84, 0xe2, 0x00, 0xc0, 0x4f, 0xb9, 0x98, 0xa2 } }; // TcpIp
+        case 0x08: return { 0xbf3a50c5, 0xa9c9, 0x4988, { 0xa0, 0x05, 0x2d, 0xf0, 0xb7, 0xc8, 0x0f, 0x80 } }; // UdpIp
+        case 0x09: return { 0xae53722e, 0xc863, 0x11d2, { 0x86, 0x59, 0x00, 0xc0, 0x4f, 0xa3, 0x21, 0xa1 } }; // Registry
+        case 0x0A: return { 0x13976d09, 0xa327, 0x438c, { 0x95, 0x0b, 0x7f, 0x03, 0x19, 0x28, 0x15, 0xc7 } }; // DbgPrint
+        case 0x0B: return { 0x01853a65, 0x418f, 0x4f36, { 0xae, 0xfc, 0xdc, 0x0f, 0x1d, 0x2f, 0xd2, 0x35 } }; // EventTraceConfig
+        case 0x0D: return { 0x0268a8b6, 0x74fd, 0x4302, { 0x9d, 0xd0, 0x6e, 0x8f, 0x17, 0x95, 0xc0, 0xcf } }; // Pool
+        case 0x0F: return { 0xce1dbfb4, 0x137e, 0x4da6, { 0x87, 0xb0, 0x3f, 0x59, 0xaa, 0x10, 0x2c, 0xbc } }; // PerfInfo
+        case 0x10: return { 0x222962ab, 0x6180, 0x4b88, { 0xa8, 0x25, 0x34, 0x6b, 0x75, 0xf2, 0xa2, 0x4a } }; // Heap
+        case 0x11: return { 0x89497f50, 0xeffe, 0x4440, { 0x8c, 0xf2, 0xce, 0x6b, 0x1c, 0xdc, 0xac, 0xa7 } }; // Object
+        case 0x12: return { 0xe43445e0, 0x0903, 0x48c3, { 0xb8, 0x78, 0xff, 0x0f, 0xcc, 0xeb, 0xdd, 0x04 } }; // Power
+        case 0x14: return { 0x2cb15d1d, 0x5fc1, 0x11d2, { 0xab, 0xe1, 0x00, 0xa0, 0xc9, 0x11, 0xf5, 0x18 } }; // Image
+        case 0x18: return { 0xdef2fe46, 0x7bd6, 0x4b80, { 0xbd, 0x94, 0xf5, 0x7f, 0xe2, 0x0d, 0x0c, 0xe3 } }; // StackWalk
+        case 0x1A: return { 0x45d8cccd, 0x539f, 0x4b72, { 0xa8, 0xb7, 0x5c, 0x68, 0x31, 0x42, 0x60, 0x9a } }; // ALPC
+        case 0x1B: return { 0xd837ca92, 0x12b9, 0x44a5, { 0xad, 0x6a, 0x3a, 0x65, 0xb3, 0x57, 0x8a, 0xa8 } }; // SplitIo
+        case 0x1C: return { 0xc861d0e2, 0xa2c1, 0x4d36, { 0x9f, 0x9c, 0x97, 0x0b, 0xab, 0x94, 0x3a, 0x12 } }; // ThreadPool
+        default: return EtlGuid{};
+        }
+    }
+
+private:
+    void IndexBuffers()
+    {
+        const uint8_t* pData = m_file.Data();
+        uint64_t size = m_file.Size();
+        uint64_t offset = 0;
+        while (size - offset >= sizeof(EtlRawBufferHeader)) {
+            EtlRawBufferHeader header;
+            memcpy(&header, pData + offset, sizeof(header));
+            if (header.BufferSize < sizeof(EtlRawBufferHeader) || header.BufferSize > size - offset)
+                break;
+
+            uint32_t filled = header.SavedOffset;
+            if (filled < sizeof(EtlRawBufferHeader) || filled > header.BufferSize)
+                filled = header.Offset;
+            if (filled < sizeof(EtlRawBufferHeader) || filled > header.BufferSize)
+                filled = header.BufferSize;
+
+            EtlBufferInfo info;
+            info.m_fileOffset = offset;
+            info.m_bufferSize = header.BufferSize;
+            info.m_filledBytes = filled;
+            info.m_timestamp = header.TimeStamp;
+            info.m_processorIndex = header.ProcessorNumber;
+            info.m_loggerId = header.LoggerId;
+            info.m_bufferType = header.BufferType;
+            m_buffers.push_back(info);
+
+            offset += header.BufferSize;
+        }
+
+        if (m_buffers.empty())
+            throw std::runtime_error("File does not contain any ETW buffers");
+    }
+
+    void ReadLogFileInfo()
+    {
+        m_logFileInfo.m_bufferSize = m_buffers.front().m_bufferSize;
+        ForEachEventInBuffer(0, [this](const EtlEventView& view) {
+            if (!EtlGuidEquals(view.m_providerId, ETL_EVENT_TRACE_GUID) || view.m_opcode != 0)
+                return true;
+
+            const uint8_t* p = view.m_pUserData;
+            uint32_t length = view.m_userDataLength;
+            if (length < 56)
+                return false;
+            m_logFileInfo.m_bufferSize = EtlRead<uint32_t>(p + 0);
+            m_logFileInfo.m_version = EtlRead<uint32_t>(p + 4);
+            m_logFileInfo.m_numberOfProcessors = EtlRead<uint32_t>(p + 12);
+            m_logFileInfo.m_endTime = EtlRead<int64_t>(p + 16);
+            m_logFileInfo.m_timerResolution = EtlRead<uint32_t>(p + 24);
+            m_logFileInfo.m_logFileMode = EtlRead<uint32_t>(p + 32);
+            m_logFileInfo.m_buffersWritten = EtlRead<uint32_t>(p + 36);
+            uint32_t pointerSize = EtlRead<uint32_t>(p + 44);
+            if (pointerSize == 4 || pointerSize == 8)
+                m_logFileInfo.m_pointerSize = pointerSize;
+            m_logFileInfo.m_eventsLost = EtlRead<uint32_t>(p + 48);
+            m_logFileInfo.m_cpuSpeedMHz = EtlRead<uint32_t>(p + 52);
+            m_logFileInfo.m_startTimestamp = view.m_timestamp;
+
+            // LoggerName and LogFileName are pointers followed by a 172 byte TIME_ZONE_INFORMATION,
+            // the LARGE_INTEGERs after it are 8 byte aligned.
+            uint32_t timesOffset = (56 + 2 * m_logFileInfo.m_pointerSize + 172 + 7) & ~7u;
+            if (length >= timesOffset + 32) {
+                m_logFileInfo.m_bootTime = EtlRead<int64_t>(p + timesOffset);
+                m_logFileInfo.m_perfFreq = EtlRead<int64_t>(p + timesOffset + 8);
+                m_logFileInfo.m_startTime = EtlRead<int64_t>(p + timesOffset + 16);
+                m_logFileInfo.m_clockType = EtlRead<uint32_t>(p + timesOffset + 24);
+                m_logFileInfo.m_buffersLost = EtlRead<uint32_t>(p + timesOffset + 28);
+            }
+            return false;
+        });
+    }
+
+    static void SetPayload(const uint8_t* pEvent, uint32_t headerSize, uint32_t size, EtlEventView* pView)
+    {
+        pView->m_pUserData = pEvent + headerSize;
+        pView->m_userDataLength = static_cast<uint16_t>(size - headerSize);
+    }
+
+    static bool DecodeEventHeader(const uint8_t* pEvent, uint32_t size, EtlEventView* pView)
+    {
+        if (size < sizeof(EtlRawEventHeader))
+            return false;
+
+        EtlRawEventHeader header;
+        memcpy(&header, pEvent, sizeof(header));
+        pView->m_providerId = header.ProviderId;
+        pView->m_activityId = header.ActivityId;
+        pView->m_timestamp = header.TimeStamp;
+        pView->m_keyword = header.Keyword;
+        pView->m_threadId = header.ThreadId;
+        pView->m_processId = header.ProcessId;
+        pView->m_kernelTime = header.KernelTime;
+        pView->m_userTime = header.UserTime;
+        pView->m_id = header.Id;
+        pView->m_version = header.Version;
+        pView->m_channel = header.Channel;
+        pView->m_level = header.Level;
+        pView->m_opcode = header.Opcode;
+        pView->m_task = header.Task;
+        pView->m_eventProperty = header.EventProperty;
+        pView->m_flags = header.Flags | (header.HeaderType == ETL_HEADER_TYPE_EVENT_HEADER32 ? ETL_HEADER_FLAG_32_BIT_HEADER : ETL_HEADER_FLAG_64_BIT_HEADER);
+
+        uint32_t headerSize = sizeof(EtlRawEventHeader);
+        if (header.Flags & ETL_HEADER_FLAG_EXTENDED_INFO) {
+            // Extended items are chained: bit 0 of the linkage word says another item follows.
+            for (;;) {
+                if (size - headerSize < ETL_EXTENDED_ITEM_HEADER_SIZE)
+                    return false;
+                const uint8_t* pItem = pEvent + headerSize;
+                uint16_t extType = EtlRead<uint16_t>(pItem + 2);
+                uint16_t linkage = EtlRead<uint16_t>(pItem + 4);
+                uint16_t dataSize = EtlRead<uint16_t>(pItem + 6);
+                if (size - headerSize - ETL_EXTENDED_ITEM_HEADER_SIZE < dataSize)
+                    return false;
+                if (pView->m_extendedDataCount < ETL_MAX_EXTENDED_DATA) {
+                    EtlExtendedDataItem& item = pView->m_extendedData[pView->m_extendedDataCount++];
+                    item.m_extType = extType;
+                    item.m_dataSize = dataSize;
+                    item.m_pData = pItem + ETL_EXTENDED_ITEM_HEADER_SIZE;
+                }
+                headerSize += (ETL_EXTENDED_ITEM_HEADER_SIZE + dataSize + 7u) & ~7u;
+                if (headerSize > size)
+                    return false;
+                if ((linkage & 1) == 0)
+                    break;
+            }
+        }
+        else {
+            pView->m_flags &= ~ETL_HEADER_FLAG_EXTENDED_INFO;
+        }
+
+        SetPayload(pEvent, headerSize, size, pView);
+        return true;
+    }
+
+    static bool DecodeSystemHeader(const uint8_t* pEvent, uint32_t size, EtlEventView* pView)
+    {
+        bool compact = pEvent[2] == ETL_HEADER_TYPE_COMPACT32 || pEvent[2] == ETL_HEADER_TYPE_COMPACT64;
+        uint32_t headerSize = compact ? ETL_COMPACT_SYSTEM_HEADER_SIZE : static_cast<uint32_t>(sizeof(EtlRawSystemHeader));
+        if (size < headerSize)
+            return false;
+
+        EtlRawSystemHeader header = {};
+        memcpy(&header, pEvent, headerSize);
+        bool is32 = header.HeaderType == ETL_HEADER_TYPE_SYSTEM32 || header.HeaderType == ETL_HEADER_TYPE_COMPACT32;
+        pView->m_providerId = KernelGroupGuid(header.Group);
+        pView->m_timestamp = header.SystemTime;
+        pView->m_threadId = header.ThreadId;
+        pView->m_processId = header.ProcessId;
+        pView->m_kernelTime = header.KernelTime;
+        pView->m_userTime = header.UserTime;
+        pView->m_version = static_cast<uint8_t>(header.Version);
+        pView->m_opcode = header.Type;
+        pView->m_flags = ETL_HEADER_FLAG_CLASSIC_HEADER | (is32 ? ETL_HEADER_FLAG_32_BIT_HEADER : ETL_HEADER_FLAG_64_BIT_HEADER);
+        if (compact)
+            pView->m_flags |= ETL_HEADER_FLAG_NO_CPUTIME;
+        SetPayload(pEvent, headerSize, size, pView);
+        return true;
+    }
+
+    static bool DecodePerfInfoHeader(const uint8_t* pEvent, uint32_t size, EtlEventView* pView)
+    {
+        if (size < sizeof(EtlRawPerfInfoHeader))
+            return false;
+
+        EtlRawPerfInfoHeader header;
+        memcpy(&header, pEvent, sizeof(header));
+        pView->m_providerId = KernelGroupGuid(header.Group);
+        pView->m_timestamp = header.SystemTime;
+        pView->m_threadId = 0xFFFFFFFF; // PerfInfo records carry no thread or process.
+        pView->m_processId = 0xFFFFFFFF;
+        pView->m_version = static_cast<uint8_t>(header.Version);
+        pView->m_opcode = header.Type;
+        pView->m_flags = ETL_HEADER_FLAG_CLASSIC_HEADER | ETL_HEADER_FLAG_NO_CPUTIME |
+            (header.HeaderType == ETL_HEADER_TYPE_PERFINFO32 ? ETL_HEADER_FLAG_32_BIT_HEADER : ETL_HEADER_FLAG_64_BIT_HEADER);
+        SetPayload(pEvent, sizeof(EtlRawPerfInfoHeader), size, pView);
+        return true;
+    }
+
+    static bool DecodeFullHeader(const uint8_t* pEvent, uint32_t size, EtlEventView* pView)
+    {
+        if (size < sizeof(EtlRawFullHeader))
+            return false;
+
+        EtlRawFullHeader header;
+        memcpy(&header, pEvent, sizeof(header));
+        pView->m_providerId = header.Guid;
+        pView->m_timestamp = header.TimeStamp;
+        pView->m_threadId = header.ThreadId;
+        pView->m_processId = header.ProcessId;
+        pView->m_kernelTime = header.KernelTime;
+        pView->m_userTime = header.UserTime;
+        pView->m_version = static_cast<uint8_t>(header.Version);
+        pView->m_level = header.Level;
+        pView->m_opcode = header.Type;
+        pView->m_flags = ETL_HEADER_FLAG_CLASSIC_HEADER |
+            (header.HeaderType == ETL_HEADER_TYPE_FULL_HEADER32 ? ETL_HEADER_FLAG_32_BIT_HEADER : ETL_HEADER_FLAG_64_BIT_HEADER);
+        SetPayload(pEvent, sizeof(EtlRawFullHeader), size, pView);
+        return true;
+    }
+
+    static bool DecodeMessageHeader(const uint8_t* pEvent, uint32_t size, EtlEventView* pView)
+    {
+        // MESSAGE_TRACE_HEADER is followed by optional fields selected by OptionFlags (TRACE_MESSAGE_*).
+        if (size < 8)
+            return false;
+
+        uint16_t messageNumber = EtlRead<uint16_t>(pEvent + 4);
+        uint16_t optionFlags = EtlRead<uint16_t>(pEvent + 6);
+        uint32_t headerSize = 8;
+        auto take = [&](uint32_t bytes) -> const uint8_t* {
+            if (size - headerSize < bytes)
+                return nullptr;
+            const uint8_t* p = pEvent + headerSize;
+            headerSize += bytes;
+            return p;
+        };
+
+        if (optionFlags & 0x0001) { // TRACE_MESSAGE_SEQUENCE
+            if (!take(4))
+                return false;
+        }
+        if (optionFlags & 0x0002) { // TRACE_MESSAGE_GUID
+            const uint8_t* p = take(sizeof(EtlGuid));
+            if (!p)
+                return false;
+            pView->m_providerId = EtlRead<EtlGuid>(p);
+        }
+        else if (optionFlags & 0x0004) { // TRACE_MESSAGE_COMPONENTID
+            if (!take(4))
+                return false;
+        }
+        if (optionFlags & 0x0008) { // TRACE_MESSAGE_TIMESTAMP
+            const uint8_t* p = take(8);
+            if (!p)
+                return false;
+            pView->m_timestamp = EtlRead<int64_t>(p);
+        }
+        if (optionFlags & 0x0020) { // TRACE_MESSAGE_SYSTEMINFO
+            const uint8_t* p = take(8);
+            if (!p)
+                return false;
+            pView->m_threadId = EtlRead<uint32_t>(p);
+            pView->m_processId = EtlRead<uint32_t>(p + 4);
+        }
+
+        pView->m_id = messageNumber;
+        pView->m_flags = ETL_HEADER_FLAG_TRACE_MESSAGE;
+        SetPayload(pEvent, headerSize, size, pView);
+        return true;
+    }
+
+    MappedFile m_file;
+    std::vector<EtlBufferInfo> m_buffers;
+    EtlLogFileInfo m_logFileInfo;
+};
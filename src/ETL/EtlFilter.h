@@ -0,0 +1,830 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <ETL/DecodePlan.h>
+#include <ETL/EtlFile.h>
+
+// Header fields a filter can test without decoding the payload.
+enum EtlFilterField : uint8_t {
+    ETL_FILTER_TIMESTAMP,
+    ETL_FILTER_PROCESS_ID,
+    ETL_FILTER_THREAD_ID,
+    ETL_FILTER_CPU,
+    ETL_FILTER_LEVEL,
+    ETL_FILTER_KEYWORDS,
+    ETL_FILTER_OPCODE,
+    ETL_FILTER_TASK,
+    ETL_FILTER_EVENT_ID,
+    ETL_FILTER_VERSION,
+    ETL_FILTER_FIELD_COUNT,
+};
+
+/*
+A batch of events for EtlFilter: one column per header field, plus the property values of rows whose
+payload has been decoded. Values point into the payloads (or into text kept by the batch), so the
+trace must stay mapped while the batch is evaluated. Also holds the evaluation stack of the filter;
+each thread evaluates its own batch.
+*/
+class EtlFilterBatch
+{
+public:
+    // Removes every row. Rows appended afterwards hold propertyCount values each.
+    void Clear(size_t propertyCount)
+    {
+        for (auto& field : m_fields)
+            field.clear();
+        m_values.clear();
+        m_text.clear();
+        m_propertyCount = propertyCount;
+        m_size = 0;
+    }
+
+    size_t Size() const { return m_size; }
+
+    void AppendHeader(const EtlEventView& view)
+    {
+        m_fields[ETL_FILTER_TIMESTAMP].push_back(static_cast<uint64_t>(view.m_timestamp));
+        m_fields[ETL_FILTER_PROCESS_ID].push_back(view.m_processId);
+        m_fields[ETL_FILTER_THREAD_ID].push_back(view.m_threadId);
+        m_fields[ETL_FILTER_CPU].push_back(view.m_processorIndex);
+        m_fields[ETL_FILTER_LEVEL].push_back(view.m_level);
+        m_fields[ETL_FILTER_KEYWORDS].push_back(view.m_keyword);
+        m_fields[ETL_FILTER_OPCODE].push_back(view.m_opcode);
+        m_fields[ETL_FILTER_TASK].push_back(view.m_task);
+        m_fields[ETL_FILTER_EVENT_ID].push_back(view.m_id);
+        m_fields[ETL_FILTER_VERSION].push_back(view.m_version);
+        m_size++;
+    }
+
+    // Appends the header fields of a row of another batch.
+    void AppendHeader(const EtlFilterBatch& other, size_t row)
+    {
+        for (size_t field = 0; field < ETL_FILTER_FIELD_COUNT; field++)
+            m_fields[field].push_back(other.m_fields[field][row]);
+        m_size++;
+    }
+
+    // Sets the property values of the last row from DecodePlan output. Values beyond the payload stay missing.
+    void SetValues(const std::vector<EtlValue>& values)
+    {
+        EtlValue* pRow = LastRowValues();
+        std::copy_n(values.begin(), (std::min)(values.size(), m_propertyCount), pRow);
+    }
+
+    // Sets the property values of the last row from preformatted UTF-8 text, for schemas without a DecodePlan.
+    void SetTextValues(const std::vector<std::string>& values)
+    {
+        EtlValue* pRow = LastRowValues();
+        for (size_t i = 0; i < (std::min)(values.size(), m_propertyCount); i++) {
+            const std::string& text = m_text.emplace_back(values[i]);
+            pRow[i].m_kind = EtlValueKind::AnsiString;
+            pRow[i].m_pData = reinterpret_cast<const uint8_t*>(text.data());
+            pRow[i].m_size = static_cast<uint32_t>(text.size());
+        }
+    }
+
+    const std::vector<uint64_t>& GetField(EtlFilterField field) const { return m_fields[field]; }
+
+    // Missing for rows whose values were never set.
+    const EtlValue& GetValue(size_t row, size_t property) const
+    {
+        size_t index = row * m_propertyCount + property;
+        return index < m_values.size() ? m_values[index] : MISSING;
+    }
+
+private:
+    friend class EtlFilter;
+
+    static constexpr EtlValue MISSING = { EtlValueKind::Missing, 0, 0, { 0 }, nullptr, 0, 0 };
+
+    EtlValue* LastRowValues()
+    {
+        m_values.resize(m_size * m_propertyCount, MISSING);
+        return m_values.data() + (m_size - 1) * m_propertyCount;
+    }
+
+    std::vector<uint64_t> m_fields[ETL_FILTER_FIELD_COUNT];
+    std::vector<EtlValue> m_values; // Row-major, m_propertyCount per row.
+    std::deque<std::string> m_text; // Never relocates, so values can point into it.
+    size_t m_propertyCount = 0;
+    size_t m_size = 0;
+    std::vector<std::vector<uint8_t>> m_stack;
+};
+
+/*
+A filter expression over the instances of one event type, compiled against its property names.
+
+    ProcessId == 4 && FileName contains ".dll" && IoSize > 65536
+    level <= 3 && (keywords & 0x10 || !(tid == 1234))
+
+Operands are a field on the left and a literal on the right: ==, !=, <, <=, >, >= compare with numbers
+(decimal, hex or floating point) or strings, contains tests for a substring and & for any common bit.
+String comparisons ignore ASCII case. A name matches a property first (ignoring case), then one of
+the header fields: timestamp, pid/ProcessId, tid/ThreadId, cpu, level, keywords, opcode, task, id
+and version. A comparison with a property the event does not have, or whose value does not fit the
+literal, is false.
+
+The expression is compiled to postfix code that evaluates one instruction over a whole batch at a
+time with three-valued results. Without decoded values, every property test yields MAYBE, so the
+header fields alone settle most rows; only rows left at MAYBE need their payload decoded and a
+second evaluation.
+*/
+class EtlFilter
+{
+public:
+    static constexpr uint8_t NO_MATCH = 0;
+    static constexpr uint8_t MAYBE = 1; // Depends on property values that were not decoded.
+    static constexpr uint8_t MATCH = 2;
+
+    // Throws std::runtime_error describing the first error in the text.
+    static EtlFilter Compile(std::string_view text, const std::vector<std::string>& propertyNames)
+    {
+        EtlFilter filter;
+        Parser parser{ text, propertyNames, filter };
+        parser.Next();
+        parser.ParseOr();
+        if (parser.m_token.m_type != TokenType::End)
+            parser.Fail("Unexpected '" + std::string(parser.m_token.m_text) + "'");
+        filter.m_text = text;
+        return filter;
+    }
+
+    const std::string& GetText() const { return m_text; }
+
+    // True if some rows can only be settled with their property values.
+    bool NeedsProperties() const { return m_needsProperties; }
+
+    /*
+    Restricts the filter to timestamps in [begin, end); a default constructed filter then only tests
+    the range. Scans can skip occurrences outside of [GetTimeBegin(), GetTimeEnd()) without reading them.
+    */
+    void RestrictTime(int64_t begin, int64_t end)
+    {
+        begin = (std::max)(begin, m_timeBegin);
+        end = (std::min)(end, m_timeEnd);
+        m_timeBegin = begin;
+        m_timeEnd = end;
+        int64_t low = (std::max)(begin, static_cast<int64_t>(0)); // Timestamps are tested as unsigned header fields.
+        NumberTest test = {};
+        test.m_unsignedEmpty = end <= low;
+        test.m_unsignedLow = static_cast<uint64_t>(low);
+        test.m_unsignedSpan = test.m_unsignedEmpty ? 0 : static_cast<uint64_t>(end) - 1 - static_cast<uint64_t>(low);
+        m_numberTests.push_back(test);
+        m_code.push_back({ Op::Field, ETL_FILTER_TIMESTAMP, static_cast<uint32_t>(m_numberTests.size() - 1), 0 });
+        if (m_code.size() > 1)
+            m_code.push_back({ Op::And, 0, 0, 0 });
+        m_depth = (std::max)(m_depth, m_code.size() > 1 ? 2u : 1u);
+    }
+
+    int64_t GetTimeBegin() const { return m_timeBegin; }
+    int64_t GetTimeEnd() const { return m_timeEnd; }
+
+    /*
+    Sets results[row] to NO_MATCH, MAYBE or MATCH for every row of the batch. With decoded false, the
+    property values are ignored and only the header fields are tested.
+    */
+    void Evaluate(EtlFilterBatch& batch, bool decoded, std::vector<uint8_t>& results) const
+    {
+        size_t size = batch.Size();
+        std::vector<std::vector<uint8_t>>& stack = batch.m_stack;
+        if (stack.size() < m_depth)
+            stack.resize(m_depth);
+
+        size_t top = 0;
+        for (const Instruction& instruction : m_code) {
+            if (instruction.m_op == Op::And || instruction.m_op == Op::Or) {
+                const uint8_t* pRight = stack[--top].data();
+                uint8_t* pLeft = stack[top - 1].data();
+                if (instruction.m_op == Op::And) {
+                    for (size_t row = 0; row < size; row++)
+                        pLeft[row] = (std::min)(pLeft[row], pRight[row]);
+                }
+                else {
+                    for (size_t row = 0; row < size; row++)
+                        pLeft[row] = (std::max)(pLeft[row], pRight[row]);
+                }
+                continue;
+            }
+            if (instruction.m_op == Op::Not) {
+                uint8_t* pOperand = stack[top - 1].data();
+                for (size_t row = 0; row < size; row++)
+                    pOperand[row] = MATCH - pOperand[row];
+                continue;
+            }
+
+            std::vector<uint8_t>& out = stack[top++];
+            out.resize(size);
+            uint8_t* pOut = out.data();
+            switch (instruction.m_op) {
+            case Op::Field: {
+                const NumberTest& test = m_numberTests[instruction.m_index];
+                const uint64_t* pField = batch.m_fields[instruction.m_operand].data();
+                if (test.m_unsignedEmpty) {
+                    std::fill_n(pOut, size, test.m_invert ? MATCH : NO_MATCH);
+                    break;
+                }
+                for (size_t row = 0; row < size; row++)
+                    pOut[row] = static_cast<uint8_t>(((pField[row] - test.m_unsignedLow <= test.m_unsignedSpan) != test.m_invert) * MATCH);
+                break;
+            }
+            case Op::FieldBits: {
+                const uint64_t* pField = batch.m_fields[instruction.m_operand].data();
+                uint64_t mask = instruction.m_mask;
+                for (size_t row = 0; row < size; row++)
+                    pOut[row] = static_cast<uint8_t>(((pField[row] & mask) != 0) * MATCH);
+                break;
+            }
+            case Op::PropertyNumber:
+            case Op::PropertyBits:
+            case Op::PropertyText:
+                if (!decoded) {
+                    std::fill_n(pOut, size, MAYBE);
+                    break;
+                }
+                for (size_t row = 0; row < size; row++) {
+                    const EtlValue& value = batch.GetValue(row, instruction.m_operand);
+                    if (instruction.m_op == Op::PropertyNumber)
+                        pOut[row] = TestNumber(value, m_numberTests[instruction.m_index]);
+                    else if (instruction.m_op == Op::PropertyBits)
+                        pOut[row] = TestBits(value, instruction.m_mask);
+                    else
+                        pOut[row] = TestText(value, m_textTests[instruction.m_index]);
+                }
+                break;
+            default:
+                break;
+            }
+        }
+        std::swap(results, stack[0]);
+        results.resize(size);
+    }
+
+private:
+    enum class Op : uint8_t {
+        Field,          // Header field against m_numberTests[m_index].
+        FieldBits,      // Header field & m_mask.
+        PropertyNumber, // Property against m_numberTests[m_index].
+        PropertyBits,   // Property & m_mask.
+        PropertyText,   // Property against m_textTests[m_index].
+        And,
+        Or,
+        Not,
+    };
+
+    enum class Compare : uint8_t { Equal, NotEqual, Less, LessEqual, Greater, GreaterEqual, Contains };
+
+    struct Instruction {
+        Op m_op;
+        uint32_t m_operand; // Field or property index.
+        uint32_t m_index;
+        uint64_t m_mask;
+    };
+
+    /*
+    A numeric comparison as inclusive ranges of each value domain, tested as (value - low) <= span
+    in unsigned arithmetic. != is the inverted == range.
+    */
+    struct NumberTest {
+        uint64_t m_unsignedLow;
+        uint64_t m_unsignedSpan;
+        bool m_unsignedEmpty;
+        uint64_t m_signedLow; // Two's complement bits of the int64 bounds.
+        uint64_t m_signedSpan;
+        bool m_signedEmpty;
+        double m_doubleLow;
+        double m_doubleHigh;
+        bool m_invert;
+    };
+
+    // Needles with ASCII letters lowered, in both encodings of string values.
+    struct TextTest {
+        Compare m_compare; // Equal, NotEqual or Contains.
+        std::string m_utf8;
+        std::u16string m_utf16;
+    };
+
+    // Integers of a literal's range, as 128 bit two's complement so bounds one past the value domains fit.
+    struct Wide {
+        int64_t m_high;
+        uint64_t m_low;
+
+        static Wide FromUnsigned(uint64_t value) { return { 0, value }; }
+        static Wide FromNegative(uint64_t magnitude) { return magnitude == 0 ? Wide{ 0, 0 } : Wide{ -1, 0 - magnitude }; }
+
+        // value must have no fractional part.
+        static Wide FromDouble(double value)
+        {
+            constexpr double TWO_64 = 18446744073709551616.0;
+            if (value >= TWO_64)
+                return { 1, 0 };
+            if (value <= -TWO_64)
+                return { -2, 0 };
+            return value >= 0.0 ? FromUnsigned(static_cast<uint64_t>(value)) : FromNegative(static_cast<uint64_t>(-value));
+        }
+
+        Wide Plus1() const { return m_low == UINT64_MAX ? Wide{ m_high + 1, 0 } : Wide{ m_high, m_low + 1 }; }
+        Wide Minus1() const { return m_low == 0 ? Wide{ m_high - 1, UINT64_MAX } : Wide{ m_high, m_low - 1 }; }
+
+        bool operator<(const Wide& other) const { return m_high != other.m_high ? m_high < other.m_high : m_low < other.m_low; }
+    };
+
+    struct Literal {
+        bool m_isText;
+        std::string m_text;
+        double m_double;
+        Wide m_floor; // Largest integer <= the value.
+        Wide m_ceil;  // Smallest integer >= the value.
+    };
+
+    enum class TokenType : uint8_t { End, Name, Number, String, Operator, LeftParen, RightParen };
+
+    struct Token {
+        TokenType m_type;
+        std::string_view m_text;
+        size_t m_position;
+    };
+
+    struct Parser {
+        std::string_view m_source;
+        const std::vector<std::string>& m_propertyNames;
+        EtlFilter& m_filter;
+        size_t m_position = 0;
+        Token m_token = {};
+        uint32_t m_depth = 0;
+
+        [[noreturn]] void Fail(const std::string& message) const
+        {
+            throw std::runtime_error(message + " at column " + std::to_string(m_token.m_position + 1));
+        }
+
+        void Next()
+        {
+            while (m_position < m_source.size() && IsSpace(m_source[m_position]))
+                m_position++;
+            size_t start = m_position;
+            if (m_position == m_source.size()) {
+                m_token = { TokenType::End, {}, start };
+                return;
+            }
+
+            char c = m_source[m_position];
+            TokenType type;
+            if (IsNameStart(c)) {
+                while (m_position < m_source.size() && IsNameChar(m_source[m_position]))
+                    m_position++;
+                type = TokenType::Name;
+            }
+            else if (IsDigit(c) || ((c == '-' || c == '.') && m_position + 1 < m_source.size() && IsDigit(m_source[m_position + 1]))) {
+                m_position++;
+                while (m_position < m_source.size() && (IsNameChar(m_source[m_position]) ||
+                    ((m_source[m_position] == '+' || m_source[m_position] == '-') && (m_source[m_position - 1] | 0x20) == 'e' && !IsHex(m_source.substr(start)))))
+                    m_position++;
+                type = TokenType::Number;
+            }
+            else if (c == '"') {
+                for (m_position++; m_position < m_source.size() && m_source[m_position] != '"'; m_position++) {
+                    if (m_source[m_position] == '\\')
+                        m_position++;
+                }
+                if (m_position >= m_source.size()) {
+                    m_token.m_position = start;
+                    Fail("Unterminated string");
+                }
+                m_position++;
+                type = TokenType::String;
+            }
+            else if (c == '(' || c == ')') {
+                m_position++;
+                type = c == '(' ? TokenType::LeftParen : TokenType::RightParen;
+            }
+            else {
+                static constexpr std::string_view OPERATORS[] = { "==", "!=", "<=", ">=", "&&", "||", "<", ">", "!", "&" };
+                type = TokenType::Operator;
+                for (std::string_view op : OPERATORS) {
+                    if (m_source.substr(m_position, op.size()) == op) {
+                        m_position += op.size();
+                        break;
+                    }
+                }
+                if (m_position == start) {
+                    m_token = { TokenType::Operator, m_source.substr(start, 1), start };
+                    Fail("Unexpected '" + std::string(1, c) + "'");
+                }
+            }
+            m_token = { type, m_source.substr(start, m_position - start), start };
+        }
+
+        bool IsOperator(std::string_view op) const { return m_token.m_type == TokenType::Operator && m_token.m_text == op; }
+
+        void Emit(Op op, uint32_t operand = 0, uint32_t index = 0, uint64_t mask = 0)
+        {
+            m_filter.m_code.push_back({ op, operand, index, mask });
+        }
+
+        // Tracks the depth of the evaluation stack: leaves push one result, And and Or pop one.
+        void Push()
+        {
+            m_depth++;
+            m_filter.m_depth = (std::max)(m_filter.m_depth, m_depth);
+        }
+
+        void ParseOr()
+        {
+            ParseAnd();
+            while (IsOperator("||")) {
+                Next();
+                ParseAnd();
+                Emit(Op::Or);
+                m_depth--;
+            }
+        }
+
+        void ParseAnd()
+        {
+            ParseUnary();
+            while (IsOperator("&&")) {
+                Next();
+                ParseUnary();
+                Emit(Op::And);
+                m_depth--;
+            }
+        }
+
+        void ParseUnary()
+        {
+            if (IsOperator("!")) {
+                Next();
+                ParseUnary();
+                Emit(Op::Not);
+                return;
+            }
+            if (m_token.m_type == TokenType::LeftParen) {
+                Next();
+                ParseOr();
+                if (m_token.m_type != TokenType::RightParen)
+                    Fail("Expected ')'");
+                Next();
+                return;
+            }
+            ParseComparison();
+        }
+
+        void ParseComparison()
+        {
+            if (m_token.m_type != TokenType::Name)
+                Fail(m_token.m_type == TokenType::End ? std::string("Expected a field name") : "Expected a field name instead of '" + std::string(m_token.m_text) + "'");
+            Token name = m_token;
+            uint32_t property = FindProperty(name.m_text);
+            uint32_t field = property == UINT32_MAX ? FindField(name.m_text) : static_cast<uint32_t>(ETL_FILTER_FIELD_COUNT);
+            if (property == UINT32_MAX && field == ETL_FILTER_FIELD_COUNT)
+                Fail("Unknown field '" + std::string(name.m_text) + "'");
+            Next();
+
+            Compare compare;
+            if (m_token.m_type == TokenType::Name && EqualsIgnoreCase(m_token.m_text, "contains"))
+                compare = Compare::Contains;
+            else if (IsOperator("=="))
+                compare = Compare::Equal;
+            else if (IsOperator("!="))
+                compare = Compare::NotEqual;
+            else if (IsOperator("<"))
+                compare = Compare::Less;
+            else if (IsOperator("<="))
+                compare = Compare::LessEqual;
+            else if (IsOperator(">"))
+                compare = Compare::Greater;
+            else if (IsOperator(">="))
+                compare = Compare::GreaterEqual;
+            else if (IsOperator("&")) {
+                Next();
+                Literal mask = ParseLiteral();
+                if (mask.m_isText || mask.m_floor.m_high != 0 || mask.m_ceil.m_high != 0 || mask.m_floor.m_low != mask.m_ceil.m_low)
+                    Fail("Expected an unsigned integer mask");
+                Emit(property == UINT32_MAX ? Op::FieldBits : Op::PropertyBits, property == UINT32_MAX ? field : property, 0, mask.m_floor.m_low);
+                Push();
+                m_filter.m_needsProperties |= property != UINT32_MAX;
+                return;
+            }
+            else {
+                Fail("Expected a comparison after '" + std::string(name.m_text) + "'");
+            }
+            Next();
+
+            Literal literal = ParseLiteral();
+            if (property == UINT32_MAX && literal.m_isText)
+                Fail("'" + std::string(name.m_text) + "' is a header field and compares with numbers");
+            if (compare == Compare::Contains && !literal.m_isText)
+                Fail("contains expects a string");
+            if (literal.m_isText && compare != Compare::Equal && compare != Compare::NotEqual && compare != Compare::Contains)
+                Fail("Strings can only be compared with ==, != and contains");
+
+            if (literal.m_isText) {
+                m_filter.m_textTests.push_back(MakeTextTest(compare, literal.m_text));
+                Emit(Op::PropertyText, property, static_cast<uint32_t>(m_filter.m_textTests.size() - 1));
+            }
+            else {
+                m_filter.m_numberTests.push_back(MakeNumberTest(compare, literal));
+                Emit(property == UINT32_MAX ? Op::Field : Op::PropertyNumber, property == UINT32_MAX ? field : property,
+                    static_cast<uint32_t>(m_filter.m_numberTests.size() - 1));
+            }
+            Push();
+            m_filter.m_needsProperties |= property != UINT32_MAX;
+        }
+
+        Literal ParseLiteral()
+        {
+            Literal literal = {};
+            if (m_token.m_type == TokenType::String) {
+                literal.m_isText = true;
+                std::string_view body = m_token.m_text.substr(1, m_token.m_text.size() - 2);
+                for (size_t i = 0; i < body.size(); i++) {
+                    char c = body[i];
+                    if (c == '\\' && ++i < body.size()) {
+                        c = body[i];
+                        if (c == 'n')
+                            c = '\n';
+                        else if (c == 't')
+                            c = '\t';
+                    }
+                    literal.m_text += c;
+                }
+            }
+            else if (m_token.m_type == TokenType::Number) {
+                std::string_view text = m_token.m_text;
+                bool negative = text[0] == '-';
+                std::string_view digits = negative ? text.substr(1) : text;
+                uint64_t value = 0;
+                bool hex = IsHex(digits);
+                std::from_chars_result result = hex ? std::from_chars(digits.data() + 2, digits.data() + digits.size(), value, 16)
+                    : std::from_chars(digits.data(), digits.data() + digits.size(), value);
+                if (result.ec == std::errc() && result.ptr == digits.data() + digits.size() && (!hex || digits.size() > 2)) {
+                    literal.m_floor = literal.m_ceil = negative ? Wide::FromNegative(value) : Wide::FromUnsigned(value);
+                    literal.m_double = negative ? -static_cast<double>(value) : static_cast<double>(value);
+                }
+                else {
+                    std::string copy(text); // Floating point, or an integer beyond 64 bits.
+                    char* pEnd = nullptr;
+                    double number = std::strtod(copy.c_str(), &pEnd);
+                    if (hex || pEnd != copy.c_str() + copy.size() || !std::isfinite(number))
+                        Fail("Invalid number '" + copy + "'");
+                    literal.m_double = number;
+                    literal.m_floor = Wide::FromDouble(std::floor(number));
+                    literal.m_ceil = Wide::FromDouble(std::ceil(number));
+                }
+            }
+            else {
+                Fail(m_token.m_type == TokenType::End ? std::string("Expected a number or a string") : "Expected a number or a string instead of '" + std::string(m_token.m_text) + "'");
+            }
+            Next();
+            return literal;
+        }
+
+        uint32_t FindProperty(std::string_view name) const
+        {
+            for (size_t i = 0; i < m_propertyNames.size(); i++) {
+                if (EqualsIgnoreCase(m_propertyNames[i], name))
+                    return static_cast<uint32_t>(i);
+            }
+            return UINT32_MAX;
+        }
+
+        static uint32_t FindField(std::string_view name)
+        {
+            static constexpr struct {
+                std::string_view m_name;
+                EtlFilterField m_field;
+            } FIELDS[] = {
+                { "timestamp", ETL_FILTER_TIMESTAMP },
+                { "pid", ETL_FILTER_PROCESS_ID },
+                { "ProcessId", ETL_FILTER_PROCESS_ID },
+                { "tid", ETL_FILTER_THREAD_ID },
+                { "ThreadId", ETL_FILTER_THREAD_ID },
+                { "cpu", ETL_FILTER_CPU },
+                { "level", ETL_FILTER_LEVEL },
+                { "keywords", ETL_FILTER_KEYWORDS },
+                { "keyword", ETL_FILTER_KEYWORDS },
+                { "opcode", ETL_FILTER_OPCODE },
+                { "task", ETL_FILTER_TASK },
+                { "id", ETL_FILTER_EVENT_ID },
+                { "version", ETL_FILTER_VERSION },
+            };
+            for (const auto& entry : FIELDS) {
+                if (EqualsIgnoreCase(entry.m_name, name))
+                    return entry.m_field;
+            }
+            return ETL_FILTER_FIELD_COUNT;
+        }
+
+        static bool IsSpace(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; }
+        static bool IsDigit(char c) { return c >= '0' && c <= '9'; }
+        static bool IsNameStart(char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_'; }
+        static bool IsNameChar(char c) { return IsNameStart(c) || IsDigit(c) || c == '.'; }
+        static bool IsHex(std::string_view digits) { return digits.size() >= 2 && digits[0] == '0' && (digits[1] | 0x20) == 'x'; }
+    };
+
+    static NumberTest MakeNumberTest(Compare compare, const Literal& literal)
+    {
+        NumberTest test = {};
+        test.m_invert = compare == Compare::NotEqual;
+        if (compare == Compare::NotEqual)
+            compare = Compare::Equal;
+
+        constexpr double INF = std::numeric_limits<double>::infinity();
+        double value = literal.m_double;
+        test.m_doubleLow = compare == Compare::Greater ? std::nextafter(value, INF) : compare == Compare::Less || compare == Compare::LessEqual ? -INF : value;
+        test.m_doubleHigh = compare == Compare::Less ? std::nextafter(value, -INF) : compare == Compare::Greater || compare == Compare::GreaterEqual ? INF : value;
+
+        // Integer bounds; an empty range stays empty after clamping.
+        Wide low = { INT64_MIN, 0 };
+        Wide high = { INT64_MAX, UINT64_MAX };
+        bool empty = false;
+        switch (compare) {
+        case Compare::Equal:
+            low = literal.m_ceil;
+            high = literal.m_floor;
+            empty = high < low; // A fractional literal equals no integer.
+            break;
+        case Compare::Less: high = literal.m_ceil.Minus1(); break;
+        case Compare::LessEqual: high = literal.m_floor; break;
+        case Compare::Greater: low = literal.m_floor.Plus1(); break;
+        case Compare::GreaterEqual: low = literal.m_ceil; break;
+        default: break;
+        }
+        ClampRange(low, high, empty, Wide::FromUnsigned(0), Wide::FromUnsigned(UINT64_MAX), test.m_unsignedLow, test.m_unsignedSpan, test.m_unsignedEmpty);
+        ClampRange(low, high, empty, Wide::FromNegative(1ull << 63), Wide::FromUnsigned(INT64_MAX), test.m_signedLow, test.m_signedSpan, test.m_signedEmpty);
+        return test;
+    }
+
+    static void ClampRange(Wide low, Wide high, bool empty, Wide domainLow, Wide domainHigh, uint64_t& rangeLow, uint64_t& rangeSpan, bool& rangeEmpty)
+    {
+        if (low < domainLow)
+            low = domainLow;
+        if (domainHigh < high)
+            high = domainHigh;
+        rangeEmpty = empty || high < low;
+        rangeLow = low.m_low;
+        rangeSpan = high.m_low - low.m_low;
+    }
+
+    static TextTest MakeTextTest(Compare compare, const std::string& text)
+    {
+        TextTest test = { compare, {}, {} };
+        for (char c : text)
+            test.m_utf8 += LowerAscii(c);
+        // UTF-8 to UTF-16; invalid sequences are kept byte by byte.
+        for (size_t i = 0; i < text.size();) {
+            uint8_t lead = static_cast<uint8_t>(text[i]);
+            size_t length = lead < 0x80 ? 1 : (lead >> 5) == 0x6 ? 2 : (lead >> 4) == 0xE ? 3 : (lead >> 3) == 0x1E ? 4 : 0;
+            bool valid = length != 0 && i + length <= text.size();
+            for (size_t j = 1; valid && j < length; j++)
+                valid = (static_cast<uint8_t>(text[i + j]) & 0xC0) == 0x80;
+            if (!valid) {
+                test.m_utf16 += static_cast<char16_t>(lead);
+                i++;
+                continue;
+            }
+            uint32_t codePoint = length == 1 ? lead : lead & (0x7F >> length);
+            for (size_t j = 1; j < length; j++)
+                codePoint = (codePoint << 6) | (static_cast<uint8_t>(text[i + j]) & 0x3F);
+            if (codePoint >= 0x10000) {
+                codePoint -= 0x10000;
+                test.m_utf16 += static_cast<char16_t>(0xD800 + (codePoint >> 10));
+                test.m_utf16 += static_cast<char16_t>(0xDC00 + (codePoint & 0x3FF));
+            }
+            else {
+                test.m_utf16 += static_cast<char16_t>(LowerAscii(static_cast<char16_t>(codePoint)));
+            }
+            i += length;
+        }
+        return test;
+    }
+
+    static uint8_t TestNumber(const EtlValue& value, const NumberTest& test)
+    {
+        bool inRange;
+        switch (value.m_kind) {
+        case EtlValueKind::Int:
+            inRange = !test.m_signedEmpty && static_cast<uint64_t>(value.m_int) - test.m_signedLow <= test.m_signedSpan;
+            break;
+        case EtlValueKind::UInt:
+        case EtlValueKind::Bool:
+        case EtlValueKind::FileTime:
+            inRange = !test.m_unsignedEmpty && value.m_uint - test.m_unsignedLow <= test.m_unsignedSpan;
+            break;
+        case EtlValueKind::Double:
+            inRange = value.m_double >= test.m_doubleLow && value.m_double <= test.m_doubleHigh;
+            break;
+        case EtlValueKind::AnsiString:
+        case EtlValueKind::UnicodeString: {
+            // Numbers formatted as text by TDH, or string properties holding numbers.
+            double number;
+            if (!ParseNumber(value, &number))
+                return NO_MATCH;
+            inRange = number >= test.m_doubleLow && number <= test.m_doubleHigh;
+            break;
+        }
+        default:
+            return NO_MATCH;
+        }
+        return inRange != test.m_invert ? MATCH : NO_MATCH;
+    }
+
+    static uint8_t TestBits(const EtlValue& value, uint64_t mask)
+    {
+        if (value.m_kind == EtlValueKind::Int || value.m_kind == EtlValueKind::UInt || value.m_kind == EtlValueKind::Bool)
+            return (value.m_uint & mask) != 0 ? MATCH : NO_MATCH;
+        double number;
+        if ((value.m_kind == EtlValueKind::AnsiString || value.m_kind == EtlValueKind::UnicodeString) && ParseNumber(value, &number) && number >= 0.0 && number < 18446744073709551616.0)
+            return (static_cast<uint64_t>(number) & mask) != 0 ? MATCH : NO_MATCH;
+        return NO_MATCH;
+    }
+
+    static uint8_t TestText(const EtlValue& value, const TextTest& test)
+    {
+        bool found;
+        if (value.m_kind == EtlValueKind::AnsiString)
+            found = Match(reinterpret_cast<const char*>(value.m_pData), value.m_size, test.m_utf8, test.m_compare == Compare::Contains);
+        else if (value.m_kind == EtlValueKind::UnicodeString)
+            found = Match(reinterpret_cast<const Utf16Unit*>(value.m_pData), value.m_size / 2, test.m_utf16, test.m_compare == Compare::Contains);
+        else
+            return NO_MATCH;
+        return found != (test.m_compare == Compare::NotEqual) ? MATCH : NO_MATCH;
+    }
+
+    // A UTF-16 code unit read from a payload, which may be unaligned.
+    struct Utf16Unit {
+        uint8_t m_bytes[2];
+    };
+
+    static char LowerAscii(char c) { return c >= 'A' && c <= 'Z' ? static_cast<char>(c + ('a' - 'A')) : c; }
+    static char16_t LowerAscii(char16_t c) { return c >= u'A' && c <= u'Z' ? static_cast<char16_t>(c + (u'a' - u'A')) : c; }
+    static char16_t LowerAscii(Utf16Unit unit) { return LowerAscii(static_cast<char16_t>(unit.m_bytes[0] | (unit.m_bytes[1] << 8))); }
+
+    static bool EqualsIgnoreCase(std::string_view lhs, std::string_view rhs)
+    {
+        return lhs.size() == rhs.size() && std::equal(lhs.begin(), lhs.end(), rhs.begin(), [](char a, char b) { return LowerAscii(a) == LowerAscii(b); });
+    }
+
+    // Haystack against a needle already in lower case. Strings are compared without their terminators.
+    template<typename Unit, typename Char>
+    static bool Match(const Unit* pText, size_t length, const std::basic_string<Char>& needle, bool contains)
+    {
+        while (length > 0 && LowerAscii(pText[length - 1]) == 0)
+            length--;
+        if (!contains && length != needle.size())
+            return false;
+        if (length < needle.size())
+            return false;
+        for (size_t start = 0; start + needle.size() <= length; start++) {
+            size_t i = 0;
+            while (i < needle.size() && LowerAscii(pText[start + i]) == needle[i])
+                i++;
+            if (i == needle.size())
+                return true;
+        }
+        return false;
+    }
+
+    static bool ParseNumber(const EtlValue& value, double* pNumber)
+    {
+        char text[64];
+        size_t length = 0;
+        for (uint32_t i = 0; i < value.m_size; i += value.m_kind == EtlValueKind::UnicodeString ? 2 : 1) {
+            uint16_t c = value.m_kind == EtlValueKind::UnicodeString ? static_cast<uint16_t>(value.m_pData[i] | (value.m_pData[i + 1] << 8)) : value.m_pData[i];
+            if (c == 0)
+                break;
+            if (c >= 0x80 || length == sizeof(text) - 1)
+                return false;
+            text[length++] = static_cast<char>(c);
+        }
+        text[length] = '\0';
+        const char* pStart = text;
+        while (*pStart == ' ')
+            pStart++;
+        char* pEnd = nullptr;
+        bool hex = pStart[0] == '0' && (pStart[1] | 0x20) == 'x';
+        *pNumber = hex ? static_cast<double>(std::strtoull(pStart, &pEnd, 16)) : std::strtod(pStart, &pEnd);
+        while (pEnd != nullptr && *pEnd == ' ')
+            pEnd++;
+        return pEnd != pStart && pEnd != nullptr && *pEnd == '\0';
+    }
+
+    std::string m_text;
+    std::vector<Instruction> m_code;
+    std::vector<NumberTest> m_numberTests;
+    std::vector<TextTest> m_textTests;
+    uint32_t m_depth = 0;
+    bool m_needsProperties = false;
+    int64_t m_timeBegin = INT64_MIN;
+    int64_t m_timeEnd = INT64_MAX;
+};
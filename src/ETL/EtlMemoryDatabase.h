@@ -0,0 +1,655 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <ETL/EtlColumnTable.h>
+#include <ETL/EtlTraceDatabase.h>
+#include <ETL/EventIdentifier.h>
+#include <utils/QueryScheduler.h>
+#include <utils/SqliteDatabase.h>
+#include <utils/TableSortIndex.h>
+
+// Output of the last statement run by EtlMemoryDatabase::Execute that returned columns, as text.
+struct EtlSqlResult {
+    std::vector<std::string> m_columns;
+    std::vector<std::string> m_cells; // Row-major, m_columns.size() cells per row.
+    size_t m_rowCount = 0;
+    bool m_truncated = false; // The statement returned more rows than were kept.
+    std::string m_error;
+    double m_milliseconds = 0.0;
+    uint64_t m_rowsScanned = 0; // Rows the virtual table scans selected, before SQLite checked the constraints.
+};
+
+/*
+In-memory SQLite database for ad-hoc queries over a loaded trace. Every event type is an
+events_<type id> virtual table (module etl_events) reading the decoded EtlColumnTable of the type
+in place, so no rows are copied into SQLite; event_types and event_columns have the layout of
+EtlTraceDatabase, so the same queries run against both.
+
+The column table of a type is loaded the first time a statement reads it, or handed over with
+Publish once the UI has decoded it, and kept in an LRU cache of CACHE_BYTES. Its size counts the
+row indexes built for a table and the strings, as every table owns the dictionaries of its text
+columns, so evicting a table frees all of them. xBestIndex pushes
+down one indexed column per scan: timestamp bounds are binary searched, as rows are stored in
+timestamp order, and equality or bounds on a property use a sorted row index of the column built
+on its first use (numbers by value, text by dictionary id, so text only supports equality). Rows are
+always produced in timestamp order, which makes ORDER BY timestamp free. SQLite still checks
+every constraint, so pushdown only has to narrow the rows to a superset of the matches.
+
+Publish may be called from any thread; everything else from the thread running the queries.
+*/
+class EtlMemoryDatabase
+{
+public:
+    // Decodes every instance of a type; returns null if the token was cancelled.
+    using Loader = std::function<std::shared_ptr<const EtlColumnTable>(const EventIdentifier&, const QueryCancelToken&)>;
+
+    static constexpr const char* MODULE_NAME = "etl_events";
+    static constexpr size_t CACHE_BYTES = size_t(1) << 30;
+    static constexpr int PROGRESS_STEPS = 10000; // Virtual machine steps between cancellation checks.
+
+    explicit EtlMemoryDatabase(Loader loader) : m_loader(std::move(loader))
+    {
+        m_database = SqliteDatabase(":memory:", false);
+        if (sqlite3_create_module_v2(m_database.Get(), MODULE_NAME, &Module(), this, nullptr) != SQLITE_OK)
+            throw std::runtime_error(std::string("Failed to register module: ") + sqlite3_errmsg(m_database.Get()));
+        m_database.Execute(EtlTraceDatabase::TYPE_TABLES_SQL);
+        m_insertType = m_database.Prepare(EtlTraceDatabase::INSERT_TYPE_SQL);
+        m_insertColumn = m_database.Prepare(EtlTraceDatabase::INSERT_COLUMN_SQL);
+    }
+
+    EtlMemoryDatabase(const EtlMemoryDatabase&) = delete;
+    EtlMemoryDatabase& operator=(const EtlMemoryDatabase&) = delete;
+
+    // Describes a type and creates its virtual table. rowCount is the number of occurrences, used for query planning.
+    void AddEventType(uint32_t typeId, std::shared_ptr<const EtlDatabaseEventType> pType, uint64_t rowCount)
+    {
+        EtlTraceDatabase::InsertTypeRows(m_insertType, m_insertColumn, typeId, *pType, rowCount);
+        TypeInfo& info = m_types[typeId];
+        std::vector<std::string> names;
+        for (const auto& property : pType->m_properties)
+            names.push_back(property.first);
+        info.m_columnNames = SqliteDatabase::UniqueColumnNames(names, { "timestamp" });
+        info.m_rowCount = rowCount;
+        m_typeIds[pType->m_id] = typeId;
+        info.m_pType = std::move(pType);
+        m_database.Execute("CREATE VIRTUAL TABLE " + EtlTraceDatabase::TableName(typeId) + " USING " + MODULE_NAME + "(" + std::to_string(typeId) + ")");
+    }
+
+    // Hands over the complete column table of a type decoded elsewhere, so queries do not decode it again.
+    void Publish(const EventIdentifier& id, std::shared_ptr<const EtlColumnTable> pTable)
+    {
+        auto it = m_typeIds.find(id);
+        if (it == m_typeIds.end() || !pTable)
+            return;
+        std::lock_guard lock(m_cacheLock);
+        auto& pEntry = m_cache[it->second];
+        if (pEntry && pEntry->m_pTable == pTable)
+            return;
+        pEntry = std::make_shared<CachedTable>(std::move(pTable));
+        pEntry->m_lastUse = ++m_useCounter;
+        TrimCache();
+    }
+
+    /*
+    Runs every statement of sql and keeps the rows of the last one that returns columns, at most
+    maxRows of them. Errors, including cancellation through the token, end up in m_error.
+    */
+    EtlSqlResult Execute(const std::string& sql, const QueryCancelToken& token, size_t maxRows)
+    {
+        auto start = std::chrono::steady_clock::now();
+        uint64_t rowsScanned = m_rowsScanned;
+        EtlSqlResult result;
+        m_pToken = &token;
+        sqlite3_progress_handler(m_database.Get(), PROGRESS_STEPS, &Progress, this);
+        try {
+            std::string_view remaining = sql;
+            while (!remaining.empty()) {
+                size_t used = 0;
+                SqliteStatement statement(m_database.Get(), remaining, &used);
+                remaining.remove_prefix(used);
+                if (statement.Get() == nullptr)
+                    continue; // Whitespace or a comment.
+                if (statement.ColumnCount() > 0) {
+                    result = EtlSqlResult{};
+                    for (int column = 0; column < statement.ColumnCount(); column++)
+                        result.m_columns.push_back(statement.GetColumnName(column));
+                }
+                while (statement.Step()) {
+                    if (result.m_rowCount == maxRows) {
+                        result.m_truncated = true;
+                        statement.Reset();
+                        break;
+                    }
+                    for (int column = 0; column < statement.ColumnCount(); column++)
+                        result.m_cells.push_back(FormatValue(statement, column));
+                    result.m_rowCount++;
+                }
+            }
+        }
+        catch (const std::exception& e) {
+            result.m_error = token.IsCancelled() ? "Cancelled" : e.what();
+        }
+        sqlite3_progress_handler(m_database.Get(), 0, nullptr, nullptr);
+        m_pToken = nullptr;
+        result.m_milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        result.m_rowsScanned = m_rowsScanned - rowsScanned;
+        return result;
+    }
+
+private:
+    struct TypeInfo {
+        std::shared_ptr<const EtlDatabaseEventType> m_pType;
+        std::vector<std::string> m_columnNames; // Unique property column names.
+        uint64_t m_rowCount = 0;
+    };
+
+    // Rows of a column that have a value, ordered by key (see IndexKey), ties in row order.
+    struct ColumnIndex {
+        std::vector<uint64_t> m_keys;
+        std::vector<uint32_t> m_rows;
+    };
+
+    struct CachedTable {
+        explicit CachedTable(std::shared_ptr<const EtlColumnTable> pTable)
+            : m_pTable(std::move(pTable)), m_indexes(m_pTable->ColumnCount()), m_byteSize(m_pTable->ByteSize()) {
+
+        }
+
+        std::shared_ptr<const EtlColumnTable> m_pTable;
+        std::vector<std::unique_ptr<ColumnIndex>> m_indexes; // Per property column; query thread only.
+        size_t m_byteSize;                                   // Guarded by m_cacheLock.
+        uint64_t m_lastUse = 0;                              // Guarded by m_cacheLock.
+    };
+
+    struct VirtualTable : sqlite3_vtab {
+        EtlMemoryDatabase* m_pOwner;
+        uint32_t m_typeId;
+    };
+
+    struct Cursor : sqlite3_vtab_cursor {
+        std::shared_ptr<CachedTable> m_pEntry;
+        std::vector<uint32_t> m_rows; // Rows to visit in ascending order, unless m_range is set.
+        bool m_range = true;          // Visit [m_position, m_end) instead.
+        size_t m_position = 0;
+        size_t m_end = 0;
+
+        size_t Row() const { return m_range ? m_position : m_rows[m_position]; }
+        bool Eof() const { return m_position >= (m_range ? m_end : m_rows.size()); }
+    };
+
+    // idxNum of a plan: the column constrained (0 for the timestamp, n for property n - 1) and which bounds are passed in argv.
+    static constexpr int PLAN_LOWER = 1;
+    static constexpr int PLAN_UPPER = 2;
+    static constexpr int PLAN_EQUAL = 4; // One argument that is both bounds.
+    static constexpr int PLAN_COLUMN_SHIFT = 3;
+
+    static const sqlite3_module& Module()
+    {
+        static const sqlite3_module module = []() {
+            sqlite3_module m = {};
+            m.iVersion = 1;
+            m.xCreate = &Connect;
+            m.xConnect = &Connect;
+            m.xBestIndex = &BestIndex;
+            m.xDisconnect = &Disconnect;
+            m.xDestroy = &Disconnect;
+            m.xOpen = &Open;
+            m.xClose = &Close;
+            m.xFilter = &Filter;
+            m.xNext = &Next;
+            m.xEof = &Eof;
+            m.xColumn = &Column;
+            m.xRowid = &Rowid;
+            return m;
+        }();
+        return module;
+    }
+
+    static int Progress(void* pContext)
+    {
+        const QueryCancelToken* pToken = static_cast<EtlMemoryDatabase*>(pContext)->m_pToken;
+        return pToken != nullptr && pToken->IsCancelled() ? 1 : 0;
+    }
+
+    // argv[3] is the type id given to CREATE VIRTUAL TABLE.
+    static int Connect(sqlite3* pDatabase, void* pAux, int argc, const char* const* argv, sqlite3_vtab** ppTable, char** pError)
+    {
+        auto* pOwner = static_cast<EtlMemoryDatabase*>(pAux);
+        uint32_t typeId = argc > 3 ? static_cast<uint32_t>(std::strtoul(argv[3], nullptr, 10)) : 0;
+        auto it = pOwner->m_types.find(typeId);
+        if (it == pOwner->m_types.end()) {
+            *pError = sqlite3_mprintf("unknown event type %s", argc > 3 ? argv[3] : "");
+            return SQLITE_ERROR;
+        }
+
+        std::string declaration = "CREATE TABLE x(timestamp INTEGER";
+        for (const auto& name : it->second.m_columnNames)
+            declaration += ", " + SqliteDatabase::QuoteIdentifier(name);
+        declaration += ")";
+        int result = sqlite3_declare_vtab(pDatabase, declaration.c_str());
+        if (result != SQLITE_OK)
+            return result;
+
+        auto* pTable = new VirtualTable{};
+        pTable->m_pOwner = pOwner;
+        pTable->m_typeId = typeId;
+        *ppTable = pTable;
+        return SQLITE_OK;
+    }
+
+    static int Disconnect(sqlite3_vtab* pTable)
+    {
+        delete static_cast<VirtualTable*>(pTable);
+        return SQLITE_OK;
+    }
+
+    /*
+    Picks the timestamp if it is constrained, otherwise the first property with an equality, then
+    the first with a bound. At most one lower and one upper bound of that column are passed on.
+    */
+    static int BestIndex(sqlite3_vtab* pVirtualTable, sqlite3_index_info* pInfo)
+    {
+        auto* pTable = static_cast<VirtualTable*>(pVirtualTable);
+        double rowCount = static_cast<double>((std::max)(uint64_t(1), pTable->m_pOwner->m_types[pTable->m_typeId].m_rowCount));
+
+        auto isBound = [](unsigned char op) {
+            return op == SQLITE_INDEX_CONSTRAINT_EQ || op == SQLITE_INDEX_CONSTRAINT_GT || op == SQLITE_INDEX_CONSTRAINT_GE ||
+                op == SQLITE_INDEX_CONSTRAINT_LT || op == SQLITE_INDEX_CONSTRAINT_LE;
+        };
+        int column = -1;
+        for (int pass = 0; pass < 3 && column < 0; pass++) {
+            for (int i = 0; i < pInfo->nConstraint && column < 0; i++) {
+                const auto& constraint = pInfo->aConstraint[i];
+                if (!constraint.usable || constraint.iColumn < 0 || !isBound(constraint.op))
+                    continue;
+                if ((pass == 0 && constraint.iColumn == 0) || (pass == 1 && constraint.op == SQLITE_INDEX_CONSTRAINT_EQ) || pass == 2)
+                    column = constraint.iColumn;
+            }
+        }
+
+        int lower = -1;
+        int upper = -1;
+        int equal = -1;
+        for (int i = 0; i < pInfo->nConstraint && column >= 0; i++) {
+            const auto& constraint = pInfo->aConstraint[i];
+            if (!constraint.usable || constraint.iColumn != column)
+                continue;
+            if (constraint.op == SQLITE_INDEX_CONSTRAINT_EQ && equal < 0)
+                equal = i;
+            else if ((constraint.op == SQLITE_INDEX_CONSTRAINT_GT || constraint.op == SQLITE_INDEX_CONSTRAINT_GE) && lower < 0)
+                lower = i;
+            else if ((constraint.op == SQLITE_INDEX_CONSTRAINT_LT || constraint.op == SQLITE_INDEX_CONSTRAINT_LE) && upper < 0)
+                upper = i;
+        }
+
+        int plan = 0;
+        double rows = rowCount;
+        if (equal >= 0) {
+            plan = PLAN_EQUAL;
+            pInfo->aConstraintUsage[equal].argvIndex = 1;
+            rows = column == 0 ? 1.0 : (std::max)(1.0, rowCount / 100.0);
+        }
+        else if (column >= 0) {
+            int argvIndex = 1;
+            if (lower >= 0) {
+                plan |= PLAN_LOWER;
+                pInfo->aConstraintUsage[lower].argvIndex = argvIndex++;
+                rows /= 2.0;
+            }
+            if (upper >= 0) {
+                plan |= PLAN_UPPER;
+                pInfo->aConstraintUsage[upper].argvIndex = argvIndex++;
+                rows /= 2.0;
+            }
+        }
+        if (plan != 0)
+            pInfo->idxNum = plan | (column << PLAN_COLUMN_SHIFT);
+        pInfo->estimatedRows = static_cast<sqlite3_int64>(rows);
+        pInfo->estimatedCost = plan != 0 ? rows + std::log2(rowCount) : rows;
+
+        // Every plan visits rows in timestamp order.
+        if (pInfo->nOrderBy == 1 && (pInfo->aOrderBy[0].iColumn == 0 || pInfo->aOrderBy[0].iColumn == -1) && !pInfo->aOrderBy[0].desc)
+            pInfo->orderByConsumed = 1;
+        return SQLITE_OK;
+    }
+
+    static int Open(sqlite3_vtab*, sqlite3_vtab_cursor** ppCursor)
+    {
+        *ppCursor = new Cursor();
+        return SQLITE_OK;
+    }
+
+    static int Close(sqlite3_vtab_cursor* pCursor)
+    {
+        delete static_cast<Cursor*>(pCursor);
+        return SQLITE_OK;
+    }
+
+    static int Filter(sqlite3_vtab_cursor* pBaseCursor, int idxNum, const char*, int argc, sqlite3_value** argv)
+    {
+        auto* pCursor = static_cast<Cursor*>(pBaseCursor);
+        auto* pTable = static_cast<VirtualTable*>(pBaseCursor->pVtab);
+        try {
+            pCursor->m_pEntry = pTable->m_pOwner->GetTable(pTable->m_typeId);
+            if (!pCursor->m_pEntry)
+                return SQLITE_INTERRUPT;
+            pTable->m_pOwner->Select(*pCursor, idxNum, argc, argv);
+            pTable->m_pOwner->m_rowsScanned += pCursor->m_range ? pCursor->m_end - pCursor->m_position : pCursor->m_rows.size();
+            return SQLITE_OK;
+        }
+        catch (const std::exception& e) {
+            sqlite3_free(pTable->zErrMsg);
+            pTable->zErrMsg = sqlite3_mprintf("%s", e.what());
+            return SQLITE_ERROR;
+        }
+    }
+
+    static int Next(sqlite3_vtab_cursor* pCursor)
+    {
+        static_cast<Cursor*>(pCursor)->m_position++;
+        return SQLITE_OK;
+    }
+
+    static int Eof(sqlite3_vtab_cursor* pCursor)
+    {
+        return static_cast<Cursor*>(pCursor)->Eof() ? 1 : 0;
+    }
+
+    // Unsigned values are returned as their int64 bit pattern, like EtlTraceDatabase stores them.
+    static int Column(sqlite3_vtab_cursor* pBaseCursor, sqlite3_context* pContext, int index)
+    {
+        auto* pCursor = static_cast<Cursor*>(pBaseCursor);
+        const EtlColumnTable& table = *pCursor->m_pEntry->m_pTable;
+        size_t row = pCursor->Row();
+        if (index == 0) {
+            sqlite3_result_int64(pContext, table.GetTimestamp(row));
+            return SQLITE_OK;
+        }
+        if (static_cast<size_t>(index) > table.ColumnCount() || !table.GetColumn(index - 1).IsValid(row))
+            return SQLITE_OK; // NULL.
+
+        const EtlColumn& column = table.GetColumn(index - 1);
+        switch (column.GetType()) {
+        case EtlColumnType::Int64:
+            sqlite3_result_int64(pContext, column.GetInt(row));
+            break;
+        case EtlColumnType::UInt64:
+            sqlite3_result_int64(pContext, static_cast<int64_t>(column.GetUInt(row)));
+            break;
+        case EtlColumnType::Double:
+            sqlite3_result_double(pContext, column.GetDouble(row));
+            break;
+        case EtlColumnType::String: {
+            // The table is complete, so its strings no longer move and SQLite can use them in place.
+            std::string_view text = column.GetString(row);
+            sqlite3_result_text(pContext, text.data(), static_cast<int>(text.size()), SQLITE_STATIC);
+            break;
+        }
+        }
+        return SQLITE_OK;
+    }
+
+    // The rowid is the occurrence ordinal of the event within its type.
+    static int Rowid(sqlite3_vtab_cursor* pCursor, sqlite3_int64* pRowid)
+    {
+        *pRowid = static_cast<sqlite3_int64>(static_cast<Cursor*>(pCursor)->Row());
+        return SQLITE_OK;
+    }
+
+    // Returns the cached table of a type, loading it first if needed; null if loading was cancelled.
+    std::shared_ptr<CachedTable> GetTable(uint32_t typeId)
+    {
+        {
+            std::lock_guard lock(m_cacheLock);
+            auto it = m_cache.find(typeId);
+            if (it != m_cache.end() && it->second) {
+                it->second->m_lastUse = ++m_useCounter;
+                return it->second;
+            }
+        }
+
+        std::shared_ptr<const EtlColumnTable> pTable = m_loader(m_types[typeId].m_pType->m_id, *m_pToken);
+        if (!pTable)
+            return nullptr;
+        auto pEntry = std::make_shared<CachedTable>(std::move(pTable));
+        std::lock_guard lock(m_cacheLock);
+        pEntry->m_lastUse = ++m_useCounter;
+        m_cache[typeId] = pEntry;
+        TrimCache();
+        return pEntry;
+    }
+
+    // Drops the least recently used tables beyond CACHE_BYTES, with their strings and indexes. Cursors keep the tables they read alive.
+    void TrimCache()
+    {
+        for (;;) {
+            size_t bytes = 0;
+            auto oldest = m_cache.end();
+            for (auto it = m_cache.begin(); it != m_cache.end(); ++it) {
+                bytes += it->second->m_byteSize;
+                if (oldest == m_cache.end() || it->second->m_lastUse < oldest->second->m_lastUse)
+                    oldest = it;
+            }
+            if (bytes <= CACHE_BYTES || m_cache.size() <= 1)
+                return;
+            m_cache.erase(oldest);
+        }
+    }
+
+    // Sets the rows a cursor visits for a plan chosen by BestIndex.
+    void Select(Cursor& cursor, int idxNum, int argc, sqlite3_value** argv)
+    {
+        const EtlColumnTable& table = *cursor.m_pEntry->m_pTable;
+        cursor.m_position = 0;
+        cursor.m_end = table.RowCount();
+        cursor.m_range = true;
+        cursor.m_rows.clear();
+
+        size_t column = static_cast<size_t>(idxNum >> PLAN_COLUMN_SHIFT);
+        sqlite3_value* pLower = nullptr;
+        sqlite3_value* pUpper = nullptr;
+        if ((idxNum & PLAN_EQUAL) && argc > 0) {
+            pLower = argv[0];
+            pUpper = argv[0];
+        }
+        else {
+            int arg = 0;
+            if ((idxNum & PLAN_LOWER) && arg < argc)
+                pLower = argv[arg++];
+            if ((idxNum & PLAN_UPPER) && arg < argc)
+                pUpper = argv[arg++];
+        }
+        if (pLower == nullptr && pUpper == nullptr)
+            return;
+        if ((pLower != nullptr && sqlite3_value_type(pLower) == SQLITE_NULL) || (pUpper != nullptr && sqlite3_value_type(pUpper) == SQLITE_NULL)) {
+            cursor.m_end = 0; // Comparisons with NULL never hold.
+            return;
+        }
+
+        if (column == 0) {
+            const std::vector<int64_t>& timestamps = table.GetTimestamps();
+            int64_t lower = INT64_MIN;
+            int64_t upper = INT64_MAX;
+            if (pLower != nullptr && !IntegerBound(pLower, false, &lower))
+                return;
+            if (pUpper != nullptr && !IntegerBound(pUpper, true, &upper))
+                return;
+            cursor.m_position = std::lower_bound(timestamps.begin(), timestamps.end(), lower) - timestamps.begin();
+            cursor.m_end = (std::max)(cursor.m_position, static_cast<size_t>(std::upper_bound(timestamps.begin(), timestamps.end(), upper) - timestamps.begin()));
+            return;
+        }
+        if (column > table.ColumnCount())
+            return;
+
+        const EtlColumn& property = table.GetColumn(column - 1);
+        uint64_t lower = 0;
+        uint64_t upper = UINT64_MAX;
+        if (property.GetType() == EtlColumnType::String) {
+            // Text is indexed by dictionary id, which only supports equality with a text value.
+            if (pLower != pUpper || sqlite3_value_type(pLower) != SQLITE_TEXT)
+                return;
+            StringDictionary::Id id;
+            std::string_view text(reinterpret_cast<const char*>(sqlite3_value_text(pLower)), sqlite3_value_bytes(pLower));
+            if (!property.GetDictionary().Find(text, &id)) {
+                cursor.m_end = 0;
+                return;
+            }
+            lower = id;
+            upper = id;
+        }
+        else {
+            if (pLower != nullptr && !NumberKeyBound(property.GetType(), pLower, false, &lower))
+                return;
+            if (pUpper != nullptr && !NumberKeyBound(property.GetType(), pUpper, true, &upper))
+                return;
+        }
+
+        const ColumnIndex& index = GetIndex(*cursor.m_pEntry, column - 1);
+        auto first = std::lower_bound(index.m_keys.begin(), index.m_keys.end(), lower);
+        auto last = std::upper_bound(first, index.m_keys.end(), upper);
+        cursor.m_rows.assign(index.m_rows.begin() + (first - index.m_keys.begin()), index.m_rows.begin() + (last - index.m_keys.begin()));
+        std::sort(cursor.m_rows.begin(), cursor.m_rows.end()); // Back to timestamp order.
+        cursor.m_range = false;
+    }
+
+    const ColumnIndex& GetIndex(CachedTable& entry, size_t column)
+    {
+        if (entry.m_indexes[column])
+            return *entry.m_indexes[column];
+
+        const EtlColumn& property = entry.m_pTable->GetColumn(column);
+        TableSortIndex sortIndex(1);
+        std::vector<uint64_t>& keys = sortIndex.GetKeys(0);
+        keys.resize(property.Size());
+        for (size_t row = 0; row < keys.size(); row++)
+            keys[row] = IndexKey(property, row);
+        sortIndex.AppendRows(keys.size());
+        sortIndex.Sort({ { 0, false } });
+
+        auto pIndex = std::make_unique<ColumnIndex>();
+        for (uint32_t row : sortIndex.GetOrder()) {
+            if (!property.IsValid(row))
+                continue;
+            pIndex->m_keys.push_back(keys[row]);
+            pIndex->m_rows.push_back(row);
+        }
+        pIndex->m_keys.shrink_to_fit();
+        pIndex->m_rows.shrink_to_fit();
+        {
+            std::lock_guard lock(m_cacheLock);
+            entry.m_byteSize += pIndex->m_keys.size() * (sizeof(uint64_t) + sizeof(uint32_t));
+            TrimCache();
+        }
+        entry.m_indexes[column] = std::move(pIndex);
+        return *entry.m_indexes[column];
+    }
+
+    // Integers (unsigned ones by their int64 bit pattern, as SQLite sees them) and doubles map to order-preserving keys; text to its dictionary id.
+    static uint64_t IndexKey(const EtlColumn& column, size_t row)
+    {
+        switch (column.GetType()) {
+        case EtlColumnType::Int64:
+        case EtlColumnType::UInt64:
+            return column.GetUInt(row) ^ (1ull << 63);
+        case EtlColumnType::Double:
+            return DoubleKey(column.GetDouble(row));
+        default:
+            return column.GetStringId(row);
+        }
+    }
+
+    static uint64_t DoubleKey(double value)
+    {
+        uint64_t bits = std::bit_cast<uint64_t>(value);
+        return (bits >> 63) ? ~bits : bits | (1ull << 63);
+    }
+
+    // Integer bound that keeps every integer matching a numeric value, rounding outwards. False for other values.
+    static bool IntegerBound(sqlite3_value* pValue, bool upper, int64_t* pBound)
+    {
+        int type = sqlite3_value_type(pValue);
+        if (type == SQLITE_INTEGER) {
+            *pBound = sqlite3_value_int64(pValue);
+            return true;
+        }
+        if (type != SQLITE_FLOAT)
+            return false;
+        double value = upper ? std::ceil(sqlite3_value_double(pValue)) : std::floor(sqlite3_value_double(pValue));
+        if (std::isnan(value))
+            return false;
+        if (value >= 9223372036854775807.0)
+            *pBound = INT64_MAX;
+        else if (value <= -9223372036854775808.0)
+            *pBound = INT64_MIN;
+        else
+            *pBound = static_cast<int64_t>(value);
+        return true;
+    }
+
+    // Index key bound of a numeric column for a value. Doubles are widened by one step, which also covers -0.0 and rounded integers.
+    static bool NumberKeyBound(EtlColumnType type, sqlite3_value* pValue, bool upper, uint64_t* pKey)
+    {
+        if (type != EtlColumnType::Double) {
+            int64_t bound;
+            if (!IntegerBound(pValue, upper, &bound))
+                return false;
+            *pKey = static_cast<uint64_t>(bound) ^ (1ull << 63);
+            return true;
+        }
+        int valueType = sqlite3_value_type(pValue);
+        if (valueType != SQLITE_INTEGER && valueType != SQLITE_FLOAT)
+            return false;
+        double value = sqlite3_value_double(pValue);
+        if (std::isnan(value))
+            return false;
+        *pKey = DoubleKey(std::nextafter(value, upper ? std::numeric_limits<double>::infinity() : -std::numeric_limits<double>::infinity()));
+        return true;
+    }
+
+    static std::string FormatValue(const SqliteStatement& statement, int column)
+    {
+        switch (statement.GetType(column)) {
+        case SQLITE_INTEGER:
+            return std::to_string(statement.GetInt64(column));
+        case SQLITE_FLOAT: {
+            char text[32]; // Shortest text that round trips.
+            size_t size = static_cast<size_t>(std::to_chars(text, text + sizeof(text), statement.GetDouble(column)).ptr - text);
+            return std::string(text, size);
+        }
+        case SQLITE_TEXT:
+            return std::string(statement.GetText(column));
+        case SQLITE_BLOB: {
+            std::string text = "<";
+            text += std::to_string(sqlite3_column_bytes(statement.Get(), column));
+            return text + " bytes>";
+        }
+        default:
+            return "NULL";
+        }
+    }
+
+    Loader m_loader;
+    std::unordered_map<uint32_t, TypeInfo> m_types; // Filled before queries run.
+    EventIdentifierMap<uint32_t> m_typeIds;
+    std::mutex m_cacheLock;
+    std::unordered_map<uint32_t, std::shared_ptr<CachedTable>> m_cache;
+    uint64_t m_useCounter = 0;
+    const QueryCancelToken* m_pToken = nullptr; // Token of the statement being run.
+    uint64_t m_rowsScanned = 0;
+    SqliteDatabase m_database; // Closed after its statements but before the state its virtual tables use.
+    SqliteStatement m_insertType;
+    SqliteStatement m_insertColumn;
+};
@@ -0,0 +1,271 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <span>
+#include <vector>
+#include <ETL/EtlParallelReader.h>
+#include <ETL/EventIdentifier.h>
+
+/*
+Delta-compressed list of event locations.
+Each entry is stored as three LEB128 varints: the zigzagged timestamp delta, the zigzagged buffer
+index delta and the buffer offset in 8 byte units (events are 8 byte aligned). Lists kept in
+timestamp order typically cost 3-5 bytes per event.
+A skip point every SKIP_INTERVAL entries allows starting a scan at any ordinal.
+A list can also be a read-only view of bytes and skip points stored elsewhere, such as a mapped
+sidecar index file.
+*/
+class EtlPostingList
+{
+public:
+    static constexpr size_t SKIP_INTERVAL = 128;
+
+    struct SkipPoint {
+        uint64_t m_byteOffset;
+        EtlEventLocation m_previous;
+    };
+
+    EtlPostingList() = default;
+
+    // View of a list written from GetBytes, GetSkipPoints, Size and GetLast; the storage must outlive it.
+    EtlPostingList(std::span<const uint8_t> bytes, std::span<const SkipPoint> skipPoints, size_t count, const EtlEventLocation& last)
+        : m_mappedBytes(bytes), m_mappedSkipPoints(skipPoints), m_count(count), m_last(last), m_mapped(true) {
+
+    }
+
+    // Not allowed on views.
+    void Append(const EtlEventLocation& location)
+    {
+        if (m_count % SKIP_INTERVAL == 0)
+            m_skipPoints.push_back({ m_bytes.size(), m_last });
+        WriteVarint(ZigZag(location.m_timestamp - m_last.m_timestamp));
+        WriteVarint(ZigZag(static_cast<int64_t>(location.m_bufferIndex) - static_cast<int64_t>(m_last.m_bufferIndex)));
+        WriteVarint(location.m_bufferOffset >> 3);
+        m_last = location;
+        m_count++;
+    }
+
+    size_t Size() const { return m_count; }
+    size_t ByteSize() const { return GetBytes().size(); }
+    bool Empty() const { return m_count == 0; }
+
+    std::span<const uint8_t> GetBytes() const { return m_mapped ? m_mappedBytes : std::span<const uint8_t>(m_bytes); }
+    std::span<const SkipPoint> GetSkipPoints() const { return m_mapped ? m_mappedSkipPoints : std::span<const SkipPoint>(m_skipPoints); }
+    const EtlEventLocation& GetLast() const { return m_last; }
+
+    void ShrinkToFit()
+    {
+        m_bytes.shrink_to_fit();
+        m_skipPoints.shrink_to_fit();
+    }
+
+    /*
+    Calls func(const EtlEventLocation&) for every entry in insertion order until it returns false.
+    */
+    template<typename Func>
+    void ForEach(Func&& func) const
+    {
+        ForEachFrom(0, func);
+    }
+
+    /*
+    Same as ForEach but starts at the entry with the given ordinal.
+    Returns the ordinal of the entry func returned false for, or Size() if it never did, so a
+    pager can resume at the entry it turned down. Decoding never reads past the bytes of the list:
+    a view of corrupted storage ends at the first entry that does not fit.
+    */
+    template<typename Func>
+    size_t ForEachFrom(size_t start, Func&& func) const
+    {
+        std::span<const uint8_t> bytes = GetBytes();
+        std::span<const SkipPoint> skipPoints = GetSkipPoints();
+        if (start >= m_count || start / SKIP_INTERVAL >= skipPoints.size() || skipPoints[start / SKIP_INTERVAL].m_byteOffset > bytes.size())
+            return m_count;
+
+        const SkipPoint& skip = skipPoints[start / SKIP_INTERVAL];
+        EtlEventLocation location = skip.m_previous;
+        const uint8_t* p = bytes.data() + skip.m_byteOffset;
+        const uint8_t* pEnd = bytes.data() + bytes.size();
+        for (size_t i = start - start % SKIP_INTERVAL; i < m_count; i++) {
+            uint64_t timestampDelta = 0;
+            uint64_t bufferIndexDelta = 0;
+            uint64_t bufferOffset = 0;
+            if (!ReadVarint(p, pEnd, timestampDelta) || !ReadVarint(p, pEnd, bufferIndexDelta) || !ReadVarint(p, pEnd, bufferOffset))
+                return m_count;
+            location.m_timestamp += UnZigZag(timestampDelta);
+            location.m_bufferIndex = static_cast<uint32_t>(static_cast<int64_t>(location.m_bufferIndex) + UnZigZag(bufferIndexDelta));
+            location.m_bufferOffset = static_cast<uint32_t>(bufferOffset << 3);
+            if (i < start)
+                continue;
+            if (!func(static_cast<const EtlEventLocation&>(location)))
+                return i;
+        }
+        return m_count;
+    }
+
+    /*
+    For lists in timestamp order: the ordinal to start a scan at so that it reaches every entry at or
+    after timestamp, found by a binary search of the skip points. Scans starting there read at most
+    SKIP_INTERVAL - 1 earlier entries.
+    */
+    size_t SeekTimestamp(int64_t timestamp) const
+    {
+        std::span<const SkipPoint> skipPoints = GetSkipPoints();
+        if (skipPoints.size() <= 1)
+            return 0;
+        // The first block has no previous entry, so the search starts at the second.
+        auto it = std::partition_point(skipPoints.begin() + 1, skipPoints.end(), [timestamp](const SkipPoint& skip) {
+            return skip.m_previous.m_timestamp < timestamp;
+        });
+        return static_cast<size_t>(it - skipPoints.begin() - 1) * SKIP_INTERVAL;
+    }
+
+    std::vector<EtlEventLocation> Decode() const
+    {
+        std::vector<EtlEventLocation> locations;
+        locations.reserve(m_count);
+        ForEach([&locations](const EtlEventLocation& location) {
+            locations.push_back(location);
+            return true;
+        });
+        return locations;
+    }
+
+private:
+    static uint64_t ZigZag(int64_t value) { return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63); }
+    static int64_t UnZigZag(uint64_t value) { return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1); }
+
+    void WriteVarint(uint64_t value)
+    {
+        while (value >= 0x80) {
+            m_bytes.push_back(static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        m_bytes.push_back(static_cast<uint8_t>(value));
+    }
+
+    // Returns false if the varint runs into pEnd or past 64 bits.
+    static bool ReadVarint(const uint8_t*& p, const uint8_t* pEnd, uint64_t& value)
+    {
+        value = 0;
+        for (unsigned shift = 0; shift < 64 && p != pEnd; shift += 7) {
+            uint8_t byte = *p++;
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0)
+                return true;
+        }
+        return false;
+    }
+
+    std::vector<uint8_t> m_bytes;
+    std::vector<SkipPoint> m_skipPoints;
+    std::span<const uint8_t> m_mappedBytes;
+    std::span<const SkipPoint> m_mappedSkipPoints;
+    size_t m_count = 0;
+    EtlEventLocation m_last = {};
+    bool m_mapped = false;
+};
+
+/*
+Per EventIdentifier posting lists of every event location in a trace, in timestamp order.
+Built during the metadata pass: each worker appends to its own EtlOccurrenceIndex::Partial (in the
+file order it visits buffers), then Build merges the partials per type into timestamp order.
+*/
+class EtlOccurrenceIndex
+{
+public:
+    class Partial
+    {
+    public:
+        void Add(const EventIdentifier& id, const EtlEventLocation& location)
+        {
+            m_lists[id].Append(location);
+        }
+
+    private:
+        friend class EtlOccurrenceIndex;
+        EventIdentifierMap<EtlPostingList> m_lists;
+    };
+
+    EtlOccurrenceIndex() = default;
+
+    /*
+    Merges the workers' partial lists. Types are finalized in parallel on the reader's workers;
+    only one type per worker is ever expanded to full EtlEventLocation entries at a time.
+    */
+    void Build(std::vector<Partial>& partials, const EtlParallelReader& reader)
+    {
+        std::vector<EventIdentifier> ids;
+        for (auto& partial : partials) {
+            for (auto& pair : partial.m_lists) {
+                if (!m_lists.contains(pair.first)) {
+                    m_lists.emplace(pair.first, EtlPostingList{});
+                    ids.push_back(pair.first);
+                }
+            }
+        }
+
+        reader.ParallelFor(ids.size(), [&](unsigned, size_t i) {
+            const EventIdentifier& id = ids[i];
+            std::vector<EtlEventLocation> locations;
+            for (auto& partial : partials) {
+                auto it = partial.m_lists.find(id);
+                if (it == partial.m_lists.end())
+                    continue;
+                it->second.ForEach([&locations](const EtlEventLocation& location) {
+                    locations.push_back(location);
+                    return true;
+                });
+                it->second = EtlPostingList{}; // Release the partial list as soon as it is consumed.
+            }
+            std::sort(locations.begin(), locations.end(), EtlLocationLess);
+
+            EtlPostingList& list = m_lists.find(id)->second;
+            for (const auto& location : locations)
+                list.Append(location);
+            list.ShrinkToFit();
+        });
+        partials.clear();
+    }
+
+    // Adds the list of a type that is not indexed yet, e.g. a view into a sidecar index.
+    void Add(const EventIdentifier& id, EtlPostingList list)
+    {
+        m_lists.emplace(id, std::move(list));
+    }
+
+    const EtlPostingList* Find(const EventIdentifier& id) const
+    {
+        auto it = m_lists.find(id);
+        return it == m_lists.end() ? nullptr : &it->second;
+    }
+
+    size_t GetTypeCount() const { return m_lists.size(); }
+
+    template<typename Func>
+    void ForEachList(Func&& func) const
+    {
+        for (const auto& pair : m_lists)
+            func(pair.first, pair.second);
+    }
+
+    size_t GetEventCount() const
+    {
+        size_t count = 0;
+        for (const auto& pair : m_lists)
+            count += pair.second.Size();
+        return count;
+    }
+
+    size_t GetByteSize() const
+    {
+        size_t bytes = 0;
+        for (const auto& pair : m_lists)
+            bytes += pair.second.ByteSize();
+        return bytes;
+    }
+
+private:
+    EventIdentifierMap<EtlPostingList> m_lists;
+};
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+#include <ETL/EtlFile.h>
+#include <utils/ThreadPool.h>
+
+// Position of an event in the file plus the key used to order it.
+struct EtlEventLocation {
+    int64_t m_timestamp;
+    uint32_t m_bufferIndex;
+    uint32_t m_bufferOffset;
+};
+
+// Total order used by the merge: timestamp, then file position so ties are deterministic.
+inline bool EtlLocationLess(const EtlEventLocation& lhs, const EtlEventLocation& rhs) {
+    if (lhs.m_timestamp != rhs.m_timestamp)
+        return lhs.m_timestamp < rhs.m_timestamp;
+    if (lhs.m_bufferIndex != rhs.m_bufferIndex)
+        return lhs.m_bufferIndex < rhs.m_bufferIndex;
+    return lhs.m_bufferOffset < rhs.m_bufferOffset;
+}
+
+/*
+K-way merge of runs that are each sorted by EtlLocationLess.
+Calls func(const EtlEventLocation&) in global order until it returns false.
+*/
+template<typename Func>
+void EtlMergeRuns(const std::vector<std::vector<EtlEventLocation>>& runs, Func&& func)
+{
+    struct Cursor {
+        const EtlEventLocation* m_pCurrent;
+        const EtlEventLocation* m_pEnd;
+    };
+    auto greater = [](const Cursor& a, const Cursor& b) {
+        return EtlLocationLess(*b.m_pCurrent, *a.m_pCurrent);
+    };
+
+    std::vector<Cursor> heap;
+    heap.reserve(runs.size());
+    for (const auto& run : runs) {
+        if (!run.empty())
+            heap.push_back({ run.data(), run.data() + run.size() });
+    }
+    std::make_heap(heap.begin(), heap.end(), greater);
+
+    while (!heap.empty()) {
+        std::pop_heap(heap.begin(), heap.end(), greater);
+        Cursor& cursor = heap.back();
+        if (!func(static_cast<const EtlEventLocation&>(*cursor.m_pCurrent)))
+            return;
+        if (++cursor.m_pCurrent == cursor.m_pEnd)
+            heap.pop_back();
+        else
+            std::push_heap(heap.begin(), heap.end(), greater);
+    }
+}
+
+/*
+Spreads the buffers of an EtlFile over the workers of a thread pool.
+Workers pull buffer indices from a shared counter, so every worker sees its buffers in
+increasing file order, and per-thread results can be combined deterministically afterwards.
+*/
+class EtlParallelReader
+{
+public:
+    explicit EtlParallelReader(const EtlFile& file, unsigned threadCount = 0, ThreadPool& pool = ThreadPool::Shared())
+        : m_file(file), m_threadCount(threadCount), m_pool(pool)
+    {
+        if (m_threadCount == 0 || m_threadCount > m_pool.SlotCount())
+            m_threadCount = m_pool.SlotCount();
+    }
+
+    unsigned GetThreadCount() const { return m_threadCount; }
+    const EtlFile& GetFile() const { return m_file; }
+
+    /*
+    Runs func(threadIndex, itemIndex) for every index in [0, count) across the workers.
+    threadIndex is below GetThreadCount() and is used by one worker at a time.
+    */
+    template<typename Func>
+    void ParallelFor(size_t count, Func&& func) const
+    {
+        m_pool.ParallelFor(count, func, m_threadCount);
+    }
+
+    /*
+    Runs func(threadIndex, const EtlEventView&) for every event, buffers spread across the workers.
+    */
+    template<typename Func>
+    void ForEachEvent(Func&& func) const
+    {
+        ParallelFor(m_file.GetBufferCount(), [&](unsigned threadIndex, size_t bufferIndex) {
+            m_file.ForEachEventInBuffer(bufferIndex, [&](const EtlEventView& view) {
+                func(threadIndex, view);
+                return true;
+            });
+        });
+    }
+
+    /*
+    Finds the events accepted by predicate(const EtlEventView&) and returns the first
+    limit of them in global timestamp order.
+    Each buffer produces a sorted run in parallel; the runs are then k-way merged.
+    */
+    template<typename Predicate>
+    std::vector<EtlEventLocation> CollectOrdered(Predicate&& predicate, size_t limit = SIZE_MAX) const
+    {
+        std::vector<uint32_t> buffers(m_file.GetBufferCount());
+        for (size_t i = 0; i < buffers.size(); i++)
+            buffers[i] = static_cast<uint32_t>(i);
+        return CollectOrdered(buffers, predicate, limit);
+    }
+
+    /*
+    Same as CollectOrdered, reading only the given buffers, e.g. those an EtlTimeIndex found for
+    a time range.
+    */
+    template<typename Predicate>
+    std::vector<EtlEventLocation> CollectOrdered(const std::vector<uint32_t>& buffers, Predicate&& predicate, size_t limit = SIZE_MAX) const
+    {
+        std::vector<std::vector<EtlEventLocation>> runs(buffers.size());
+        ParallelFor(runs.size(), [&](unsigned, size_t i) {
+            std::vector<EtlEventLocation>& run = runs[i];
+            m_file.ForEachEventInBuffer(buffers[i], [&](const EtlEventView& view) {
+                if (predicate(view))
+                    run.push_back({ view.m_timestamp, view.m_bufferIndex, view.m_bufferOffset });
+                return true;
+            });
+            // Events in a buffer are written in time order, but clock skew can leave a few out of place.
+            if (!std::is_sorted(run.begin(), run.end(), EtlLocationLess))
+                std::sort(run.begin(), run.end(), EtlLocationLess);
+        });
+
+        std::vector<EtlEventLocation> result;
+        EtlMergeRuns(runs, [&](const EtlEventLocation& location) {
+            if (result.size() >= limit)
+                return false;
+            result.push_back(location);
+            return true;
+        });
+        return result;
+    }
+
+    /*
+    Decodes a list of locations in parallel. The list is split into at most GetThreadCount()
+    contiguous chunks and func(chunkIndex, locationIndex, const EtlEventView&) is called for each
+    element. A chunk is decoded in list order by a single worker, so per-chunk outputs can simply
+    be concatenated. If func returns bool, returning false stops its chunk early.
+    Returns the first location index of every chunk plus a final end index.
+    */
+    template<typename Func>
+    std::vector<size_t> ForEachLocation(const std::vector<EtlEventLocation>& locations, Func&& func) const
+    {
+        size_t chunkCount = (std::max)(static_cast<size_t>(1), (std::min)(static_cast<size_t>(m_threadCount), locations.size()));
+        std::vector<size_t> bounds(chunkCount + 1);
+        for (size_t i = 0; i <= chunkCount; i++)
+            bounds[i] = locations.size() * i / chunkCount;
+
+        ParallelFor(chunkCount, [&](unsigned, size_t chunk) {
+            EtlEventView view;
+            for (size_t i = bounds[chunk]; i < bounds[chunk + 1]; i++) {
+                if (!m_file.ReadEventAt(locations[i].m_bufferIndex, locations[i].m_bufferOffset, &view))
+                    continue;
+                if constexpr (std::is_same_v<decltype(func(0u, i, static_cast<const EtlEventView&>(view))), bool>) {
+                    if (!func(static_cast<unsigned>(chunk), i, static_cast<const EtlEventView&>(view)))
+                        break;
+                }
+                else {
+                    func(static_cast<unsigned>(chunk), i, static_cast<const EtlEventView&>(view));
+                }
+            }
+        });
+        return bounds;
+    }
+
+private:
+    const EtlFile& m_file;
+    unsigned m_threadCount;
+    ThreadPool& m_pool;
+};
@@ -0,0 +1,362 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+#include <ETL/EtlFile.h>
+#include <ETL/EtlOccurrenceIndex.h>
+#include <ETL/EtlTimeIndex.h>
+#include <ETL/EtlTraceSource.h>
+#include <ETL/EventIdentifier.h>
+#include <utils/MappedFile.h>
+
+// Metadata texts stored per type, indices into EtlSidecarType::m_strings.
+enum EtlSidecarString : uint32_t {
+    ETL_SIDECAR_PROVIDER_NAME,
+    ETL_SIDECAR_LEVEL_NAME,
+    ETL_SIDECAR_CHANNEL_NAME,
+    ETL_SIDECAR_KEYWORDS_NAME,
+    ETL_SIDECAR_PROVIDER_MESSAGE,
+    ETL_SIDECAR_EVENT_MESSAGE,
+    ETL_SIDECAR_TASK_NAME,
+    ETL_SIDECAR_OPCODE_NAME,
+    ETL_SIDECAR_DECODING_SOURCE,
+    ETL_SIDECAR_STRING_COUNT,
+};
+
+// One event type in the sidecar: its metadata, event count and where its posting list lives.
+struct EtlSidecarType {
+    EventIdentifier m_id;
+    EtlGuid m_providerGuid;
+    uint32_t m_strings[ETL_SIDECAR_STRING_COUNT]; // String table indices.
+    uint32_t m_firstProperty;                      // Index of the first (name, type) pair in the property table.
+    uint32_t m_propertyCount;
+    uint32_t m_hasMetadata;                        // 0 for types whose metadata could not be collected.
+    uint64_t m_eventCount;
+    uint64_t m_postingOffset;                      // Into the posting byte section.
+    uint64_t m_postingByteSize;
+    uint64_t m_firstSkipPoint;                     // Into the skip point section.
+    uint64_t m_skipPointCount;
+    EtlEventLocation m_lastLocation;
+};
+
+// Property of a type, as string table indices.
+struct EtlSidecarProperty {
+    uint32_t m_name;
+    uint32_t m_type;
+};
+
+/*
+Versioned index file stored next to a trace (<trace>.etl.lensidx), so that reopening it skips the
+metadata pass. It holds the metadata table, per-type event counts, the occurrence posting lists
+and the buffer table, which is the time index of the file: buffer offsets and headers, and the
+range of event timestamps of every buffer.
+
+The file is a header followed by 8 byte aligned sections of fixed-layout records, and is used
+in place through a read-only mapping: posting lists become views of the mapped bytes and the
+buffer table is copied once, so opening costs the same however many events the trace has. Only
+the strings of the metadata are interned again. The header records the EtlTraceSource of the
+.etl; a sidecar that does not match it, or that is truncated or of another version, is ignored.
+Files are written to a temporary name and renamed, so a crash never leaves a half-written index.
+*/
+class EtlSidecarIndex
+{
+public:
+    static constexpr uint64_t MAGIC = 0x5844494e454c5445ull; // "ETLENIDX" in file order.
+    static constexpr uint32_t VERSION = 2;
+
+    // Collects the contents of a sidecar and writes it.
+    class Writer
+    {
+    public:
+        Writer()
+        {
+            AddString({}); // Index 0 is the empty string.
+        }
+
+        uint32_t AddString(std::string_view text)
+        {
+            auto it = m_stringIndices.find(std::string(text));
+            if (it != m_stringIndices.end())
+                return it->second;
+            uint32_t index = static_cast<uint32_t>(m_stringOffsets.size());
+            m_stringOffsets.push_back(m_stringBytes.size());
+            m_stringBytes.insert(m_stringBytes.end(), text.begin(), text.end());
+            m_stringIndices.emplace(std::string(text), index);
+            return index;
+        }
+
+        /*
+        Adds a type. strings are the texts of EtlSidecarString, properties (name, type) pairs;
+        a type without metadata only keeps its posting list.
+        */
+        void AddType(const EventIdentifier& id, const EtlGuid& providerGuid, const std::array<std::string_view, ETL_SIDECAR_STRING_COUNT>& strings,
+            const std::vector<std::pair<std::string_view, std::string_view>>& properties, bool hasMetadata, const EtlPostingList* pPostings)
+        {
+            EtlSidecarType type = {};
+            type.m_id = id;
+            type.m_providerGuid = providerGuid;
+            for (size_t i = 0; i < strings.size(); i++)
+                type.m_strings[i] = AddString(strings[i]);
+            type.m_firstProperty = static_cast<uint32_t>(m_properties.size());
+            type.m_propertyCount = static_cast<uint32_t>(properties.size());
+            type.m_hasMetadata = hasMetadata ? 1 : 0;
+            for (const auto& [name, propertyType] : properties)
+                m_properties.push_back({ AddString(name), AddString(propertyType) });
+            if (pPostings != nullptr) {
+                type.m_eventCount = pPostings->Size();
+                type.m_postingOffset = m_postingByteCount;
+                type.m_postingByteSize = pPostings->ByteSize();
+                type.m_firstSkipPoint = m_skipPointCount;
+                type.m_skipPointCount = pPostings->GetSkipPoints().size();
+                type.m_lastLocation = pPostings->GetLast();
+                m_postingByteCount += type.m_postingByteSize;
+                m_skipPointCount += type.m_skipPointCount;
+                m_pLists.push_back(pPostings);
+            }
+            m_types.push_back(type);
+        }
+
+        /*
+        Writes the sidecar for source with the buffer table of its file and the event time range of each
+        of its buffers, bufferRanges[i] being that of buffers[i]. The posting lists are copied straight
+        from the lists passed to AddType, which must still be alive. Returns false on I/O errors.
+        */
+        bool Write(const std::filesystem::path& path, const EtlTraceSource& source, std::span<const EtlBufferInfo> buffers,
+            std::span<const EtlTimeIndex::BufferRange> bufferRanges)
+        {
+            if (bufferRanges.size() != buffers.size())
+                return false;
+
+            std::vector<uint64_t> stringOffsets = m_stringOffsets;
+            stringOffsets.push_back(m_stringBytes.size());
+
+            Header header = {};
+            header.m_magic = MAGIC;
+            header.m_version = VERSION;
+            header.m_headerSize = sizeof(Header);
+            header.m_etlSize = source.m_size;
+            header.m_etlModifiedTime = source.m_modifiedTime;
+            header.m_etlHeaderHash = source.m_headerHash;
+
+            uint64_t offset = sizeof(Header);
+            auto place = [&offset](Section& section, uint64_t count, size_t recordSize) {
+                section = { offset, count };
+                offset = (offset + count * recordSize + 7) & ~7ull;
+            };
+            place(header.m_sections[SECTION_STRING_OFFSETS], stringOffsets.size(), sizeof(uint64_t));
+            place(header.m_sections[SECTION_STRING_BYTES], m_stringBytes.size(), 1);
+            place(header.m_sections[SECTION_TYPES], m_types.size(), sizeof(EtlSidecarType));
+            place(header.m_sections[SECTION_PROPERTIES], m_properties.size(), sizeof(EtlSidecarProperty));
+            place(header.m_sections[SECTION_SKIP_POINTS], m_skipPointCount, sizeof(EtlPostingList::SkipPoint));
+            place(header.m_sections[SECTION_POSTING_BYTES], m_postingByteCount, 1);
+            place(header.m_sections[SECTION_BUFFERS], buffers.size(), sizeof(EtlBufferInfo));
+            place(header.m_sections[SECTION_BUFFER_RANGES], bufferRanges.size(), sizeof(EtlTimeIndex::BufferRange));
+            header.m_fileSize = offset;
+
+            std::filesystem::path temporaryPath = path;
+            temporaryPath += ".tmp";
+            {
+                std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+                WriteSection(file, &header, sizeof(header));
+                WriteSection(file, stringOffsets.data(), stringOffsets.size() * sizeof(uint64_t));
+                WriteSection(file, m_stringBytes.data(), m_stringBytes.size());
+                WriteSection(file, m_types.data(), m_types.size() * sizeof(EtlSidecarType));
+                WriteSection(file, m_properties.data(), m_properties.size() * sizeof(EtlSidecarProperty));
+                for (const EtlPostingList* pList : m_pLists)
+                    file.write(reinterpret_cast<const char*>(pList->GetSkipPoints().data()), static_cast<std::streamsize>(pList->GetSkipPoints().size_bytes()));
+                WriteSection(file, nullptr, 0);
+                for (const EtlPostingList* pList : m_pLists)
+                    file.write(reinterpret_cast<const char*>(pList->GetBytes().data()), static_cast<std::streamsize>(pList->GetBytes().size()));
+                WriteSection(file, nullptr, m_postingByteCount);
+                WriteSection(file, buffers.data(), buffers.size() * sizeof(EtlBufferInfo));
+                WriteSection(file, bufferRanges.data(), bufferRanges.size() * sizeof(EtlTimeIndex::BufferRange));
+                if (!file.flush())
+                    return false;
+            }
+            std::error_code error;
+            std::filesystem::rename(temporaryPath, path, error);
+            if (error)
+                std::filesystem::remove(temporaryPath, error);
+            return !error;
+        }
+
+    private:
+        // Writes size bytes of pData, or only the padding after them if pData is null.
+        static void WriteSection(std::ofstream& file, const void* pData, size_t size)
+        {
+            static const char padding[8] = {};
+            if (pData != nullptr)
+                file.write(static_cast<const char*>(pData), static_cast<std::streamsize>(size));
+            file.write(padding, static_cast<std::streamsize>((8 - size % 8) % 8));
+        }
+
+        std::unordered_map<std::string, uint32_t> m_stringIndices;
+        std::vector<uint64_t> m_stringOffsets;
+        std::vector<char> m_stringBytes;
+        std::vector<EtlSidecarType> m_types;
+        std::vector<EtlSidecarProperty> m_properties;
+        std::vector<const EtlPostingList*> m_pLists;
+        uint64_t m_skipPointCount = 0;
+        uint64_t m_postingByteCount = 0;
+    };
+
+    /*
+    Maps the sidecar at path if it exists, matches source and is well formed; returns null otherwise.
+    Posting lists handed out by GetPostingList point into the mapping and must not outlive the index.
+    */
+    static std::unique_ptr<EtlSidecarIndex> Open(const std::filesystem::path& path, const EtlTraceSource& source)
+    {
+        std::error_code error;
+        if (!std::filesystem::exists(path, error))
+            return nullptr;
+        std::unique_ptr<EtlSidecarIndex> pIndex(new EtlSidecarIndex());
+        try {
+            pIndex->m_file = MappedFile(path);
+        }
+        catch (const std::exception&) {
+            return nullptr;
+        }
+        if (!pIndex->Validate(source))
+            return nullptr;
+        return pIndex;
+    }
+
+    size_t GetTypeCount() const { return m_types.size(); }
+    const EtlSidecarType& GetType(size_t index) const { return m_types[index]; }
+    std::span<const EtlBufferInfo> GetBuffers() const { return m_buffers; }
+    // Event time range of every buffer, in the order of GetBuffers.
+    std::span<const EtlTimeIndex::BufferRange> GetBufferRanges() const { return m_bufferRanges; }
+
+    std::string_view GetString(uint32_t index) const
+    {
+        if (index + 1 >= m_stringOffsets.size())
+            return {};
+        return std::string_view(m_stringBytes.data() + m_stringOffsets[index], m_stringOffsets[index + 1] - m_stringOffsets[index]);
+    }
+
+    std::span<const EtlSidecarProperty> GetProperties(const EtlSidecarType& type) const
+    {
+        return m_properties.subspan(type.m_firstProperty, type.m_propertyCount);
+    }
+
+    EtlPostingList GetPostingList(const EtlSidecarType& type) const
+    {
+        return EtlPostingList(m_postingBytes.subspan(type.m_postingOffset, type.m_postingByteSize),
+            m_skipPoints.subspan(type.m_firstSkipPoint, type.m_skipPointCount), type.m_eventCount, type.m_lastLocation);
+    }
+
+private:
+    enum SectionIndex : uint32_t {
+        SECTION_STRING_OFFSETS,
+        SECTION_STRING_BYTES,
+        SECTION_TYPES,
+        SECTION_PROPERTIES,
+        SECTION_SKIP_POINTS,
+        SECTION_POSTING_BYTES,
+        SECTION_BUFFERS,
+        SECTION_BUFFER_RANGES,
+        SECTION_COUNT,
+    };
+
+    struct Section {
+        uint64_t m_offset;
+        uint64_t m_count;
+    };
+
+    struct Header {
+        uint64_t m_magic;
+        uint32_t m_version;
+        uint32_t m_headerSize;
+        uint64_t m_fileSize;
+        uint64_t m_etlSize;
+        int64_t m_etlModifiedTime;
+        uint64_t m_etlHeaderHash;
+        Section m_sections[SECTION_COUNT];
+    };
+
+    static_assert(std::is_trivially_copyable_v<EtlSidecarType> && std::is_trivially_copyable_v<EtlBufferInfo> &&
+        std::is_trivially_copyable_v<EtlPostingList::SkipPoint> && std::is_trivially_copyable_v<EtlTimeIndex::BufferRange>, "Sidecar records are used in place");
+
+    EtlSidecarIndex() = default;
+
+    template<typename T>
+    bool MapSection(const Header& header, SectionIndex index, std::span<const T>& records) const
+    {
+        const Section& section = header.m_sections[index];
+        if (section.m_offset % alignof(T) != 0 || section.m_offset > m_file.Size() || section.m_count > (m_file.Size() - section.m_offset) / sizeof(T))
+            return false;
+        records = std::span<const T>(reinterpret_cast<const T*>(m_file.Data() + section.m_offset), static_cast<size_t>(section.m_count));
+        return true;
+    }
+
+    // Checks the header against the trace and every section and record range against the file.
+    bool Validate(const EtlTraceSource& source)
+    {
+        if (m_file.Size() < sizeof(Header))
+            return false;
+        Header header;
+        memcpy(&header, m_file.Data(), sizeof(header));
+        if (header.m_magic != MAGIC || header.m_version != VERSION || header.m_headerSize != sizeof(Header) || header.m_fileSize != m_file.Size())
+            return false;
+        if (header.m_etlSize != source.m_size || header.m_etlModifiedTime != source.m_modifiedTime || header.m_etlHeaderHash != source.m_headerHash)
+            return false;
+
+        if (!MapSection(header, SECTION_STRING_OFFSETS, m_stringOffsets) || !MapSection(header, SECTION_STRING_BYTES, m_stringBytes) ||
+            !MapSection(header, SECTION_TYPES, m_types) || !MapSection(header, SECTION_PROPERTIES, m_properties) ||
+            !MapSection(header, SECTION_SKIP_POINTS, m_skipPoints) || !MapSection(header, SECTION_POSTING_BYTES, m_postingBytes) ||
+            !MapSection(header, SECTION_BUFFERS, m_buffers) || !MapSection(header, SECTION_BUFFER_RANGES, m_bufferRanges))
+            return false;
+        if (m_bufferRanges.size() != m_buffers.size())
+            return false;
+        for (size_t i = 0; i < m_bufferRanges.size(); i++) {
+            if (m_bufferRanges[i].m_bufferIndex != i)
+                return false;
+        }
+
+        if (m_stringOffsets.empty() || m_stringOffsets.back() != m_stringBytes.size())
+            return false;
+        for (size_t i = 1; i < m_stringOffsets.size(); i++) {
+            if (m_stringOffsets[i] < m_stringOffsets[i - 1])
+                return false;
+        }
+        for (const EtlSidecarProperty& property : m_properties) {
+            if (property.m_name + 1 >= m_stringOffsets.size() || property.m_type + 1 >= m_stringOffsets.size())
+                return false;
+        }
+        for (const EtlSidecarType& type : m_types) {
+            if (type.m_firstProperty > m_properties.size() || type.m_propertyCount > m_properties.size() - type.m_firstProperty ||
+                type.m_postingOffset > m_postingBytes.size() || type.m_postingByteSize > m_postingBytes.size() - type.m_postingOffset ||
+                type.m_firstSkipPoint > m_skipPoints.size() || type.m_skipPointCount > m_skipPoints.size() - type.m_firstSkipPoint ||
+                type.m_skipPointCount != (type.m_eventCount + EtlPostingList::SKIP_INTERVAL - 1) / EtlPostingList::SKIP_INTERVAL)
+                return false;
+            // Skip points start scans inside the list's own bytes, in order.
+            std::span<const EtlPostingList::SkipPoint> skipPoints = m_skipPoints.subspan(type.m_firstSkipPoint, type.m_skipPointCount);
+            for (size_t i = 0; i < skipPoints.size(); i++) {
+                if (skipPoints[i].m_byteOffset >= type.m_postingByteSize || (i != 0 && skipPoints[i].m_byteOffset <= skipPoints[i - 1].m_byteOffset))
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    MappedFile m_file;
+    std::span<const uint64_t> m_stringOffsets;
+    std::span<const char> m_stringBytes;
+    std::span<const EtlSidecarType> m_types;
+    std::span<const EtlSidecarProperty> m_properties;
+    std::span<const EtlPostingList::SkipPoint> m_skipPoints;
+    std::span<const uint8_t> m_postingBytes;
+    std::span<const EtlBufferInfo> m_buffers;
+    std::span<const EtlTimeIndex::BufferRange> m_bufferRanges;
+};
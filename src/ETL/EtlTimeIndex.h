@@ -0,0 +1,137 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <span>
+#include <vector>
+#include <ETL/EtlFile.h>
+
+/*
+Sparse index from time to file position: the range of event timestamps of every buffer, ordered by
+first timestamp. Buffers of different processors overlap in time, so a range query takes the buffers
+that start before its end, and skips the leading buffers whose running maximum of last timestamps is
+still before its start. Built from the buffer ranges that the ingest pass records and the sidecar
+index stores, so opening a trace costs O(buffers) whether or not it has a sidecar.
+*/
+class EtlTimeIndex
+{
+public:
+    struct BufferRange {
+        int64_t m_first; // Timestamps of the earliest and the latest event of the buffer.
+        int64_t m_last;
+        uint32_t m_bufferIndex;
+    };
+
+    // The range of a buffer before any event is recorded; buffers left empty are not indexed.
+    static constexpr BufferRange EmptyRange(uint32_t bufferIndex) { return { INT64_MAX, INT64_MIN, bufferIndex }; }
+
+    EtlTimeIndex() = default;
+
+    static EtlTimeIndex Build(std::span<const BufferRange> buffers)
+    {
+        EtlTimeIndex index;
+        for (const BufferRange& range : buffers) {
+            if (range.m_first <= range.m_last)
+                index.m_ranges.push_back(range);
+        }
+        std::sort(index.m_ranges.begin(), index.m_ranges.end(), [](const BufferRange& lhs, const BufferRange& rhs) {
+            return lhs.m_first != rhs.m_first ? lhs.m_first < rhs.m_first : lhs.m_bufferIndex < rhs.m_bufferIndex;
+        });
+        index.m_maxLast.reserve(index.m_ranges.size());
+        for (const BufferRange& range : index.m_ranges)
+            index.m_maxLast.push_back(index.m_maxLast.empty() ? range.m_last : (std::max)(index.m_maxLast.back(), range.m_last));
+        return index;
+    }
+
+    // Buffers holding events with timestamps in [begin, end), in order of their first event.
+    std::vector<uint32_t> FindBuffers(int64_t begin, int64_t end) const
+    {
+        std::vector<uint32_t> buffers;
+        size_t i = std::lower_bound(m_maxLast.begin(), m_maxLast.end(), begin) - m_maxLast.begin();
+        for (; i < m_ranges.size() && m_ranges[i].m_first < end; i++) {
+            if (m_ranges[i].m_last >= begin)
+                buffers.push_back(m_ranges[i].m_bufferIndex);
+        }
+        return buffers;
+    }
+
+    // Buffers with events; the others are left out of every query.
+    size_t GetBufferCount() const { return m_ranges.size(); }
+    int64_t GetFirst() const { return m_ranges.empty() ? 0 : m_ranges.front().m_first; }
+    int64_t GetLast() const { return m_maxLast.empty() ? 0 : m_maxLast.back(); }
+
+private:
+    std::vector<BufferRange> m_ranges;
+    std::vector<int64_t> m_maxLast; // Largest m_last of m_ranges[0..i].
+};
+
+/*
+Converts raw event timestamps to seconds from the start of the trace and to wall time (FILETIME), in
+bulk. Raw timestamps count QPC ticks, 100ns of system time or CPU cycles depending on the clock type of
+the session; the log file header gives their frequency and the wall time of the trace header event.
+Traces without a header are measured from their first event, and their wall time is unknown.
+*/
+class EtlTimeConverter
+{
+public:
+    static constexpr int64_t FILETIME_FREQUENCY = 10000000;
+
+    EtlTimeConverter() = default;
+
+    EtlTimeConverter(const EtlLogFileInfo& info, int64_t firstTimestamp)
+    {
+        if (info.m_clockType == 2)
+            m_frequency = FILETIME_FREQUENCY;
+        else if (info.m_clockType == 3 && info.m_cpuSpeedMHz != 0)
+            m_frequency = static_cast<int64_t>(info.m_cpuSpeedMHz) * 1000000;
+        else if (info.m_perfFreq > 0)
+            m_frequency = info.m_perfFreq;
+        m_hasWallTime = info.m_startTime != 0;
+        m_origin = m_hasWallTime ? info.m_startTimestamp : firstTimestamp;
+        m_startTime = info.m_startTime;
+        m_secondsPerTick = 1.0 / static_cast<double>(m_frequency);
+    }
+
+    int64_t GetFrequency() const { return m_frequency; }
+    bool HasWallTime() const { return m_hasWallTime; }
+
+    double ToSeconds(int64_t timestamp) const { return static_cast<double>(timestamp - m_origin) * m_secondsPerTick; }
+    int64_t FromSeconds(double seconds) const { return m_origin + std::llround(seconds * static_cast<double>(m_frequency)); }
+
+    // FILETIME of a timestamp, exact to the 100ns tick.
+    int64_t ToFileTime(int64_t timestamp) const
+    {
+        int64_t ticks = timestamp - m_origin;
+        return m_startTime + ticks / m_frequency * FILETIME_FREQUENCY + ticks % m_frequency * FILETIME_FREQUENCY / m_frequency;
+    }
+
+    // seconds must be as large as timestamps.
+    void ToSeconds(std::span<const int64_t> timestamps, std::span<double> seconds) const
+    {
+        const int64_t origin = m_origin;
+        const double scale = m_secondsPerTick;
+        for (size_t i = 0; i < timestamps.size(); i++)
+            seconds[i] = static_cast<double>(timestamps[i] - origin) * scale;
+    }
+
+    // fileTimes must be as large as timestamps.
+    void ToFileTime(std::span<const int64_t> timestamps, std::span<int64_t> fileTimes) const
+    {
+        if (m_frequency == FILETIME_FREQUENCY) {
+            const int64_t offset = m_startTime - m_origin;
+            for (size_t i = 0; i < timestamps.size(); i++)
+                fileTimes[i] = timestamps[i] + offset;
+            return;
+        }
+        for (size_t i = 0; i < timestamps.size(); i++)
+            fileTimes[i] = ToFileTime(timestamps[i]);
+    }
+
+private:
+    int64_t m_origin = 0;
+    int64_t m_frequency = FILETIME_FREQUENCY;
+    int64_t m_startTime = 0;
+    double m_secondsPerTick = 1.0 / FILETIME_FREQUENCY;
+    bool m_hasWallTime = false;
+};
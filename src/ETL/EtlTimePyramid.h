@@ -0,0 +1,230 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <ETL/EtlOccurrenceIndex.h>
+#include <ETL/EtlParallelReader.h>
+#include <ETL/EventIdentifier.h>
+
+/*
+Event counts of one type over time at every power-of-two resolution. Level 0 divides the trace into
+buckets of equal width and each level above merges pairs of buckets of the level below. A bucket
+keeps its event count plus the smallest and the largest level 0 count it covers, so a coarse level
+still shows the bursts and the gaps that its average hides. Only buckets with events are stored.
+*/
+class EtlTimePyramid
+{
+public:
+    struct Bucket {
+        uint64_t m_count;
+        uint32_t m_index; // Position of the bucket in its level.
+        uint32_t m_min;   // Level 0 counts inside the bucket; m_min is 0 if one of them is empty.
+        uint32_t m_max;
+    };
+
+    // A bucket of a level sampled densely; empty buckets are zeros.
+    struct Sample {
+        double m_mean; // Average level 0 count of the bucket.
+        uint32_t m_min;
+        uint32_t m_max;
+    };
+
+    EtlTimePyramid() = default;
+
+    // levelZero holds the non-empty level 0 buckets by increasing index; levelCount includes level 0.
+    EtlTimePyramid(std::vector<Bucket> levelZero, unsigned levelCount)
+    {
+        m_levels.reserve(levelCount);
+        m_levels.push_back(std::move(levelZero));
+        for (unsigned level = 1; level < levelCount; level++) {
+            const std::vector<Bucket>& below = m_levels.back();
+            std::vector<Bucket> buckets;
+            buckets.reserve((below.size() + 1) / 2);
+            for (size_t i = 0; i < below.size(); i++) {
+                Bucket bucket = below[i];
+                bucket.m_index >>= 1;
+                if (i + 1 < below.size() && (below[i + 1].m_index >> 1) == bucket.m_index) {
+                    const Bucket& next = below[++i];
+                    bucket.m_count += next.m_count;
+                    bucket.m_min = (std::min)(bucket.m_min, next.m_min);
+                    bucket.m_max = (std::max)(bucket.m_max, next.m_max);
+                }
+                else {
+                    bucket.m_min = 0;
+                }
+                buckets.push_back(bucket);
+            }
+            m_levels.push_back(std::move(buckets));
+        }
+    }
+
+    unsigned GetLevelCount() const { return static_cast<unsigned>(m_levels.size()); }
+    const std::vector<Bucket>& GetLevel(unsigned level) const { return m_levels[level]; }
+
+    // Sets samples to the buckets [first, first + count) of a level. Costs O(count + log(stored buckets)).
+    void GetSamples(unsigned level, uint32_t first, uint32_t count, std::vector<Sample>& samples) const
+    {
+        samples.assign(count, Sample{});
+        if (level >= m_levels.size())
+            return;
+        const std::vector<Bucket>& buckets = m_levels[level];
+        auto it = std::lower_bound(buckets.begin(), buckets.end(), first, [](const Bucket& bucket, uint32_t index) { return bucket.m_index < index; });
+        double scale = std::ldexp(1.0, -static_cast<int>(level));
+        for (; it != buckets.end() && it->m_index - first < count; ++it)
+            samples[it->m_index - first] = { static_cast<double>(it->m_count) * scale, it->m_min, it->m_max };
+    }
+
+    size_t ByteSize() const
+    {
+        size_t bytes = 0;
+        for (const auto& level : m_levels)
+            bytes += level.capacity() * sizeof(Bucket);
+        return bytes;
+    }
+
+private:
+    std::vector<std::vector<Bucket>> m_levels;
+};
+
+/*
+Time pyramids of every event type of a trace and of all of its events, over the same buckets: level 0
+starts at the first timestamp of the trace and has at most 2^MAX_BUCKETS_LOG2 buckets of 2^shift
+ticks. Built from the timestamps kept in the occurrence lists, without reading the trace.
+*/
+class EtlTimeDensityIndex
+{
+public:
+    static constexpr unsigned MAX_BUCKETS_LOG2 = 15;
+
+    // Buckets of one level covering a range of time.
+    struct Window {
+        unsigned m_level;
+        uint32_t m_first;
+        uint32_t m_count;
+    };
+
+    /*
+    Pyramids over the timestamps [first, last] of the trace, as given by EtlTimeIndex, so the occurrence
+    lists are walked once. Events outside of it are not counted.
+    */
+    static std::shared_ptr<const EtlTimeDensityIndex> Build(const EtlOccurrenceIndex& occurrenceIndex, int64_t first, int64_t last, const EtlParallelReader& reader)
+    {
+        std::vector<EventIdentifier> ids;
+        std::vector<const EtlPostingList*> lists;
+        occurrenceIndex.ForEachList([&](const EventIdentifier& id, const EtlPostingList& postings) {
+            ids.push_back(id);
+            lists.push_back(&postings);
+        });
+
+        auto pIndex = std::make_shared<EtlTimeDensityIndex>();
+        int64_t begin = first;
+        int64_t end = last;
+        if (end < begin)
+            begin = end = 0; // No events.
+        uint64_t span = static_cast<uint64_t>(end) - static_cast<uint64_t>(begin);
+        unsigned shift = 0;
+        while ((span >> shift) >= (1ull << MAX_BUCKETS_LOG2))
+            shift++;
+        uint32_t bucketCount = static_cast<uint32_t>(span >> shift) + 1;
+        unsigned levelCount = static_cast<unsigned>(std::bit_width(bucketCount - 1)) + 1;
+        pIndex->m_begin = begin;
+        pIndex->m_shift = shift;
+        pIndex->m_bucketCount = bucketCount;
+        pIndex->m_levelCount = levelCount;
+
+        // Rare types touch few buckets, so each type only visits the buckets it touched, not all of them.
+        std::vector<std::vector<uint32_t>> counts(reader.GetThreadCount(), std::vector<uint32_t>(bucketCount));
+        std::vector<std::vector<uint32_t>> touched(reader.GetThreadCount());
+        std::vector<std::vector<uint64_t>> totals(reader.GetThreadCount(), std::vector<uint64_t>(bucketCount));
+        std::vector<EtlTimePyramid> pyramids(lists.size());
+        reader.ParallelFor(lists.size(), [&](unsigned threadIndex, size_t i) {
+            std::vector<uint32_t>& dense = counts[threadIndex];
+            std::vector<uint32_t>& buckets = touched[threadIndex];
+            lists[i]->ForEach([&](const EtlEventLocation& location) {
+                if (location.m_timestamp < begin || location.m_timestamp > end)
+                    return true;
+                uint32_t bucket = static_cast<uint32_t>((static_cast<uint64_t>(location.m_timestamp) - static_cast<uint64_t>(begin)) >> shift);
+                if (dense[bucket]++ == 0)
+                    buckets.push_back(bucket);
+                return true;
+            });
+            std::sort(buckets.begin(), buckets.end());
+            std::vector<EtlTimePyramid::Bucket> levelZero;
+            levelZero.reserve(buckets.size());
+            for (uint32_t bucket : buckets) {
+                levelZero.push_back({ dense[bucket], bucket, dense[bucket], dense[bucket] });
+                totals[threadIndex][bucket] += dense[bucket];
+                dense[bucket] = 0;
+            }
+            buckets.clear();
+            pyramids[i] = EtlTimePyramid(std::move(levelZero), levelCount);
+        });
+
+        std::vector<EtlTimePyramid::Bucket> levelZero;
+        for (uint32_t bucket = 0; bucket < bucketCount; bucket++) {
+            uint64_t count = 0;
+            for (const auto& threadTotals : totals)
+                count += threadTotals[bucket];
+            if (count == 0)
+                continue;
+            uint32_t clamped = static_cast<uint32_t>((std::min)(count, static_cast<uint64_t>(UINT32_MAX)));
+            levelZero.push_back({ count, bucket, clamped, clamped });
+        }
+        pIndex->m_total = EtlTimePyramid(std::move(levelZero), levelCount);
+        for (size_t i = 0; i < ids.size(); i++)
+            pIndex->m_pyramids.emplace(ids[i], std::move(pyramids[i]));
+        return pIndex;
+    }
+
+    // First timestamp of the trace; times below are in ticks from it.
+    int64_t GetBegin() const { return m_begin; }
+    double GetSpan() const { return std::ldexp(static_cast<double>(m_bucketCount), static_cast<int>(m_shift)); }
+    unsigned GetLevelCount() const { return m_levelCount; }
+    const EtlTimePyramid& GetTotal() const { return m_total; }
+
+    const EtlTimePyramid* Find(const EventIdentifier& id) const
+    {
+        auto it = m_pyramids.find(id);
+        return it != m_pyramids.end() ? &it->second : nullptr;
+    }
+
+    /*
+    Finest level whose buckets overlapping [begin, end) number at most maxBuckets, so drawing a range
+    costs about one bucket per pixel whatever the number of events.
+    */
+    Window GetWindow(double begin, double end, size_t maxBuckets) const
+    {
+        begin = std::clamp(begin, 0.0, GetSpan());
+        end = std::clamp(end, begin, GetSpan());
+        for (unsigned level = 0;; level++) {
+            double width = GetBucketWidth(level);
+            uint32_t levelBuckets = ((m_bucketCount - 1) >> level) + 1;
+            uint32_t first = (std::min)(static_cast<uint32_t>(begin / width), levelBuckets - 1);
+            uint32_t last = std::clamp(static_cast<uint32_t>(std::ceil(end / width)), first + 1, levelBuckets);
+            if (last - first <= maxBuckets || level + 1 == m_levelCount)
+                return { level, first, last - first };
+        }
+    }
+
+    double GetBucketWidth(unsigned level) const { return std::ldexp(1.0, static_cast<int>(m_shift + level)); }
+
+    size_t ByteSize() const
+    {
+        size_t bytes = m_total.ByteSize();
+        for (const auto& pair : m_pyramids)
+            bytes += pair.second.ByteSize();
+        return bytes;
+    }
+
+private:
+    int64_t m_begin = 0;
+    unsigned m_shift = 0;
+    uint32_t m_bucketCount = 1;
+    unsigned m_levelCount = 1;
+    EtlTimePyramid m_total;
+    EventIdentifierMap<EtlTimePyramid> m_pyramids;
+};
@@ -0,0 +1,404 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <ETL/EtlColumnTable.h>
+#include <ETL/EtlTraceSource.h>
+#include <ETL/EventIdentifier.h>
+#include <utils/SqliteDatabase.h>
+#include <utils/TaskHandler.h>
+
+// Row of the event_types table; every type gets its own events_<type id> table.
+struct EtlDatabaseEventType {
+    EventIdentifier m_id;
+    std::string m_providerGuid;
+    std::string m_provider;
+    std::string m_task;
+    std::string m_opcode;
+    std::string m_level;
+    std::string m_channel;
+    std::string m_keywords;
+    std::string m_message;
+    std::string m_decodingSource;
+    std::vector<std::pair<std::string, std::string>> m_properties; // Name and TDH type.
+};
+
+// Message to the writer thread of an EtlTraceDatabase.
+struct EtlDatabaseWrite {
+    uint32_t m_typeId = 0;
+    std::shared_ptr<const EtlDatabaseEventType> m_pType; // Registers the type.
+    std::shared_ptr<const EtlColumnTable> m_pBatch;      // Rows of the type, with their strings; released once inserted.
+    bool m_finish = false;
+};
+
+/*
+SQLite database of a decoded trace: an event_types table describing every type and one
+events_<type id> table per type holding its decoded instances (timestamp first, then one column
+per top-level property). Unsigned values are stored as their int64 bit pattern, as SQLite has no
+unsigned integers. trace_info records the source .etl (see EtlTraceSource), so a reopened trace
+can be queried without decoding it again.
+
+Ingest is write-optimized: the file is rebuilt from scratch in WAL mode without syncs, rows are
+inserted through prepared multi-row statements inside transactions of TRANSACTION_ROWS rows, and
+indexes are only created by Finish. All SQLite work happens on a dedicated writer thread fed
+through a bounded queue, so Write blocks when decoding gets ahead of the disk.
+*/
+class EtlTraceDatabase
+{
+public:
+    static constexpr int64_t SCHEMA_VERSION = 1;
+    static constexpr size_t TRANSACTION_ROWS = 1 << 20;
+    static constexpr size_t WRITE_QUEUE_CAPACITY = 32;
+    static constexpr size_t ROWS_PER_INSERT = 64;
+
+    // Tables describing the event types, shared with EtlMemoryDatabase so queries run against both.
+    static constexpr const char* TYPE_TABLES_SQL =
+        "CREATE TABLE event_types (type_id INTEGER PRIMARY KEY, provider_guid TEXT, provider TEXT, event_id INTEGER, version INTEGER,"
+        " task TEXT, opcode TEXT, level TEXT, channel TEXT, keywords TEXT, message TEXT, decoding_source TEXT, table_name TEXT, row_count INTEGER);"
+        "CREATE TABLE event_columns (type_id INTEGER, column_index INTEGER, name TEXT, tdh_type TEXT, PRIMARY KEY (type_id, column_index));";
+    static constexpr const char* INSERT_TYPE_SQL = "INSERT INTO event_types VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)";
+    static constexpr const char* INSERT_COLUMN_SQL = "INSERT INTO event_columns VALUES (?, ?, ?, ?)";
+
+    static std::string TableName(uint32_t typeId) { return "events_" + std::to_string(typeId); }
+
+    // Inserts the event_types and event_columns rows of a type through INSERT_TYPE_SQL and INSERT_COLUMN_SQL statements.
+    static void InsertTypeRows(SqliteStatement& insertType, SqliteStatement& insertColumn, uint32_t typeId, const EtlDatabaseEventType& type, uint64_t rowCount)
+    {
+        std::string tableName = TableName(typeId);
+        insertType.BindInt64(1, typeId);
+        insertType.BindText(2, type.m_providerGuid);
+        insertType.BindText(3, type.m_provider);
+        insertType.BindInt64(4, type.m_id.m_id);
+        insertType.BindInt64(5, type.m_id.m_version);
+        insertType.BindText(6, type.m_task);
+        insertType.BindText(7, type.m_opcode);
+        insertType.BindText(8, type.m_level);
+        insertType.BindText(9, type.m_channel);
+        insertType.BindText(10, type.m_keywords);
+        insertType.BindText(11, type.m_message);
+        insertType.BindText(12, type.m_decodingSource);
+        insertType.BindText(13, tableName);
+        insertType.BindInt64(14, static_cast<int64_t>(rowCount));
+        insertType.Step();
+
+        for (size_t i = 0; i < type.m_properties.size(); i++) {
+            insertColumn.BindInt64(1, typeId);
+            insertColumn.BindInt64(2, static_cast<int64_t>(i));
+            insertColumn.BindText(3, type.m_properties[i].first);
+            insertColumn.BindText(4, type.m_properties[i].second);
+            insertColumn.Step();
+        }
+    }
+
+    // Creates an empty database at path, replacing any existing one.
+    EtlTraceDatabase(const std::filesystem::path& path, const EtlTraceSource& source)
+        : m_source(source)
+    {
+        std::error_code error;
+        for (const wchar_t* suffix : { L"", L"-wal", L"-shm" })
+            std::filesystem::remove(std::filesystem::path(path).concat(suffix), error);
+
+        m_database = SqliteDatabase(path, false);
+        m_database.Execute("PRAGMA page_size = 65536");
+        m_database.Execute("PRAGMA journal_mode = WAL");
+        m_database.Execute("PRAGMA synchronous = OFF");
+        m_database.Execute("PRAGMA temp_store = MEMORY");
+        m_database.Execute("PRAGMA cache_size = -262144");
+        m_database.Execute("CREATE TABLE trace_info (key TEXT PRIMARY KEY, value)");
+        m_database.Execute(TYPE_TABLES_SQL);
+        m_insertType = m_database.Prepare(INSERT_TYPE_SQL);
+        m_insertColumn = m_database.Prepare(INSERT_COLUMN_SQL);
+
+        m_pWriter = std::make_unique<TaskHandler<EtlDatabaseWrite, bool>>(
+            [this](EtlDatabaseWrite&& write, TaskHandler<EtlDatabaseWrite, bool>* pHandler) { return Process(std::move(write), pHandler); },
+            1, WRITE_QUEUE_CAPACITY);
+    }
+
+    ~EtlTraceDatabase()
+    {
+        m_pWriter.reset(); // Queued writes are dropped; an unfinished database is rebuilt next time.
+        if (m_inTransaction)
+            sqlite3_exec(m_database.Get(), "ROLLBACK", nullptr, nullptr, nullptr);
+    }
+
+    EtlTraceDatabase(const EtlTraceDatabase&) = delete;
+    EtlTraceDatabase& operator=(const EtlTraceDatabase&) = delete;
+
+    // True if path holds a finished database of the current schema built from source.
+    static bool IsCurrent(const std::filesystem::path& path, const EtlTraceSource& source)
+    {
+        std::error_code error;
+        if (!std::filesystem::exists(path, error))
+            return false;
+        try {
+            SqliteDatabase database(path, true);
+            SqliteStatement query = database.Prepare("SELECT key, value FROM trace_info");
+            std::unordered_map<std::string, std::string> info;
+            while (query.Step())
+                info[std::string(query.GetText(0))] = query.GetText(1);
+            return info["schema_version"] == std::to_string(SCHEMA_VERSION) && info["complete"] == "1" && info["etl_path"] == source.m_path &&
+                info["etl_size"] == std::to_string(source.m_size) && info["etl_modified_time"] == std::to_string(source.m_modifiedTime) &&
+                info["etl_header_hash"] == std::to_string(source.m_headerHash);
+        }
+        catch (const std::exception&) {
+            return false;
+        }
+    }
+
+    // Queues a type; typeId must be unique and registered before its rows are written.
+    bool AddEventType(uint32_t typeId, std::shared_ptr<const EtlDatabaseEventType> pType)
+    {
+        return m_pWriter->PushInput(EtlDatabaseWrite{ typeId, std::move(pType), nullptr, false });
+    }
+
+    // Queues rows of a type, blocking while the writer is behind. Returns false once writing has failed.
+    bool Write(uint32_t typeId, std::shared_ptr<const EtlColumnTable> pBatch)
+    {
+        if (m_failed.load(std::memory_order_acquire))
+            return false;
+        return m_pWriter->PushInput(EtlDatabaseWrite{ typeId, nullptr, std::move(pBatch), false });
+    }
+
+    /*
+    Waits for the queued writes, creates the indexes and marks the database complete.
+    Returns false if any write failed; GetError describes the first failure.
+    */
+    bool Finish()
+    {
+        bool succeeded = false;
+        if (!m_pWriter->PushInput(EtlDatabaseWrite{ 0, nullptr, nullptr, true }) || !m_pWriter->PopOutput(&succeeded))
+            return false;
+        return succeeded;
+    }
+
+    uint64_t GetRowsWritten() const { return m_rowsWritten.load(std::memory_order_relaxed); }
+    bool HasFailed() const { return m_failed.load(std::memory_order_acquire); }
+
+    std::string GetError() const
+    {
+        std::lock_guard lock(m_errorLock);
+        return m_error;
+    }
+
+private:
+    struct TypeTable {
+        std::string m_name;
+        SqliteStatement m_insert;      // One row.
+        SqliteStatement m_insertBlock; // m_blockRows rows.
+        size_t m_blockRows = 1;
+        size_t m_columnCount = 0;
+        uint64_t m_rowCount = 0;
+        bool m_created = false;
+    };
+
+    // Runs on the writer thread. Returns true to stop it.
+    bool Process(EtlDatabaseWrite&& write, TaskHandler<EtlDatabaseWrite, bool>* pHandler)
+    {
+        if (write.m_finish) {
+            bool succeeded = !m_failed.load(std::memory_order_acquire) && Guard([this]() { Complete(); });
+            pHandler->PushOutput(std::move(succeeded));
+            return true;
+        }
+        if (m_failed.load(std::memory_order_acquire))
+            return false;
+
+        Guard([&]() {
+            if (!m_inTransaction) {
+                m_database.Execute("BEGIN");
+                m_inTransaction = true;
+            }
+            if (write.m_pType)
+                InsertType(write.m_typeId, *write.m_pType);
+            if (write.m_pBatch) {
+                InsertRows(write.m_typeId, *write.m_pBatch);
+                write.m_pBatch.reset(); // Frees its rows and strings before a commit that may take a while.
+            }
+            // Large transactions amortize the commit; an idle queue commits early so progress is durable.
+            if (m_rowsInTransaction >= TRANSACTION_ROWS || pHandler->PendingInputs() == 0) {
+                m_database.Execute("COMMIT");
+                m_inTransaction = false;
+                m_rowsInTransaction = 0;
+            }
+        });
+        return false;
+    }
+
+    template<typename Func>
+    bool Guard(Func&& func)
+    {
+        try {
+            func();
+            return true;
+        }
+        catch (const std::exception& e) {
+            std::lock_guard lock(m_errorLock);
+            if (m_error.empty())
+                m_error = e.what();
+            m_failed.store(true, std::memory_order_release);
+            return false;
+        }
+    }
+
+    void InsertType(uint32_t typeId, const EtlDatabaseEventType& type)
+    {
+        TypeTable& table = m_tables[typeId];
+        table.m_name = TableName(typeId);
+        table.m_columnCount = type.m_properties.size() + 1;
+        InsertTypeRows(m_insertType, m_insertColumn, typeId, type, 0); // The count is set by Complete.
+    }
+
+    // Creates the table of a type from the columns of its first batch.
+    void CreateTable(TypeTable& table, const EtlColumnTable& batch)
+    {
+        std::vector<std::string> names(batch.ColumnCount());
+        for (size_t i = 0; i < names.size(); i++)
+            names[i] = batch.GetColumn(i).GetName();
+        names = SqliteDatabase::UniqueColumnNames(names, { "timestamp" });
+        std::string create = "CREATE TABLE " + table.m_name + " (timestamp INTEGER";
+        for (size_t i = 0; i < names.size(); i++)
+            create += ", " + SqliteDatabase::QuoteIdentifier(names[i]) + SqlType(batch.GetColumn(i).GetType());
+        m_database.Execute(create + ")");
+
+        table.m_columnCount = batch.ColumnCount() + 1;
+        size_t maxParameters = static_cast<size_t>(sqlite3_limit(m_database.Get(), SQLITE_LIMIT_VARIABLE_NUMBER, -1));
+        table.m_blockRows = (std::max)(size_t(1), (std::min)(ROWS_PER_INSERT, maxParameters / table.m_columnCount));
+        table.m_insert = m_database.Prepare(InsertSql(table, 1));
+        table.m_insertBlock = m_database.Prepare(InsertSql(table, table.m_blockRows));
+        table.m_created = true;
+    }
+
+    static std::string InsertSql(const TypeTable& table, size_t rows)
+    {
+        std::string values = "(?";
+        for (size_t i = 1; i < table.m_columnCount; i++)
+            values += ",?";
+        values += ")";
+        std::string sql = "INSERT INTO " + table.m_name + " VALUES " + values;
+        for (size_t row = 1; row < rows; row++)
+            sql += "," + values;
+        return sql;
+    }
+
+    static const char* SqlType(EtlColumnType type)
+    {
+        switch (type) {
+        case EtlColumnType::Int64:
+        case EtlColumnType::UInt64:
+            return " INTEGER";
+        case EtlColumnType::Double:
+            return " REAL";
+        default:
+            return " TEXT";
+        }
+    }
+
+    void InsertRows(uint32_t typeId, const EtlColumnTable& batch)
+    {
+        auto it = m_tables.find(typeId);
+        if (it == m_tables.end())
+            throw std::runtime_error("Rows written for an unregistered event type");
+        TypeTable& table = it->second;
+        if (!table.m_created)
+            CreateTable(table, batch);
+        if (batch.ColumnCount() + 1 != table.m_columnCount)
+            throw std::runtime_error("Batch columns do not match table " + table.m_name);
+
+        // Multi-row inserts run the statement once per block, which is most of the per-row cost.
+        size_t row = 0;
+        for (; row + table.m_blockRows <= batch.RowCount(); row += table.m_blockRows) {
+            for (size_t i = 0; i < table.m_blockRows; i++)
+                BindRow(table.m_insertBlock, batch, row + i, static_cast<int>(i * table.m_columnCount) + 1);
+            table.m_insertBlock.Step();
+        }
+        for (; row < batch.RowCount(); row++) {
+            BindRow(table.m_insert, batch, row, 1);
+            table.m_insert.Step();
+        }
+        table.m_rowCount += batch.RowCount();
+        m_rowsInTransaction += batch.RowCount();
+        m_rowsWritten.fetch_add(batch.RowCount(), std::memory_order_relaxed);
+    }
+
+    static void BindRow(SqliteStatement& insert, const EtlColumnTable& batch, size_t row, int firstParameter)
+    {
+        insert.BindInt64(firstParameter, batch.GetTimestamp(row));
+        for (size_t i = 0; i < batch.ColumnCount(); i++) {
+            const EtlColumn& column = batch.GetColumn(i);
+            int parameter = firstParameter + static_cast<int>(i) + 1;
+            if (!column.IsValid(row)) {
+                insert.BindNull(parameter);
+                continue;
+            }
+            switch (column.GetType()) {
+            case EtlColumnType::Int64:
+                insert.BindInt64(parameter, column.GetInt(row));
+                break;
+            case EtlColumnType::UInt64:
+                insert.BindInt64(parameter, static_cast<int64_t>(column.GetUInt(row)));
+                break;
+            case EtlColumnType::Double:
+                insert.BindDouble(parameter, column.GetDouble(row));
+                break;
+            case EtlColumnType::String:
+                insert.BindText(parameter, column.GetString(row));
+                break;
+            }
+        }
+    }
+
+    // Commits, builds the deferred indexes and records the source once everything is written.
+    void Complete()
+    {
+        if (!m_inTransaction)
+            m_database.Execute("BEGIN");
+        m_inTransaction = true;
+        SqliteStatement updateCount = m_database.Prepare("UPDATE event_types SET row_count = ? WHERE type_id = ?");
+        for (auto& [typeId, table] : m_tables) {
+            if (table.m_created)
+                m_database.Execute("CREATE INDEX " + table.m_name + "_timestamp ON " + table.m_name + " (timestamp)");
+            updateCount.BindInt64(1, static_cast<int64_t>(table.m_rowCount));
+            updateCount.BindInt64(2, typeId);
+            updateCount.Step();
+        }
+        m_database.Execute("CREATE INDEX event_types_identity ON event_types (provider_guid, event_id, version)");
+
+        SqliteStatement insertInfo = m_database.Prepare("INSERT INTO trace_info VALUES (?, ?)");
+        std::pair<const char*, std::string> info[] = {
+            { "schema_version", std::to_string(SCHEMA_VERSION) },
+            { "etl_path", m_source.m_path },
+            { "etl_size", std::to_string(m_source.m_size) },
+            { "etl_modified_time", std::to_string(m_source.m_modifiedTime) },
+            { "etl_header_hash", std::to_string(m_source.m_headerHash) },
+            { "complete", "1" },
+        };
+        for (const auto& [key, value] : info) {
+            insertInfo.BindText(1, key);
+            insertInfo.BindText(2, value);
+            insertInfo.Step();
+        }
+        m_database.Execute("COMMIT");
+        m_inTransaction = false;
+        m_database.Execute("PRAGMA synchronous = NORMAL");
+        m_database.Execute("PRAGMA wal_checkpoint(TRUNCATE)");
+    }
+
+    EtlTraceSource m_source;
+    SqliteDatabase m_database;
+    SqliteStatement m_insertType;
+    SqliteStatement m_insertColumn;
+    std::unordered_map<uint32_t, TypeTable> m_tables; // Writer thread only.
+    bool m_inTransaction = false;
+    size_t m_rowsInTransaction = 0;
+    std::atomic<uint64_t> m_rowsWritten = 0;
+    std::atomic<bool> m_failed = false;
+    mutable std::mutex m_errorLock;
+    std::string m_error;
+    std::unique_ptr<TaskHandler<EtlDatabaseWrite, bool>> m_pWriter;
+};
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <utils/StringPool.h>
+
+/*
+Identifies the .etl that derived files (the trace database, the sidecar index) were built from.
+They are only reused while the path, size, modification time and a hash of the first
+HEADER_HASH_BYTES of the file (the first buffer, with the log file header) all match.
+*/
+struct EtlTraceSource {
+    static constexpr size_t HEADER_HASH_BYTES = 64 * 1024;
+
+    std::string m_path; // UTF-8.
+    uint64_t m_size = 0;
+    int64_t m_modifiedTime = 0;
+    uint64_t m_headerHash = 0;
+
+    static EtlTraceSource Of(const std::filesystem::path& path)
+    {
+        EtlTraceSource source;
+        source.m_path = reinterpret_cast<const char*>(path.u8string().c_str());
+        source.m_size = std::filesystem::file_size(path);
+        source.m_modifiedTime = static_cast<int64_t>(std::filesystem::last_write_time(path).time_since_epoch().count());
+
+        std::vector<char> header(static_cast<size_t>((std::min)(source.m_size, static_cast<uint64_t>(HEADER_HASH_BYTES))));
+        std::ifstream file(path, std::ios::binary);
+        if (!file.read(header.data(), static_cast<std::streamsize>(header.size())))
+            throw std::runtime_error("Failed to read trace header");
+        source.m_headerHash = HashString64(std::string_view(header.data(), header.size()));
+        return source;
+    }
+
+    bool operator==(const EtlTraceSource& other) const = default;
+};
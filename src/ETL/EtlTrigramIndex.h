@@ -0,0 +1,288 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <ETL/EtlParallelReader.h>
+#include <ETL/EventIdentifier.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ETL_TRIGRAM_SSE2 1
+#endif
+
+inline char EtlLowerAscii(char c)
+{
+    return c >= 'A' && c <= 'Z' ? static_cast<char>(c + ('a' - 'A')) : c;
+}
+
+inline void EtlLowerAscii(char* p, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+        p[i] = EtlLowerAscii(p[i]);
+}
+
+/*
+Position of needle in text, or std::string_view::npos. With SSE2, 16 positions are tested at once
+against the first and the last byte of the needle, and only positions where both match are compared
+in full, which skips most of the text for needles of a few bytes and more.
+*/
+inline size_t EtlFindText(std::string_view text, std::string_view needle)
+{
+    if (needle.empty())
+        return 0;
+    if (needle.size() > text.size())
+        return std::string_view::npos;
+    size_t last = needle.size() - 1;
+    size_t i = 0;
+#ifdef ETL_TRIGRAM_SSE2
+    const __m128i firstByte = _mm_set1_epi8(needle[0]);
+    const __m128i lastByte = _mm_set1_epi8(needle[last]);
+    for (; i + last + 16 <= text.size(); i += 16) {
+        __m128i firstBlock = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text.data() + i));
+        __m128i lastBlock = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text.data() + i + last));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(firstBlock, firstByte), _mm_cmpeq_epi8(lastBlock, lastByte))));
+        while (mask != 0) {
+            unsigned bit = static_cast<unsigned>(std::countr_zero(mask));
+            if (memcmp(text.data() + i + bit, needle.data(), needle.size()) == 0)
+                return i + bit;
+            mask &= mask - 1;
+        }
+    }
+#endif
+    for (; i + last < text.size(); i++) {
+        if (text[i] == needle[0] && memcmp(text.data() + i, needle.data(), needle.size()) == 0)
+            return i;
+    }
+    return std::string_view::npos;
+}
+
+/*
+Strictly increasing list of document numbers, stored as LEB128 varints of the gaps. Lists of
+frequent trigrams have small gaps, so most entries take a single byte.
+*/
+class EtlDocList
+{
+public:
+    // doc must follow the last document of the list.
+    void Append(uint32_t doc)
+    {
+        uint32_t gap = m_count == 0 ? doc : doc - m_last;
+        while (gap >= 0x80) {
+            m_bytes.push_back(static_cast<uint8_t>(gap | 0x80));
+            gap >>= 7;
+        }
+        m_bytes.push_back(static_cast<uint8_t>(gap));
+        m_last = doc;
+        m_count++;
+    }
+
+    size_t Size() const { return m_count; }
+    size_t ByteSize() const { return m_bytes.capacity(); }
+    void ShrinkToFit() { m_bytes.shrink_to_fit(); }
+
+    // Calls func(uint32_t doc) in increasing order until it returns false.
+    template<typename Func>
+    void ForEach(Func&& func) const
+    {
+        const uint8_t* p = m_bytes.data();
+        uint32_t doc = 0;
+        for (uint32_t i = 0; i < m_count; i++) {
+            uint32_t gap = 0;
+            for (unsigned shift = 0;; shift += 7) {
+                uint8_t byte = *p++;
+                gap |= static_cast<uint32_t>(byte & 0x7F) << shift;
+                if ((byte & 0x80) == 0)
+                    break;
+            }
+            doc += gap;
+            if (!func(doc))
+                return;
+        }
+    }
+
+private:
+    std::vector<uint8_t> m_bytes;
+    uint32_t m_last = 0;
+    uint32_t m_count = 0;
+};
+
+/*
+Trigram index over the text of the events of a trace, for substring search.
+Documents are the events, numbered type after type: the events of the i-th type added get the
+numbers following those of the previous type, in the order of its occurrence list, so a number
+maps back to a type and an occurrence ordinal. A trigram is three consecutive bytes of the UTF-8
+text with ASCII letters lowered. Every document containing a needle contains all of its trigrams,
+so intersecting their lists gives candidates that a verification pass then confirms.
+Postings are sharded by trigram: workers fill Partials for consecutive ranges of documents, and
+Merge appends them to the lists shard by shard in parallel.
+*/
+class EtlTrigramIndex
+{
+public:
+    static constexpr size_t SHARD_COUNT = 64;
+    // Lists this many times longer than the current candidates are not intersected; verification is cheaper.
+    static constexpr size_t SKIP_RATIO = 64;
+
+    using Trigram = uint32_t;
+
+    // Trigrams of the documents one worker indexed since the last Merge, in increasing document order.
+    class Partial
+    {
+    public:
+        // Adds the trigrams of a value of the current document. Trigrams do not span values.
+        void AddText(std::string_view text)
+        {
+            if (text.size() < 3)
+                return;
+            Trigram trigram = (static_cast<uint8_t>(EtlLowerAscii(text[0])) << 8) | static_cast<uint8_t>(EtlLowerAscii(text[1]));
+            for (size_t i = 2; i < text.size(); i++) {
+                trigram = ((trigram << 8) | static_cast<uint8_t>(EtlLowerAscii(text[i]))) & 0xFFFFFF;
+                m_current.push_back(trigram);
+            }
+        }
+
+        // Files the trigrams added since the previous document under doc.
+        void EndDocument(uint32_t doc)
+        {
+            std::sort(m_current.begin(), m_current.end());
+            m_current.erase(std::unique(m_current.begin(), m_current.end()), m_current.end());
+            for (Trigram trigram : m_current)
+                m_shards[ShardOf(trigram)][trigram].push_back(doc);
+            m_current.clear();
+        }
+
+    private:
+        friend class EtlTrigramIndex;
+        std::array<std::unordered_map<Trigram, std::vector<uint32_t>>, SHARD_COUNT> m_shards;
+        std::vector<Trigram> m_current;
+    };
+
+    // Registers the next type and returns the number of its first document.
+    uint32_t AddType(const EventIdentifier& id, size_t documentCount)
+    {
+        uint32_t first = m_typeBases.back();
+        if (documentCount > UINT32_MAX - first)
+            throw std::runtime_error("Too many events for the text index");
+        m_types.push_back(id);
+        m_typeBases.push_back(first + static_cast<uint32_t>(documentCount));
+        return first;
+    }
+
+    /*
+    Appends the documents of the partials, which must all follow the documents merged so far,
+    with those of partials[i] preceding those of partials[i + 1]. Empties the partials.
+    */
+    void Merge(std::vector<Partial>& partials, const EtlParallelReader& reader)
+    {
+        reader.ParallelFor(SHARD_COUNT, [&](unsigned, size_t shard) {
+            for (auto& partial : partials) {
+                for (const auto& [trigram, docs] : partial.m_shards[shard]) {
+                    EtlDocList& list = m_shards[shard][trigram];
+                    for (uint32_t doc : docs)
+                        list.Append(doc);
+                }
+                partial.m_shards[shard].clear();
+            }
+        });
+    }
+
+    // Releases the slack of the lists once every document has been merged.
+    void Finish(const EtlParallelReader& reader)
+    {
+        reader.ParallelFor(SHARD_COUNT, [&](unsigned, size_t shard) {
+            for (auto& pair : m_shards[shard])
+                pair.second.ShrinkToFit();
+        });
+    }
+
+    /*
+    Documents containing every trigram of the needle, in increasing order: a superset of the
+    documents containing it. Returns false for needles too short to have a trigram.
+    */
+    bool FindCandidates(std::string_view needle, std::vector<uint32_t>& candidates) const
+    {
+        candidates.clear();
+        if (needle.size() < 3)
+            return false;
+
+        Partial trigrams;
+        trigrams.AddText(needle);
+        std::sort(trigrams.m_current.begin(), trigrams.m_current.end());
+        trigrams.m_current.erase(std::unique(trigrams.m_current.begin(), trigrams.m_current.end()), trigrams.m_current.end());
+        std::vector<const EtlDocList*> lists;
+        for (Trigram trigram : trigrams.m_current) {
+            const auto& shard = m_shards[ShardOf(trigram)];
+            auto it = shard.find(trigram);
+            if (it == shard.end())
+                return true; // No document has this trigram.
+            lists.push_back(&it->second);
+        }
+        std::sort(lists.begin(), lists.end(), [](const EtlDocList* pLhs, const EtlDocList* pRhs) { return pLhs->Size() < pRhs->Size(); });
+
+        candidates.reserve(lists[0]->Size());
+        lists[0]->ForEach([&candidates](uint32_t doc) {
+            candidates.push_back(doc);
+            return true;
+        });
+        for (size_t i = 1; i < lists.size() && !candidates.empty(); i++) {
+            if (lists[i]->Size() / SKIP_RATIO > candidates.size())
+                break;
+            size_t kept = 0;
+            size_t next = 0;
+            lists[i]->ForEach([&](uint32_t doc) {
+                while (next < candidates.size() && candidates[next] < doc)
+                    next++;
+                if (next == candidates.size())
+                    return false;
+                if (candidates[next] == doc)
+                    candidates[kept++] = candidates[next++];
+                return true;
+            });
+            candidates.resize(kept);
+        }
+        return true;
+    }
+
+    size_t GetTypeCount() const { return m_types.size(); }
+    const EventIdentifier& GetType(size_t typeIndex) const { return m_types[typeIndex]; }
+    uint32_t GetFirstDocument(size_t typeIndex) const { return m_typeBases[typeIndex]; }
+    uint32_t GetDocumentCount() const { return m_typeBases.back(); }
+
+    // Index of the type whose documents include doc.
+    size_t TypeOf(uint32_t doc) const
+    {
+        return std::upper_bound(m_typeBases.begin(), m_typeBases.end(), doc) - m_typeBases.begin() - 1;
+    }
+
+    size_t GetTrigramCount() const
+    {
+        size_t count = 0;
+        for (const auto& shard : m_shards)
+            count += shard.size();
+        return count;
+    }
+
+    size_t GetByteSize() const
+    {
+        size_t bytes = 0;
+        for (const auto& shard : m_shards) {
+            for (const auto& pair : shard)
+                bytes += pair.second.ByteSize() + sizeof(pair);
+        }
+        return bytes;
+    }
+
+private:
+    static size_t ShardOf(Trigram trigram) { return (trigram * 0x9E3779B1u) >> 26; }
+
+    std::vector<EventIdentifier> m_types;
+    std::vector<uint32_t> m_typeBases = { 0 }; // First document of each type, then the document count.
+    std::array<std::unordered_map<Trigram, EtlDocList>, SHARD_COUNT> m_shards;
+};
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+/*
+Platform independent mirrors of the few ETW definitions the ETL parsing layer needs.
+On Windows EtlGuid is the SDK's GUID so values can be handed straight to TDH; elsewhere
+it is a layout compatible struct with the same member names.
+*/
+#ifdef _WIN32
+using EtlGuid = GUID;
+#else
+struct EtlGuid {
+    uint32_t Data1;
+    uint16_t Data2;
+    uint16_t Data3;
+    uint8_t Data4[8];
+};
+
+inline bool operator==(const EtlGuid& lhs, const EtlGuid& rhs) {
+    return memcmp(&lhs, &rhs, sizeof(EtlGuid)) == 0;
+}
+#endif
+
+static_assert(sizeof(EtlGuid) == 16, "EtlGuid must match the on-disk GUID layout");
+
+// Values of EVENT_HEADER::Flags (see evntcons.h).
+constexpr uint16_t ETL_HEADER_FLAG_EXTENDED_INFO = 0x0001;
+constexpr uint16_t ETL_HEADER_FLAG_PRIVATE_SESSION = 0x0002;
+constexpr uint16_t ETL_HEADER_FLAG_STRING_ONLY = 0x0004;
+constexpr uint16_t ETL_HEADER_FLAG_TRACE_MESSAGE = 0x0008;
+constexpr uint16_t ETL_HEADER_FLAG_NO_CPUTIME = 0x0010;
+constexpr uint16_t ETL_HEADER_FLAG_32_BIT_HEADER = 0x0020;
+constexpr uint16_t ETL_HEADER_FLAG_64_BIT_HEADER = 0x0040;
+constexpr uint16_t ETL_HEADER_FLAG_CLASSIC_HEADER = 0x0100;
+constexpr uint16_t ETL_HEADER_FLAG_PROCESSOR_INDEX = 0x0200;
+
+// Values of EVENT_HEADER_EXTENDED_DATA_ITEM::ExtType that the reader cares about.
+constexpr uint16_t ETL_EXT_TYPE_EVENT_SCHEMA_TL = 0x000B;
+
+// Well known provider ids.
+constexpr EtlGuid ETL_EVENT_TRACE_GUID = { 0x68fdd900, 0x4a3e, 0x11d1, { 0x84, 0xf4, 0x00, 0x00, 0xf8, 0x04, 0x64, 0xe3 } };
+
+template<typename T>
+inline T EtlRead(const uint8_t* p) {
+    T value;
+    memcpy(&value, p, sizeof(T));
+    return value;
+}
+
+inline bool EtlGuidEquals(const EtlGuid& lhs, const EtlGuid& rhs) {
+    return memcmp(&lhs, &rhs, sizeof(EtlGuid)) == 0;
+}
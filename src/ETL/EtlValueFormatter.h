@@ -0,0 +1,359 @@
+#pragma once
+
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <ETL/DecodePlan.h>
+#include <utils/Utf16ToUtf8.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ETL_FORMATTER_SSE2 1
+#endif
+
+/*
+Native UTF-8 formatting of decoded property values.
+Covers the in-types that make up nearly all real payloads; everything else (value maps, IP
+addresses, ports, XML, error codes...) reports EtlFormatResult::Unsupported so the caller can use
+TdhFormatProperty instead. The formatter never allocates: it writes into a caller supplied buffer
+sized with EtlFormatBound.
+*/
+
+// Mirrors of the _TDH_OUT_TYPE values the native formatter accepts.
+constexpr uint16_t ETL_OUTTYPE_STRING = 1;
+constexpr uint16_t ETL_OUTTYPE_DATETIME = 2;
+constexpr uint16_t ETL_OUTTYPE_BYTE = 3;
+constexpr uint16_t ETL_OUTTYPE_UNSIGNEDLONG = 10;
+constexpr uint16_t ETL_OUTTYPE_FLOAT = 11;
+constexpr uint16_t ETL_OUTTYPE_DOUBLE = 12;
+constexpr uint16_t ETL_OUTTYPE_BOOLEAN = 13;
+constexpr uint16_t ETL_OUTTYPE_GUID = 14;
+constexpr uint16_t ETL_OUTTYPE_HEXBINARY = 15;
+constexpr uint16_t ETL_OUTTYPE_HEXINT8 = 16;
+constexpr uint16_t ETL_OUTTYPE_HEXINT64 = 19;
+constexpr uint16_t ETL_OUTTYPE_PID = 20;
+constexpr uint16_t ETL_OUTTYPE_TID = 21;
+constexpr uint16_t ETL_OUTTYPE_DATETIME_UTC = 38;
+
+enum class EtlFormatResult : uint8_t {
+    Ok,
+    Unsupported,
+    BufferTooSmall,
+};
+
+// Upper bound of the bytes EtlFormatValue can write for the value.
+inline size_t EtlFormatBound(const EtlValue& value)
+{
+    switch (value.m_kind) {
+    case EtlValueKind::UnicodeString: return static_cast<size_t>(value.m_size / 2) * 3;
+    case EtlValueKind::AnsiString: return value.m_size;
+    case EtlValueKind::Binary: return 2 + static_cast<size_t>(value.m_size) * 2;
+    case EtlValueKind::Sid: return 16 + static_cast<size_t>(value.m_size) * 3; // "S-1-" + up to 15 digits per sub authority
+    default: return 64;
+    }
+}
+
+namespace EtlFormatDetail {
+
+inline char* WriteHexDigits(char* p, uint64_t value, unsigned digits)
+{
+    static const char HEX[] = "0123456789ABCDEF";
+    for (unsigned i = digits; i-- > 0; value >>= 4)
+        p[i] = HEX[value & 0xF];
+    return p + digits;
+}
+
+inline char* WriteHex(char* p, uint64_t value)
+{
+    *p++ = '0';
+    *p++ = 'x';
+    unsigned digits = 1;
+    while (digits < 16 && (value >> (digits * 4)) != 0)
+        digits++;
+    return WriteHexDigits(p, value, digits);
+}
+
+inline char* WriteBool(char* p, bool value)
+{
+    memcpy(p, value ? "true" : "false", value ? 4 : 5);
+    return p + (value ? 4 : 5);
+}
+
+inline char* WriteDigits(char* p, uint64_t value, unsigned digits)
+{
+    for (unsigned i = digits; i-- > 0; value /= 10)
+        p[i] = static_cast<char>('0' + value % 10);
+    return p + digits;
+}
+
+// Uppercase hex of size bytes, 16 bytes per iteration when SSE2 is available.
+inline char* WriteHexBytes(char* p, const uint8_t* pData, size_t size)
+{
+    size_t i = 0;
+#ifdef ETL_FORMATTER_SSE2
+    const __m128i mask = _mm_set1_epi8(0x0F);
+    const __m128i nine = _mm_set1_epi8(9);
+    const __m128i zero = _mm_set1_epi8('0');
+    const __m128i letterGap = _mm_set1_epi8('A' - '0' - 10);
+    for (; i + 16 <= size; i += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pData + i));
+        __m128i hi = _mm_and_si128(_mm_srli_epi16(bytes, 4), mask);
+        __m128i lo = _mm_and_si128(bytes, mask);
+        __m128i first = _mm_unpacklo_epi8(hi, lo);
+        __m128i second = _mm_unpackhi_epi8(hi, lo);
+        first = _mm_add_epi8(_mm_add_epi8(first, zero), _mm_and_si128(_mm_cmpgt_epi8(first, nine), letterGap));
+        second = _mm_add_epi8(_mm_add_epi8(second, zero), _mm_and_si128(_mm_cmpgt_epi8(second, nine), letterGap));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p), first);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p + 16), second);
+        p += 32;
+    }
+#endif
+    for (; i < size; i++)
+        p = WriteHexDigits(p, pData[i], 2);
+    return p;
+}
+
+// UTF-16LE to UTF-8; unpaired surrogates become U+FFFD.
+inline char* WriteUtf16(char* p, const uint8_t* pData, size_t units)
+{
+    return p + Utf16ToUtf8(pData, units, p);
+}
+
+inline char* WriteGuid(char* p, const uint8_t* pData)
+{
+    *p++ = '{';
+    p = WriteHexDigits(p, EtlRead<uint32_t>(pData), 8);
+    *p++ = '-';
+    p = WriteHexDigits(p, EtlRead<uint16_t>(pData + 4), 4);
+    *p++ = '-';
+    p = WriteHexDigits(p, EtlRead<uint16_t>(pData + 6), 4);
+    *p++ = '-';
+    p = WriteHexBytes(p, pData + 8, 2);
+    *p++ = '-';
+    p = WriteHexBytes(p, pData + 10, 6);
+    *p++ = '}';
+    return p;
+}
+
+// yyyy-mm-ddThh:mm:ss followed by the given fraction digits.
+inline char* WriteDateTime(char* p, unsigned year, unsigned month, unsigned day, unsigned hour, unsigned minute, unsigned second)
+{
+    p = WriteDigits(p, year, 4);
+    *p++ = '-';
+    p = WriteDigits(p, month, 2);
+    *p++ = '-';
+    p = WriteDigits(p, day, 2);
+    *p++ = 'T';
+    p = WriteDigits(p, hour, 2);
+    *p++ = ':';
+    p = WriteDigits(p, minute, 2);
+    *p++ = ':';
+    return WriteDigits(p, second, 2);
+}
+
+// FILETIME (100ns ticks since 1601-01-01 UTC) as ISO 8601 with 7 fraction digits.
+inline char* WriteFileTime(char* p, uint64_t fileTime)
+{
+    uint64_t seconds = fileTime / 10000000;
+    uint64_t fraction = fileTime % 10000000;
+    int64_t days = static_cast<int64_t>(seconds / 86400) - 134774; // Days from 1970-01-01.
+    uint64_t secondOfDay = seconds % 86400;
+
+    // Civil date from days since the Unix epoch (Howard Hinnant's algorithm).
+    days += 719468;
+    int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    unsigned doe = static_cast<unsigned>(days - era * 146097);
+    unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    unsigned mp = (5 * doy + 2) / 153;
+    unsigned day = doy - (153 * mp + 2) / 5 + 1;
+    unsigned month = mp < 10 ? mp + 3 : mp - 9;
+    unsigned year = static_cast<unsigned>(yoe + era * 400 + (month <= 2 ? 1 : 0));
+
+    p = WriteDateTime(p, year, month, day, static_cast<unsigned>(secondOfDay / 3600),
+        static_cast<unsigned>(secondOfDay / 60 % 60), static_cast<unsigned>(secondOfDay % 60));
+    *p++ = '.';
+    p = WriteDigits(p, fraction, 7);
+    *p++ = 'Z';
+    return p;
+}
+
+// SYSTEMTIME: wYear, wMonth, wDayOfWeek, wDay, wHour, wMinute, wSecond, wMilliseconds.
+inline char* WriteSystemTime(char* p, const uint8_t* pData)
+{
+    p = WriteDateTime(p, EtlRead<uint16_t>(pData) % 10000, EtlRead<uint16_t>(pData + 2) % 100, EtlRead<uint16_t>(pData + 6) % 100,
+        EtlRead<uint16_t>(pData + 8) % 100, EtlRead<uint16_t>(pData + 10) % 100, EtlRead<uint16_t>(pData + 12) % 100);
+    *p++ = '.';
+    return WriteDigits(p, EtlRead<uint16_t>(pData + 14) % 1000, 3);
+}
+
+// S-Revision-Authority-SubAuthority...
+inline char* WriteSid(char* p, char* pEnd, const uint8_t* pData, uint32_t size)
+{
+    uint64_t authority = 0;
+    for (int i = 2; i < 8; i++)
+        authority = (authority << 8) | pData[i];
+    *p++ = 'S';
+    *p++ = '-';
+    p = std::to_chars(p, pEnd, pData[0]).ptr;
+    *p++ = '-';
+    p = std::to_chars(p, pEnd, authority).ptr;
+    for (uint32_t offset = 8; offset + 4 <= size; offset += 4) {
+        *p++ = '-';
+        p = std::to_chars(p, pEnd, EtlRead<uint32_t>(pData + offset)).ptr;
+    }
+    return p;
+}
+
+} // namespace EtlFormatDetail
+
+/*
+Formats a decoded scalar value as UTF-8 into [pBuffer, pBuffer + capacity).
+On success *pWritten receives the number of bytes written (no terminator is added).
+*/
+inline EtlFormatResult EtlFormatValue(const EtlValue& value, char* pBuffer, size_t capacity, size_t* pWritten)
+{
+    using namespace EtlFormatDetail;
+
+    if (capacity < EtlFormatBound(value))
+        return EtlFormatResult::BufferTooSmall;
+
+    char* p = pBuffer;
+    char* pEnd = pBuffer + capacity;
+    uint16_t outType = value.m_outType;
+
+    switch (value.m_inType) {
+    case ETL_INTYPE_INT8:
+    case ETL_INTYPE_INT16:
+    case ETL_INTYPE_INT32:
+    case ETL_INTYPE_INT64:
+        if (outType >= ETL_OUTTYPE_HEXINT8 && outType <= ETL_OUTTYPE_HEXINT64)
+            p = WriteHex(p, static_cast<uint64_t>(value.m_int) & (~0ull >> (64 - 8 * value.m_size)));
+        else if (outType == ETL_OUTTYPE_NULL || (outType >= ETL_OUTTYPE_BYTE && outType <= ETL_OUTTYPE_UNSIGNEDLONG))
+            p = std::to_chars(p, pEnd, value.m_int).ptr;
+        else
+            return EtlFormatResult::Unsupported;
+        break;
+
+    case ETL_INTYPE_UINT8:
+    case ETL_INTYPE_UINT16:
+    case ETL_INTYPE_UINT32:
+    case ETL_INTYPE_UINT64:
+        if (outType >= ETL_OUTTYPE_HEXINT8 && outType <= ETL_OUTTYPE_HEXINT64)
+            p = WriteHex(p, value.m_uint);
+        else if (outType == ETL_OUTTYPE_NULL || (outType >= ETL_OUTTYPE_BYTE && outType <= ETL_OUTTYPE_UNSIGNEDLONG) ||
+            outType == ETL_OUTTYPE_PID || outType == ETL_OUTTYPE_TID)
+            p = std::to_chars(p, pEnd, value.m_uint).ptr;
+        else if (outType == ETL_OUTTYPE_BOOLEAN)
+            p = WriteBool(p, value.m_uint != 0);
+        else
+            return EtlFormatResult::Unsupported;
+        break;
+
+    case ETL_INTYPE_HEXINT32:
+    case ETL_INTYPE_HEXINT64:
+    case ETL_INTYPE_POINTER:
+    case ETL_INTYPE_SIZET:
+        if (outType != ETL_OUTTYPE_NULL && !(outType >= ETL_OUTTYPE_HEXINT8 && outType <= ETL_OUTTYPE_HEXINT64))
+            return EtlFormatResult::Unsupported;
+        if (value.m_inType == ETL_INTYPE_POINTER) {
+            *p++ = '0';
+            *p++ = 'x';
+            p = WriteHexDigits(p, value.m_uint, value.m_size * 2);
+        }
+        else {
+            p = WriteHex(p, value.m_uint);
+        }
+        break;
+
+    case ETL_INTYPE_FLOAT:
+    case ETL_INTYPE_DOUBLE:
+        if (outType != ETL_OUTTYPE_NULL && outType != ETL_OUTTYPE_FLOAT && outType != ETL_OUTTYPE_DOUBLE)
+            return EtlFormatResult::Unsupported;
+        if (value.m_inType == ETL_INTYPE_FLOAT)
+            p = std::to_chars(p, pEnd, static_cast<float>(value.m_double)).ptr;
+        else
+            p = std::to_chars(p, pEnd, value.m_double).ptr;
+        break;
+
+    case ETL_INTYPE_BOOLEAN:
+        if (outType != ETL_OUTTYPE_NULL && outType != ETL_OUTTYPE_BOOLEAN)
+            return EtlFormatResult::Unsupported;
+        p = WriteBool(p, value.m_uint != 0);
+        break;
+
+    case ETL_INTYPE_GUID:
+        if (outType != ETL_OUTTYPE_NULL && outType != ETL_OUTTYPE_GUID)
+            return EtlFormatResult::Unsupported;
+        p = WriteGuid(p, value.m_pData);
+        break;
+
+    // DATETIME asks for local time in the user's locale, which only TdhFormatProperty gets right;
+    // formatting it here as UTC would give one column two formats depending on who wrote the cell.
+    case ETL_INTYPE_FILETIME:
+        if (outType != ETL_OUTTYPE_NULL && outType != ETL_OUTTYPE_DATETIME_UTC)
+            return EtlFormatResult::Unsupported;
+        p = WriteFileTime(p, value.m_uint);
+        break;
+
+    case ETL_INTYPE_SYSTEMTIME:
+        if (outType != ETL_OUTTYPE_NULL && outType != ETL_OUTTYPE_DATETIME_UTC)
+            return EtlFormatResult::Unsupported;
+        p = WriteSystemTime(p, value.m_pData);
+        break;
+
+    case ETL_INTYPE_SID:
+    case ETL_INTYPE_WBEMSID:
+        if (outType != ETL_OUTTYPE_NULL)
+            return EtlFormatResult::Unsupported;
+        p = WriteSid(p, pEnd, value.m_pData, value.m_size);
+        break;
+
+    case ETL_INTYPE_UNICODECHAR:
+        if (outType != ETL_OUTTYPE_NULL && outType != ETL_OUTTYPE_STRING)
+            return EtlFormatResult::Unsupported;
+        p = WriteUtf16(p, value.m_pData, 1);
+        break;
+
+    case ETL_INTYPE_ANSICHAR:
+        if (outType != ETL_OUTTYPE_NULL && outType != ETL_OUTTYPE_STRING)
+            return EtlFormatResult::Unsupported;
+        *p++ = static_cast<char>(value.m_uint);
+        break;
+
+    case ETL_INTYPE_BINARY:
+    case ETL_INTYPE_MANIFEST_COUNTEDBINARY:
+    case ETL_INTYPE_HEXDUMP:
+        if (outType != ETL_OUTTYPE_NULL && outType != ETL_OUTTYPE_HEXBINARY)
+            return EtlFormatResult::Unsupported;
+        *p++ = '0';
+        *p++ = 'x';
+        p = WriteHexBytes(p, value.m_pData, value.m_size);
+        break;
+
+    default:
+        if (value.m_kind == EtlValueKind::UnicodeString) {
+            if (outType != ETL_OUTTYPE_NULL && outType != ETL_OUTTYPE_STRING)
+                return EtlFormatResult::Unsupported;
+            p = WriteUtf16(p, value.m_pData, value.m_size / 2);
+        }
+        else if (value.m_kind == EtlValueKind::AnsiString) {
+            // Only ASCII is passed through; other code pages need the TDH conversion.
+            if (outType != ETL_OUTTYPE_NULL && outType != ETL_OUTTYPE_STRING)
+                return EtlFormatResult::Unsupported;
+            for (uint32_t i = 0; i < value.m_size; i++) {
+                if (value.m_pData[i] & 0x80)
+                    return EtlFormatResult::Unsupported;
+            }
+            memcpy(p, value.m_pData, value.m_size);
+            p += value.m_size;
+        }
+        else {
+            return EtlFormatResult::Unsupported;
+        }
+        break;
+    }
+
+    *pWritten = static_cast<size_t>(p - pBuffer);
+    return EtlFormatResult::Ok;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <unordered_map>
+#include <ETL/EtlTypes.h>
+
+// Structure to uniquely identify an event
+struct EventIdentifier {
+    EventIdentifier() : m_providerId{}, m_id(0), m_version(0), padding(0) {
+
+    }
+
+    EventIdentifier(EtlGuid providerId, uint16_t id, uint8_t version) : padding(0) {
+        this->m_providerId = providerId;
+        this->m_id = id;
+        this->m_version = version;
+    }
+
+
+    EtlGuid m_providerId;
+    uint16_t m_id;
+    uint8_t m_version;
+    uint8_t padding; //Must explicitly pad otherwise memcmp won't work.
+};
+
+// Equality operator for EventIdentifier
+inline bool operator==(const EventIdentifier& lhs, const EventIdentifier& rhs) {
+    bool result = memcmp(reinterpret_cast<const void*>(&lhs), reinterpret_cast<const void*>(&rhs), sizeof(lhs)) == 0;
+    return result;
+}
+
+// Hash function for EventIdentifier
+inline size_t HashEventIdentifier(const EventIdentifier& id) {
+    size_t h1 = std::hash<uint32_t>{}(id.m_providerId.Data1);
+    size_t h2 = std::hash<uint16_t>{}(id.m_providerId.Data2);
+    size_t h3 = std::hash<uint16_t>{}(id.m_providerId.Data3);
+
+    size_t h4 = 0;
+    for (size_t i = 0; i < sizeof(id.m_providerId.Data4); ++i) {
+        h4 = (h4 << 8) | id.m_providerId.Data4[i];
+    }
+
+    size_t result = h1 ^ (h2 << 1) ^ (h3 << 2) ^ (h4 << 3) ^ (std::hash<uint16_t>{}(id.m_id) << 4) ^ (std::hash<uint8_t>{}(id.m_version) << 5);
+    return result;
+}
+
+// Specialize std::hash for EventIdentifier
+namespace std {
+    template <>
+    struct hash<EventIdentifier> {
+        std::size_t operator()(const EventIdentifier& id) const {
+            return HashEventIdentifier(id);
+        }
+    };
+}
+
+// Specialize std::equals for EventIdentifier
+struct EventIdentifierEqual {
+    inline bool operator()(const EventIdentifier& lhs, const EventIdentifier& rhs) const {
+        bool result = memcmp(reinterpret_cast<const void*>(&lhs), reinterpret_cast<const void*>(&rhs), sizeof(lhs)) == 0;
+        return result;
+    }
+};
+
+template<typename T>
+using EventIdentifierMap = std::unordered_map<EventIdentifier, T, std::hash<EventIdentifier>, EventIdentifierEqual>;
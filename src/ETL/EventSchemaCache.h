@@ -0,0 +1,224 @@
+#pragma once
+
+#include <Windows.h>
+#include <tdh.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+#include <ETL/DecodePlan.h>
+#include <ETL/EventIdentifier.h>
+
+/*
+Decoding information for one event schema: the TRACE_EVENT_INFO returned by
+TdhGetEventInformation, every value map referenced by its properties and the
+compiled DecodePlan for its top-level properties.
+Immutable once built, so it can be shared by all decoders.
+*/
+struct EventSchema
+{
+    ULONG m_status = ERROR_SUCCESS; // Result of TdhGetEventInformation; failures are cached too.
+    std::vector<BYTE> m_teiBuffer;
+    std::unordered_map<ULONG, std::vector<BYTE>> m_maps; // Keyed by MapNameOffset.
+    DecodePlan m_plan; // Invalid if the schema uses structures or unsupported types.
+
+    TRACE_EVENT_INFO const* Tei() const
+    {
+        return reinterpret_cast<TRACE_EVENT_INFO const*>(m_teiBuffer.data());
+    }
+
+    _Ret_z_ LPCWSTR TeiString(unsigned offset) const
+    {
+        return reinterpret_cast<LPCWSTR>(m_teiBuffer.data() + offset);
+    }
+
+    PEVENT_MAP_INFO FindMap(ULONG mapNameOffset) const
+    {
+        auto it = m_maps.find(mapNameOffset);
+        if (it == m_maps.end())
+            return nullptr;
+        return reinterpret_cast<PEVENT_MAP_INFO>(const_cast<BYTE*>(it->second.data()));
+    }
+};
+
+/*
+Identifies the schema of an event.
+The EventIdentifier alone is not enough for classic (MOF) events, which share Id 0 and are told
+apart by opcode, nor for TraceLogging events, which carry their schema in extended data.
+*/
+struct EventSchemaKey
+{
+    EventIdentifier m_id;
+    uint64_t m_opcode;     // Only set for classic events.
+    uint64_t m_schemaHash; // Only set for TraceLogging events.
+};
+
+inline bool operator==(const EventSchemaKey& lhs, const EventSchemaKey& rhs)
+{
+    return lhs.m_id == rhs.m_id && lhs.m_opcode == rhs.m_opcode && lhs.m_schemaHash == rhs.m_schemaHash;
+}
+
+struct EventSchemaKeyHash
+{
+    size_t operator()(const EventSchemaKey& key) const
+    {
+        return HashEventIdentifier(key.m_id) ^ (std::hash<uint64_t>{}(key.m_opcode) << 7) ^ (std::hash<uint64_t>{}(key.m_schemaHash) << 11);
+    }
+};
+
+/*
+Thread safe cache of EventSchema objects shared by every DecoderContext.
+Lookups take a shared lock; only the first event of a schema pays for the TDH calls.
+Schemas are never evicted, so raw pointers to them stay valid for the lifetime of the cache.
+*/
+class EventSchemaCache
+{
+public:
+    static EventSchemaKey MakeKey(EVENT_RECORD const* pEvent)
+    {
+        EventSchemaKey key{ EventIdentifier{ pEvent->EventHeader.ProviderId, pEvent->EventHeader.EventDescriptor.Id, pEvent->EventHeader.EventDescriptor.Version }, 0, 0 };
+        if (pEvent->EventHeader.Flags & EVENT_HEADER_FLAG_CLASSIC_HEADER)
+            key.m_opcode = pEvent->EventHeader.EventDescriptor.Opcode;
+        for (USHORT i = 0; i < pEvent->ExtendedDataCount; i++)
+        {
+            EVENT_HEADER_EXTENDED_DATA_ITEM const& item = pEvent->ExtendedData[i];
+            if (item.ExtType == EVENT_HEADER_EXT_TYPE_EVENT_SCHEMA_TL)
+                key.m_schemaHash = HashBytes(reinterpret_cast<BYTE const*>(item.DataPtr), item.DataSize);
+        }
+        return key;
+    }
+
+    /*
+    Returns the schema for the event, building it on a miss.
+    */
+    std::shared_ptr<const EventSchema> Get(EVENT_RECORD* pEvent, ULONG tdhContextCount, PTDH_CONTEXT pTdhContext)
+    {
+        EventSchemaKey key = MakeKey(pEvent);
+        {
+            std::shared_lock lock(m_lock);
+            auto it = m_schemas.find(key);
+            if (it != m_schemas.end())
+            {
+                m_hits.fetch_add(1, std::memory_order_relaxed);
+                return it->second;
+            }
+        }
+
+        m_misses.fetch_add(1, std::memory_order_relaxed);
+        std::shared_ptr<const EventSchema> pSchema = Build(pEvent, tdhContextCount, pTdhContext);
+        std::unique_lock lock(m_lock);
+        return m_schemas.try_emplace(key, std::move(pSchema)).first->second;
+    }
+
+    uint64_t GetHitCount() const { return m_hits.load(std::memory_order_relaxed); }
+    uint64_t GetMissCount() const { return m_misses.load(std::memory_order_relaxed); }
+
+    size_t Size() const
+    {
+        std::shared_lock lock(m_lock);
+        return m_schemas.size();
+    }
+
+private:
+    static uint64_t HashBytes(BYTE const* pData, size_t size)
+    {
+        uint64_t hash = 14695981039346656037ull; // FNV-1a
+        for (size_t i = 0; i < size; i++)
+        {
+            hash ^= pData[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    static std::shared_ptr<const EventSchema> Build(EVENT_RECORD* pEvent, ULONG tdhContextCount, PTDH_CONTEXT pTdhContext)
+    {
+        auto pSchema = std::make_shared<EventSchema>();
+
+        ULONG cb = 0;
+        pSchema->m_status = TdhGetEventInformation(pEvent, tdhContextCount, pTdhContext, nullptr, &cb);
+        if (pSchema->m_status == ERROR_INSUFFICIENT_BUFFER)
+        {
+            pSchema->m_teiBuffer.resize(cb);
+            pSchema->m_status = TdhGetEventInformation(pEvent, tdhContextCount, pTdhContext,
+                reinterpret_cast<TRACE_EVENT_INFO*>(pSchema->m_teiBuffer.data()), &cb);
+        }
+        if (pSchema->m_status != ERROR_SUCCESS)
+        {
+            pSchema->m_teiBuffer.clear();
+            return pSchema;
+        }
+
+        // Resolve every value map up front so the schema never changes after it is published.
+        TRACE_EVENT_INFO const* pTei = pSchema->Tei();
+        for (ULONG i = 0; i < pTei->PropertyCount; i++)
+        {
+            EVENT_PROPERTY_INFO const& epi = pTei->EventPropertyInfoArray[i];
+            if ((epi.Flags & PropertyStruct) || epi.nonStructType.MapNameOffset == 0)
+                continue;
+            switch (epi.nonStructType.InType)
+            {
+            case TDH_INTYPE_UINT8:
+            case TDH_INTYPE_UINT16:
+            case TDH_INTYPE_UINT32:
+            case TDH_INTYPE_HEXINT32:
+                break;
+            default:
+                continue;
+            }
+            if (pSchema->m_maps.contains(epi.nonStructType.MapNameOffset))
+                continue;
+
+            std::vector<BYTE> mapBuffer(sizeof(EVENT_MAP_INFO));
+            for (;;)
+            {
+                ULONG cbBuffer = static_cast<ULONG>(mapBuffer.size());
+                ULONG status = TdhGetEventMapInformation(
+                    pEvent,
+                    const_cast<LPWSTR>(pSchema->TeiString(epi.nonStructType.MapNameOffset)),
+                    reinterpret_cast<PEVENT_MAP_INFO>(mapBuffer.data()),
+                    &cbBuffer);
+
+                if (status == ERROR_INSUFFICIENT_BUFFER && mapBuffer.size() < cbBuffer)
+                {
+                    mapBuffer.resize(cbBuffer);
+                    continue;
+                }
+                else if (status == ERROR_SUCCESS)
+                {
+                    pSchema->m_maps.emplace(epi.nonStructType.MapNameOffset, std::move(mapBuffer));
+                }
+                break;
+            }
+        }
+
+        pSchema->m_plan = CompilePlan(pTei);
+        return pSchema;
+    }
+
+    static DecodePlan CompilePlan(TRACE_EVENT_INFO const* pTei)
+    {
+        std::vector<EtlPropertyDesc> properties(pTei->TopLevelPropertyCount);
+        for (ULONG i = 0; i < pTei->TopLevelPropertyCount; i++)
+        {
+            EVENT_PROPERTY_INFO const& epi = pTei->EventPropertyInfoArray[i];
+            if (epi.Flags & PropertyStruct)
+                return DecodePlan{};
+            properties[i] = EtlPropertyDesc{
+                epi.nonStructType.InType,
+                epi.nonStructType.OutType,
+                static_cast<uint32_t>(epi.Flags),
+                epi.length,
+                epi.count,
+                epi.nonStructType.MapNameOffset != 0 };
+        }
+        return DecodePlan::Compile(properties);
+    }
+
+    mutable std::shared_mutex m_lock;
+    std::unordered_map<EventSchemaKey, std::shared_ptr<const EventSchema>, EventSchemaKeyHash> m_schemas;
+    std::atomic<uint64_t> m_hits = 0;
+    std::atomic<uint64_t> m_misses = 0;
+};
@@ -16,6 +16,7 @@
 #endif
 
 #include "imgui/imgui_internal.h"
+#include "implot/implot.h"
 #include <D3DWrappers/CommandAllocatorWrapper.h>
 #include <D3DWrappers/CommandListWrapper.h>
 #include <D3DWrappers/FenceWrapper.h>
@@ -36,128 +37,199 @@
 #include <unordered_map>
 #include <sqlite3/sqlite3.h>
 #include <filesystem>
-#include <utils/TaskHandler.h>
+#include <chrono>
+#include <future>
+#include <utils/QueryScheduler.h>
+#include <ETL/EtlEventRecord.h>
+#include <ETL/EtlParallelReader.h>
+#include <ETL/EventIdentifier.h>
+#include <ETL/EtlOccurrenceIndex.h>
+#include <ETL/EventSchemaCache.h>
+#include <ETL/EtlValueFormatter.h>
+#include <ETL/EtlColumnTable.h>
+#include <ETL/EtlFilter.h>
+#include <ETL/EtlTrigramIndex.h>
+#include <ETL/EtlTimePyramid.h>
+#include <ETL/EtlTimeIndex.h>
+#include <ETL/EtlSidecarIndex.h>
+#include <ETL/EtlTraceDatabase.h>
+#include <ETL/EtlMemoryDatabase.h>
+#include <utils/StringPool.h>
+#include <utils/Utf16ToUtf8.h>
+#include <utils/PageCache.h>
+#include <utils/TableRowSource.h>
+#include <utils/TableSortIndex.h>
 
 // Link with Tdh.lib and Advapi32.lib
 #pragma comment(lib, "tdh.lib")
 #pragma comment(lib, "advapi32.lib")
 
-template<typename T>
-T coalesce(T first) {
-    return first;
-}
+// Structure to hold event metadata
+struct EventMetadata {
+    //Below need to remain contiguous
+    GUID m_providerId;
+    USHORT m_eventId;
+    UCHAR m_version;
+    UCHAR padding;
+    //Above need to remain contiguous
+    std::string m_decodingSource;
+    // Names are UTF-8 strings in g_stringPool.
+    StringPool::Id m_providerName;
+    StringPool::Id m_levelName;
+    StringPool::Id m_channelName;
+    StringPool::Id m_keywordsName;
+    StringPool::Id m_providerMessage;
+    StringPool::Id m_eventMessage;
+    GUID m_providerGuid;
+    StringPool::Id m_taskName;
+    StringPool::Id m_opCodeName;
+    std::vector<std::pair<StringPool::Id, StringPool::Id>> m_properties; // Name and type.
+    StringPool::Id m_displayLabel; // ImGui label of the metadata row, built once before the first frame.
+};
 
-template<typename T, typename... Args>
-T coalesce(T first, Args... args) {
-    return first != 0 ? first : coalesce(args...);
-}
+/*
+One event of a query result. Only the payload span inside the mapped trace and the schema to
+decode it with are kept; DecoderContext::FormatEventRow formats a row when the table shows it.
+*/
+struct EventRow {
+    uint64_t m_timestamp;
+    const EventSchema* m_pSchema; // Owned by the EventSchemaCache.
+    const BYTE* m_pUserData;      // Points into the mapped trace file.
+    USHORT m_userDataLength;
+    USHORT m_flags;               // EVENT_HEADER::Flags.
+};
 
-// Structure to uniquely identify an event
-struct EventIdentifier {
-    EventIdentifier() : m_providerId{}, m_id(0), m_version(0), padding(0) {
+// Request for a page of decoded instances of one event type, starting at the cursor-th occurrence.
+struct EventPageQuery {
+    EventIdentifier m_id;
+    uint64_t m_cursor;
+    uint32_t m_pageSize;
+};
 
-    }
+struct EventPage {
+    EventIdentifier m_id;
+    uint64_t m_cursor;
+    uint64_t m_nextCursor; // Cursor to continue from, equal to m_totalCount at the end.
+    uint64_t m_totalCount;
+    std::vector<EventRow> m_rows;
+};
 
-    EventIdentifier(GUID providerId, USHORT id, UCHAR version) : padding(0) {
-        this->m_providerId = providerId;
-        this->m_id = id;
-        this->m_version = version;
-    }
+static uint32_t const EVENT_PAGE_SIZE = 256;
+static size_t const EVENT_PAGE_CACHE_CAPACITY = 64;
+static size_t const FORMATTED_ROW_CACHE_CAPACITY = 512;
+static size_t const COLUMN_TABLE_BATCH_ROWS = 1 << 16; // Rows per batch streamed to the UI while a type is decoded.
+static size_t const SQL_CONSOLE_MAX_ROWS = 100000; // Result rows kept by the SQL console; the rest are counted as truncated.
+static size_t const SQL_CONSOLE_MAX_COLUMNS = 64; // Columns shown; ImGui tables are limited.
+static size_t const SQL_CONSOLE_TEXT_CAPACITY = 1 << 14;
+static size_t const FILTER_BATCH_ROWS = 1 << 16; // Occurrences tested per batch of a filter scan; matches are streamed after each.
+static size_t const FILTER_TEXT_CAPACITY = 1024;
+static size_t const TEXT_INDEX_BATCH_ROWS = 1 << 16; // Events whose text is indexed before the workers' postings are merged.
+static size_t const TEXT_SEARCH_MAX_MATCHES = 10000; // Matching events listed by a text search; the rest are only counted.
+static size_t const TEXT_SEARCH_SNIPPET_BYTES = 200;
+static size_t const TEXT_SEARCH_TEXT_CAPACITY = 256;
+static size_t const WINDOW_MAX_EVENTS = 100000; // Events of the time window listed in time order; a longer window is cut.
+
+// Every decoded instance of one event type, built in the background when the type is selected.
+// A batch of the column table of a type, streamed while the type is decoded. The last result has m_done set.
+struct ColumnTableResult {
+    EventIdentifier m_id;
+    std::shared_ptr<const EtlColumnTable> m_pBatch; // Rows that follow the previous batch; may be null.
+    bool m_done;
+};
 
+// Request for the occurrences of a type that match a filter.
+struct FilterQuery {
+    EventIdentifier m_id;
+    std::shared_ptr<const EtlFilter> m_pFilter;
+};
 
-    GUID m_providerId;
-    USHORT m_id;
-    UCHAR m_version;
-    UCHAR padding; //Must explicitly pad otherwise memcmp won't work.
+// Matching occurrences of a batch of a filter scan, in increasing order. The last result has m_done set.
+struct FilterResult {
+    EventIdentifier m_id;
+    std::vector<uint32_t> m_matches;
+    uint64_t m_scanned; // Occurrences scanned so far.
+    uint64_t m_decoded; // Of those, how many the header fields alone could not settle.
+    bool m_done;
 };
 
-// Equality operator for EventIdentifier
-bool operator==(const EventIdentifier& lhs, const EventIdentifier& rhs) {
-    bool result = memcmp(reinterpret_cast<const void*>(&lhs), reinterpret_cast<const void*>(&rhs), sizeof(lhs)) == 0;
-    return result;
-}
+struct TextSearchQuery {
+    std::string m_text;
+    std::shared_ptr<const EtlTrigramIndex> m_pIndex;
+};
 
-// Hash function for EventIdentifier
-static size_t HashEventIdentifier(const EventIdentifier& id) {
-    size_t h1 = std::hash<unsigned long>{}(id.m_providerId.Data1);
-    size_t h2 = std::hash<unsigned short>{}(id.m_providerId.Data2);
-    size_t h3 = std::hash<unsigned short>{}(id.m_providerId.Data3);
+// An event whose text contains the searched string.
+struct TextSearchMatch {
+    EventIdentifier m_id;
+    uint64_t m_ordinal; // Occurrence of the event in its type.
+    int64_t m_timestamp;
+    std::string m_text; // Part of the value around the match.
+};
 
-    size_t h4 = 0;
-    for (int i = 0; i < sizeof(id.m_providerId.Data4); ++i) {
-        h4 = (h4 << 8) | id.m_providerId.Data4[i];
-    }
+struct TextSearchResult {
+    std::vector<TextSearchMatch> m_matches;                    // In type order, at most TEXT_SEARCH_MAX_MATCHES.
+    std::vector<std::pair<EventIdentifier, uint64_t>> m_types; // Matching events per type, most first.
+    uint64_t m_matchCount = 0;
+    uint64_t m_candidateCount = 0; // Events the index could not rule out.
+    double m_milliseconds = 0.0;
+    std::string m_error;
+};
 
-    size_t result = h1 ^ (h2 << 1) ^ (h3 << 2) ^ (h4 << 3) ^ (std::hash<USHORT>{}(id.m_id) << 4) ^ (std::hash<UCHAR>{}(id.m_version) << 5);
-    return result;
-}
+// Request for the events of every type in the timestamps [m_begin, m_end).
+struct WindowQuery {
+    int64_t m_begin;
+    int64_t m_end;
+};
 
-// Specialize std::hash for EventIdentifier
-namespace std {
-    template <>
-    struct hash<EventIdentifier> {
-        std::size_t operator()(const EventIdentifier& id) const {
-            return HashEventIdentifier(id);
-        }
-    };
-}
+// Events of a time window in time order, with their times converted in bulk.
+struct WindowResult {
+    std::vector<EventIdentifier> m_ids;
+    std::vector<int64_t> m_timestamps;
+    std::vector<double> m_seconds;    // From the start of the trace.
+    std::vector<int64_t> m_fileTimes; // Wall time; only valid if the trace has a header.
+    size_t m_bufferCount = 0;         // Buffers read.
+    bool m_truncated = false;
+    double m_milliseconds = 0.0;
+};
 
-// Specialize std::equals for EventIdentifier
-namespace {
-    struct EventIdentifierEqual {
-        __forceinline bool operator()(const EventIdentifier& lhs, const EventIdentifier& rhs) const {
-            bool result = memcmp(reinterpret_cast<const void*>(&lhs), reinterpret_cast<const void*>(&rhs), sizeof(lhs)) == 0;
-            return result;
-        }
-    };
-}
+// Timings of the queries for the selected type, shown under the table stats.
+struct SelectionTimings {
+    std::chrono::steady_clock::time_point m_start;
+    double m_firstRowMs = -1.0; // Until the first page of rows arrived.
+    double m_tableMs = -1.0;    // Until the column table was complete.
+    uint64_t m_tableRows = 0;
 
-// Structure to hold event metadata
-struct EventMetadata {
-    //Below need to remain contiguous
-    GUID m_providerId;
-    USHORT m_eventId;
-    UCHAR m_version;
-    UCHAR padding;
-    //Above need to remain contiguous
-    std::string m_decodingSource;
-    std::wstring m_providerName;
-    std::wstring m_levelName;
-    std::wstring m_channelName;
-    std::wstring m_keywordsName;
-    std::wstring m_providerMessage;
-    std::wstring m_eventMessage;
-    GUID m_providerGuid;
-    std::wstring m_taskName;
-    std::wstring m_opCodeName;
-    std::vector<std::pair<std::wstring, std::string>> m_properties;
-};
+    double ElapsedMs() const { return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_start).count(); }
 
-struct EventData {
-    //Below need to remain contiguous
-    GUID m_providerId;
-    USHORT m_eventId;
-    UCHAR m_version;
-    UCHAR padding;
-    //Above need to remain contiguous
-    uint64_t timestamp;
-    std::vector<std::pair<std::wstring, std::wstring>> m_properties;
+    double RowsPerSecond() const
+    {
+        double ms = m_tableMs >= 0.0 ? m_tableMs : ElapsedMs();
+        return ms > 0.0 ? m_tableRows * 1000.0 / ms : 0.0;
+    }
 };
 
+using PageScheduler = QueryScheduler<EventPageQuery, EventPage>;
+using TableScheduler = QueryScheduler<EventIdentifier, ColumnTableResult>;
+using SqlScheduler = QueryScheduler<std::string, EtlSqlResult>;
+using FilterScheduler = QueryScheduler<FilterQuery, FilterResult>;
+using SearchScheduler = QueryScheduler<TextSearchQuery, TextSearchResult>;
+using WindowScheduler = QueryScheduler<WindowQuery, WindowResult>;
+
 bool operator==(const EventMetadata& lhs, const EventMetadata& rhs) {
     return memcmp(reinterpret_cast<const void*>(&lhs.m_providerId), reinterpret_cast<const void*>(&rhs.m_providerId), sizeof(lhs.m_providerId) + sizeof(lhs.m_eventId) + sizeof(lhs.m_version)) == 0;
 }
 
+using EventMetadataMap = EventIdentifierMap<EventMetadata>;
+
 // Global map to store event metadata
-std::unordered_map<EventIdentifier, EventMetadata, std::hash<EventIdentifier>, ::EventIdentifierEqual> m_eventMetadataMap;
-
-// Helper function to convert std::wstring to std::string
-void ConvertWStringToString(const std::wstring& wstr, std::string* pStr) {
-    int byteCount = WideCharToMultiByte(CP_UTF8, 0, wstr.c_str(), -1, NULL, 0, nullptr, nullptr);
-    byte* pBuffer = new byte[byteCount];
-    WideCharToMultiByte(CP_UTF8, 0, wstr.c_str(), -1, reinterpret_cast<char*>(pBuffer), byteCount, nullptr, nullptr);
-    *pStr = reinterpret_cast<char*>(pBuffer);
-    delete[] pBuffer;
+EventMetadataMap m_eventMetadataMap;
+
+// Interned UTF-8 names and schema text shared by the metadata and the UI. Decoded values go to the dictionaries of their column tables.
+StringPool g_stringPool;
+
+// Helper function to convert a UTF-16 string to UTF-8. Reuses the capacity of *pStr.
+void ConvertWStringToString(std::wstring_view wstr, std::string* pStr) {
+    pStr->resize(Utf16ToUtf8MaxBytes(wstr.size()));
+    pStr->resize(Utf16ToUtf8(wstr.data(), wstr.size(), pStr->data()));
 }
 
 // Helper function to convert std::string to std::wstring
@@ -169,6 +241,13 @@ void ConvertStringToWString(const std::string& str, std::wstring* pWstr) {
     delete[] pBuffer;
 }
 
+// Converts a UTF-16 string to UTF-8 and interns it in g_stringPool.
+StringPool::Id InternWString(PCWSTR wstr) {
+    thread_local std::string str;
+    ConvertWStringToString(wstr, &str);
+    return g_stringPool.Intern(str);
+}
+
 // Function to get the property data type as a string
 std::string GetPropertyDataType(EVENT_PROPERTY_INFO& propInfo) {
     switch (propInfo.nonStructType.InType) {
@@ -232,7 +311,7 @@ std::string GetPropertyDataType(EVENT_PROPERTY_INFO& propInfo) {
         return "REVERSEDCOUNTEDSTRING";
     case TDH_INTYPE_REVERSEDCOUNTEDANSISTRING:
         return "REVERSEDCOUNTEDANSISTRING";
-    case TDH_INTYPE_NONNULLTERMINATEDSTRING:
+    case ETL_INTYPE_NONNULLTERMINATEDSTRING:
         return "NONNULLTERMINATEDSTRING";
     case TDH_INTYPE_NONNULLTERMINATEDANSISTRING:
         return "NONNULLTERMINATEDANSISTRING";
@@ -251,11 +330,11 @@ std::string GetPropertyDataType(EVENT_PROPERTY_INFO& propInfo) {
     }
 }
 
-// Function to collect event metadata
-void CollectEventMetadata(PEVENT_RECORD pEventRecord) {
+// Function to collect event metadata into metadataMap. Returns true if a new entry was added.
+bool CollectEventMetadata(PEVENT_RECORD pEventRecord, EventMetadataMap& metadataMap) {
     EventIdentifier id{ pEventRecord->EventHeader.ProviderId, pEventRecord->EventHeader.EventDescriptor.Id, pEventRecord->EventHeader.EventDescriptor.Version };
-    if (m_eventMetadataMap.contains(id)) {
-        return; // Already handled
+    if (metadataMap.contains(id)) {
+        return false; // Already handled
     }
 
     TRACE_EVENT_INFO* pEventInfo = nullptr;
@@ -264,7 +343,7 @@ void CollectEventMetadata(PEVENT_RECORD pEventRecord) {
     if (status == ERROR_INSUFFICIENT_BUFFER) {
         pEventInfo = (TRACE_EVENT_INFO*)malloc(bufferSize);
         if (pEventInfo == nullptr) {
-            return; // Failed to allocate memory for event info
+            return false; // Failed to allocate memory for event info
         }
 
         status = TdhGetEventInformation(pEventRecord, 0, nullptr, pEventInfo, &bufferSize);
@@ -272,32 +351,32 @@ void CollectEventMetadata(PEVENT_RECORD pEventRecord) {
 
     if (status != ERROR_SUCCESS) {
         free(pEventInfo);
-        return; // TdhGetEventInformation failed
+        return false; // TdhGetEventInformation failed
     }
 
-    EventMetadata eventMeta;
+    EventMetadata eventMeta{};
     eventMeta.m_providerId = pEventRecord->EventHeader.ProviderId;
     eventMeta.m_providerGuid = pEventInfo->ProviderGuid;
     eventMeta.m_eventId = pEventInfo->EventDescriptor.Id;
     eventMeta.m_version = pEventInfo->EventDescriptor.Version;
     if (pEventInfo->ProviderNameOffset)
-        eventMeta.m_providerName = (PWCHAR)((PBYTE)pEventInfo + pEventInfo->ProviderNameOffset);
+        eventMeta.m_providerName = InternWString((PWCHAR)((PBYTE)pEventInfo + pEventInfo->ProviderNameOffset));
     if (pEventInfo->LevelNameOffset)
-        eventMeta.m_levelName = (PWCHAR)((PBYTE)pEventInfo + pEventInfo->LevelNameOffset);
+        eventMeta.m_levelName = InternWString((PWCHAR)((PBYTE)pEventInfo + pEventInfo->LevelNameOffset));
     if (pEventInfo->ChannelNameOffset)
-        eventMeta.m_channelName = (PWCHAR)((PBYTE)pEventInfo + pEventInfo->ChannelNameOffset);
+        eventMeta.m_channelName = InternWString((PWCHAR)((PBYTE)pEventInfo + pEventInfo->ChannelNameOffset));
     if (pEventInfo->KeywordsNameOffset)
-        eventMeta.m_keywordsName = (PWCHAR)((PBYTE)pEventInfo + pEventInfo->KeywordsNameOffset);
+        eventMeta.m_keywordsName = InternWString((PWCHAR)((PBYTE)pEventInfo + pEventInfo->KeywordsNameOffset));
     if (pEventInfo->DecodingSource != DecodingSourceWPP) {
         if (pEventInfo->TaskNameOffset)
-            eventMeta.m_taskName = (PWCHAR)((PBYTE)pEventInfo + pEventInfo->TaskNameOffset);
+            eventMeta.m_taskName = InternWString((PWCHAR)((PBYTE)pEventInfo + pEventInfo->TaskNameOffset));
         if (pEventInfo->OpcodeNameOffset)
-            eventMeta.m_opCodeName = (PWCHAR)((PBYTE)pEventInfo + pEventInfo->OpcodeNameOffset);
+            eventMeta.m_opCodeName = InternWString((PWCHAR)((PBYTE)pEventInfo + pEventInfo->OpcodeNameOffset));
     }
     if (pEventInfo->EventMessageOffset)
-        eventMeta.m_eventMessage = (PWCHAR)((PBYTE)pEventInfo + pEventInfo->EventMessageOffset);
+        eventMeta.m_eventMessage = InternWString((PWCHAR)((PBYTE)pEventInfo + pEventInfo->EventMessageOffset));
     if (pEventInfo->ProviderMessageOffset)
-        eventMeta.m_providerMessage = (PWCHAR)((PBYTE)pEventInfo + pEventInfo->ProviderMessageOffset);
+        eventMeta.m_providerMessage = InternWString((PWCHAR)((PBYTE)pEventInfo + pEventInfo->ProviderMessageOffset));
 
     for (ULONG i = 0; i < pEventInfo->TopLevelPropertyCount; i++) {
         PROPERTY_DATA_DESCRIPTOR propertyDescriptor;
@@ -310,19 +389,119 @@ void CollectEventMetadata(PEVENT_RECORD pEventRecord) {
             std::vector<BYTE> propertyBuffer(propertyBufferSize);
             status = TdhGetProperty(pEventRecord, 0, nullptr, 1, &propertyDescriptor, propertyBufferSize, propertyBuffer.data());
             if (status == ERROR_SUCCESS) {
-                std::wstring propertyName = (PWCHAR)((PBYTE)pEventInfo + pEventInfo->EventPropertyInfoArray[i].NameOffset);
-                eventMeta.m_properties.push_back({ propertyName, GetPropertyDataType(pEventInfo->EventPropertyInfoArray[i]) });
+                StringPool::Id propertyName = InternWString((PWCHAR)((PBYTE)pEventInfo + pEventInfo->EventPropertyInfoArray[i].NameOffset));
+                eventMeta.m_properties.push_back({ propertyName, g_stringPool.Intern(GetPropertyDataType(pEventInfo->EventPropertyInfoArray[i])) });
             }
         }
     }
 
-    m_eventMetadataMap[id] = eventMeta;
+    metadataMap[id] = eventMeta;
     free(pEventInfo);
+    return true;
 }
 
-// Callback function for processing events
-void WINAPI EventRecordCallback(PEVENT_RECORD pEventRecord) {
-    CollectEventMetadata(pEventRecord);
+// Collects metadata for every event type in the file using all of the reader's workers, and
+// records where every event of each type lives in occurrenceIndex and the range of event
+// timestamps of every buffer in bufferRanges, for EtlTimeIndex.
+// Each worker fills its own map; when several workers saw the same type, the entry built from
+// the event that comes first in the file is kept so the result does not depend on scheduling.
+void IngestTrace(const EtlParallelReader& reader, EventMetadataMap& metadataMap, EtlOccurrenceIndex& occurrenceIndex,
+    std::vector<EtlTimeIndex::BufferRange>& bufferRanges) {
+    // Every buffer is read by a single worker, so the workers update distinct ranges.
+    bufferRanges.clear();
+    for (size_t i = 0; i < reader.GetFile().GetBufferCount(); i++)
+        bufferRanges.push_back(EtlTimeIndex::EmptyRange(static_cast<uint32_t>(i)));
+    std::vector<EventMetadataMap> partialMetadata(reader.GetThreadCount());
+    std::vector<EventIdentifierMap<uint64_t>> firstSeen(reader.GetThreadCount());
+    std::vector<EtlOccurrenceIndex::Partial> partialIndex(reader.GetThreadCount());
+    reader.ForEachEvent([&](unsigned threadIndex, const EtlEventView& view) {
+        EventIdentifier id{ view.m_providerId, view.m_id, view.m_version };
+        partialIndex[threadIndex].Add(id, { view.m_timestamp, view.m_bufferIndex, view.m_bufferOffset });
+        EtlTimeIndex::BufferRange& range = bufferRanges[view.m_bufferIndex];
+        range.m_first = (std::min)(range.m_first, view.m_timestamp);
+        range.m_last = (std::max)(range.m_last, view.m_timestamp);
+        if (partialMetadata[threadIndex].contains(id))
+            return;
+        EtlEventRecord record(view);
+        if (CollectEventMetadata(record.Get(), partialMetadata[threadIndex])) {
+            uint64_t position = (static_cast<uint64_t>(view.m_bufferIndex) << 32) | view.m_bufferOffset;
+            firstSeen[threadIndex][id] = position;
+        }
+    });
+    occurrenceIndex.Build(partialIndex, reader);
+
+    EventIdentifierMap<uint64_t> winner;
+    for (size_t t = 0; t < partialMetadata.size(); t++) {
+        for (auto& pair : partialMetadata[t]) {
+            uint64_t position = firstSeen[t][pair.first];
+            auto it = winner.find(pair.first);
+            if (it != winner.end() && it->second <= position)
+                continue;
+            winner[pair.first] = position;
+            metadataMap[pair.first] = std::move(pair.second);
+        }
+    }
+}
+
+/*
+Writes the metadata map and the occurrence lists of a trace to its sidecar index, together with the
+buffer table of the file and the event time range of its buffers. Types seen without metadata keep their lists.
+*/
+bool SaveSidecarIndex(const std::filesystem::path& path, const EtlTraceSource& source, const EventMetadataMap& metadataMap,
+    const EtlOccurrenceIndex& occurrenceIndex, const EtlFile& file, std::span<const EtlTimeIndex::BufferRange> bufferRanges) {
+    EtlSidecarIndex::Writer writer;
+    std::vector<std::pair<std::string_view, std::string_view>> properties;
+    occurrenceIndex.ForEachList([&](const EventIdentifier& id, const EtlPostingList& list) {
+        std::array<std::string_view, ETL_SIDECAR_STRING_COUNT> strings = {};
+        properties.clear();
+        auto it = metadataMap.find(id);
+        if (it == metadataMap.end()) {
+            writer.AddType(id, {}, strings, properties, false, &list);
+            return;
+        }
+        const EventMetadata& metadata = it->second;
+        strings[ETL_SIDECAR_PROVIDER_NAME] = g_stringPool.Get(metadata.m_providerName);
+        strings[ETL_SIDECAR_LEVEL_NAME] = g_stringPool.Get(metadata.m_levelName);
+        strings[ETL_SIDECAR_CHANNEL_NAME] = g_stringPool.Get(metadata.m_channelName);
+        strings[ETL_SIDECAR_KEYWORDS_NAME] = g_stringPool.Get(metadata.m_keywordsName);
+        strings[ETL_SIDECAR_PROVIDER_MESSAGE] = g_stringPool.Get(metadata.m_providerMessage);
+        strings[ETL_SIDECAR_EVENT_MESSAGE] = g_stringPool.Get(metadata.m_eventMessage);
+        strings[ETL_SIDECAR_TASK_NAME] = g_stringPool.Get(metadata.m_taskName);
+        strings[ETL_SIDECAR_OPCODE_NAME] = g_stringPool.Get(metadata.m_opCodeName);
+        strings[ETL_SIDECAR_DECODING_SOURCE] = metadata.m_decodingSource;
+        for (const auto& [name, type] : metadata.m_properties)
+            properties.emplace_back(g_stringPool.Get(name), g_stringPool.Get(type));
+        writer.AddType(id, metadata.m_providerGuid, strings, properties, true, &list);
+    });
+    return writer.Write(path, source, file.GetBuffers(), bufferRanges);
+}
+
+// Restores the metadata map and the occurrence lists from a sidecar index. The lists point into its mapping.
+void LoadSidecarIndex(const EtlSidecarIndex& sidecar, EventMetadataMap& metadataMap, EtlOccurrenceIndex& occurrenceIndex) {
+    for (size_t i = 0; i < sidecar.GetTypeCount(); i++) {
+        const EtlSidecarType& type = sidecar.GetType(i);
+        occurrenceIndex.Add(type.m_id, sidecar.GetPostingList(type));
+        if (!type.m_hasMetadata)
+            continue;
+
+        EventMetadata metadata{};
+        metadata.m_providerId = type.m_id.m_providerId;
+        metadata.m_eventId = type.m_id.m_id;
+        metadata.m_version = type.m_id.m_version;
+        metadata.m_providerGuid = type.m_providerGuid;
+        metadata.m_providerName = g_stringPool.Intern(sidecar.GetString(type.m_strings[ETL_SIDECAR_PROVIDER_NAME]));
+        metadata.m_levelName = g_stringPool.Intern(sidecar.GetString(type.m_strings[ETL_SIDECAR_LEVEL_NAME]));
+        metadata.m_channelName = g_stringPool.Intern(sidecar.GetString(type.m_strings[ETL_SIDECAR_CHANNEL_NAME]));
+        metadata.m_keywordsName = g_stringPool.Intern(sidecar.GetString(type.m_strings[ETL_SIDECAR_KEYWORDS_NAME]));
+        metadata.m_providerMessage = g_stringPool.Intern(sidecar.GetString(type.m_strings[ETL_SIDECAR_PROVIDER_MESSAGE]));
+        metadata.m_eventMessage = g_stringPool.Intern(sidecar.GetString(type.m_strings[ETL_SIDECAR_EVENT_MESSAGE]));
+        metadata.m_taskName = g_stringPool.Intern(sidecar.GetString(type.m_strings[ETL_SIDECAR_TASK_NAME]));
+        metadata.m_opCodeName = g_stringPool.Intern(sidecar.GetString(type.m_strings[ETL_SIDECAR_OPCODE_NAME]));
+        metadata.m_decodingSource = sidecar.GetString(type.m_strings[ETL_SIDECAR_DECODING_SOURCE]);
+        for (const EtlSidecarProperty& property : sidecar.GetProperties(type))
+            metadata.m_properties.push_back({ g_stringPool.Intern(sidecar.GetString(property.m_name)), g_stringPool.Intern(sidecar.GetString(property.m_type)) });
+        metadataMap[type.m_id] = std::move(metadata);
+    }
 }
 
 // Function to convert GUID to string
@@ -336,11 +515,6 @@ std::string GuidToString(const GUID& guid) {
     return std::string(buffer);
 }
 
-// Callback function for processing events
-void WINAPI BackgroundEventRecordCallback(PEVENT_RECORD pEventRecord) {
-    static_cast<std::function<void(PEVENT_RECORD pEventRecord)> *>(pEventRecord->UserContext)->operator()(pEventRecord);
-}
-
 /// <summary>
 /// Modified example code from: https://learn.microsoft.com/en-us/windows/win32/etw/using-tdhformatproperty-to-consume-event-data
 /// </summary>
@@ -348,13 +522,11 @@ class DecoderContext
 {
 public:
 
-    TRACEHANDLE m_traceHandle;
     /*
     Initialize the decoder context.
     Sets up the TDH_CONTEXT array that will be used for decoding.
     */
-    explicit DecoderContext(std::deque<EventData> &events, EventIdentifier &idFilter, size_t requestedCount,
-        _In_opt_ LPCWSTR szTmfSearchPath) : m_events(events), m_idFilter(idFilter), m_requestedCount(requestedCount)
+    explicit DecoderContext(EventSchemaCache &schemaCache, _In_opt_ LPCWSTR szTmfSearchPath) : m_schemaCache(schemaCache)
     {
         TDH_CONTEXT* p = m_tdhContext;
 
@@ -370,21 +542,13 @@ public:
     }
 
     /*
-    Decode and print the data for an event.
-    Might throw an exception for out-of-memory conditions. Caller should catch
-    the exception before returning from the ProcessTrace callback.
+    Fills a result row for an event: its payload span and cached schema, without formatting anything.
+    Returns false for events that are not shown.
     */
-    void PrintEventRecord(
-        _In_ EVENT_RECORD* pEventRecord)
+    bool MakeEventRow(
+        _In_ EVENT_RECORD* pEventRecord,
+        _Out_ EventRow* pRow)
     {
-        if (m_events.size() == m_requestedCount) {
-            m_requestedCount = 0;
-            CloseTrace(m_traceHandle);
-            return;
-        }
-        else if (m_requestedCount == 0) {
-            return;
-        }
         if (pEventRecord->EventHeader.EventDescriptor.Opcode == EVENT_TRACE_TYPE_INFO &&
             pEventRecord->EventHeader.ProviderId == EventTraceGuid)
         {
@@ -394,27 +558,53 @@ public:
             OpenTrace. Since we've already seen this information, we'll skip this
             event.
             */
-            return;
+            return false;
         }
-        EventIdentifier id{pEventRecord->EventHeader.ProviderId, pEventRecord->EventHeader.EventDescriptor.Id, pEventRecord->EventHeader.EventDescriptor.Version};
-        if (id != m_idFilter)
-            return;
-        m_events.emplace_back(EventData{id.m_providerId, id.m_id, id.m_version, 0, static_cast<uint64_t>(pEventRecord->EventHeader.TimeStamp.QuadPart) });
-        // Reset state to process a new event.
-        m_pEvent = pEventRecord;
-        m_pbData = static_cast<BYTE const*>(m_pEvent->UserData);
-        m_pbDataEnd = m_pbData + m_pEvent->UserDataLength;
-        m_pointerSize =
-            m_pEvent->EventHeader.Flags & EVENT_HEADER_FLAG_32_BIT_HEADER
+
+        pRow->m_timestamp = static_cast<uint64_t>(pEventRecord->EventHeader.TimeStamp.QuadPart);
+        pRow->m_pSchema = nullptr;
+        pRow->m_pUserData = static_cast<BYTE const*>(pEventRecord->UserData);
+        pRow->m_userDataLength = pEventRecord->UserDataLength;
+        pRow->m_flags = pEventRecord->EventHeader.Flags;
+        if ((pRow->m_flags & EVENT_HEADER_FLAG_TRACE_MESSAGE) == 0)
+        {
+            pRow->m_pSchema = m_schemaCache.Get(
+                pEventRecord,
+                m_tdhContextCount,
+                m_tdhContextCount ? m_tdhContext : nullptr).get();
+        }
+        return true;
+    }
+
+    /*
+    Pointer size of an event's payload, from its EVENT_HEADER::Flags.
+    */
+    static BYTE PointerSize(USHORT flags)
+    {
+        return
+            flags & EVENT_HEADER_FLAG_32_BIT_HEADER
             ? 4
-            : m_pEvent->EventHeader.Flags & EVENT_HEADER_FLAG_64_BIT_HEADER
+            : flags & EVENT_HEADER_FLAG_64_BIT_HEADER
             ? 8
             : sizeof(void*); // Ambiguous, assume size of the decoder's pointer.
+    }
+
+    /*
+    Decode the data for a row into one UTF-8 string per property.
+    Might throw an exception for out-of-memory conditions.
+    */
+    void FormatEventRow(
+        _In_ EventRow const& row,
+        _Out_ std::vector<std::string>& values)
+    {
+        values.clear();
+        // Reset state to process a new event.
+        m_pRow = &row;
+        m_pValues = &values;
+        m_pbData = row.m_pUserData;
+        m_pbDataEnd = m_pbData + row.m_userDataLength;
+        m_pointerSize = PointerSize(row.m_flags);
 
-        // There is a lot of information available in the event even without decoding,
-        // including timestamp, PID, TID, provider ID, activity ID, and the raw data.
-        // including timestamp, PID, TID, provider ID, activity ID, and the raw data.
-        
         if (IsWppEvent())
         {
             PrintWppEvent();
@@ -471,79 +661,14 @@ private:
     }
 
     /*
-    Print the value of the given UNICODESTRING property.
-    */
-    void PrintWppStringProperty(_In_z_ LPCWSTR szPropertyName)
-    {
-        PROPERTY_DATA_DESCRIPTOR pdd = { reinterpret_cast<UINT_PTR>(szPropertyName) };
-
-        ULONG status;
-        ULONG cb = 0;
-        status = TdhGetPropertySize(
-            m_pEvent,
-            m_tdhContextCount,
-            m_tdhContextCount ? m_tdhContext : nullptr,
-            1,
-            &pdd,
-            &cb);
-        if (status == ERROR_SUCCESS)
-        {
-            if (m_propertyBuffer.size() < cb / 2)
-            {
-                m_propertyBuffer.resize(cb / 2);
-            }
-
-            status = TdhGetProperty(
-                m_pEvent,
-                m_tdhContextCount,
-                m_tdhContextCount ? m_tdhContext : nullptr,
-                1,
-                &pdd,
-                cb,
-                reinterpret_cast<BYTE*>(m_propertyBuffer.data()));
-        }
-
-        if (status != ERROR_SUCCESS)
-        {
-            wprintf(L"[TdhGetProperty(%ls) error %u]", szPropertyName, status);
-        }
-        else
-        {
-            // Print the FormattedString property data (nul-terminated
-            // wchar_t string).
-            wprintf(L"%ls", m_propertyBuffer.data());
-        }
-    }
-
-    /*
-    Use TdhGetEventInformation to obtain information about this event
-    (including the names and types of the event's properties). Print some
-    basic information about the event (provider name, event name), then print
-    each property (using TdhFormatProperty to format each property value).
+    Use the decoding information for this event (including the names and
+    types of the event's properties) that MakeEventRow found in the schema
+    cache. Then print each property.
     */
     void PrintNonWppEvent()
     {
-        ULONG status;
-        ULONG cb;
-
-        // Try to get event decoding information from TDH.
-        cb = static_cast<ULONG>(m_teiBuffer.size());
-        status = TdhGetEventInformation(
-            m_pEvent,
-            m_tdhContextCount,
-            m_tdhContextCount ? m_tdhContext : nullptr,
-            reinterpret_cast<TRACE_EVENT_INFO*>(m_teiBuffer.data()),
-            &cb);
-        if (status == ERROR_INSUFFICIENT_BUFFER)
-        {
-            m_teiBuffer.resize(cb);
-            status = TdhGetEventInformation(
-                m_pEvent,
-                m_tdhContextCount,
-                m_tdhContextCount ? m_tdhContext : nullptr,
-                reinterpret_cast<TRACE_EVENT_INFO*>(m_teiBuffer.data()),
-                &cb);
-        }
+        m_pSchema = m_pRow->m_pSchema;
+        ULONG status = m_pSchema != nullptr ? m_pSchema->m_status : ERROR_NOT_FOUND;
 
         if (status != ERROR_SUCCESS)
         {
@@ -556,14 +681,18 @@ private:
             // TDH found decoding information. Print some basic info about the event,
             // then format the event contents.
 
-            TRACE_EVENT_INFO const* const pTei =
-                reinterpret_cast<TRACE_EVENT_INFO const*>(m_teiBuffer.data());
+            TRACE_EVENT_INFO const* const pTei = m_pSchema->Tei();
             
             if (IsStringEvent())
             {
                 // The event was written using EventWriteString.
                 // We'll handle it later.
             }
+            else if (m_pSchema->m_plan.IsValid())
+            {
+                // Flat schemas run their compiled plan over the raw payload.
+                PrintPlannedProperties();
+            }
             else
             {
                 // The event is a MOF, manifest, or TraceLogging event.
@@ -584,16 +713,130 @@ private:
         {
             // The event was written using EventWriteString.
             // We can print it whether or not we have decoding information.
-            LPCWSTR pchData = static_cast<LPCWSTR>(m_pEvent->UserData);
-            unsigned cchData = m_pEvent->UserDataLength / 2;
-            
-            // It's probably nul-terminated, but just in case, limit to cchData chars.
-            m_events.back().m_properties.emplace_back(std::make_pair(L"WriteString", std::wstring(pchData, cchData)));
+            EtlValue value = {};
+            value.m_kind = EtlValueKind::UnicodeString;
+            value.m_inType = ETL_INTYPE_NONNULLTERMINATEDSTRING;
+            value.m_pData = m_pRow->m_pUserData;
+            value.m_size = m_pRow->m_userDataLength & ~1u;
+
+            // It's probably nul-terminated, but just in case, limit to UserDataLength.
+            std::string text = FormatValue(value);
+            size_t nul = text.find('\0');
+            if (nul != std::string::npos)
+                text.resize(nul);
+            m_pValues->push_back(std::move(text));
         }
 
 
     }
 
+    /*
+    Prints the top-level properties using the schema's DecodePlan.
+    Values are formatted natively with EtlFormatValue; value maps and types it does not cover go
+    through TdhFormatProperty, with the exact bytes and length the plan located.
+    */
+    void PrintPlannedProperties()
+    {
+        TRACE_EVENT_INFO const* const pTei = m_pSchema->Tei();
+        DecodePlan const& plan = m_pSchema->m_plan;
+        plan.Execute(m_pbData, static_cast<uint32_t>(m_pbDataEnd - m_pbData), m_pointerSize, m_values);
+
+        for (unsigned propIndex = 0; propIndex != m_values.size(); propIndex += 1)
+        {
+            EVENT_PROPERTY_INFO const& epi = pTei->EventPropertyInfoArray[propIndex];
+            DecodePlan::Step const& step = plan.GetStep(propIndex);
+            EtlValue const& value = m_values[propIndex];
+
+            std::string propertyValue;
+
+            switch (value.m_kind)
+            {
+            case EtlValueKind::Missing:
+            case EtlValueKind::Null:
+                break;
+            case EtlValueKind::Array:
+                propertyValue = std::vformat("Array[{}]", std::make_format_args(value.m_uint)); //ETL Lens: Need to actually implement this part.
+                break;
+            default:
+                // Value maps are resolved by TDH; everything else is tried natively first.
+                if (!step.m_hasMap)
+                    propertyValue = FormatValue(value, &epi, plan.ResolveLength(propIndex, m_values));
+                else
+                    ConvertWStringToString(FormatPropertyBytes(epi, m_pbData + value.m_offset, plan.ResolveLength(propIndex, m_values)), &propertyValue);
+                break;
+            }
+            m_pValues->push_back(std::move(propertyValue));
+        }
+    }
+
+    /*
+    Formats a decoded value as UTF-8 with the native formatter. Types it does not handle are
+    passed to TdhFormatProperty when the property info is available.
+    */
+    std::string FormatValue(EtlValue const& value, EVENT_PROPERTY_INFO const* pEpi = nullptr, USHORT propLength = 0)
+    {
+        size_t bound = EtlFormatBound(value);
+        if (m_formatBuffer.size() < bound)
+            m_formatBuffer.resize(bound);
+
+        size_t written = 0;
+        if (EtlFormatValue(value, m_formatBuffer.data(), m_formatBuffer.size(), &written) == EtlFormatResult::Ok)
+            return std::string(m_formatBuffer.data(), written);
+
+        std::string result;
+        if (pEpi != nullptr)
+            ConvertWStringToString(FormatPropertyBytes(*pEpi, m_pbData + value.m_offset, propLength), &result);
+        return result;
+    }
+
+    /*
+    Formats one property value that starts at pbData using TdhFormatProperty, applying the
+    property's value map if it has one.
+    */
+    std::wstring FormatPropertyBytes(EVENT_PROPERTY_INFO const& epi, BYTE const* pbData, USHORT propLength)
+    {
+        PEVENT_MAP_INFO pMapInfo = epi.nonStructType.MapNameOffset != 0 ? m_pSchema->FindMap(epi.nonStructType.MapNameOffset) : nullptr;
+        bool useMap = pMapInfo != nullptr;
+
+        for (;;)
+        {
+            ULONG cbBuffer = static_cast<ULONG>(m_propertyBuffer.size() * 2);
+            USHORT cbUsed = 0;
+            ULONG status = TdhFormatProperty(
+                const_cast<TRACE_EVENT_INFO*>(m_pSchema->Tei()),
+                useMap ? pMapInfo : nullptr,
+                m_pointerSize,
+                epi.nonStructType.InType,
+                static_cast<USHORT>(
+                    epi.nonStructType.OutType == TDH_OUTTYPE_NOPRINT
+                    ? TDH_OUTTYPE_NULL
+                    : epi.nonStructType.OutType),
+                propLength,
+                static_cast<USHORT>(m_pbDataEnd - pbData),
+                const_cast<PBYTE>(pbData),
+                &cbBuffer,
+                m_propertyBuffer.data(),
+                &cbUsed);
+
+            if (status == ERROR_INSUFFICIENT_BUFFER &&
+                m_propertyBuffer.size() < cbBuffer / 2)
+            {
+                m_propertyBuffer.resize(cbBuffer / 2);
+                continue;
+            }
+            else if (status == ERROR_EVT_INVALID_EVENT_DATA && useMap)
+            {
+                useMap = false;
+                continue;
+            }
+            else if (status != ERROR_SUCCESS)
+            {
+                return L"";
+            }
+            return m_propertyBuffer.data();
+        }
+    }
+
     /*
     Prints out the values of properties from begin..end.
     Called by PrintEventRecord for the top-level properties.
@@ -602,8 +845,7 @@ private:
     */
     void PrintProperties(unsigned propBegin, unsigned propEnd)
     {
-        TRACE_EVENT_INFO const* const pTei =
-            reinterpret_cast<TRACE_EVENT_INFO const*>(m_teiBuffer.data());
+        TRACE_EVENT_INFO const* const pTei = m_pSchema->Tei();
 
         for (unsigned propIndex = propBegin; propIndex != propEnd; propIndex += 1)
         {
@@ -642,7 +884,6 @@ private:
                 }
             }
 
-            std::wstring propertyName = epi.NameOffset ? TeiString(epi.NameOffset) : L"(noname)";
             std::wstring propertyValue = L"";
 
             // We recorded the values of all previous integer properties just
@@ -692,45 +933,10 @@ private:
                 }
 
                 // If the property has an associated map (i.e. an enumerated type),
-                // try to look up the map data. (If this is an array, we only need
-                // to do the lookup on the first iteration.)
+                // the schema cache has already looked up the map data.
                 if (epi.nonStructType.MapNameOffset != 0 && arrayIndex == 0)
                 {
-                    switch (epi.nonStructType.InType)
-                    {
-                    case TDH_INTYPE_UINT8:
-                    case TDH_INTYPE_UINT16:
-                    case TDH_INTYPE_UINT32:
-                    case TDH_INTYPE_HEXINT32:
-                        if (m_mapBuffer.size() == 0)
-                        {
-                            m_mapBuffer.resize(sizeof(EVENT_MAP_INFO));
-                        }
-
-                        for (;;)
-                        {
-                            ULONG cbBuffer = static_cast<ULONG>(m_mapBuffer.size());
-                            ULONG status = TdhGetEventMapInformation(
-                                m_pEvent,
-                                const_cast<LPWSTR>(TeiString(epi.nonStructType.MapNameOffset)),
-                                reinterpret_cast<PEVENT_MAP_INFO>(m_mapBuffer.data()),
-                                &cbBuffer);
-
-                            if (status == ERROR_INSUFFICIENT_BUFFER &&
-                                m_mapBuffer.size() < cbBuffer)
-                            {
-                                m_mapBuffer.resize(cbBuffer);
-                                continue;
-                            }
-                            else if (status == ERROR_SUCCESS)
-                            {
-                                pMapInfo = reinterpret_cast<PEVENT_MAP_INFO>(m_mapBuffer.data());
-                            }
-
-                            break;
-                        }
-                        break;
-                    }
+                    pMapInfo = m_pSchema->FindMap(epi.nonStructType.MapNameOffset);
                 }
 
                 bool useMap = pMapInfo != nullptr;
@@ -814,7 +1020,9 @@ private:
                     break;
                 }
             }
-            m_events.back().m_properties.emplace_back(std::make_pair(propertyName, propertyValue));
+            std::string utf8Value;
+            ConvertWStringToString(propertyValue, &utf8Value);
+            m_pValues->push_back(std::move(utf8Value));
         }
     }
 
@@ -824,7 +1032,7 @@ private:
     */
     bool IsStringEvent() const
     {
-        return (m_pEvent->EventHeader.Flags & EVENT_HEADER_FLAG_STRING_ONLY) != 0;
+        return (m_pRow->m_flags & EVENT_HEADER_FLAG_STRING_ONLY) != 0;
     }
 
     /*
@@ -833,7 +1041,7 @@ private:
     */
     bool IsWppEvent() const
     {
-        return (m_pEvent->EventHeader.Flags & EVENT_HEADER_FLAG_TRACE_MESSAGE) != 0;
+        return (m_pRow->m_flags & EVENT_HEADER_FLAG_TRACE_MESSAGE) != 0;
     }
 
     /*
@@ -841,7 +1049,7 @@ private:
     */
     _Ret_z_ LPCWSTR TeiString(unsigned offset)
     {
-        return reinterpret_cast<LPCWSTR>(m_teiBuffer.data() + offset);
+        return m_pSchema->TeiString(offset);
     }
 
 private:
@@ -849,22 +1057,1087 @@ private:
     TDH_CONTEXT m_tdhContext[1]; // May contain TDH_CONTEXT_WPP_TMFSEARCHPATH.
     BYTE m_tdhContextCount;  // 1 if a TMF search path is present.
     BYTE m_pointerSize;
-    EVENT_RECORD* m_pEvent;      // The event we're currently printing.
+    EventRow const* m_pRow;      // The row we're currently formatting.
+    std::vector<std::string>* m_pValues; // Receives the formatted properties of m_pRow.
     BYTE const* m_pbData;        // Position of the next byte of event data to be consumed.
     BYTE const* m_pbDataEnd;     // Position of the end of the event data.
     std::vector<USHORT> m_integerValues; // Stored property values for resolving array lengths.
-    std::vector<BYTE> m_teiBuffer; // Buffer for TRACE_EVENT_INFO data.
+    std::vector<EtlValue> m_values; // Output of the current schema's DecodePlan.
+    std::vector<char> m_formatBuffer; // UTF-8 output of EtlFormatValue.
+    EventSchema const* m_pSchema; // Cached TRACE_EVENT_INFO and value maps of the current event.
     std::vector<wchar_t> m_propertyBuffer; // Buffer for the string returned by TdhFormatProperty.
-    std::vector<BYTE> m_mapBuffer; // Buffer for the data returned by TdhGetEventMapInformation.
-    std::deque<EventData>& m_events;
-    EventIdentifier& m_idFilter;
-    size_t m_requestedCount;
+    EventSchemaCache& m_schemaCache;
+};
+
+/*
+Decodes every occurrence of a type into EtlColumnTables of at most batchRows rows and passes each
+batch to emit(std::shared_ptr<const EtlColumnTable>) in timestamp order as soon as it is complete;
+emit returns false to stop. Column types come from the DecodePlan of the type's first event,
+and a column falls back to text when a later event's value has another kind; types without a plan
+get text columns filled by DecoderContext. Within a batch, chunks are
+decoded in parallel and joined in order. Returns false if the token was cancelled.
+*/
+template<typename Emit>
+bool DecodeColumnTable(const EventIdentifier& id, const EtlParallelReader& reader, const EtlOccurrenceIndex& occurrenceIndex,
+    EventSchemaCache& schemaCache, const QueryCancelToken& token, size_t batchRows, Emit&& emit) {
+    const EtlPostingList* pPostings = occurrenceIndex.Find(id);
+    auto metadataIt = m_eventMetadataMap.find(id);
+    if (pPostings == nullptr || metadataIt == m_eventMetadataMap.end())
+        return true;
+
+    std::vector<std::string> names(metadataIt->second.m_properties.size());
+    for (size_t i = 0; i < names.size(); i++)
+        names[i] = g_stringPool.Get(metadataIt->second.m_properties[i].first);
+    std::vector<EtlColumnType> types(names.size(), EtlColumnType::String);
+
+    std::vector<EtlEventLocation> locations = pPostings->Decode();
+    DecoderContext firstContext(schemaCache, nullptr);
+    for (size_t i = 0; i < (std::min)(locations.size(), static_cast<size_t>(2)); i++) {
+        EtlEventView view;
+        EventRow row;
+        if (!reader.GetFile().ReadEventAt(locations[i].m_bufferIndex, locations[i].m_bufferOffset, &view))
+            continue;
+        EtlEventRecord record(view);
+        if (!firstContext.MakeEventRow(record.Get(), &row))
+            continue; // The trace header event.
+        if (row.m_pSchema != nullptr && row.m_pSchema->m_plan.IsValid() && row.m_pSchema->m_plan.StepCount() == names.size())
+            types = EtlColumnTable::ColumnTypesFor(row.m_pSchema->m_plan);
+        break;
+    }
+
+    std::deque<DecoderContext> contexts;
+    for (unsigned i = 0; i < reader.GetThreadCount(); i++)
+        contexts.emplace_back(schemaCache, nullptr);
+    struct ChunkScratch {
+        std::vector<EtlValue> m_values;
+        std::vector<std::string> m_text;
+        std::vector<char> m_format;
+    };
+    std::vector<ChunkScratch> scratch(contexts.size());
+    std::vector<EtlEventLocation> batch;
+    for (size_t first = 0; first < locations.size(); first += batchRows) {
+        batch.assign(locations.begin() + first, locations.begin() + (std::min)(first + batchRows, locations.size()));
+        std::vector<EtlColumnTable> chunks;
+        for (size_t i = 0; i < contexts.size(); i++)
+            chunks.emplace_back(names, types);
+
+        reader.ForEachLocation(batch, [&](unsigned chunkIndex, size_t, const EtlEventView& view) -> bool {
+            if (token.IsCancelled())
+                return false;
+            EtlEventRecord record(view);
+            EventRow row;
+            if (!contexts[chunkIndex].MakeEventRow(record.Get(), &row))
+                return true;
+            ChunkScratch& chunkScratch = scratch[chunkIndex];
+            if (row.m_pSchema != nullptr && row.m_pSchema->m_plan.IsValid() && (row.m_flags & EVENT_HEADER_FLAG_STRING_ONLY) == 0) {
+                row.m_pSchema->m_plan.Execute(row.m_pUserData, row.m_userDataLength, DecoderContext::PointerSize(row.m_flags), chunkScratch.m_values);
+                chunks[chunkIndex].AppendRow(static_cast<int64_t>(row.m_timestamp), chunkScratch.m_values, chunkScratch.m_format);
+            }
+            else {
+                contexts[chunkIndex].FormatEventRow(row, chunkScratch.m_text);
+                chunks[chunkIndex].AppendTextRow(static_cast<int64_t>(row.m_timestamp), chunkScratch.m_text);
+            }
+            return true;
+        });
+        if (token.IsCancelled())
+            return false;
+
+        auto pTable = std::make_shared<EtlColumnTable>(std::move(chunks[0]));
+        pTable->Reserve(batch.size());
+        for (size_t i = 1; i < chunks.size(); i++)
+            pTable->Append(chunks[i]);
+        if (!emit(std::shared_ptr<const EtlColumnTable>(std::move(pTable))))
+            return false;
+    }
+    return true;
+}
+
+/*
+Scans the occurrences of a type in batches of batchRows and passes the ordinals that match the filter
+of the query to emit(FilterResult&&) after each batch; emit returns false to stop. The header fields
+of a whole batch are tested first, and only occurrences they leave undecided have their payload
+decoded (by the DecodePlan, or formatted by DecoderContext for schemas without one) and are tested
+again. The posting list is streamed from the skip point before the time range of the filter and the
+scan stops past its end, so occurrences outside of it are not read. Returns false if the token was
+cancelled.
+*/
+template<typename Emit>
+bool FilterOccurrences(const FilterQuery& query, const EtlParallelReader& reader, const EtlOccurrenceIndex& occurrenceIndex,
+    EventSchemaCache& schemaCache, const QueryCancelToken& token, size_t batchRows, Emit&& emit) {
+    const EtlPostingList* pPostings = occurrenceIndex.Find(query.m_id);
+    auto metadataIt = m_eventMetadataMap.find(query.m_id);
+    if (pPostings == nullptr || metadataIt == m_eventMetadataMap.end())
+        return true;
+    const EtlFilter& filter = *query.m_pFilter;
+    size_t propertyCount = metadataIt->second.m_properties.size();
+
+    std::deque<DecoderContext> contexts;
+    for (unsigned i = 0; i < reader.GetThreadCount(); i++)
+        contexts.emplace_back(schemaCache, nullptr);
+    struct ChunkScratch {
+        EtlFilterBatch m_header;
+        EtlFilterBatch m_decoded;
+        std::vector<uint32_t> m_batchRows;   // Index into the batch of each row of m_header.
+        std::vector<uint32_t> m_decodedRows; // Row of m_header of each row of m_decoded.
+        std::vector<uint8_t> m_results;
+        std::vector<uint8_t> m_decodedResults;
+        std::vector<uint32_t> m_matches;
+        std::vector<EtlValue> m_values;
+        std::vector<std::string> m_text;
+        uint64_t m_decodedCount = 0;
+    };
+    std::vector<ChunkScratch> scratch(contexts.size());
+
+    std::vector<EtlEventLocation> batch;
+    std::vector<uint32_t> batchOrdinals; // Occurrence ordinal of each location of the batch.
+    uint64_t scanned = 0;
+    size_t next = pPostings->SeekTimestamp(filter.GetTimeBegin());
+    bool pastEnd = false;
+    while (next < pPostings->Size() && !pastEnd) {
+        batch.clear();
+        batchOrdinals.clear();
+        size_t ordinal = next;
+        next = pPostings->ForEachFrom(next, [&](const EtlEventLocation& location) {
+            if (location.m_timestamp >= filter.GetTimeEnd()) {
+                pastEnd = true;
+                return false;
+            }
+            if (batch.size() == batchRows)
+                return false;
+            if (location.m_timestamp >= filter.GetTimeBegin()) {
+                batch.push_back(location);
+                batchOrdinals.push_back(static_cast<uint32_t>(ordinal));
+            }
+            ordinal++;
+            return true;
+        });
+        if (batch.empty())
+            break;
+        scanned += batch.size();
+
+        for (auto& chunk : scratch) {
+            chunk.m_header.Clear(propertyCount);
+            chunk.m_batchRows.clear();
+            chunk.m_matches.clear();
+        }
+        std::vector<size_t> bounds = reader.ForEachLocation(batch, [&](unsigned chunkIndex, size_t i, const EtlEventView& view) -> bool {
+            if (token.IsCancelled())
+                return false;
+            scratch[chunkIndex].m_header.AppendHeader(view);
+            scratch[chunkIndex].m_batchRows.push_back(static_cast<uint32_t>(i));
+            return true;
+        });
+
+        reader.ParallelFor(bounds.size() - 1, [&](unsigned, size_t chunkIndex) {
+            ChunkScratch& chunk = scratch[chunkIndex];
+            filter.Evaluate(chunk.m_header, false, chunk.m_results);
+            chunk.m_decoded.Clear(propertyCount);
+            chunk.m_decodedRows.clear();
+            for (size_t row = 0; row < chunk.m_results.size(); row++) {
+                if (chunk.m_results[row] != EtlFilter::MAYBE)
+                    continue;
+                chunk.m_results[row] = EtlFilter::NO_MATCH;
+                if (token.IsCancelled())
+                    return;
+                const EtlEventLocation& location = batch[chunk.m_batchRows[row]];
+                EtlEventView view;
+                if (!reader.GetFile().ReadEventAt(location.m_bufferIndex, location.m_bufferOffset, &view))
+                    continue;
+                EtlEventRecord record(view);
+                EventRow eventRow;
+                if (!contexts[chunkIndex].MakeEventRow(record.Get(), &eventRow))
+                    continue; // The trace header event.
+                chunk.m_decoded.AppendHeader(chunk.m_header, row);
+                chunk.m_decodedRows.push_back(static_cast<uint32_t>(row));
+                if (eventRow.m_pSchema != nullptr && eventRow.m_pSchema->m_plan.IsValid() && (eventRow.m_flags & EVENT_HEADER_FLAG_STRING_ONLY) == 0) {
+                    eventRow.m_pSchema->m_plan.Execute(eventRow.m_pUserData, eventRow.m_userDataLength, DecoderContext::PointerSize(eventRow.m_flags), chunk.m_values);
+                    chunk.m_decoded.SetValues(chunk.m_values);
+                }
+                else {
+                    contexts[chunkIndex].FormatEventRow(eventRow, chunk.m_text);
+                    chunk.m_decoded.SetTextValues(chunk.m_text);
+                }
+            }
+            if (chunk.m_decoded.Size() != 0) {
+                filter.Evaluate(chunk.m_decoded, true, chunk.m_decodedResults);
+                for (size_t i = 0; i < chunk.m_decodedRows.size(); i++)
+                    chunk.m_results[chunk.m_decodedRows[i]] = chunk.m_decodedResults[i];
+                chunk.m_decodedCount += chunk.m_decoded.Size();
+            }
+            for (size_t row = 0; row < chunk.m_results.size(); row++) {
+                if (chunk.m_results[row] == EtlFilter::MATCH)
+                    chunk.m_matches.push_back(batchOrdinals[chunk.m_batchRows[row]]);
+            }
+        });
+        if (token.IsCancelled())
+            return false;
+
+        FilterResult result{ query.m_id, {}, scanned, 0, false };
+        for (const auto& chunk : scratch) {
+            result.m_matches.insert(result.m_matches.end(), chunk.m_matches.begin(), chunk.m_matches.end());
+            result.m_decoded += chunk.m_decodedCount;
+        }
+        if (!emit(std::move(result)))
+            return false;
+    }
+    return true;
+}
+
+// Per-thread scratch of ForEachEventText.
+struct EventTextScratch {
+    std::vector<EtlValue> m_values;
+    std::vector<std::string> m_text;
+    std::vector<char> m_format;
+};
+
+/*
+Calls func(std::string_view) with the UTF-8 text of every string and GUID value of an event, or with
+the message of an event written by EventWriteString. Schemas without a DecodePlan are formatted by
+DecoderContext, and all of their values are passed.
+*/
+template<typename Func>
+void ForEachEventText(DecoderContext& context, const EventRow& row, EventTextScratch& scratch, Func&& func) {
+    bool stringOnly = (row.m_flags & EVENT_HEADER_FLAG_STRING_ONLY) != 0;
+    if (!stringOnly && (row.m_pSchema == nullptr || !row.m_pSchema->m_plan.IsValid())) {
+        context.FormatEventRow(row, scratch.m_text);
+        for (const auto& text : scratch.m_text)
+            func(std::string_view(text));
+        return;
+    }
+
+    if (stringOnly) {
+        EtlValue value = {};
+        value.m_kind = EtlValueKind::UnicodeString;
+        value.m_inType = ETL_INTYPE_NONNULLTERMINATEDSTRING;
+        value.m_pData = row.m_pUserData;
+        value.m_size = row.m_userDataLength & ~1u;
+        scratch.m_values.assign(1, value);
+    }
+    else {
+        row.m_pSchema->m_plan.Execute(row.m_pUserData, row.m_userDataLength, DecoderContext::PointerSize(row.m_flags), scratch.m_values);
+    }
+    for (const EtlValue& value : scratch.m_values) {
+        if (value.m_kind != EtlValueKind::UnicodeString && value.m_kind != EtlValueKind::AnsiString && value.m_kind != EtlValueKind::Guid)
+            continue;
+        size_t bound = EtlFormatBound(value);
+        if (scratch.m_format.size() < bound)
+            scratch.m_format.resize(bound);
+        size_t written = 0;
+        if (EtlFormatValue(value, scratch.m_format.data(), scratch.m_format.size(), &written) != EtlFormatResult::Ok)
+            continue;
+        std::string_view text(scratch.m_format.data(), written);
+        func(text.substr(0, text.find('\0'))); // WriteString messages are usually nul-terminated.
+    }
+}
+
+/*
+Builds the trigram index of the text of every event, type after type in batches of batchRows. Each
+worker indexes a contiguous chunk of a batch into its own partial index, and the partials are merged
+after every batch. progress counts the events done. Returns null if the token was cancelled.
+*/
+std::shared_ptr<const EtlTrigramIndex> BuildTextIndex(const EtlParallelReader& reader, const EtlOccurrenceIndex& occurrenceIndex,
+    EventSchemaCache& schemaCache, const QueryCancelToken& token, size_t batchRows, std::atomic<uint64_t>& progress) {
+    auto pIndex = std::make_shared<EtlTrigramIndex>();
+    std::deque<DecoderContext> contexts;
+    for (unsigned i = 0; i < reader.GetThreadCount(); i++)
+        contexts.emplace_back(schemaCache, nullptr);
+    std::vector<EventTextScratch> scratch(contexts.size());
+    std::vector<EtlTrigramIndex::Partial> partials(contexts.size());
+
+    std::vector<EventIdentifier> ids;
+    occurrenceIndex.ForEachList([&ids](const EventIdentifier& id, const EtlPostingList&) { ids.push_back(id); });
+    std::vector<EtlEventLocation> batch;
+    for (const EventIdentifier& id : ids) {
+        const EtlPostingList& postings = *occurrenceIndex.Find(id);
+        uint32_t firstDocument = pIndex->AddType(id, postings.Size());
+        std::vector<EtlEventLocation> locations = postings.Decode();
+        for (size_t first = 0; first < locations.size(); first += batchRows) {
+            batch.assign(locations.begin() + first, locations.begin() + (std::min)(first + batchRows, locations.size()));
+            reader.ForEachLocation(batch, [&](unsigned chunkIndex, size_t i, const EtlEventView& view) -> bool {
+                if (token.IsCancelled())
+                    return false;
+                EtlEventRecord record(view);
+                EventRow row;
+                if (!contexts[chunkIndex].MakeEventRow(record.Get(), &row))
+                    return true;
+                EtlTrigramIndex::Partial& partial = partials[chunkIndex];
+                ForEachEventText(contexts[chunkIndex], row, scratch[chunkIndex], [&partial](std::string_view text) { partial.AddText(text); });
+                partial.EndDocument(firstDocument + static_cast<uint32_t>(first + i));
+                return true;
+            });
+            if (token.IsCancelled())
+                return nullptr;
+            pIndex->Merge(partials, reader);
+            progress += batch.size();
+        }
+    }
+    pIndex->Finish(reader);
+    return pIndex;
+}
+
+// Part of text around a match, cut on UTF-8 character boundaries.
+std::string_view TextSnippet(std::string_view text, size_t position) {
+    size_t begin = position > TEXT_SEARCH_SNIPPET_BYTES / 4 ? position - TEXT_SEARCH_SNIPPET_BYTES / 4 : 0;
+    while (begin > 0 && (static_cast<uint8_t>(text[begin]) & 0xC0) == 0x80)
+        begin--;
+    size_t end = (std::min)(text.size(), begin + TEXT_SEARCH_SNIPPET_BYTES);
+    while (end < text.size() && (static_cast<uint8_t>(text[end]) & 0xC0) == 0x80)
+        end--;
+    return text.substr(begin, end - begin);
+}
+
+/*
+Finds the events whose text contains the query text, ignoring ASCII case. The trigram index gives the
+candidates; their locations come from one walk per type over the occurrence lists, restarted from a
+skip point across long gaps, and their text is read again to verify them with EtlFindText.
+Returns nullopt if the token was cancelled.
+*/
+std::optional<TextSearchResult> SearchText(const TextSearchQuery& query, const EtlParallelReader& reader, const EtlOccurrenceIndex& occurrenceIndex,
+    EventSchemaCache& schemaCache, const QueryCancelToken& token) {
+    auto start = std::chrono::steady_clock::now();
+    const EtlTrigramIndex& index = *query.m_pIndex;
+    TextSearchResult result;
+    std::string needle = query.m_text;
+    EtlLowerAscii(needle.data(), needle.size());
+    std::vector<uint32_t> candidates;
+    if (!index.FindCandidates(needle, candidates)) {
+        result.m_error = "Search for at least 3 characters";
+        return result;
+    }
+    result.m_candidateCount = candidates.size();
+
+    std::vector<EtlEventLocation> locations;
+    locations.reserve(candidates.size());
+    for (size_t next = 0; next < candidates.size();) {
+        if (token.IsCancelled())
+            return std::nullopt;
+        size_t typeIndex = index.TypeOf(candidates[next]);
+        uint32_t firstDocument = index.GetFirstDocument(typeIndex);
+        uint32_t endDocument = index.GetFirstDocument(typeIndex + 1);
+        const EtlPostingList* pPostings = occurrenceIndex.Find(index.GetType(typeIndex));
+        while (next < candidates.size() && candidates[next] < endDocument) {
+            size_t ordinal = candidates[next] - firstDocument;
+            pPostings->ForEachFrom(ordinal, [&](const EtlEventLocation& location) {
+                if (ordinal++ == candidates[next] - firstDocument) {
+                    locations.push_back(location);
+                    if (++next == candidates.size() || candidates[next] >= endDocument)
+                        return false;
+                }
+                return candidates[next] - firstDocument - ordinal < EtlPostingList::SKIP_INTERVAL;
+            });
+        }
+    }
+
+    std::deque<DecoderContext> contexts;
+    for (unsigned i = 0; i < reader.GetThreadCount(); i++)
+        contexts.emplace_back(schemaCache, nullptr);
+    struct ChunkState {
+        EventTextScratch m_scratch;
+        std::string m_lowered;
+        std::vector<uint32_t> m_documents; // Every verified match.
+        std::vector<TextSearchMatch> m_matches;
+    };
+    std::vector<ChunkState> chunks(contexts.size());
+    reader.ForEachLocation(locations, [&](unsigned chunkIndex, size_t i, const EtlEventView& view) -> bool {
+        if (token.IsCancelled())
+            return false;
+        EtlEventRecord record(view);
+        EventRow row;
+        if (!contexts[chunkIndex].MakeEventRow(record.Get(), &row))
+            return true;
+        ChunkState& chunk = chunks[chunkIndex];
+        bool found = false;
+        ForEachEventText(contexts[chunkIndex], row, chunk.m_scratch, [&](std::string_view text) {
+            if (found || text.size() < needle.size())
+                return;
+            chunk.m_lowered.assign(text);
+            EtlLowerAscii(chunk.m_lowered.data(), chunk.m_lowered.size());
+            size_t position = EtlFindText(chunk.m_lowered, needle);
+            if (position == std::string_view::npos)
+                return;
+            found = true;
+            uint32_t document = candidates[i];
+            chunk.m_documents.push_back(document);
+            if (chunk.m_matches.size() < TEXT_SEARCH_MAX_MATCHES) {
+                size_t typeIndex = index.TypeOf(document);
+                chunk.m_matches.push_back({ index.GetType(typeIndex), document - index.GetFirstDocument(typeIndex), view.m_timestamp, std::string(TextSnippet(text, position)) });
+            }
+        });
+        return true;
+    });
+    if (token.IsCancelled())
+        return std::nullopt;
+
+    std::vector<uint64_t> typeCounts(index.GetTypeCount());
+    for (auto& chunk : chunks) {
+        for (uint32_t document : chunk.m_documents)
+            typeCounts[index.TypeOf(document)]++;
+        result.m_matchCount += chunk.m_documents.size();
+        size_t count = (std::min)(chunk.m_matches.size(), TEXT_SEARCH_MAX_MATCHES - result.m_matches.size());
+        std::move(chunk.m_matches.begin(), chunk.m_matches.begin() + count, std::back_inserter(result.m_matches));
+    }
+    for (size_t typeIndex = 0; typeIndex < typeCounts.size(); typeIndex++) {
+        if (typeCounts[typeIndex] != 0)
+            result.m_types.emplace_back(index.GetType(typeIndex), typeCounts[typeIndex]);
+    }
+    std::stable_sort(result.m_types.begin(), result.m_types.end(), [](const auto& lhs, const auto& rhs) { return lhs.second > rhs.second; });
+    result.m_milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+/*
+Lists the events of every type in a time window, in time order, up to maxEvents. Only the buffers
+the time index finds for the window are read, so the cost follows the length of the window and not
+where it lies in the trace. Returns nullopt if the token was cancelled.
+*/
+std::optional<WindowResult> ListWindowEvents(const WindowQuery& query, const EtlParallelReader& reader, const EtlTimeIndex& timeIndex,
+    const EtlTimeConverter& converter, const QueryCancelToken& token, size_t maxEvents) {
+    auto start = std::chrono::steady_clock::now();
+    WindowResult result;
+    std::vector<uint32_t> buffers = timeIndex.FindBuffers(query.m_begin, query.m_end);
+    result.m_bufferCount = buffers.size();
+    std::vector<EtlEventLocation> locations = reader.CollectOrdered(buffers, [&query](const EtlEventView& view) {
+        return view.m_timestamp >= query.m_begin && view.m_timestamp < query.m_end;
+    }, maxEvents + 1);
+    if (token.IsCancelled())
+        return std::nullopt;
+    result.m_truncated = locations.size() > maxEvents;
+    if (result.m_truncated)
+        locations.resize(maxEvents);
+
+    result.m_ids.resize(locations.size());
+    result.m_timestamps.resize(locations.size());
+    for (size_t i = 0; i < locations.size(); i++)
+        result.m_timestamps[i] = locations[i].m_timestamp;
+    reader.ForEachLocation(locations, [&](unsigned, size_t i, const EtlEventView& view) {
+        result.m_ids[i] = EventIdentifier{ view.m_providerId, view.m_id, view.m_version };
+    });
+    if (token.IsCancelled())
+        return std::nullopt;
+    result.m_seconds.resize(locations.size());
+    converter.ToSeconds(result.m_timestamps, result.m_seconds);
+    if (converter.HasWallTime()) {
+        result.m_fileTimes.resize(locations.size());
+        converter.ToFileTime(result.m_timestamps, result.m_fileTimes);
+    }
+    result.m_milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+// Description of a type for the SQL databases. Both number the types in m_eventMetadataMap order from 1, so table names match.
+std::shared_ptr<EtlDatabaseEventType> MakeDatabaseEventType(const EventIdentifier& id, const EventMetadata& metadata) {
+    auto pType = std::make_shared<EtlDatabaseEventType>();
+    pType->m_id = id;
+    pType->m_providerGuid = GuidToString(metadata.m_providerId);
+    pType->m_provider = g_stringPool.Get(metadata.m_providerName);
+    pType->m_task = g_stringPool.Get(metadata.m_taskName);
+    pType->m_opcode = g_stringPool.Get(metadata.m_opCodeName);
+    pType->m_level = g_stringPool.Get(metadata.m_levelName);
+    pType->m_channel = g_stringPool.Get(metadata.m_channelName);
+    pType->m_keywords = g_stringPool.Get(metadata.m_keywordsName);
+    pType->m_message = g_stringPool.Get(metadata.m_eventMessage);
+    pType->m_decodingSource = metadata.m_decodingSource;
+    for (const auto& [name, type] : metadata.m_properties)
+        pType->m_properties.emplace_back(g_stringPool.Get(name), g_stringPool.Get(type));
+    return pType;
+}
+
+/*
+Writes every event type and all of its decoded instances to a trace database, one type after the
+other. Decoding runs on the thread pool while the database writer thread inserts the previous
+batches. Each batch owns the strings of its columns, so memory stays bounded by the write queue
+however many distinct values the trace has. Returns false if the token was cancelled or writing failed; the database is then left
+unfinished and is rebuilt on the next launch.
+*/
+bool IngestTraceDatabase(EtlTraceDatabase& database, const EtlParallelReader& reader, const EtlOccurrenceIndex& occurrenceIndex,
+    EventSchemaCache& schemaCache, const QueryCancelToken& token) {
+    uint32_t typeId = 0;
+    for (const auto& [id, metadata] : m_eventMetadataMap) {
+        typeId++;
+        if (!database.AddEventType(typeId, MakeDatabaseEventType(id, metadata)))
+            return false;
+        bool decoded = DecodeColumnTable(id, reader, occurrenceIndex, schemaCache, token, COLUMN_TABLE_BATCH_ROWS,
+            [&database, typeId](std::shared_ptr<const EtlColumnTable> pBatch) { return database.Write(typeId, std::move(pBatch)); });
+        if (!decoded || database.HasFailed())
+            return false;
+    }
+    return database.Finish();
+}
+
+// Decodes the whole column table of a type for the SQL console. Returns null if the token was cancelled.
+std::shared_ptr<const EtlColumnTable> LoadColumnTable(const EventIdentifier& id, const EtlParallelReader& reader, const EtlOccurrenceIndex& occurrenceIndex,
+    EventSchemaCache& schemaCache, const QueryCancelToken& token) {
+    std::shared_ptr<EtlColumnTable> pTable;
+    bool complete = DecodeColumnTable(id, reader, occurrenceIndex, schemaCache, token, COLUMN_TABLE_BATCH_ROWS, [&pTable](std::shared_ptr<const EtlColumnTable> pBatch) {
+        if (!pTable)
+            pTable = std::make_shared<EtlColumnTable>(*pBatch);
+        else
+            pTable->Append(*pBatch);
+        return true;
+    });
+    if (!complete)
+        return nullptr;
+    if (!pTable)
+        return std::make_shared<EtlColumnTable>();
+    pTable->ShrinkToFit(); // The cache counts capacity, so slack would evict other tables early.
+    return pTable;
+}
+
+// Rows of the last SQL console result. The first column is the row label.
+class SqlResultRows : public TableRowSource
+{
+public:
+    explicit SqlResultRows(const EtlSqlResult& result) : m_result(result) {
+
+    }
+
+    size_t RowCount() const override { return m_result.m_rowCount; }
+    size_t ColumnCount() const override { return (std::min)(m_result.m_columns.size(), SQL_CONSOLE_MAX_COLUMNS); }
+
+    const char* GetLabel(size_t row) override
+    {
+        const std::string& text = m_result.m_cells[row * m_result.m_columns.size()];
+        *std::format_to_n(m_label, sizeof(m_label) - 1, "{}###{}", std::string_view(text).substr(0, sizeof(m_label) - 32), row).out = '\0';
+        return m_label;
+    }
+
+    std::string_view GetCell(size_t row, size_t column) override { return m_result.m_cells[row * m_result.m_columns.size() + column]; }
+
+private:
+    const EtlSqlResult& m_result;
+    char m_label[256];
 };
 
 
-// Callback function for processing events
-void WINAPI EventRecordCallbackBackground(PEVENT_RECORD pEventRecord) {
-    reinterpret_cast<DecoderContext*>(pEventRecord->UserContext)->PrintEventRecord(pEventRecord);
+enum EventMetadataColumn : uint32_t {
+    METADATA_COLUMN_PROVIDER,
+    METADATA_COLUMN_TASK,
+    METADATA_COLUMN_OPCODE,
+    METADATA_COLUMN_LEVEL,
+    METADATA_COLUMN_CHANNEL,
+    METADATA_COLUMN_KEYWORDS,
+    METADATA_COLUMN_EVENT_ID,
+    METADATA_COLUMN_VERSION,
+    METADATA_COLUMN_COUNT
+};
+
+/*
+Rebuilds the sort keys of the Events table after items were appended: collation ranks for the
+name columns, values for the numeric ones. Follow with TableSortIndex::AppendRows.
+*/
+void UpdateMetadataSortKeys(TableSortIndex& sortIndex, const std::vector<EventMetadata>& items) {
+    StringPool::Id EventMetadata::* nameColumns[] = { &EventMetadata::m_providerName, &EventMetadata::m_taskName, &EventMetadata::m_opCodeName,
+        &EventMetadata::m_levelName, &EventMetadata::m_channelName, &EventMetadata::m_keywordsName };
+    std::vector<StringPool::Id> ids(items.size());
+    for (uint32_t column = METADATA_COLUMN_PROVIDER; column <= METADATA_COLUMN_KEYWORDS; column++) {
+        for (size_t i = 0; i < items.size(); i++)
+            ids[i] = items[i].*nameColumns[column];
+        std::vector<uint32_t> ranks = CollationRanks(ids, g_stringPool);
+        sortIndex.GetKeys(column).assign(ranks.begin(), ranks.end());
+    }
+    std::vector<uint64_t>& eventIds = sortIndex.GetKeys(METADATA_COLUMN_EVENT_ID);
+    std::vector<uint64_t>& versions = sortIndex.GetKeys(METADATA_COLUMN_VERSION);
+    for (size_t i = eventIds.size(); i < items.size(); i++) {
+        eventIds.push_back(items[i].m_eventId);
+        versions.push_back(items[i].m_version);
+    }
+}
+
+// Rows of the Events table in sorted order. Labels are built once when the table is loaded, so drawing a row only looks up pool strings.
+class EventMetadataRows : public TableRowSource
+{
+public:
+    EventMetadataRows(const std::vector<EventMetadata>& items, const TableSortIndex& sortIndex, const EventMetadata& selected)
+        : m_items(items), m_sortIndex(sortIndex), m_selected(selected) {
+
+    }
+
+    const EventMetadata& GetMetadata(size_t row) const { return m_items[m_sortIndex.GetRow(row)]; }
+
+    size_t RowCount() const override { return m_sortIndex.RowCount(); }
+    size_t ColumnCount() const override { return METADATA_COLUMN_COUNT; }
+    bool IsSelected(size_t row) const override { return GetMetadata(row) == m_selected; }
+    const char* GetLabel(size_t row) override { return g_stringPool.CStr(GetMetadata(row).m_displayLabel); }
+
+    std::string_view GetCell(size_t row, size_t column) override
+    {
+        const EventMetadata& metadata = GetMetadata(row);
+        switch (column) {
+        case METADATA_COLUMN_TASK: return g_stringPool.Get(metadata.m_taskName);
+        case METADATA_COLUMN_OPCODE: return g_stringPool.Get(metadata.m_opCodeName);
+        case METADATA_COLUMN_LEVEL: return g_stringPool.Get(metadata.m_levelName);
+        case METADATA_COLUMN_CHANNEL: return g_stringPool.Get(metadata.m_channelName);
+        case METADATA_COLUMN_KEYWORDS: return g_stringPool.Get(metadata.m_keywordsName);
+        case METADATA_COLUMN_EVENT_ID: return FormatNumber(metadata.m_eventId);
+        case METADATA_COLUMN_VERSION: return FormatNumber(metadata.m_version);
+        default: return "";
+        }
+    }
+
+private:
+    std::string_view FormatNumber(unsigned value)
+    {
+        size_t size = std::format_to_n(m_number, sizeof(m_number), "{}", value).size;
+        return std::string_view(m_number, size);
+    }
+
+    const std::vector<EventMetadata>& m_items;
+    const TableSortIndex& m_sortIndex;
+    const EventMetadata& m_selected;
+    char m_number[8];
+};
+
+enum TextSearchColumn : uint32_t {
+    SEARCH_COLUMN_PROVIDER,
+    SEARCH_COLUMN_TASK,
+    SEARCH_COLUMN_OPCODE,
+    SEARCH_COLUMN_EVENTS, // Matching events per type, or the timestamp of a match.
+    SEARCH_COLUMN_TEXT,
+    SEARCH_COLUMN_COUNT
+};
+
+/*
+Rows of a text search result: the matching types with their counts, or the matching events with the
+text around the match. Names come from the metadata of the type.
+*/
+class TextSearchRows : public TableRowSource
+{
+public:
+    TextSearchRows(const TextSearchResult& result, bool types) : m_result(result), m_types(types) {
+
+    }
+
+    const EventIdentifier& GetType(size_t row) const { return m_types ? m_result.m_types[row].first : m_result.m_matches[row].m_id; }
+
+    size_t RowCount() const override { return m_types ? m_result.m_types.size() : m_result.m_matches.size(); }
+    size_t ColumnCount() const override { return m_types ? SEARCH_COLUMN_TEXT : SEARCH_COLUMN_COUNT; }
+
+    const char* GetLabel(size_t row) override
+    {
+        const EventMetadata* pMetadata = FindMetadata(row);
+        std::string_view provider = pMetadata ? g_stringPool.Get(pMetadata->m_providerName) : std::string_view();
+        *std::format_to_n(m_label, sizeof(m_label) - 1, "{}###{}", provider.substr(0, sizeof(m_label) - 32), row).out = '\0';
+        return m_label;
+    }
+
+    std::string_view GetCell(size_t row, size_t column) override
+    {
+        const EventMetadata* pMetadata = FindMetadata(row);
+        switch (column) {
+        case SEARCH_COLUMN_TASK: return pMetadata ? g_stringPool.Get(pMetadata->m_taskName) : std::string_view();
+        case SEARCH_COLUMN_OPCODE: return pMetadata ? g_stringPool.Get(pMetadata->m_opCodeName) : std::string_view();
+        case SEARCH_COLUMN_EVENTS: {
+            int64_t value = m_types ? static_cast<int64_t>(m_result.m_types[row].second) : m_result.m_matches[row].m_timestamp;
+            size_t size = std::format_to_n(m_number, sizeof(m_number), "{}", value).size;
+            return std::string_view(m_number, size);
+        }
+        case SEARCH_COLUMN_TEXT: return m_result.m_matches[row].m_text;
+        default: return "";
+        }
+    }
+
+private:
+    const EventMetadata* FindMetadata(size_t row) const
+    {
+        auto it = m_eventMetadataMap.find(GetType(row));
+        return it != m_eventMetadataMap.end() ? &it->second : nullptr;
+    }
+
+    const TextSearchResult& m_result;
+    bool m_types;
+    char m_label[256];
+    char m_number[24];
+};
+
+enum WindowEventColumn : uint32_t {
+    WINDOW_COLUMN_SECONDS,
+    WINDOW_COLUMN_WALL_TIME,
+    WINDOW_COLUMN_PROVIDER,
+    WINDOW_COLUMN_TASK,
+    WINDOW_COLUMN_OPCODE,
+    WINDOW_COLUMN_COUNT
+};
+
+// Rows of the events of the time window: the time from the start of the trace, the wall time and the names of the type.
+class WindowEventRows : public TableRowSource
+{
+public:
+    explicit WindowEventRows(const WindowResult& result) : m_result(result) {
+
+    }
+
+    const EventIdentifier& GetType(size_t row) const { return m_result.m_ids[row]; }
+
+    size_t RowCount() const override { return m_result.m_ids.size(); }
+    size_t ColumnCount() const override { return WINDOW_COLUMN_COUNT; }
+
+    const char* GetLabel(size_t row) override
+    {
+        *std::format_to_n(m_label, sizeof(m_label) - 1, "{:.7f}###{}", m_result.m_seconds[row], row).out = '\0';
+        return m_label;
+    }
+
+    std::string_view GetCell(size_t row, size_t column) override
+    {
+        const EventMetadata* pMetadata = FindMetadata(row);
+        switch (column) {
+        case WINDOW_COLUMN_WALL_TIME: {
+            if (row >= m_result.m_fileTimes.size())
+                return "";
+            EtlValue value{};
+            value.m_kind = EtlValueKind::FileTime;
+            value.m_inType = ETL_INTYPE_FILETIME;
+            value.m_outType = ETL_OUTTYPE_DATETIME_UTC;
+            value.m_uint = static_cast<uint64_t>(m_result.m_fileTimes[row]);
+            size_t written = 0;
+            if (EtlFormatValue(value, m_wallTime, sizeof(m_wallTime), &written) != EtlFormatResult::Ok)
+                return "";
+            return std::string_view(m_wallTime, written);
+        }
+        case WINDOW_COLUMN_PROVIDER: return pMetadata ? g_stringPool.Get(pMetadata->m_providerName) : std::string_view();
+        case WINDOW_COLUMN_TASK: return pMetadata ? g_stringPool.Get(pMetadata->m_taskName) : std::string_view();
+        case WINDOW_COLUMN_OPCODE: return pMetadata ? g_stringPool.Get(pMetadata->m_opCodeName) : std::string_view();
+        default: return "";
+        }
+    }
+
+private:
+    const EventMetadata* FindMetadata(size_t row) const
+    {
+        auto it = m_eventMetadataMap.find(GetType(row));
+        return it != m_eventMetadataMap.end() ? &it->second : nullptr;
+    }
+
+    const WindowResult& m_result;
+    char m_label[64];
+    char m_wallTime[64]; // EtlFormatBound of a FILETIME.
+};
+
+/*
+Rows of the Events Instances table. Pages of EventRows are requested from the background worker
+when a range becomes visible, and a row is formatted the first time it is drawn. Once the column
+table of the type has been built, rows can be sorted by any column using the typed values. A filter
+restricts the rows to the occurrences a filter query has matched, in the current order.
+*/
+class EventInstanceRows : public TableRowSource
+{
+public:
+    EventInstanceRows(PageScheduler& scheduler, PageCache<EventPage>& pages,
+        PageCache<std::vector<std::string>>& formattedRows, DecoderContext& formatter)
+        : m_scheduler(scheduler), m_pages(pages), m_formattedRows(formattedRows), m_formatter(formatter) {
+
+    }
+
+    // Called whenever the selected type changes. Page queries of the previous type are cancelled.
+    void Reset(const EventIdentifier& id, uint64_t rowCount, size_t columnCount)
+    {
+        m_scheduler.NewGeneration();
+        m_id = id;
+        m_rowCount = rowCount;
+        m_columnCount = columnCount;
+        m_pages.Clear();
+        m_formattedRows.Clear();
+        m_cachedRow = SIZE_MAX;
+        m_pTable.reset();
+        m_pSortIndex.reset();
+        m_stringRanks.clear();
+        m_pOrder = nullptr;
+        SetFilter(false);
+    }
+
+    // Starts showing only the occurrences passed to AppendFilterMatches, or every occurrence again.
+    void SetFilter(bool active)
+    {
+        m_filterActive = active;
+        m_filter.clear();
+        m_filterMask.assign(active ? (m_rowCount + 63) / 64 : 0, 0);
+        m_filteredOrderDirty = true;
+        m_cachedRow = SIZE_MAX;
+    }
+
+    // Adds matches streamed by the filter query, in increasing occurrence order.
+    void AppendFilterMatches(const std::vector<uint32_t>& ordinals)
+    {
+        for (uint32_t ordinal : ordinals)
+            m_filterMask[ordinal / 64] |= 1ull << (ordinal % 64);
+        m_filter.insert(m_filter.end(), ordinals.begin(), ordinals.end());
+        m_filteredOrderDirty = true;
+        m_cachedRow = SIZE_MAX;
+    }
+
+    /*
+    Appends a batch of the column table of the current type, streamed while it is decoded. The
+    first batch enables sorting; rows of later batches are merged into the current order, and
+    until they arrive the remaining rows follow in timestamp order.
+    */
+    void AppendTableBatch(const EtlColumnTable& batch)
+    {
+        if (!m_pTable) {
+            m_pTable = std::make_shared<EtlColumnTable>(batch);
+            m_pSortIndex = std::make_unique<TableSortIndex>(m_pTable->ColumnCount() + 1);
+            m_stringRanks.assign(m_pTable->ColumnCount(), EtlStringRanks());
+        }
+        else {
+            std::vector<EtlColumnType> types(m_pTable->ColumnCount());
+            for (size_t column = 0; column < types.size(); column++)
+                types[column] = m_pTable->GetColumn(column).GetType();
+            m_pTable->Append(batch);
+            // A sorted column that turned to text no longer orders like its numbers, so sorting starts over.
+            for (size_t column = 0; column < types.size(); column++) {
+                if (m_pTable->GetColumn(column).GetType() != types[column] && !m_pSortIndex->GetKeys(column + 1).empty()) {
+                    m_pSortIndex = std::make_unique<TableSortIndex>(m_pTable->ColumnCount() + 1);
+                    m_pOrder = nullptr;
+                    break;
+                }
+            }
+        }
+        size_t firstRow = m_pSortIndex->RowCount();
+        for (size_t column = 0; column <= m_pTable->ColumnCount(); column++) {
+            if (!m_pSortIndex->GetKeys(column).empty())
+                UpdateSortKeys(column, firstRow);
+        }
+        m_pSortIndex->AppendRows(m_pTable->RowCount());
+        m_filteredOrderDirty = true;
+        m_cachedRow = SIZE_MAX;
+    }
+
+    const EtlColumnTable* GetTable() const { return m_pTable.get(); }
+
+    /*
+    The table is no longer modified once its last batch has arrived, so it can then be shared. Its
+    slack is released first, as the SQL table cache counts the bytes it holds, strings included.
+    */
+    std::shared_ptr<const EtlColumnTable> ShareTable()
+    {
+        if (m_pTable)
+            m_pTable->ShrinkToFit();
+        return m_pTable;
+    }
+
+    /*
+    Orders the rows by the given columns, where column 0 is the timestamp. Returns false until the
+    first batch of the column table has arrived. Sort keys of a column are built the first time it
+    is sorted by.
+    */
+    bool Sort(const std::vector<TableSortIndex::SortKey>& sortKeys)
+    {
+        if (!m_pTable)
+            return false;
+        m_cachedRow = SIZE_MAX;
+        m_filteredOrderDirty = true;
+        if (sortKeys.empty() || (sortKeys.size() == 1 && sortKeys[0].m_column == 0 && !sortKeys[0].m_descending)) {
+            m_pOrder = nullptr; // Occurrences are already in timestamp order.
+            return true;
+        }
+        for (const auto& key : sortKeys) {
+            if (m_pSortIndex->GetKeys(key.m_column).empty())
+                UpdateSortKeys(key.m_column, 0);
+        }
+        m_pSortIndex->Sort(sortKeys);
+        m_pOrder = &m_pSortIndex->GetOrder();
+        return true;
+    }
+
+    size_t RowCount() const override { return m_filterActive ? m_filter.size() : m_rowCount; }
+    size_t ColumnCount() const override { return m_columnCount; }
+
+    void Prepare(size_t firstRow, size_t endRow) override
+    {
+        if (m_pOrder != nullptr || m_filterActive) {
+            for (size_t row = firstRow; row < endRow; row++)
+                RequestPage(DataRow(row) / EVENT_PAGE_SIZE, QueryPriority::Foreground);
+            return;
+        }
+        for (uint64_t pageIndex = firstRow / EVENT_PAGE_SIZE; pageIndex <= (endRow - 1) / EVENT_PAGE_SIZE; pageIndex++)
+            RequestPage(pageIndex, QueryPriority::Foreground);
+        // The next page is prefetched so scrolling down rarely shows loading rows.
+        uint64_t nextPage = (endRow - 1) / EVENT_PAGE_SIZE + 1;
+        if (nextPage * EVENT_PAGE_SIZE < m_rowCount)
+            RequestPage(nextPage, QueryPriority::Background);
+    }
+
+    bool IsReady(size_t row) override { return GetRow(DataRow(row)) != nullptr; }
+
+    const char* GetLabel(size_t row) override
+    {
+        size_t dataRow = DataRow(row);
+        *std::format_to_n(m_label, sizeof(m_label) - 1, "{}###{}", GetRow(dataRow)->m_timestamp, dataRow).out = '\0';
+        return m_label;
+    }
+
+    std::string_view GetCell(size_t row, size_t column) override
+    {
+        // Cells are read row by row, so the formatted values of the last row are kept at hand.
+        row = DataRow(row);
+        if (row != m_cachedRow) {
+            m_pCachedValues = m_formattedRows.Get(row);
+            if (m_pCachedValues == nullptr) {
+                m_formatter.FormatEventRow(*GetRow(row), m_values);
+                m_formattedRows.Insert(row, std::move(m_values));
+                m_pCachedValues = m_formattedRows.Get(row);
+            }
+            m_cachedRow = row;
+        }
+        return column - 1 < m_pCachedValues->size() ? std::string_view((*m_pCachedValues)[column - 1]) : std::string_view("");
+    }
+
+    // Delivers pages produced by the scheduler since the last frame and returns how many arrived. Pages of older selections never arrive.
+    size_t ReceivePages()
+    {
+        size_t received = 0;
+        EventPage page;
+        while (m_scheduler.PopResult(&page)) {
+            m_pages.Insert(page.m_cursor / EVENT_PAGE_SIZE, std::move(page));
+            received++;
+        }
+        return received;
+    }
+
+private:
+    void UpdateSortKeys(size_t column, size_t firstRow)
+    {
+        std::vector<uint64_t>& keys = m_pSortIndex->GetKeys(column);
+        if (column == 0)
+            m_pTable->GetTimestampSortKeys(keys, firstRow);
+        else
+            m_pTable->GetColumn(column - 1).GetSortKeys(keys, firstRow, m_stringRanks[column - 1]);
+    }
+
+    // Occurrence index shown at a row of the table.
+    size_t DataRow(size_t row)
+    {
+        if (!m_filterActive)
+            return m_pOrder != nullptr && row < m_pOrder->size() ? (*m_pOrder)[row] : row;
+        if (m_pOrder == nullptr)
+            return m_filter[row];
+        if (m_filteredOrderDirty)
+            UpdateFilteredOrder();
+        return m_filteredOrder[row];
+    }
+
+    // Matches in the sort order; those beyond the rows sorted so far follow in timestamp order.
+    void UpdateFilteredOrder()
+    {
+        m_filteredOrder.clear();
+        m_filteredOrder.reserve(m_filter.size());
+        for (uint32_t ordinal : *m_pOrder) {
+            if (ordinal / 64 < m_filterMask.size() && ((m_filterMask[ordinal / 64] >> (ordinal % 64)) & 1))
+                m_filteredOrder.push_back(ordinal);
+        }
+        auto unsorted = std::lower_bound(m_filter.begin(), m_filter.end(), static_cast<uint32_t>(m_pOrder->size()));
+        m_filteredOrder.insert(m_filteredOrder.end(), unsorted, m_filter.end());
+        m_filteredOrderDirty = false;
+    }
+
+    void RequestPage(uint64_t pageIndex, QueryPriority priority)
+    {
+        if (m_pages.Get(pageIndex) == nullptr && m_pages.MarkRequested(pageIndex))
+            m_scheduler.Submit(EventPageQuery{ m_id, pageIndex * EVENT_PAGE_SIZE, EVENT_PAGE_SIZE }, priority);
+    }
+
+    const EventRow* GetRow(size_t row)
+    {
+        const EventPage* pPage = m_pages.Get(row / EVENT_PAGE_SIZE);
+        size_t pageRow = row % EVENT_PAGE_SIZE;
+        return pPage != nullptr && pageRow < pPage->m_rows.size() ? &pPage->m_rows[pageRow] : nullptr;
+    }
+
+    PageScheduler& m_scheduler;
+    PageCache<EventPage>& m_pages;
+    PageCache<std::vector<std::string>>& m_formattedRows;
+    DecoderContext& m_formatter;
+    std::vector<std::string> m_values;
+    EventIdentifier m_id{};
+    uint64_t m_rowCount = 0;
+    size_t m_columnCount = 0;
+    size_t m_cachedRow = SIZE_MAX;
+    const std::vector<std::string>* m_pCachedValues = nullptr;
+    std::shared_ptr<EtlColumnTable> m_pTable;
+    std::unique_ptr<TableSortIndex> m_pSortIndex;
+    std::vector<EtlStringRanks> m_stringRanks; // Per property column, so streamed batches only rank their new strings.
+    const std::vector<uint32_t>* m_pOrder = nullptr; // Row order, or nullptr for timestamp order.
+    bool m_filterActive = false;
+    std::vector<uint32_t> m_filter;        // Matching occurrences in timestamp order.
+    std::vector<uint64_t> m_filterMask;    // One bit per occurrence, set for matches.
+    std::vector<uint32_t> m_filteredOrder; // Matches in the order of m_pOrder.
+    bool m_filteredOrderDirty = true;
+    char m_label[64];
+};
+
+// Scratch of PlotTimeDensity, kept across frames.
+struct TimelineScratch {
+    std::vector<EtlTimePyramid::Sample> m_samples;
+    std::vector<double> m_x;
+    std::vector<double> m_mean;
+    std::vector<double> m_min;
+    std::vector<double> m_max;
+    std::vector<int64_t> m_edges; // Timestamps of the bucket edges, converted to seconds into m_x.
+};
+
+/*
+Plots a time pyramid over the visible part of the current plot, whose x axis is in seconds from the
+start of the trace, from the level with about one bucket per pixel: the mean level 0 count of each
+bucket as a line over the band between the smallest and the largest level 0 count it covers.
+*/
+static void PlotTimeDensity(const char* label, const EtlTimeDensityIndex& density, const EtlTimePyramid& pyramid, const EtlTimeConverter& converter, TimelineScratch& scratch)
+{
+    ImPlotRect limits = ImPlot::GetPlotLimits();
+    size_t pixels = (std::max)(static_cast<size_t>(ImPlot::GetPlotSize().x), static_cast<size_t>(1));
+    double begin = static_cast<double>(converter.FromSeconds(limits.X.Min) - density.GetBegin());
+    double end = static_cast<double>(converter.FromSeconds(limits.X.Max) - density.GetBegin());
+    EtlTimeDensityIndex::Window window = density.GetWindow(begin, end, pixels);
+    pyramid.GetSamples(window.m_level, window.m_first, window.m_count, scratch.m_samples);
+    int64_t width = static_cast<int64_t>(density.GetBucketWidth(window.m_level));
+    scratch.m_edges.clear();
+    scratch.m_mean.clear();
+    scratch.m_min.clear();
+    scratch.m_max.clear();
+    for (uint32_t i = 0; i < window.m_count; i++) {
+        const EtlTimePyramid::Sample& sample = scratch.m_samples[i];
+        // Both edges of the bucket, so the outline steps between buckets.
+        for (uint32_t edge = 0; edge < 2; edge++) {
+            scratch.m_edges.push_back(density.GetBegin() + static_cast<int64_t>(window.m_first + i + edge) * width);
+            scratch.m_mean.push_back(sample.m_mean);
+            scratch.m_min.push_back(sample.m_min);
+            scratch.m_max.push_back(sample.m_max);
+        }
+    }
+    scratch.m_x.resize(scratch.m_edges.size());
+    converter.ToSeconds(scratch.m_edges, scratch.m_x);
+    int count = static_cast<int>(scratch.m_x.size());
+    ImPlot::PushStyleVar(ImPlotStyleVar_FillAlpha, 0.25f);
+    ImPlot::PlotShaded(label, scratch.m_x.data(), scratch.m_min.data(), scratch.m_max.data(), count);
+    ImPlot::PopStyleVar();
+    ImPlot::PlotLine(label, scratch.m_x.data(), scratch.m_mean.data(), count);
+}
+
+/*
+Draws the rows of a table that are visible in the current window through ImGuiListClipper.
+Returns the index of the row whose label was clicked, or -1.
+*/
+static int64_t DrawTableRows(TableRowSource& source)
+{
+    int64_t clickedRow = -1;
+    ImGuiListClipper clipper;
+    clipper.Begin(static_cast<int>(source.RowCount()));
+    while (clipper.Step()) {
+        VisitTableRows(source, clipper.DisplayStart, clipper.DisplayEnd, [&](size_t row, bool ready) {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            if (!ready) {
+                ImGui::TextDisabled("Loading...");
+                return;
+            }
+            if (ImGui::Selectable(source.GetLabel(row), source.IsSelected(row), ImGuiSelectableFlags_SpanAllColumns))
+                clickedRow = static_cast<int64_t>(row);
+            for (size_t column = 1; column < source.ColumnCount(); column++) {
+                ImGui::TableNextColumn();
+                std::string_view text = source.GetCell(row, column);
+                ImGui::TextUnformatted(text.data(), text.data() + text.size());
+            }
+        });
+    }
+    return clickedRow;
 }
 
 std::map<LONG, std::string> styleNames = {
@@ -992,26 +2265,86 @@ int main(int, char**)
     std::wstring etlFilePathW;
     ConvertStringToWString(etlFilePath, &etlFilePathW);
 
-    EVENT_TRACE_LOGFILE logFile = { 0 };    
-    logFile.LoggerName = NULL;
-    logFile.LogFileName = const_cast<LPWSTR>(etlFilePathW.c_str());
-    logFile.ProcessTraceMode = PROCESS_TRACE_MODE_EVENT_RECORD | PROCESS_TRACE_MODE_RAW_TIMESTAMP;
-    logFile.EventRecordCallback = (PEVENT_RECORD_CALLBACK)(EventRecordCallback);
-
-    TRACEHANDLE traceHandle = OpenTrace(&logFile);
-    if (traceHandle == INVALID_PROCESSTRACE_HANDLE) {
-        std::cerr << "Failed to open trace" << std::endl;
-        return 1;
+    // A current sidecar index replaces the metadata pass, including the scan of the buffer headers.
+    std::filesystem::path sidecarPath = etlFilePathW + L".lensidx";
+    EtlTraceSource traceSource;
+    std::unique_ptr<EtlSidecarIndex> pSidecar;
+    std::unique_ptr<EtlFile> pEtlFile;
+    try {
+        traceSource = EtlTraceSource::Of(etlFilePathW);
+        pSidecar = EtlSidecarIndex::Open(sidecarPath, traceSource);
+        if (pSidecar)
+            pEtlFile = std::make_unique<EtlFile>(etlFilePathW, pSidecar->GetBuffers());
+        else
+            pEtlFile = std::make_unique<EtlFile>(etlFilePathW);
     }
-
-    ULONG status = ProcessTrace(&traceHandle, 1, NULL, NULL);
-    if (status != ERROR_SUCCESS) {
-        std::cerr << "ProcessTrace failed with status: " << status << std::endl;
-        CloseTrace(traceHandle);
+    catch (const std::exception& e) {
+        std::cerr << "Failed to open trace: " << e.what() << std::endl;
         return 1;
     }
+    const EtlFile& etlFile = *pEtlFile;
+    EtlParallelReader etlReader(etlFile);
+    EtlOccurrenceIndex occurrenceIndex;
+    EventSchemaCache schemaCache;
+
+    std::future<bool> sidecarWrite;
+    std::vector<EtlTimeIndex::BufferRange> bufferRanges;
+    if (pSidecar) {
+        LoadSidecarIndex(*pSidecar, m_eventMetadataMap, occurrenceIndex);
+        bufferRanges.assign(pSidecar->GetBufferRanges().begin(), pSidecar->GetBufferRanges().end());
+    }
+    else {
+        IngestTrace(etlReader, m_eventMetadataMap, occurrenceIndex, bufferRanges);
+        // Whole-trace jobs get threads of their own and fork their chunks onto the pool, so they
+        // never hold a pool worker for their whole length.
+        sidecarWrite = std::async(std::launch::async, [&]() {
+            return SaveSidecarIndex(sidecarPath, traceSource, m_eventMetadataMap, occurrenceIndex, etlFile, bufferRanges);
+        });
+    }
+    // Time range of every buffer, so a time window reads only its buffers, and the clock of the trace.
+    EtlTimeIndex timeIndex = EtlTimeIndex::Build(bufferRanges);
+    EtlTimeConverter timeConverter(etlFile.GetLogFileInfo(), timeIndex.GetFirst());
+
+    // The trace database next to the .etl is rebuilt in the background unless it is already current.
+    std::filesystem::path databasePath = etlFilePathW + L".sqlite";
+    std::atomic<uint64_t> databaseGeneration = 0;
+    std::atomic<bool> databaseStopping = false;
+    QueryCancelToken databaseToken(databaseGeneration, 0, databaseStopping, nullptr);
+    std::unique_ptr<EtlTraceDatabase> pDatabase;
+    std::future<bool> databaseIngest;
+    std::string databaseStatus = "Database: up to date";
+    auto databaseStart = std::chrono::steady_clock::now();
+    try {
+        if (!EtlTraceDatabase::IsCurrent(databasePath, traceSource)) {
+            pDatabase = std::make_unique<EtlTraceDatabase>(databasePath, traceSource);
+            databaseIngest = std::async(std::launch::async, [&]() {
+                return IngestTraceDatabase(*pDatabase, etlReader, occurrenceIndex, schemaCache, databaseToken);
+            });
+        }
+    }
+    catch (const std::exception& e) {
+        databaseStatus = std::string("Database: ") + e.what();
+    }
 
-    CloseTrace(traceHandle);
+    // The text index is only built when asked for from the Search tab, as it reads and decodes every
+    // event; it is built in the background and searches are enabled once it is done.
+    std::atomic<uint64_t> textIndexGeneration = 0;
+    std::atomic<bool> textIndexStopping = false;
+    QueryCancelToken textIndexToken(textIndexGeneration, 0, textIndexStopping, nullptr);
+    std::atomic<uint64_t> textIndexProgress = 0;
+    uint64_t textIndexTotal = 0;
+    occurrenceIndex.ForEachList([&textIndexTotal](const EventIdentifier&, const EtlPostingList& postings) { textIndexTotal += postings.Size(); });
+    std::future<std::shared_ptr<const EtlTrigramIndex>> textIndexBuild;
+    std::shared_ptr<const EtlTrigramIndex> pTextIndex;
+    std::string textIndexStatus = "Build the text index to search";
+    // Event counts over time for the timeline, from the timestamps of the occurrence lists.
+    std::future<std::shared_ptr<const EtlTimeDensityIndex>> timeDensityBuild = std::async(std::launch::async, [&]() {
+        return EtlTimeDensityIndex::Build(occurrenceIndex, timeIndex.GetFirst(), timeIndex.GetLast(), etlReader);
+    });
+    std::shared_ptr<const EtlTimeDensityIndex> pTimeDensity;
+    TimelineScratch timelineScratch;
+    std::optional<std::pair<int64_t, int64_t>> timeWindow; // Timestamps [first, second) brushed on the timeline.
+    bool windowPending = false; // Set when timeWindow changes, so its events are listed again.
 
     ImGui_ImplWin32_EnableDpiAwareness();
     WNDCLASSEXW wc = { sizeof(wc), CS_CLASSDC, WndProc, 0L, 0L, GetModuleHandle(nullptr), nullptr, nullptr, nullptr, nullptr, L"ETL Lens", nullptr };
@@ -1045,6 +2378,7 @@ int main(int, char**)
 
     IMGUI_CHECKVERSION();
     ImGui::CreateContext();
+    ImPlot::CreateContext();
     ImGuiIO& io = ImGui::GetIO(); (void)io;
     io.ConfigFlags |= ImGuiConfigFlags_NavEnableKeyboard;
     io.ConfigFlags |= ImGuiConfigFlags_NavEnableGamepad;
@@ -1067,44 +2401,136 @@ int main(int, char**)
 
     bool running = true;
     //std::thread renderThread([&running, &hwnd, &io] {
-    TaskHandler<EventIdentifier, std::deque<EventData>> backgroundWorker([&running, &etlFilePathW](EventIdentifier&& filter, TaskHandler<EventIdentifier, std::deque<EventData>>* tH) -> bool {
-        EventIdentifier filterId = filter;
-        std::deque<EventData> events;
-        DecoderContext context(events, filterId, 100, nullptr);
-        EVENT_TRACE_LOGFILE logFile = { 0 };
-        logFile.LoggerName = NULL;
-        logFile.LogFileName = const_cast<LPWSTR>(etlFilePathW.c_str());
-        logFile.ProcessTraceMode = PROCESS_TRACE_MODE_EVENT_RECORD | PROCESS_TRACE_MODE_RAW_TIMESTAMP;
-        logFile.EventRecordCallback = (PEVENT_RECORD_CALLBACK)(EventRecordCallbackBackground);
-        logFile.Context = &context;
-
-        TRACEHANDLE traceHandle = OpenTrace(&logFile);
-        if (traceHandle == INVALID_PROCESSTRACE_HANDLE) {
-            std::cerr << "Failed to open trace" << std::endl;
-            return !running;
+    PageScheduler pageScheduler([&etlReader, &occurrenceIndex, &schemaCache](const EventPageQuery& query, PageScheduler::Context& context) -> std::optional<EventPage> {
+        EventIdentifier filterId = query.m_id;
+        EventPage page{ filterId, query.m_cursor, query.m_cursor, 0, {} };
+        // The occurrence index lists the type's events in timestamp order, so only the
+        // events of the requested page are read from the file.
+        std::vector<EtlEventLocation> locations;
+        if (const EtlPostingList* pPostings = occurrenceIndex.Find(filterId)) {
+            page.m_totalCount = pPostings->Size();
+            page.m_nextCursor = pPostings->ForEachFrom(query.m_cursor, [&locations, &query](const EtlEventLocation& location) {
+                if (locations.size() >= query.m_pageSize)
+                    return false;
+                locations.push_back(location);
+                return true;
+            });
         }
 
-        context.m_traceHandle = traceHandle;
-
-        ULONG status = ProcessTrace(&traceHandle, 1, NULL, NULL);
-        if (status != ERROR_SUCCESS) {
-            std::cerr << "ProcessTrace failed with status: " << status << std::endl;
-            CloseTrace(traceHandle);
-            return !running;
+        // Rows only reference their payload and schema; formatting waits until a row is shown.
+        std::vector<std::vector<EventRow>> chunkRows(etlReader.GetThreadCount());
+        std::deque<DecoderContext> contexts;
+        for (size_t i = 0; i < chunkRows.size(); i++)
+            contexts.emplace_back(schemaCache, nullptr);
+        etlReader.ForEachLocation(locations, [&contexts, &chunkRows, &context](unsigned chunkIndex, size_t, const EtlEventView& view) -> bool {
+            if (context.IsCancelled())
+                return false;
+            EtlEventRecord record(view);
+            EventRow row;
+            if (contexts[chunkIndex].MakeEventRow(record.Get(), &row))
+                chunkRows[chunkIndex].push_back(row);
+            return true;
+        });
+        if (context.IsCancelled())
+            return std::nullopt;
+
+        page.m_rows.reserve(locations.size());
+        for (auto& chunk : chunkRows)
+            page.m_rows.insert(page.m_rows.end(), chunk.begin(), chunk.end());
+        return page;
+    });
+    // Only the column table of the latest selection is built; selecting another type cancels the running build.
+    // Batches are streamed to the UI as they are decoded, and decoding waits while the UI falls behind.
+    TableScheduler tableScheduler([&etlReader, &occurrenceIndex, &schemaCache](const EventIdentifier& id, TableScheduler::Context& context) -> std::optional<ColumnTableResult> {
+        bool complete = DecodeColumnTable(id, etlReader, occurrenceIndex, schemaCache, context, COLUMN_TABLE_BATCH_ROWS, [&](std::shared_ptr<const EtlColumnTable> pBatch) {
+            return context.Emit(ColumnTableResult{ id, std::move(pBatch), false });
+        });
+        if (!complete)
+            return std::nullopt;
+        return ColumnTableResult{ id, nullptr, true };
+    });
+    // Filter scans of the selected type; entering another filter or selecting another type cancels the running scan.
+    FilterScheduler filterScheduler([&etlReader, &occurrenceIndex, &schemaCache](const FilterQuery& query, FilterScheduler::Context& context) -> std::optional<FilterResult> {
+        uint64_t scanned = 0;
+        uint64_t decoded = 0;
+        bool complete = FilterOccurrences(query, etlReader, occurrenceIndex, schemaCache, context, FILTER_BATCH_ROWS, [&](FilterResult&& result) {
+            scanned = result.m_scanned;
+            decoded = result.m_decoded;
+            return context.Emit(std::move(result));
+        });
+        if (!complete)
+            return std::nullopt;
+        return FilterResult{ query.m_id, {}, scanned, decoded, true };
+    });
+    // Text searches run on their own worker; searching again cancels the previous search.
+    SearchScheduler searchScheduler([&etlReader, &occurrenceIndex, &schemaCache](const TextSearchQuery& query, SearchScheduler::Context& context) -> std::optional<TextSearchResult> {
+        return SearchText(query, etlReader, occurrenceIndex, schemaCache, context);
+    });
+    std::vector<char> searchText(TEXT_SEARCH_TEXT_CAPACITY);
+    TextSearchResult searchResult;
+    TextSearchRows searchTypeRows(searchResult, true);
+    TextSearchRows searchMatchRows(searchResult, false);
+    std::string searchStatus;
+    // Events of all types in the brushed time window, listed on their own worker.
+    WindowScheduler windowScheduler([&etlReader, &timeIndex, &timeConverter](const WindowQuery& query, WindowScheduler::Context& context) -> std::optional<WindowResult> {
+        return ListWindowEvents(query, etlReader, timeIndex, timeConverter, context, WINDOW_MAX_EVENTS);
+    });
+    WindowResult windowResult;
+    WindowEventRows windowRows(windowResult);
+    std::string windowStatus;
+    // SQL console over the decoded column tables. Statements run on their own worker; running another one cancels the previous.
+    std::unique_ptr<EtlMemoryDatabase> pMemoryDatabase;
+    std::string sqlStatus;
+    try {
+        pMemoryDatabase = std::make_unique<EtlMemoryDatabase>([&etlReader, &occurrenceIndex, &schemaCache](const EventIdentifier& id, const QueryCancelToken& token) {
+            return LoadColumnTable(id, etlReader, occurrenceIndex, schemaCache, token);
+        });
+        uint32_t typeId = 0;
+        for (const auto& [id, metadata] : m_eventMetadataMap) {
+            const EtlPostingList* pPostings = occurrenceIndex.Find(id);
+            pMemoryDatabase->AddEventType(++typeId, MakeDatabaseEventType(id, metadata), pPostings ? pPostings->Size() : 0);
         }
-
-        CloseTrace(traceHandle);
-        tH->PushOutput(std::move(events));
-        return !running;
+    }
+    catch (const std::exception& e) {
+        pMemoryDatabase.reset();
+        sqlStatus = e.what();
+    }
+    SqlScheduler sqlScheduler([&pMemoryDatabase](const std::string& sql, SqlScheduler::Context& context) -> std::optional<EtlSqlResult> {
+        return pMemoryDatabase->Execute(sql, context, SQL_CONSOLE_MAX_ROWS);
     });
-    std::deque<EventData> uiEvents;
+    std::vector<char> sqlText(SQL_CONSOLE_TEXT_CAPACITY);
+    std::format_to_n(sqlText.data(), sqlText.size() - 1, "SELECT table_name, provider, task, opcode, row_count FROM event_types ORDER BY row_count DESC");
+    EtlSqlResult sqlResult;
+    SqlResultRows sqlRows(sqlResult);
+    bool sqlRunning = false;
+    SelectionTimings selectionTimings;
+    PageCache<EventPage> eventPages(EVENT_PAGE_CACHE_CAPACITY);
+    PageCache<std::vector<std::string>> formattedRows(FORMATTED_ROW_CACHE_CAPACITY);
+    DecoderContext rowFormatter(schemaCache, nullptr);
+    EventIdentifier selectedId{};
     std::vector<EventMetadata> items;
     items.reserve(m_eventMetadataMap.size());
     for (auto& pair : m_eventMetadataMap)
+    {
         items.push_back(pair.second);
+        EventMetadata& item = items.back();
+        std::string label = std::format("{}###{}{}{}", g_stringPool.Get(item.m_providerName), GuidToString(item.m_providerId), item.m_eventId, item.m_version);
+        item.m_displayLabel = g_stringPool.Intern(label);
+    }
     ImVec4 clear_color = ImVec4(0.f, 0.f, 0.f, 1.00f);
     EventMetadata noEvent{}; //Compare with all zero.
     EventMetadata selectedEvent{};
+    std::optional<EventIdentifier> requestedSelection; // Type picked outside the Events table, selected on the next frame.
+    TableSortIndex metadataSortIndex(METADATA_COLUMN_COUNT);
+    UpdateMetadataSortKeys(metadataSortIndex, items);
+    metadataSortIndex.AppendRows(items.size());
+    EventMetadataRows metadataRows(items, metadataSortIndex, selectedEvent);
+    EventInstanceRows instanceRows(pageScheduler, eventPages, formattedRows, rowFormatter);
+    bool instanceSortPending = false; // Set when column table rows arrive, so the current sort specs are applied.
+    std::vector<char> filterText(FILTER_TEXT_CAPACITY);
+    std::string filterStatus;
+    bool filterPending = false; // Set when a filter is entered or another type is selected, so the filter is compiled for it.
+    std::chrono::steady_clock::time_point filterStart;
     while (running)
     {
         MSG msg;
@@ -1169,78 +2595,37 @@ int main(int, char**)
                     // Handle sorting
                     if (ImGuiTableSortSpecs* sortSpecs = ImGui::TableGetSortSpecs()) {
                         if (sortSpecs->SpecsDirty) {
-                            std::sort(items.begin(), items.end(), [&](const EventMetadata& a, const EventMetadata& b) -> bool {
-                                for (int n = 0; n < sortSpecs->SpecsCount; n++) {
-                                    const ImGuiTableColumnSortSpecs* spec = &sortSpecs->Specs[n];
-                                    int delta = 0;
-                                    switch (spec->ColumnIndex) {
-                                    case 0: delta = a.m_providerName.compare(b.m_providerName); break;
-                                    case 1: delta = a.m_taskName.compare(b.m_taskName); break;
-                                    case 2: delta = a.m_opCodeName.compare(b.m_opCodeName); break;
-                                    case 3: delta = a.m_levelName.compare(b.m_levelName); break;
-                                    case 4: delta = a.m_channelName.compare(b.m_channelName); break;
-                                    case 5: delta = a.m_keywordsName.compare(b.m_keywordsName); break;
-                                    case 6: delta = (int)a.m_eventId - (int)b.m_eventId; break;
-                                    case 7: delta = (int)a.m_version - (int)b.m_version; break;
-                                    }
-                                    if (delta > 0)
-                                        return (spec->SortDirection == ImGuiSortDirection_Descending);
-                                    if (delta < 0)
-                                        return (spec->SortDirection == ImGuiSortDirection_Ascending);
-                                }
-                                return coalesce(a.m_providerName.compare(b.m_providerName), a.m_taskName.compare(b.m_taskName), (int)a.m_eventId - (int)b.m_eventId, (int)a.m_version - (int)b.m_version);
-                                });
+                            // Provider, task, id and version break the remaining ties.
+                            std::vector<TableSortIndex::SortKey> sortKeys;
+                            for (int n = 0; n < sortSpecs->SpecsCount; n++)
+                                sortKeys.push_back({ static_cast<uint32_t>(sortSpecs->Specs[n].ColumnIndex), sortSpecs->Specs[n].SortDirection == ImGuiSortDirection_Descending });
+                            for (uint32_t column : { METADATA_COLUMN_PROVIDER, METADATA_COLUMN_TASK, METADATA_COLUMN_EVENT_ID, METADATA_COLUMN_VERSION }) {
+                                if (std::none_of(sortKeys.begin(), sortKeys.end(), [column](const TableSortIndex::SortKey& key) { return key.m_column == column; }))
+                                    sortKeys.push_back({ column, false });
+                            }
+                            metadataSortIndex.Sort(sortKeys);
                             sortSpecs->SpecsDirty = false;
                         }
                     }
 
-                    for (auto& metadata : items) {
-                        ImGui::TableNextRow();
-                        ImGui::TableNextColumn();
-                        std::string providerName;
-                        ConvertWStringToString(metadata.m_providerName, &providerName);
-                        ImGui::PushStyleColor(ImGuiCol_HeaderHovered, ImGui::GetStyleColorVec4(ImGuiCol_Header)); 
-                        std::string providerIdStr = GuidToString(metadata.m_providerId);
-                        std::string label = std::vformat("{}###{}{}{}", std::make_format_args(providerName, providerIdStr, metadata.m_eventId, metadata.m_version));
-                        if (ImGui::Selectable(label.c_str(), metadata == selectedEvent, ImGuiSelectableFlags_SpanAllColumns)) {
-                            if (selectedEvent != metadata) {
-                                selectedEvent = metadata;
-                                uiEvents.clear();
-                                backgroundWorker.PushInput(EventIdentifier{ selectedEvent.m_providerId, selectedEvent.m_eventId, selectedEvent.m_version });
-                            }
-                        }
-                        ImGui::PopStyleColor();
-
-                        ImGui::TableNextColumn();
-                        std::string taskName;
-                        ConvertWStringToString(metadata.m_taskName, &taskName);
-                        ImGui::Text(taskName.c_str());
-
-                        ImGui::TableNextColumn();
-                        std::string opCode;
-                        ConvertWStringToString(metadata.m_opCodeName, &opCode);
-                        ImGui::Text(opCode.c_str());
-
-                        ImGui::TableNextColumn();
-                        std::string level;
-                        ConvertWStringToString(metadata.m_levelName, &level);
-                        ImGui::Text(level.c_str());
-
-                        ImGui::TableNextColumn();
-                        std::string channel;
-                        ConvertWStringToString(metadata.m_channelName, &channel);
-                        ImGui::Text(channel.c_str());
-
-                        ImGui::TableNextColumn();
-                        std::string keywords;
-                        ConvertWStringToString(metadata.m_keywordsName, &keywords);
-                        ImGui::Text(keywords.c_str());
-
-                        ImGui::TableNextColumn();
-                        ImGui::Text(std::to_string(metadata.m_eventId).c_str());
-
-                        ImGui::TableNextColumn();
-                        ImGui::Text(std::to_string(metadata.m_version).c_str());
+                    ImGui::PushStyleColor(ImGuiCol_HeaderHovered, ImGui::GetStyleColorVec4(ImGuiCol_Header));
+                    int64_t clickedRow = DrawTableRows(metadataRows);
+                    ImGui::PopStyleColor();
+                    if (clickedRow >= 0) {
+                        const EventMetadata& clicked = metadataRows.GetMetadata(clickedRow);
+                        requestedSelection = EventIdentifier{ clicked.m_providerId, clicked.m_eventId, clicked.m_version };
+                    }
+                    auto requestedIt = requestedSelection ? m_eventMetadataMap.find(*requestedSelection) : m_eventMetadataMap.end();
+                    requestedSelection.reset();
+                    if (requestedIt != m_eventMetadataMap.end() && selectedEvent != requestedIt->second) {
+                        selectedEvent = requestedIt->second;
+                        selectedId = EventIdentifier{ selectedEvent.m_providerId, selectedEvent.m_eventId, selectedEvent.m_version };
+                        const EtlPostingList* pPostings = occurrenceIndex.Find(selectedId);
+                        instanceRows.Reset(selectedId, pPostings ? pPostings->Size() : 0, selectedEvent.m_properties.size() + 1); // Pages are requested as rows become visible.
+                        tableScheduler.NewGeneration();
+                        tableScheduler.Submit(EventIdentifier{ selectedId });
+                        selectionTimings = SelectionTimings{ std::chrono::steady_clock::now() };
+                        filterPending = true;
                     }
 
                     ImGui::EndTable();
@@ -1249,6 +2634,48 @@ int main(int, char**)
             ImGui::EndChild();
             if (ImGui::BeginChild("Bottom", ImVec2(0,0), ImGuiChildFlags_Border)) {
                 if (ImGui::BeginChild("Event Struct", ImVec2(ImGui::GetWindowWidth() * 0.1f, -1), ImGuiChildFlags_Border | ImGuiChildFlags_ResizeX)) {
+                    // Batches are appended as they arrive, so the table grows while the type is decoded.
+                    ColumnTableResult receivedTable;
+                    while (tableScheduler.PopResult(&receivedTable)) {
+                        if (receivedTable.m_pBatch) {
+                            instanceRows.AppendTableBatch(*receivedTable.m_pBatch);
+                            selectionTimings.m_tableRows += receivedTable.m_pBatch->RowCount();
+                            instanceSortPending = true;
+                        }
+                        if (receivedTable.m_done) {
+                            selectionTimings.m_tableMs = selectionTimings.ElapsedMs();
+                            if (pMemoryDatabase)
+                                pMemoryDatabase->Publish(receivedTable.m_id, instanceRows.ShareTable());
+                        }
+                    }
+                    if (selectedEvent != noEvent) {
+                        const EtlColumnTable* pTable = instanceRows.GetTable();
+                        ImGui::TextDisabled("%s%zu rows, %.1f MB", selectionTimings.m_tableMs < 0.0 ? "Decoding... " : "",
+                            pTable ? pTable->RowCount() : 0, pTable ? pTable->ByteSize() / (1024.0 * 1024.0) : 0.0);
+                        if (selectionTimings.m_firstRowMs >= 0.0)
+                            ImGui::TextDisabled("First rows in %.1f ms", selectionTimings.m_firstRowMs);
+                        ImGui::TextDisabled("%.0f rows/s", selectionTimings.RowsPerSecond());
+                    }
+                    if (databaseIngest.valid()) {
+                        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - databaseStart).count();
+                        if (databaseIngest.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+                            bool finished = false;
+                            try {
+                                finished = databaseIngest.get();
+                            }
+                            catch (const std::exception&) {
+                            }
+                            databaseStatus = finished ? std::format("Database: {} rows in {:.1f} s", pDatabase->GetRowsWritten(), seconds)
+                                : "Database: failed, " + pDatabase->GetError();
+                        }
+                        else {
+                            databaseStatus = std::format("Database: writing, {} rows, {:.0f} rows/s", pDatabase->GetRowsWritten(), pDatabase->GetRowsWritten() / (std::max)(seconds, 1e-3));
+                        }
+                    }
+                    ImGui::TextDisabled("%s", databaseStatus.c_str());
+                    ImGui::TextDisabled("Schemas: %zu, %llu hits, %llu misses", schemaCache.Size(), schemaCache.GetHitCount(), schemaCache.GetMissCount());
+                    StringPool::Stats poolStats = g_stringPool.GetStats();
+                    ImGui::TextDisabled("Names: %llu unique, %.1fx dedup, %.1f MB saved", poolStats.m_uniqueCount, poolStats.DedupRatio(), poolStats.BytesSaved() / (1024.0 * 1024.0));
                     if (ImGui::BeginTable("Event Details", 2, ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders | ImGuiTableFlags_ScrollX | ImGuiTableFlags_ScrollY | ImGuiTableFlags_SizingFixedFit)) {
                         ImGui::TableSetupScrollFreeze(0, 1);
                         ImGui::TableSetupColumn("Property");
@@ -1257,11 +2684,9 @@ int main(int, char**)
                         for (auto& pair : selectedEvent.m_properties) {
                             ImGui::TableNextRow();
                             ImGui::TableNextColumn();
-                            std::string name;
-                            ConvertWStringToString(pair.first, &name);
-                            ImGui::Text(name.c_str());
+                            ImGui::TextUnformatted(g_stringPool.CStr(pair.first));
                             ImGui::TableNextColumn();
-                            ImGui::Text(pair.second.c_str());
+                            ImGui::TextUnformatted(g_stringPool.CStr(pair.second));
                         }
 
                     }
@@ -1270,43 +2695,272 @@ int main(int, char**)
                 ImGui::EndChild();
                 ImGui::SameLine();
                 if (ImGui::BeginChild("Events", ImVec2(-1, -1), ImGuiChildFlags_Border | ImGuiChildFlags_AlwaysAutoResize | ImGuiChildFlags_AutoResizeX)) {
-                    backgroundWorker.PopOutput(&uiEvents, false); //Update if thread has provided new ones.
-                    if (selectedEvent != noEvent) {
-                        if (ImGui::BeginTable("Events Instances", selectedEvent.m_properties.size() + 1,ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders | ImGuiTableFlags_ScrollY | ImGuiTableFlags_ScrollX | ImGuiTableFlags_Reorderable | ImGuiTableFlags_SizingFixedFit, ImGui::GetWindowSize())) {
+                    if (instanceRows.ReceivePages() != 0 && selectionTimings.m_firstRowMs < 0.0)
+                        selectionTimings.m_firstRowMs = selectionTimings.ElapsedMs();
+                    // Filters are compiled against the property names of the selected type.
+                    if (filterPending) {
+                        filterPending = false;
+                        filterScheduler.NewGeneration();
+                        filterStatus.clear();
+                        instanceRows.SetFilter(false);
+                        if ((filterText[0] != '\0' || timeWindow) && selectedEvent != noEvent) {
+                            std::vector<std::string> names;
+                            for (const auto& pair : selectedEvent.m_properties)
+                                names.emplace_back(g_stringPool.Get(pair.first));
+                            try {
+                                EtlFilter filter = filterText[0] != '\0' ? EtlFilter::Compile(filterText.data(), names) : EtlFilter();
+                                if (timeWindow)
+                                    filter.RestrictTime(timeWindow->first, timeWindow->second);
+                                auto pFilter = std::make_shared<const EtlFilter>(std::move(filter));
+                                instanceRows.SetFilter(true);
+                                filterScheduler.Submit(FilterQuery{ selectedId, std::move(pFilter) });
+                                filterStart = std::chrono::steady_clock::now();
+                                filterStatus = "Filtering...";
+                            }
+                            catch (const std::exception& e) {
+                                filterStatus = e.what();
+                            }
+                        }
+                    }
+                    FilterResult receivedFilter;
+                    while (filterScheduler.PopResult(&receivedFilter)) {
+                        instanceRows.AppendFilterMatches(receivedFilter.m_matches);
+                        filterStatus = std::format("{}{} of {} matched, {} decoded in {:.1f} ms", receivedFilter.m_done ? "" : "Filtering... ",
+                            instanceRows.RowCount(), receivedFilter.m_scanned, receivedFilter.m_decoded,
+                            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - filterStart).count());
+                    }
+                    // Density of all events and of the selected type. A right-drag selection restricts the instances to its time window.
+                    if (!pTimeDensity && timeDensityBuild.valid() && timeDensityBuild.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+                        pTimeDensity = timeDensityBuild.get();
+                    if (pTimeDensity && ImPlot::BeginPlot("##Timeline", ImVec2(-1, ImGui::GetTextLineHeightWithSpacing() * 8), ImPlotFlags_NoTitle | ImPlotFlags_NoMenus | ImPlotFlags_NoMouseText)) {
+                        double first = timeConverter.ToSeconds(pTimeDensity->GetBegin());
+                        double last = timeConverter.ToSeconds(pTimeDensity->GetBegin() + static_cast<int64_t>(pTimeDensity->GetSpan()));
+                        ImPlot::SetupAxes("Seconds", nullptr, 0, ImPlotAxisFlags_AutoFit);
+                        ImPlot::SetupAxisLimits(ImAxis_X1, first, last);
+                        ImPlot::SetupAxisLimitsConstraints(ImAxis_X1, first, last);
+                        ImPlot::SetupLegend(ImPlotLocation_NorthEast);
+                        PlotTimeDensity("All events", *pTimeDensity, pTimeDensity->GetTotal(), timeConverter, timelineScratch);
+                        const EtlTimePyramid* pSelectedPyramid = selectedEvent != noEvent ? pTimeDensity->Find(selectedId) : nullptr;
+                        if (pSelectedPyramid) {
+                            std::string label = std::format("{} {}###Selected", g_stringPool.Get(selectedEvent.m_providerName), g_stringPool.Get(selectedEvent.m_taskName));
+                            PlotTimeDensity(label.c_str(), *pTimeDensity, *pSelectedPyramid, timeConverter, timelineScratch);
+                        }
+                        if (timeWindow) {
+                            ImPlotRect limits = ImPlot::GetPlotLimits();
+                            double x1 = timeConverter.ToSeconds(timeWindow->first);
+                            double x2 = timeConverter.ToSeconds(timeWindow->second);
+                            ImPlot::DragRect(0, &x1, &limits.Y.Min, &x2, &limits.Y.Max, ImVec4(1.f, 1.f, 1.f, 0.5f), ImPlotDragToolFlags_NoInputs | ImPlotDragToolFlags_NoFit);
+                        }
+                        if (ImPlot::IsPlotSelected() && !ImGui::IsMouseDown(ImGuiMouseButton_Right)) {
+                            ImPlotRect selection = ImPlot::GetPlotSelection();
+                            timeWindow = { timeConverter.FromSeconds(selection.X.Min), timeConverter.FromSeconds(selection.X.Max) + 1 };
+                            ImPlot::CancelPlotSelection();
+                            filterPending = true;
+                            windowPending = true;
+                        }
+                        ImPlot::EndPlot();
+                    }
+                    if (timeWindow) {
+                        ImGui::TextDisabled("Time window: %.6f s to %.6f s (timestamps %lld to %lld)", timeConverter.ToSeconds(timeWindow->first), timeConverter.ToSeconds(timeWindow->second),
+                            static_cast<long long>(timeWindow->first), static_cast<long long>(timeWindow->second));
+                        ImGui::SameLine();
+                        if (ImGui::SmallButton("Clear")) {
+                            timeWindow.reset();
+                            filterPending = true;
+                            windowPending = true;
+                        }
+                    }
+                    bool showTabs = ImGui::BeginTabBar("Bottom Tabs");
+                    bool showInstances = showTabs && ImGui::BeginTabItem("Instances");
+                    if (showInstances && selectedEvent != noEvent) {
+                        // Header fields are tested before any payload is decoded, e.g. pid == 4 && FileName contains ".dll".
+                        ImGui::SetNextItemWidth(ImGui::GetFontSize() * 40);
+                        if (ImGui::InputTextWithHint("##Filter", "Filter, e.g. pid == 4 && IoSize > 65536", filterText.data(), filterText.size(), ImGuiInputTextFlags_EnterReturnsTrue))
+                            filterPending = true;
+                        ImGui::SameLine();
+                        ImGui::TextDisabled("%s", filterStatus.c_str());
+                        if (ImGui::BeginTable("Events Instances", selectedEvent.m_properties.size() + 1,ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders | ImGuiTableFlags_ScrollY | ImGuiTableFlags_ScrollX | ImGuiTableFlags_Reorderable | ImGuiTableFlags_SizingFixedFit | ImGuiTableFlags_Sortable | ImGuiTableFlags_SortMulti, ImGui::GetWindowSize())) {
                             ImGui::TableSetupScrollFreeze(0, 1);
-                            ImGui::TableSetupColumn("Timestamp");
+                            ImGui::TableSetupColumn("Timestamp", ImGuiTableColumnFlags_DefaultSort);
                             for (const auto& pair : selectedEvent.m_properties) {
-                                std::string name;
-                                ConvertWStringToString(pair.first, &name);
-                                ImGui::TableSetupColumn(name.c_str());
+                                ImGui::TableSetupColumn(g_stringPool.CStr(pair.first));
                             }
                             ImGui::TableHeadersRow();
-                            for (auto& uiEvent : uiEvents) {
-                                ImGui::TableNextRow();
-                                ImGui::TableNextColumn();
-                                uint64_t selectableId = reinterpret_cast<uint64_t>(&uiEvent);
-                                std::string text = std::vformat("{}###{}", std::make_format_args(uiEvent.timestamp, selectableId));
-                                ImGui::Selectable(text.c_str(), false, ImGuiSelectableFlags_SpanAllColumns);
-                                std::string name;
-                                int i = 0;
-                                for (auto& pair : uiEvent.m_properties) {
-                                    if (++i > selectedEvent.m_properties.size())
-                                        break;
-                                    ImGui::TableNextColumn();
-                                    ConvertWStringToString(pair.second, &name);
-                                    ImGui::Text(name.c_str());
-                                }
-                                if (selectedEvent.m_properties.size() > uiEvent.m_properties.size()) {
-                                    for (int i = 0; i < selectedEvent.m_properties.size() - uiEvent.m_properties.size(); i++) {
-                                        ImGui::TableNextColumn();
+
+                            // Sorting waits for the column table; the specs stay dirty until it has arrived.
+                            if (ImGuiTableSortSpecs* sortSpecs = ImGui::TableGetSortSpecs()) {
+                                if (sortSpecs->SpecsDirty || instanceSortPending) {
+                                    std::vector<TableSortIndex::SortKey> sortKeys;
+                                    for (int n = 0; n < sortSpecs->SpecsCount; n++)
+                                        sortKeys.push_back({ static_cast<uint32_t>(sortSpecs->Specs[n].ColumnIndex), sortSpecs->Specs[n].SortDirection == ImGuiSortDirection_Descending });
+                                    if (instanceRows.Sort(sortKeys)) {
+                                        sortSpecs->SpecsDirty = false;
+                                        instanceSortPending = false;
                                     }
                                 }
                             }
-
-
+                            // Only visible rows are drawn; their pages are fetched from the worker on demand
+                            // and the page cache keeps memory bounded however many occurrences the type has.
+                            DrawTableRows(instanceRows);
                         }
                         ImGui::EndTable();
                     }
+                    if (showInstances)
+                        ImGui::EndTabItem();
+
+                    if (textIndexBuild.valid()) {
+                        if (textIndexBuild.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+                            try {
+                                pTextIndex = textIndexBuild.get();
+                                textIndexStatus = std::format("Text index: {} trigrams, {:.1f} MB", pTextIndex->GetTrigramCount(), pTextIndex->GetByteSize() / (1024.0 * 1024.0));
+                            }
+                            catch (const std::exception& e) {
+                                textIndexStatus = std::string("Text index: ") + e.what();
+                            }
+                        }
+                        else {
+                            textIndexStatus = std::format("Indexing text... {:.0f}%", 100.0 * textIndexProgress / (std::max)(textIndexTotal, static_cast<uint64_t>(1)));
+                        }
+                    }
+                    TextSearchResult receivedSearch;
+                    while (searchScheduler.PopResult(&receivedSearch)) {
+                        searchResult = std::move(receivedSearch);
+                        searchStatus = searchResult.m_error.empty() ? std::format("{} events in {} types{}, {} candidates in {:.1f} ms", searchResult.m_matchCount,
+                            searchResult.m_types.size(), searchResult.m_matchCount > searchResult.m_matches.size() ? " (list truncated)" : "", searchResult.m_candidateCount, searchResult.m_milliseconds)
+                            : searchResult.m_error;
+                    }
+                    if (showTabs && ImGui::BeginTabItem("Search")) {
+                        // Case-insensitive substring search over string properties and EventWriteString messages.
+                        if (!pTextIndex && !textIndexBuild.valid()) {
+                            if (ImGui::Button("Build index")) {
+                                textIndexProgress = 0;
+                                textIndexBuild = std::async(std::launch::async, [&]() {
+                                    return BuildTextIndex(etlReader, occurrenceIndex, schemaCache, textIndexToken, TEXT_INDEX_BATCH_ROWS, textIndexProgress);
+                                });
+                            }
+                            ImGui::SameLine();
+                        }
+                        ImGui::SetNextItemWidth(ImGui::GetFontSize() * 40);
+                        bool search = ImGui::InputTextWithHint("##Search", "Text, e.g. \\Device\\HarddiskVolume", searchText.data(), searchText.size(), ImGuiInputTextFlags_EnterReturnsTrue);
+                        ImGui::SameLine();
+                        ImGui::BeginDisabled(!pTextIndex);
+                        search |= ImGui::Button("Search");
+                        ImGui::EndDisabled();
+                        if (search && pTextIndex) {
+                            searchScheduler.NewGeneration();
+                            searchScheduler.Submit(TextSearchQuery{ searchText.data(), pTextIndex });
+                            searchStatus = "Searching...";
+                        }
+                        ImGui::SameLine();
+                        ImGui::TextDisabled("%s", (pTextIndex ? searchStatus : textIndexStatus).c_str());
+                        // Clicking a type or an event selects its type in the Events table.
+                        ImGuiTableFlags searchTableFlags = ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders | ImGuiTableFlags_ScrollY | ImGuiTableFlags_ScrollX | ImGuiTableFlags_Resizable | ImGuiTableFlags_SizingFixedFit;
+                        if (ImGui::BeginTable("Search Types", static_cast<int>(searchTypeRows.ColumnCount()), searchTableFlags, ImVec2(ImGui::GetContentRegionAvail().x * 0.3f, -1))) {
+                            ImGui::TableSetupScrollFreeze(0, 1);
+                            ImGui::TableSetupColumn("Provider");
+                            ImGui::TableSetupColumn("Task");
+                            ImGui::TableSetupColumn("OpCode");
+                            ImGui::TableSetupColumn("Events");
+                            ImGui::TableHeadersRow();
+                            int64_t clickedType = DrawTableRows(searchTypeRows);
+                            if (clickedType >= 0)
+                                requestedSelection = searchTypeRows.GetType(clickedType);
+                            ImGui::EndTable();
+                        }
+                        ImGui::SameLine();
+                        if (ImGui::BeginTable("Search Events", static_cast<int>(searchMatchRows.ColumnCount()), searchTableFlags)) {
+                            ImGui::TableSetupScrollFreeze(0, 1);
+                            ImGui::TableSetupColumn("Provider");
+                            ImGui::TableSetupColumn("Task");
+                            ImGui::TableSetupColumn("OpCode");
+                            ImGui::TableSetupColumn("Timestamp");
+                            ImGui::TableSetupColumn("Text");
+                            ImGui::TableHeadersRow();
+                            int64_t clickedMatch = DrawTableRows(searchMatchRows);
+                            if (clickedMatch >= 0)
+                                requestedSelection = searchMatchRows.GetType(clickedMatch);
+                            ImGui::EndTable();
+                        }
+                        ImGui::EndTabItem();
+                    }
+                    if (windowPending) {
+                        windowPending = false;
+                        windowScheduler.NewGeneration();
+                        windowResult = WindowResult();
+                        windowStatus.clear();
+                        if (timeWindow) {
+                            windowScheduler.Submit(WindowQuery{ timeWindow->first, timeWindow->second });
+                            windowStatus = "Reading...";
+                        }
+                    }
+                    WindowResult receivedWindow;
+                    while (windowScheduler.PopResult(&receivedWindow)) {
+                        windowResult = std::move(receivedWindow);
+                        windowStatus = std::format("{} events{}, {} of {} buffers read in {:.1f} ms", windowResult.m_ids.size(), windowResult.m_truncated ? " (truncated)" : "",
+                            windowResult.m_bufferCount, timeIndex.GetBufferCount(), windowResult.m_milliseconds);
+                    }
+                    if (showTabs && ImGui::BeginTabItem("Window")) {
+                        // Every event in the time window brushed on the timeline. Clicking one selects its type.
+                        ImGui::TextDisabled("%s", timeWindow ? windowStatus.c_str() : "Right-drag on the timeline to choose a time window.");
+                        if (ImGui::BeginTable("Window Events", static_cast<int>(windowRows.ColumnCount()), ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders | ImGuiTableFlags_ScrollY | ImGuiTableFlags_ScrollX | ImGuiTableFlags_Resizable | ImGuiTableFlags_SizingFixedFit)) {
+                            ImGui::TableSetupScrollFreeze(0, 1);
+                            ImGui::TableSetupColumn("Time (s)");
+                            ImGui::TableSetupColumn("Wall time");
+                            ImGui::TableSetupColumn("Provider");
+                            ImGui::TableSetupColumn("Task");
+                            ImGui::TableSetupColumn("OpCode");
+                            ImGui::TableHeadersRow();
+                            int64_t clickedEvent = DrawTableRows(windowRows);
+                            if (clickedEvent >= 0)
+                                requestedSelection = windowRows.GetType(clickedEvent);
+                            ImGui::EndTable();
+                        }
+                        ImGui::EndTabItem();
+                    }
+                    EtlSqlResult receivedSql;
+                    while (sqlScheduler.PopResult(&receivedSql)) {
+                        sqlResult = std::move(receivedSql);
+                        sqlRunning = false;
+                        sqlStatus = sqlResult.m_error.empty() ? std::format("{} rows{} in {:.1f} ms, {} rows scanned", sqlResult.m_rowCount, sqlResult.m_truncated ? " (truncated)" : "",
+                            sqlResult.m_milliseconds, sqlResult.m_rowsScanned)
+                            : sqlResult.m_error;
+                    }
+                    if (showTabs && ImGui::BeginTabItem("SQL")) {
+                        // Tables are events_<type id>, described by event_types and event_columns. Ctrl+Enter runs the text.
+                        bool run = ImGui::InputTextMultiline("##SQL", sqlText.data(), sqlText.size(), ImVec2(-1, ImGui::GetTextLineHeight() * 6),
+                            ImGuiInputTextFlags_EnterReturnsTrue | ImGuiInputTextFlags_AllowTabInput);
+                        ImGui::BeginDisabled(!pMemoryDatabase);
+                        run |= ImGui::Button("Run");
+                        ImGui::EndDisabled();
+                        ImGui::SameLine();
+                        ImGui::BeginDisabled(!sqlRunning);
+                        if (ImGui::Button("Cancel")) {
+                            sqlScheduler.NewGeneration();
+                            sqlRunning = false;
+                            sqlStatus = "Cancelled";
+                        }
+                        ImGui::EndDisabled();
+                        if (run && pMemoryDatabase) {
+                            sqlScheduler.NewGeneration();
+                            sqlScheduler.Submit(std::string(sqlText.data()));
+                            sqlRunning = true;
+                            sqlStatus = "Running...";
+                        }
+                        ImGui::SameLine();
+                        ImGui::TextDisabled("%s", sqlStatus.c_str());
+                        if (sqlRows.ColumnCount() != 0 && ImGui::BeginTable("SQL Result", static_cast<int>(sqlRows.ColumnCount()), ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders |
+                            ImGuiTableFlags_ScrollY | ImGuiTableFlags_ScrollX | ImGuiTableFlags_Resizable | ImGuiTableFlags_SizingFixedFit)) {
+                            ImGui::TableSetupScrollFreeze(0, 1);
+                            for (size_t column = 0; column < sqlRows.ColumnCount(); column++)
+                                ImGui::TableSetupColumn(sqlResult.m_columns[column].c_str());
+                            ImGui::TableHeadersRow();
+                            DrawTableRows(sqlRows);
+                            ImGui::EndTable();
+                        }
+                        ImGui::EndTabItem();
+                    }
+                    if (showTabs)
+                        ImGui::EndTabBar();
                 }
                 ImGui::EndChild();
             }
@@ -1354,8 +3008,24 @@ int main(int, char**)
 
         frameCtx.m_fence.Signal();
     }
-    backgroundWorker.PushInput({GUID{}, 0, 0 });
-    backgroundWorker.Join();
+    // Background builds are cancelled first, so they stop while the schedulers drain.
+    textIndexStopping = true;
+    databaseStopping = true;
+    pageScheduler.Shutdown();
+    tableScheduler.Shutdown();
+    filterScheduler.Shutdown();
+    searchScheduler.Shutdown();
+    windowScheduler.Shutdown();
+    sqlScheduler.Shutdown();
+    if (sidecarWrite.valid())
+        sidecarWrite.wait();
+    if (textIndexBuild.valid())
+        textIndexBuild.wait();
+    if (timeDensityBuild.valid())
+        timeDensityBuild.wait();
+    if (databaseIngest.valid())
+        databaseIngest.wait();
+    pDatabase.reset();
     //});
 
         //MSG msg;
@@ -1372,6 +3042,7 @@ int main(int, char**)
     // Cleanup
     ImGui_ImplDX12_Shutdown();
     ImGui_ImplWin32_Shutdown();
+    ImPlot::DestroyContext();
     ImGui::DestroyContext();
 
 
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <filesystem>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*
+Read-only memory mapping of a whole file.
+The mapping stays valid for the lifetime of the object, so pointers handed out
+by Data() can be kept around as zero-copy views into the file.
+*/
+class MappedFile
+{
+public:
+    MappedFile() = default;
+
+    explicit MappedFile(const std::filesystem::path& path)
+    {
+#ifdef _WIN32
+        m_hFile = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, nullptr);
+        if (m_hFile == INVALID_HANDLE_VALUE)
+            throw std::runtime_error("Failed to open file for mapping");
+
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(m_hFile, &size)) {
+            Close();
+            throw std::runtime_error("Failed to query file size");
+        }
+        m_size = static_cast<size_t>(size.QuadPart);
+        if (m_size == 0)
+            return;
+
+        m_hMapping = CreateFileMappingW(m_hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (m_hMapping == nullptr) {
+            Close();
+            throw std::runtime_error("Failed to create file mapping");
+        }
+
+        m_pData = static_cast<const uint8_t*>(MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0));
+        if (m_pData == nullptr) {
+            Close();
+            throw std::runtime_error("Failed to map view of file");
+        }
+#else
+        m_fd = open(path.c_str(), O_RDONLY);
+        if (m_fd < 0)
+            throw std::runtime_error("Failed to open file for mapping");
+
+        struct stat st;
+        if (fstat(m_fd, &st) != 0) {
+            Close();
+            throw std::runtime_error("Failed to query file size");
+        }
+        m_size = static_cast<size_t>(st.st_size);
+        if (m_size == 0)
+            return;
+
+        void* pData = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, m_fd, 0);
+        if (pData == MAP_FAILED) {
+            Close();
+            throw std::runtime_error("Failed to map file");
+        }
+        m_pData = static_cast<const uint8_t*>(pData);
+#endif
+    }
+
+    MappedFile(const MappedFile& other) = delete;
+
+    MappedFile& operator=(const MappedFile& other) = delete;
+
+    MappedFile(MappedFile&& other) noexcept
+    {
+        *this = std::move(other);
+    }
+
+    MappedFile& operator=(MappedFile&& other) noexcept
+    {
+        if (this != &other) {
+            Close();
+            m_pData = other.m_pData;
+            m_size = other.m_size;
+#ifdef _WIN32
+            m_hFile = other.m_hFile;
+            m_hMapping = other.m_hMapping;
+            other.m_hFile = INVALID_HANDLE_VALUE;
+            other.m_hMapping = nullptr;
+#else
+            m_fd = other.m_fd;
+            other.m_fd = -1;
+#endif
+            other.m_pData = nullptr;
+            other.m_size = 0;
+        }
+        return *this;
+    }
+
+    ~MappedFile()
+    {
+        Close();
+    }
+
+    const uint8_t* Data() const { return m_pData; }
+    size_t Size() const { return m_size; }
+
+private:
+    void Close()
+    {
+#ifdef _WIN32
+        if (m_pData)
+            UnmapViewOfFile(m_pData);
+        if (m_hMapping)
+            CloseHandle(m_hMapping);
+        if (m_hFile != INVALID_HANDLE_VALUE)
+            CloseHandle(m_hFile);
+        m_hMapping = nullptr;
+        m_hFile = INVALID_HANDLE_VALUE;
+#else
+        if (m_pData)
+            munmap(const_cast<uint8_t*>(m_pData), m_size);
+        if (m_fd >= 0)
+            close(m_fd);
+        m_fd = -1;
+#endif
+        m_pData = nullptr;
+        m_size = 0;
+    }
+
+    const uint8_t* m_pData = nullptr;
+    size_t m_size = 0;
+#ifdef _WIN32
+    HANDLE m_hFile = INVALID_HANDLE_VALUE;
+    HANDLE m_hMapping = nullptr;
+#else
+    int m_fd = -1;
+#endif
+};
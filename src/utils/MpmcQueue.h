@@ -0,0 +1,99 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+/*
+Bounded lock-free multi-producer multi-consumer queue (Vyukov's sequence-numbered ring).
+Every cell carries a sequence number that tells producers and consumers whose turn it is, so a
+push or pop is one CAS on the shared position plus one release store on the cell. Values are
+moved in and out; a failed TryPush leaves the value untouched.
+*/
+template<typename T>
+class MpmcQueue
+{
+public:
+    // The capacity is rounded up to a power of two.
+    explicit MpmcQueue(size_t capacity)
+        : m_mask(std::bit_ceil((std::max)(capacity, size_t(2))) - 1), m_cells(std::make_unique<Cell[]>(m_mask + 1))
+    {
+        for (size_t i = 0; i <= m_mask; i++)
+            m_cells[i].m_sequence.store(i, std::memory_order_relaxed);
+    }
+
+    MpmcQueue(const MpmcQueue&) = delete;
+    MpmcQueue& operator=(const MpmcQueue&) = delete;
+
+    size_t Capacity() const { return m_mask + 1; }
+
+    bool TryPush(T&& value)
+    {
+        size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = m_cells[pos & m_mask];
+            size_t sequence = cell.m_sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.m_value = std::move(value);
+                    cell.m_sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0) {
+                return false; // Full.
+            }
+            else {
+                pos = m_enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool TryPop(T& value)
+    {
+        size_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = m_cells[pos & m_mask];
+            size_t sequence = cell.m_sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (m_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    value = std::move(cell.m_value);
+                    cell.m_value = T{}; // Release whatever the moved-from value still holds.
+                    cell.m_sequence.store(pos + m_mask + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0) {
+                return false; // Empty.
+            }
+            else {
+                pos = m_dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Number of queued values; only a snapshot while other threads are pushing or popping.
+    size_t SizeApprox() const
+    {
+        size_t enqueued = m_enqueuePos.load(std::memory_order_relaxed);
+        size_t dequeued = m_dequeuePos.load(std::memory_order_relaxed);
+        return enqueued > dequeued ? enqueued - dequeued : 0;
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> m_sequence;
+        T m_value;
+    };
+
+    const size_t m_mask;
+    std::unique_ptr<Cell[]> m_cells;
+    alignas(64) std::atomic<size_t> m_enqueuePos = 0;
+    alignas(64) std::atomic<size_t> m_dequeuePos = 0;
+};
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+/*
+Small LRU cache of result pages keyed by page index.
+Also remembers which pages have been requested but not delivered yet, so a page is only
+asked for once while it is in flight.
+*/
+template<typename T>
+class PageCache
+{
+public:
+    explicit PageCache(size_t capacity) : m_capacity(capacity) {
+
+    }
+
+    // Returns the page or nullptr, and marks it as most recently used.
+    const T* Get(uint64_t pageIndex) {
+        auto it = m_index.find(pageIndex);
+        if (it == m_index.end())
+            return nullptr;
+        m_pages.splice(m_pages.begin(), m_pages, it->second);
+        return &it->second->second;
+    }
+
+    void Insert(uint64_t pageIndex, T&& page) {
+        m_pending.erase(pageIndex);
+        auto it = m_index.find(pageIndex);
+        if (it != m_index.end()) {
+            it->second->second = std::move(page);
+            m_pages.splice(m_pages.begin(), m_pages, it->second);
+            return;
+        }
+
+        m_pages.emplace_front(pageIndex, std::move(page));
+        m_index[pageIndex] = m_pages.begin();
+        while (m_pages.size() > m_capacity) {
+            m_index.erase(m_pages.back().first);
+            m_pages.pop_back();
+        }
+    }
+
+    // Returns true if the page was not cached or pending, in which case it is now pending.
+    bool MarkRequested(uint64_t pageIndex) {
+        if (m_index.contains(pageIndex))
+            return false;
+        return m_pending.insert(pageIndex).second;
+    }
+
+    void Clear() {
+        m_pages.clear();
+        m_index.clear();
+        m_pending.clear();
+    }
+
+    size_t Size() const { return m_pages.size(); }
+
+private:
+    size_t m_capacity;
+    std::list<std::pair<uint64_t, T>> m_pages;
+    std::unordered_map<uint64_t, typename std::list<std::pair<uint64_t, T>>::iterator> m_index;
+    std::unordered_set<uint64_t> m_pending;
+};
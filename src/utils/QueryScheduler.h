@@ -0,0 +1,240 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+enum class QueryPriority : uint8_t {
+    Foreground, // Work the user is waiting for.
+    Background, // Prefetch; yields to foreground queries.
+};
+
+/*
+Handed to a running query and polled at cheap checkpoints. A query is cancelled when a newer
+generation has started or the scheduler is shutting down; background queries are also
+preempted while foreground queries are waiting.
+*/
+class QueryCancelToken
+{
+public:
+    QueryCancelToken(const std::atomic<uint64_t>& generation, uint64_t queryGeneration, const std::atomic<bool>& stopping,
+        const std::atomic<size_t>* pForegroundWaiting)
+        : m_generation(generation), m_queryGeneration(queryGeneration), m_stopping(stopping), m_pForegroundWaiting(pForegroundWaiting) {
+
+    }
+
+    bool IsCancelled() const
+    {
+        return m_generation.load(std::memory_order_relaxed) != m_queryGeneration || m_stopping.load(std::memory_order_relaxed) ||
+            (m_pForegroundWaiting != nullptr && m_pForegroundWaiting->load(std::memory_order_relaxed) != 0);
+    }
+
+    uint64_t GetGeneration() const { return m_queryGeneration; }
+
+private:
+    const std::atomic<uint64_t>& m_generation;
+    uint64_t m_queryGeneration;
+    const std::atomic<bool>& m_stopping;
+    const std::atomic<size_t>* m_pForegroundWaiting;
+};
+
+/*
+Runs queries on worker threads, latest first. Every query is tagged with the generation it was
+submitted in; NewGeneration drops the queued queries of older generations, cancels the running
+ones through their token and makes PopResult discard their results, so only output for the
+current selection ever reaches the caller. Foreground queries are taken before background ones,
+and a background query that gets preempted is queued again at the front of its queue.
+
+run(query, context) returns the final result, or nullopt if it stopped because
+context.IsCancelled(). Long queries can stream partial results with context.Emit; the result
+queue is bounded, so Emit and the delivery of final results block while the caller falls
+behind. Queries that emit should be
+foreground, since a preempted background query starts over.
+*/
+template<typename Query, typename Result>
+class QueryScheduler
+{
+public:
+    class Context : public QueryCancelToken
+    {
+    public:
+        Context(QueryScheduler& scheduler, uint64_t generation, bool foreground)
+            : QueryCancelToken(scheduler.m_generation, generation, scheduler.m_stopping, foreground ? nullptr : &scheduler.m_foregroundWaiting),
+            m_scheduler(scheduler) {
+
+        }
+
+        // Queues a partial result, waiting for space. Returns false if the query was cancelled meanwhile.
+        bool Emit(Result&& result) { return m_scheduler.PushResult(std::move(result), *this); }
+
+    private:
+        QueryScheduler& m_scheduler;
+    };
+
+    using RunFunc = std::function<std::optional<Result>(const Query&, Context&)>;
+
+    static constexpr size_t DEFAULT_RESULT_CAPACITY = 64;
+
+    explicit QueryScheduler(RunFunc run, unsigned workerCount = 1, size_t resultCapacity = DEFAULT_RESULT_CAPACITY)
+        : m_run(std::move(run)), m_resultCapacity(resultCapacity)
+    {
+        for (unsigned i = 0; i < (std::max)(workerCount, 1u); i++)
+            m_workers.emplace_back([this]() { WorkerLoop(); });
+    }
+
+    ~QueryScheduler()
+    {
+        Shutdown();
+    }
+
+    QueryScheduler(const QueryScheduler&) = delete;
+    QueryScheduler& operator=(const QueryScheduler&) = delete;
+
+    // Starts a new generation and returns it. Queued, running and finished work of older generations is discarded.
+    uint64_t NewGeneration()
+    {
+        std::lock_guard lock(m_lock);
+        m_foreground.clear();
+        m_background.clear();
+        m_foregroundWaiting.store(0, std::memory_order_relaxed);
+        m_results.clear();
+        uint64_t generation = m_generation.fetch_add(1, std::memory_order_relaxed) + 1;
+        m_resultSpace.notify_all(); // Emitting queries of the old generation give up.
+        return generation;
+    }
+
+    uint64_t GetGeneration() const { return m_generation.load(std::memory_order_relaxed); }
+
+    /*
+    Queues a query in the current generation. With replacePending, queries of the same priority
+    that have not started yet are dropped first, so only the latest one runs.
+    */
+    void Submit(Query&& query, QueryPriority priority = QueryPriority::Foreground, bool replacePending = false)
+    {
+        {
+            std::lock_guard lock(m_lock);
+            std::deque<Pending>& queue = priority == QueryPriority::Foreground ? m_foreground : m_background;
+            if (replacePending)
+                queue.clear();
+            queue.push_back(Pending{ std::move(query), m_generation.load(std::memory_order_relaxed) });
+            if (priority == QueryPriority::Foreground)
+                m_foregroundWaiting.store(m_foreground.size(), std::memory_order_relaxed);
+        }
+        m_wake.notify_one();
+    }
+
+    // Pops the next result of the current generation without blocking.
+    bool PopResult(Result* pResult)
+    {
+        std::lock_guard lock(m_lock);
+        while (!m_results.empty()) {
+            Finished finished = std::move(m_results.front());
+            m_results.pop_front();
+            m_resultSpace.notify_one();
+            if (finished.m_generation == m_generation.load(std::memory_order_relaxed)) {
+                *pResult = std::move(finished.m_result);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    size_t PendingCount() const
+    {
+        std::lock_guard lock(m_lock);
+        return m_foreground.size() + m_background.size();
+    }
+
+    // Cancels running queries and joins the workers. Safe to call more than once.
+    void Shutdown()
+    {
+        {
+            std::lock_guard lock(m_lock);
+            m_stopping.store(true, std::memory_order_relaxed);
+        }
+        m_wake.notify_all();
+        m_resultSpace.notify_all();
+        for (auto& worker : m_workers) {
+            if (worker.joinable())
+                worker.join();
+        }
+    }
+
+private:
+    struct Pending {
+        Query m_query;
+        uint64_t m_generation;
+    };
+
+    struct Finished {
+        Result m_result;
+        uint64_t m_generation;
+    };
+
+    bool PushResult(Result&& result, const QueryCancelToken& token)
+    {
+        std::unique_lock lock(m_lock);
+        return PushResultLocked(lock, std::move(result), token);
+    }
+
+    // Waits for space in the result queue with the lock held. Returns false if the token was cancelled meanwhile.
+    bool PushResultLocked(std::unique_lock<std::mutex>& lock, Result&& result, const QueryCancelToken& token)
+    {
+        m_resultSpace.wait(lock, [&]() { return m_results.size() < m_resultCapacity || token.IsCancelled(); });
+        if (token.IsCancelled())
+            return false;
+        m_results.push_back(Finished{ std::move(result), token.GetGeneration() });
+        return true;
+    }
+
+    void WorkerLoop()
+    {
+        std::unique_lock lock(m_lock);
+        for (;;) {
+            m_wake.wait(lock, [this]() { return m_stopping.load(std::memory_order_relaxed) || !m_foreground.empty() || !m_background.empty(); });
+            if (m_stopping.load(std::memory_order_relaxed))
+                return;
+
+            bool foreground = !m_foreground.empty();
+            std::deque<Pending>& queue = foreground ? m_foreground : m_background;
+            Pending pending = std::move(queue.front());
+            queue.pop_front();
+            if (foreground)
+                m_foregroundWaiting.store(m_foreground.size(), std::memory_order_relaxed);
+
+            lock.unlock();
+            Context context(*this, pending.m_generation, foreground);
+            std::optional<Result> result = m_run(pending.m_query, context);
+            lock.lock();
+
+            if (result) {
+                // A query that finished is past preemption: only a new generation or shutdown drops its result.
+                QueryCancelToken token(m_generation, pending.m_generation, m_stopping, nullptr);
+                PushResultLocked(lock, std::move(*result), token);
+            }
+            else if (pending.m_generation == m_generation.load(std::memory_order_relaxed) && !foreground) {
+                m_background.push_front(std::move(pending)); // Preempted; runs again once the foreground work is done.
+            }
+        }
+    }
+
+    RunFunc m_run;
+    size_t m_resultCapacity;
+    mutable std::mutex m_lock;
+    std::condition_variable m_wake;
+    std::condition_variable m_resultSpace;
+    std::deque<Pending> m_foreground;
+    std::deque<Pending> m_background;
+    std::deque<Finished> m_results;
+    std::atomic<uint64_t> m_generation = 0;
+    std::atomic<size_t> m_foregroundWaiting = 0;
+    std::atomic<bool> m_stopping = false;
+    std::vector<std::thread> m_workers;
+};
@@ -0,0 +1,195 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include <sqlite3/sqlite3.h>
+
+/*
+Prepared SQLite statement. Parameters are numbered from 1 and columns from 0, as in the C API.
+Bound text is not copied, so it must outlive the next Step.
+*/
+class SqliteStatement
+{
+public:
+    SqliteStatement() = default;
+
+    SqliteStatement(sqlite3* pDatabase, std::string_view sql)
+    {
+        if (sqlite3_prepare_v3(pDatabase, sql.data(), static_cast<int>(sql.size()), SQLITE_PREPARE_PERSISTENT, &m_pStatement, nullptr) != SQLITE_OK)
+            throw std::runtime_error(std::string("Failed to prepare statement: ") + sqlite3_errmsg(pDatabase));
+    }
+
+    // Prepares the first statement of sql for a single run and sets *pUsed to the bytes it spans. Get() is null if sql holds no statement.
+    SqliteStatement(sqlite3* pDatabase, std::string_view sql, size_t* pUsed)
+    {
+        const char* pTail = sql.data();
+        if (sqlite3_prepare_v3(pDatabase, sql.data(), static_cast<int>(sql.size()), 0, &m_pStatement, &pTail) != SQLITE_OK)
+            throw std::runtime_error(sqlite3_errmsg(pDatabase));
+        *pUsed = static_cast<size_t>(pTail - sql.data());
+    }
+
+    SqliteStatement(const SqliteStatement& other) = delete;
+
+    SqliteStatement& operator=(const SqliteStatement& other) = delete;
+
+    SqliteStatement(SqliteStatement&& other) noexcept : m_pStatement(std::exchange(other.m_pStatement, nullptr)) {
+
+    }
+
+    SqliteStatement& operator=(SqliteStatement&& other) noexcept
+    {
+        if (this != &other) {
+            sqlite3_finalize(m_pStatement);
+            m_pStatement = std::exchange(other.m_pStatement, nullptr);
+        }
+        return *this;
+    }
+
+    ~SqliteStatement()
+    {
+        sqlite3_finalize(m_pStatement);
+    }
+
+    void BindNull(int index) { sqlite3_bind_null(m_pStatement, index); }
+    void BindInt64(int index, int64_t value) { sqlite3_bind_int64(m_pStatement, index, value); }
+    void BindDouble(int index, double value) { sqlite3_bind_double(m_pStatement, index, value); }
+    void BindText(int index, std::string_view value) { sqlite3_bind_text(m_pStatement, index, value.data(), static_cast<int>(value.size()), SQLITE_STATIC); }
+
+    // Returns true while a row is available; throws on errors. The statement is reset once it is done.
+    bool Step()
+    {
+        int result = sqlite3_step(m_pStatement);
+        if (result == SQLITE_ROW)
+            return true;
+        sqlite3_reset(m_pStatement);
+        if (result != SQLITE_DONE)
+            throw std::runtime_error(std::string("Failed to execute statement: ") + sqlite3_errmsg(sqlite3_db_handle(m_pStatement)));
+        return false;
+    }
+
+    int ColumnCount() const { return sqlite3_column_count(m_pStatement); }
+    const char* GetColumnName(int column) const { return sqlite3_column_name(m_pStatement, column); }
+    int GetType(int column) const { return sqlite3_column_type(m_pStatement, column); }
+    int64_t GetInt64(int column) const { return sqlite3_column_int64(m_pStatement, column); }
+    double GetDouble(int column) const { return sqlite3_column_double(m_pStatement, column); }
+
+    std::string_view GetText(int column) const
+    {
+        const unsigned char* pText = sqlite3_column_text(m_pStatement, column);
+        return pText ? std::string_view(reinterpret_cast<const char*>(pText), sqlite3_column_bytes(m_pStatement, column)) : std::string_view();
+    }
+
+    void Reset() { sqlite3_reset(m_pStatement); }
+    sqlite3_stmt* Get() const { return m_pStatement; }
+
+private:
+    sqlite3_stmt* m_pStatement = nullptr;
+};
+
+// Connection to an SQLite database file. Errors are thrown as std::runtime_error.
+class SqliteDatabase
+{
+public:
+    SqliteDatabase() = default;
+
+    SqliteDatabase(const std::filesystem::path& path, bool readOnly)
+    {
+        int flags = readOnly ? SQLITE_OPEN_READONLY : SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
+        if (sqlite3_open_v2(reinterpret_cast<const char*>(path.u8string().c_str()), &m_pDatabase, flags, nullptr) != SQLITE_OK) {
+            std::string message = m_pDatabase ? sqlite3_errmsg(m_pDatabase) : "out of memory";
+            Close();
+            throw std::runtime_error("Failed to open database: " + message);
+        }
+    }
+
+    SqliteDatabase(const SqliteDatabase& other) = delete;
+
+    SqliteDatabase& operator=(const SqliteDatabase& other) = delete;
+
+    SqliteDatabase(SqliteDatabase&& other) noexcept : m_pDatabase(std::exchange(other.m_pDatabase, nullptr)) {
+
+    }
+
+    SqliteDatabase& operator=(SqliteDatabase&& other) noexcept
+    {
+        if (this != &other) {
+            Close();
+            m_pDatabase = std::exchange(other.m_pDatabase, nullptr);
+        }
+        return *this;
+    }
+
+    // Statements must be finalized first.
+    ~SqliteDatabase()
+    {
+        Close();
+    }
+
+    void Execute(const std::string& sql)
+    {
+        char* pError = nullptr;
+        if (sqlite3_exec(m_pDatabase, sql.c_str(), nullptr, nullptr, &pError) != SQLITE_OK) {
+            std::string message = pError ? pError : sqlite3_errmsg(m_pDatabase);
+            sqlite3_free(pError);
+            throw std::runtime_error("Failed to execute '" + sql + "': " + message);
+        }
+    }
+
+    SqliteStatement Prepare(std::string_view sql) { return SqliteStatement(m_pDatabase, sql); }
+
+    sqlite3* Get() const { return m_pDatabase; }
+
+    // Quotes an identifier for use in SQL text.
+    static std::string QuoteIdentifier(std::string_view name)
+    {
+        std::string quoted = "\"";
+        for (char c : name) {
+            if (c == '"')
+                quoted += '"';
+            quoted += c;
+        }
+        quoted += '"';
+        return quoted;
+    }
+
+    /*
+    Makes column names unique the way SQLite compares them, ignoring ASCII case: repeated names
+    get a _2, _3... suffix. used holds lower case names that are already taken.
+    */
+    static std::vector<std::string> UniqueColumnNames(const std::vector<std::string>& names, std::unordered_set<std::string> used)
+    {
+        std::vector<std::string> unique;
+        unique.reserve(names.size());
+        for (const auto& original : names) {
+            std::string name = original;
+            for (size_t n = 2; !used.insert(FoldCase(name)).second; n++)
+                name = original + "_" + std::to_string(n);
+            unique.push_back(std::move(name));
+        }
+        return unique;
+    }
+
+private:
+    static std::string FoldCase(std::string text)
+    {
+        std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        return text;
+    }
+
+    void Close()
+    {
+        if (m_pDatabase)
+            sqlite3_close(m_pDatabase);
+        m_pDatabase = nullptr;
+    }
+
+    sqlite3* m_pDatabase = nullptr;
+};
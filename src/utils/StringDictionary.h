@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <vector>
+#include <utils/StringPool.h>
+
+/*
+Dictionary of distinct strings with dense 32 bit ids in insertion order, owned by whatever holds
+the ids (a string column), so its strings are freed with it. Unlike StringPool it is not thread
+safe and not process-wide: values of decoded events go here, names and schema text to the pool.
+Text is stored back to back in one buffer, so a dictionary copies cheaply and its size is exact,
+but views returned by Get are only valid until the next Intern. Id 0 is always the empty string.
+*/
+class StringDictionary
+{
+public:
+    using Id = uint32_t;
+    static constexpr Id EMPTY_ID = 0;
+
+    StringDictionary()
+    {
+        m_slots.resize(INITIAL_SLOTS, Slot{ 0, INVALID_ID });
+        m_offsets.push_back(0);
+        Insert(std::string_view(), HashString64(std::string_view()));
+    }
+
+    Id Intern(std::string_view text)
+    {
+        uint64_t hash = HashString64(text);
+        Id id = Find(text, hash);
+        return id != INVALID_ID ? id : Insert(text, hash);
+    }
+
+    // Looks up the id of a string without adding it. Returns false if it is not in the dictionary.
+    bool Find(std::string_view text, Id* pId) const
+    {
+        Id id = Find(text, HashString64(text));
+        if (id == INVALID_ID)
+            return false;
+        *pId = id;
+        return true;
+    }
+
+    std::string_view Get(Id id) const
+    {
+        return std::string_view(m_bytes.data() + m_offsets[id], static_cast<size_t>(m_offsets[id + 1] - m_offsets[id]));
+    }
+
+    // Distinct strings, including the empty string.
+    size_t Size() const { return m_offsets.size() - 1; }
+
+    void ShrinkToFit()
+    {
+        m_bytes.shrink_to_fit();
+        m_offsets.shrink_to_fit();
+    }
+
+    size_t ByteSize() const
+    {
+        return m_bytes.capacity() + m_offsets.capacity() * sizeof(uint64_t) + m_slots.capacity() * sizeof(Slot);
+    }
+
+private:
+    static constexpr Id INVALID_ID = 0xFFFFFFFF;
+    static constexpr size_t INITIAL_SLOTS = 16;
+
+    struct Slot {
+        uint32_t m_hash; // High half of the string hash; the low half picks the slot.
+        Id m_id;
+    };
+
+    Id Find(std::string_view text, uint64_t hash) const
+    {
+        size_t mask = m_slots.size() - 1;
+        uint32_t tag = static_cast<uint32_t>(hash >> 32);
+        for (size_t i = hash & mask;; i = (i + 1) & mask) {
+            const Slot& slot = m_slots[i];
+            if (slot.m_id == INVALID_ID)
+                return INVALID_ID;
+            if (slot.m_hash == tag) {
+                std::string_view entry = Get(slot.m_id);
+                if (entry.size() == text.size() && (text.empty() || memcmp(entry.data(), text.data(), text.size()) == 0))
+                    return slot.m_id;
+            }
+        }
+    }
+
+    Id Insert(std::string_view text, uint64_t hash)
+    {
+        Id id = static_cast<Id>(Size());
+        m_bytes.insert(m_bytes.end(), text.begin(), text.end());
+        m_offsets.push_back(m_bytes.size());
+        if (Size() * 2 > m_slots.size())
+            Grow();
+        else
+            Place(hash, id);
+        return id;
+    }
+
+    void Place(uint64_t hash, Id id)
+    {
+        size_t mask = m_slots.size() - 1;
+        size_t i = hash & mask;
+        while (m_slots[i].m_id != INVALID_ID)
+            i = (i + 1) & mask;
+        m_slots[i] = Slot{ static_cast<uint32_t>(hash >> 32), id };
+    }
+
+    // Doubles the slot table and re-places every string, including the one just added.
+    void Grow()
+    {
+        m_slots.assign(m_slots.size() * 2, Slot{ 0, INVALID_ID });
+        for (Id id = 0; id < Size(); id++)
+            Place(HashString64(Get(id)), id);
+    }
+
+    std::vector<char> m_bytes;
+    std::vector<uint64_t> m_offsets; // Start of every string in m_bytes, then the end of the last one.
+    std::vector<Slot> m_slots;
+};
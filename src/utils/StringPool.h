@@ -0,0 +1,274 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string_view>
+#include <vector>
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
+namespace StringPoolDetail {
+
+inline uint64_t Read64(const char* p) { uint64_t v; memcpy(&v, p, 8); return v; }
+inline uint64_t Read32(const char* p) { uint32_t v; memcpy(&v, p, 4); return v; }
+
+// 64x64->128 bit multiply folded to 64 bits.
+inline uint64_t Mix(uint64_t a, uint64_t b)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+    uint64_t hi;
+    uint64_t lo = _umul128(a, b, &hi);
+    return lo ^ hi;
+#elif defined(__SIZEOF_INT128__)
+    unsigned __int128 r = static_cast<unsigned __int128>(a) * b;
+    return static_cast<uint64_t>(r) ^ static_cast<uint64_t>(r >> 64);
+#else
+    uint64_t ha = a >> 32, la = a & 0xFFFFFFFF, hb = b >> 32, lb = b & 0xFFFFFFFF;
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    uint64_t t = rl + (rm0 << 32);
+    uint64_t carry = t < rl;
+    uint64_t lo = t + (rm1 << 32);
+    carry += lo < t;
+    uint64_t hi = rh + (rm0 >> 32) + (rm1 >> 32) + carry;
+    return lo ^ hi;
+#endif
+}
+
+} // namespace StringPoolDetail
+
+/*
+64 bit string hash in the style of wyhash: 16 bytes per step in two independent multiply lanes,
+finished with a full 128 bit multiply mix so every input bit reaches every output bit.
+*/
+inline uint64_t HashString64(std::string_view text, uint64_t seed = 0)
+{
+    using namespace StringPoolDetail;
+    constexpr uint64_t S0 = 0xa0761d6478bd642full;
+    constexpr uint64_t S1 = 0xe7037ed1a0b428dbull;
+    constexpr uint64_t S2 = 0x8ebc6af09c88c6e3ull;
+
+    const char* p = text.data();
+    size_t size = text.size();
+    seed ^= Mix(seed ^ S0, S1);
+
+    uint64_t a = 0;
+    uint64_t b = 0;
+    if (size <= 16) {
+        if (size >= 4) {
+            a = (Read32(p) << 32) | Read32(p + ((size >> 3) << 2));
+            b = (Read32(p + size - 4) << 32) | Read32(p + size - 4 - ((size >> 3) << 2));
+        }
+        else if (size > 0) {
+            a = (static_cast<uint64_t>(static_cast<uint8_t>(p[0])) << 16) |
+                (static_cast<uint64_t>(static_cast<uint8_t>(p[size >> 1])) << 8) |
+                static_cast<uint8_t>(p[size - 1]);
+        }
+    }
+    else {
+        size_t remaining = size;
+        uint64_t lane = seed;
+        while (remaining > 16) {
+            seed = Mix(Read64(p) ^ S1, Read64(p + 8) ^ seed);
+            lane = Mix(Read64(p) ^ S2, Read64(p + 8) ^ lane);
+            p += 16;
+            remaining -= 16;
+        }
+        seed ^= lane;
+        a = Read64(p + remaining - 16);
+        b = Read64(p + remaining - 8);
+    }
+    a ^= S1;
+    b ^= seed;
+    return Mix(S1 ^ size, Mix(a, b) ^ S2);
+}
+
+/*
+Thread safe interning pool. Each distinct string is copied once into arena chunks and identified
+by a 32 bit id; interned text is nul-terminated and never moves, so pointers returned by CStr stay
+valid for the lifetime of the pool. Id 0 is always the empty string.
+*/
+class StringPool
+{
+public:
+    using Id = uint32_t;
+    static constexpr Id EMPTY_ID = 0;
+
+    struct Stats {
+        uint64_t m_internCount;    // Calls to Intern.
+        uint64_t m_internedBytes;  // Bytes passed to Intern.
+        uint64_t m_uniqueCount;    // Distinct strings stored.
+        uint64_t m_uniqueBytes;    // Bytes of distinct strings.
+        uint64_t m_arenaBytes;     // Bytes allocated for arena chunks.
+
+        double DedupRatio() const { return m_uniqueBytes ? static_cast<double>(m_internedBytes) / m_uniqueBytes : 1.0; }
+        uint64_t BytesSaved() const { return m_internedBytes > m_uniqueBytes ? m_internedBytes - m_uniqueBytes : 0; }
+    };
+
+    StringPool()
+    {
+        m_slots.resize(INITIAL_SLOTS, Slot{ 0, INVALID_ID });
+        InsertLocked(std::string_view(), HashString64(std::string_view()));
+    }
+
+    StringPool(const StringPool&) = delete;
+    StringPool& operator=(const StringPool&) = delete;
+
+    Id Intern(std::string_view text)
+    {
+        m_internCount.fetch_add(1, std::memory_order_relaxed);
+        m_internedBytes.fetch_add(text.size(), std::memory_order_relaxed);
+        uint64_t hash = HashString64(text);
+        {
+            std::shared_lock lock(m_lock);
+            Id id = FindLocked(text, hash);
+            if (id != INVALID_ID)
+                return id;
+        }
+        std::unique_lock lock(m_lock);
+        Id id = FindLocked(text, hash);
+        if (id != INVALID_ID)
+            return id;
+        return InsertLocked(text, hash);
+    }
+
+    // Looks up the id of a string without interning it. Returns false if it was never interned.
+    bool Find(std::string_view text, Id* pId) const
+    {
+        std::shared_lock lock(m_lock);
+        Id id = FindLocked(text, HashString64(text));
+        if (id == INVALID_ID)
+            return false;
+        *pId = id;
+        return true;
+    }
+
+    std::string_view Get(Id id) const
+    {
+        std::shared_lock lock(m_lock);
+        const Entry& entry = m_entries[id];
+        return std::string_view(entry.m_pData, entry.m_size);
+    }
+
+    const char* CStr(Id id) const
+    {
+        std::shared_lock lock(m_lock);
+        return m_entries[id].m_pData;
+    }
+
+    size_t Size() const
+    {
+        std::shared_lock lock(m_lock);
+        return m_entries.size();
+    }
+
+    Stats GetStats() const
+    {
+        std::shared_lock lock(m_lock);
+        return Stats{ m_internCount.load(std::memory_order_relaxed), m_internedBytes.load(std::memory_order_relaxed),
+            m_entries.size(), m_uniqueBytes, m_arenaBytes };
+    }
+
+private:
+    static constexpr Id INVALID_ID = 0xFFFFFFFF;
+    static constexpr size_t INITIAL_SLOTS = 1024;
+    static constexpr size_t CHUNK_SIZE = 1 << 20;
+
+    struct Entry {
+        const char* m_pData;
+        uint32_t m_size;
+    };
+
+    struct Slot {
+        uint64_t m_hash;
+        Id m_id;
+    };
+
+    Id FindLocked(std::string_view text, uint64_t hash) const
+    {
+        size_t mask = m_slots.size() - 1;
+        for (size_t i = hash & mask;; i = (i + 1) & mask) {
+            const Slot& slot = m_slots[i];
+            if (slot.m_id == INVALID_ID)
+                return INVALID_ID;
+            if (slot.m_hash == hash) {
+                const Entry& entry = m_entries[slot.m_id];
+                if (entry.m_size == text.size() && memcmp(entry.m_pData, text.data(), text.size()) == 0)
+                    return slot.m_id;
+            }
+        }
+    }
+
+    Id InsertLocked(std::string_view text, uint64_t hash)
+    {
+        Id id = static_cast<Id>(m_entries.size());
+        m_entries.push_back(Entry{ Allocate(text), static_cast<uint32_t>(text.size()) });
+        m_uniqueBytes += text.size();
+
+        if ((m_entries.size()) * 2 > m_slots.size())
+            Grow();
+        else
+            PlaceSlot(hash, id);
+        return id;
+    }
+
+    void PlaceSlot(uint64_t hash, Id id)
+    {
+        size_t mask = m_slots.size() - 1;
+        size_t i = hash & mask;
+        while (m_slots[i].m_id != INVALID_ID)
+            i = (i + 1) & mask;
+        m_slots[i] = Slot{ hash, id };
+    }
+
+    // Doubles the slot table and re-places every entry, including the one just added.
+    void Grow()
+    {
+        m_slots.assign(m_slots.size() * 2, Slot{ 0, INVALID_ID });
+        for (Id id = 0; id < m_entries.size(); id++) {
+            const Entry& entry = m_entries[id];
+            PlaceSlot(HashString64(std::string_view(entry.m_pData, entry.m_size)), id);
+        }
+    }
+
+    // Copies text into the arena, followed by a nul terminator.
+    const char* Allocate(std::string_view text)
+    {
+        size_t bytes = text.size() + 1;
+        char* p;
+        if (bytes > CHUNK_SIZE / 4) {
+            m_largeChunks.push_back(std::make_unique<char[]>(bytes));
+            m_arenaBytes += bytes;
+            p = m_largeChunks.back().get();
+        }
+        else {
+            if (m_chunks.empty() || m_chunkUsed + bytes > CHUNK_SIZE) {
+                m_chunks.push_back(std::make_unique<char[]>(CHUNK_SIZE));
+                m_arenaBytes += CHUNK_SIZE;
+                m_chunkUsed = 0;
+            }
+            p = m_chunks.back().get() + m_chunkUsed;
+            m_chunkUsed += bytes;
+        }
+        if (!text.empty())
+            memcpy(p, text.data(), text.size());
+        p[text.size()] = '\0';
+        return p;
+    }
+
+    mutable std::shared_mutex m_lock;
+    std::vector<Slot> m_slots;
+    std::vector<Entry> m_entries;
+    std::vector<std::unique_ptr<char[]>> m_chunks;
+    std::vector<std::unique_ptr<char[]>> m_largeChunks;
+    size_t m_chunkUsed = 0;
+    uint64_t m_uniqueBytes = 0;
+    uint64_t m_arenaBytes = 0;
+    std::atomic<uint64_t> m_internCount = 0;
+    std::atomic<uint64_t> m_internedBytes = 0;
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <string_view>
+
+/*
+Headless view of a table for virtualized rendering. The UI asks for the range of rows that is
+visible this frame and only reads those, so the cost of a frame depends on the viewport and not
+on how many rows the table has. Column 0 is the row label; the other columns are plain text.
+Nothing here depends on the UI library, so sources can be driven without a window.
+*/
+class TableRowSource
+{
+public:
+    virtual ~TableRowSource() = default;
+
+    virtual size_t RowCount() const = 0;
+    virtual size_t ColumnCount() const = 0;
+
+    // Called once for every visible range before its rows are read, so sources can request data.
+    virtual void Prepare(size_t /*firstRow*/, size_t /*endRow*/) { }
+
+    // False while the data of a row is still being loaded.
+    virtual bool IsReady(size_t /*row*/) { return true; }
+
+    virtual bool IsSelected(size_t /*row*/) const { return false; }
+
+    // Nul-terminated label of the row. Text after "###" is used as the row id only.
+    virtual const char* GetLabel(size_t row) = 0;
+
+    // Text of a column other than the label. The view stays valid until the next call on the source.
+    virtual std::string_view GetCell(size_t row, size_t column) = 0;
+};
+
+/*
+Visits the rows in [firstRow, endRow) clamped to the table: visitRow(row, ready) for each of them.
+This is the only way the renderer walks a source, keeping the per-frame work in one place.
+*/
+template<typename Visitor>
+void VisitTableRows(TableRowSource& source, size_t firstRow, size_t endRow, Visitor&& visitRow)
+{
+    endRow = (std::min)(endRow, source.RowCount());
+    if (firstRow >= endRow)
+        return;
+    source.Prepare(firstRow, endRow);
+    for (size_t row = firstRow; row < endRow; row++)
+        visitRow(row, source.IsReady(row));
+}
@@ -0,0 +1,261 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <functional>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <utils/StringPool.h>
+#include <utils/ThreadPool.h>
+
+/*
+Ranks that order pool strings like their text: ranks[i] < ranks[j] exactly when the string of
+ids[i] sorts before the string of ids[j], and equal strings get equal ranks. Each distinct id
+is compared as text once, so sorting afterwards only compares integers.
+*/
+inline std::vector<uint32_t> CollationRanks(const std::vector<StringPool::Id>& ids, const StringPool& pool)
+{
+    std::vector<StringPool::Id> unique = ids;
+    std::sort(unique.begin(), unique.end());
+    unique.erase(std::unique(unique.begin(), unique.end()), unique.end());
+
+    std::vector<std::pair<std::string_view, StringPool::Id>> byText(unique.size());
+    for (size_t i = 0; i < unique.size(); i++)
+        byText[i] = { pool.Get(unique[i]), unique[i] };
+    std::sort(byText.begin(), byText.end());
+
+    std::vector<std::pair<StringPool::Id, uint32_t>> rankOf(byText.size());
+    for (size_t i = 0; i < byText.size(); i++)
+        rankOf[i] = { byText[i].second, static_cast<uint32_t>(i) };
+    std::sort(rankOf.begin(), rankOf.end());
+
+    std::vector<uint32_t> ranks(ids.size());
+    for (size_t i = 0; i < ids.size(); i++) {
+        auto it = std::lower_bound(rankOf.begin(), rankOf.end(), std::make_pair(ids[i], uint32_t(0)));
+        ranks[i] = it->second;
+    }
+    return ranks;
+}
+
+/*
+Sorted order of a table kept as a permutation of row indices. Every column is a vector of
+integer keys (values, or collation ranks for text), so sorting moves 4 byte indices and compares
+integers. Large tables are radix sorted or sorted in parallel chunks that are then merged. Ties
+are broken by row index, so the order is deterministic. The orders of the last few key lists are
+kept, so switching back to a previous sort does not sort again.
+*/
+class TableSortIndex
+{
+public:
+    struct SortKey {
+        uint32_t m_column;
+        bool m_descending;
+    };
+
+    static constexpr size_t PARALLEL_THRESHOLD = 1 << 15;
+    static constexpr size_t RADIX_THRESHOLD = 1 << 16;
+    static constexpr size_t ORDER_CACHE_CAPACITY = 8;
+
+    explicit TableSortIndex(size_t columnCount) : m_keys(columnCount) {
+
+    }
+
+    size_t RowCount() const { return m_order.size(); }
+    const std::vector<uint32_t>& GetOrder() const { return m_order; }
+    uint32_t GetRow(size_t position) const { return m_order[position]; }
+
+    bool IsSorted() const { return m_sorted; }
+
+    /*
+    Keys of a column, one per row. Only columns that are sorted by need keys; they must cover
+    every row before Sort or AppendRows.
+    */
+    std::vector<uint64_t>& GetKeys(size_t column) { return m_keys[column]; }
+
+    // Sorts every row by the given keys. Does nothing if the keys and rows have not changed.
+    void Sort(const std::vector<SortKey>& sortKeys)
+    {
+        if (m_sorted && SameKeys(sortKeys, m_sortKeys))
+            return;
+        if (m_sorted)
+            CacheOrder();
+        for (auto it = m_cachedOrders.begin(); it != m_cachedOrders.end(); ++it) {
+            if (SameKeys(sortKeys, it->first)) {
+                m_sortKeys = std::move(it->first);
+                m_order = std::move(it->second);
+                m_cachedOrders.erase(it);
+                m_sorted = true;
+                return;
+            }
+        }
+
+        m_sortKeys = sortKeys;
+        for (size_t i = 0; i < m_order.size(); i++)
+            m_order[i] = static_cast<uint32_t>(i);
+        SortRange(m_order.begin(), m_order.end());
+        m_sorted = true;
+    }
+
+    /*
+    Grows the table to rowCount rows: the new rows are sorted on their own and merged into the
+    existing order. Key updates for existing rows must preserve their relative order, which holds
+    for collation ranks rebuilt over the grown table. Cached orders are dropped.
+    */
+    void AppendRows(size_t rowCount)
+    {
+        size_t oldCount = m_order.size();
+        if (rowCount <= oldCount)
+            return;
+        m_cachedOrders.clear();
+        m_order.resize(rowCount);
+        for (size_t i = oldCount; i < rowCount; i++)
+            m_order[i] = static_cast<uint32_t>(i);
+        if (!m_sorted)
+            return;
+        SortRange(m_order.begin() + oldCount, m_order.end());
+        std::inplace_merge(m_order.begin(), m_order.begin() + oldCount, m_order.end(), Less());
+    }
+
+private:
+    struct Compare {
+        const TableSortIndex* m_pIndex;
+
+        bool operator()(uint32_t a, uint32_t b) const
+        {
+            for (const SortKey& key : m_pIndex->m_sortKeys) {
+                const std::vector<uint64_t>& keys = m_pIndex->m_keys[key.m_column];
+                if (keys[a] != keys[b])
+                    return (keys[a] < keys[b]) != key.m_descending;
+            }
+            return a < b;
+        }
+    };
+
+    Compare Less() const { return Compare{ this }; }
+
+    static bool SameKeys(const std::vector<SortKey>& lhs, const std::vector<SortKey>& rhs)
+    {
+        if (lhs.size() != rhs.size())
+            return false;
+        for (size_t i = 0; i < lhs.size(); i++) {
+            if (lhs[i].m_column != rhs[i].m_column || lhs[i].m_descending != rhs[i].m_descending)
+                return false;
+        }
+        return true;
+    }
+
+    // Keeps the current order for later; the oldest cached order is dropped when full.
+    void CacheOrder()
+    {
+        if (m_cachedOrders.size() == ORDER_CACHE_CAPACITY)
+            m_cachedOrders.erase(m_cachedOrders.begin());
+        m_cachedOrders.emplace_back(m_sortKeys, m_order);
+    }
+
+    /*
+    Sorts the rows in a range of the order. When the ranges of the sort keys fit in 64 bits
+    together, the keys are rebased to their minimum and packed into one integer per row, and
+    (key, row) pairs are sorted instead, which avoids chasing every key column in each comparison.
+    */
+    void SortRange(std::vector<uint32_t>::iterator begin, std::vector<uint32_t>::iterator end) const
+    {
+        std::vector<unsigned> widths(m_sortKeys.size());
+        std::vector<uint64_t> minKeys(m_sortKeys.size());
+        unsigned totalWidth = 0;
+        for (size_t i = 0; i < m_sortKeys.size(); i++) {
+            const std::vector<uint64_t>& keys = m_keys[m_sortKeys[i].m_column];
+            if (keys.empty())
+                continue;
+            auto [minIt, maxIt] = std::minmax_element(keys.begin(), keys.end());
+            minKeys[i] = *minIt;
+            widths[i] = static_cast<unsigned>(std::bit_width(*maxIt - *minIt));
+            totalWidth += widths[i];
+        }
+        if (totalWidth > 64) {
+            ParallelSort(begin, end, Less());
+            return;
+        }
+
+        std::vector<std::pair<uint64_t, uint32_t>> packed(static_cast<size_t>(end - begin));
+        for (size_t i = 0; i < packed.size(); i++) {
+            uint32_t row = begin[i];
+            uint64_t key = 0;
+            for (size_t k = 0; k < m_sortKeys.size(); k++) {
+                if (widths[k] == 0)
+                    continue;
+                uint64_t mask = widths[k] == 64 ? ~0ull : (1ull << widths[k]) - 1;
+                uint64_t value = m_keys[m_sortKeys[k].m_column][row] - minKeys[k];
+                key = (widths[k] == 64 ? 0 : key << widths[k]) | (m_sortKeys[k].m_descending ? mask - value : value);
+            }
+            packed[i] = { key, row };
+        }
+        if (packed.size() >= RADIX_THRESHOLD)
+            RadixSort(packed, totalWidth);
+        else
+            ParallelSort(packed.begin(), packed.end(), std::less<>());
+        for (size_t i = 0; i < packed.size(); i++)
+            begin[i] = packed[i].second;
+    }
+
+    /*
+    Stable LSD radix sort of (key, row) pairs on the low `width` bits of the key, one byte per
+    pass. Passes where every key has the same byte are skipped. Rows enter in increasing order,
+    so equal keys stay ordered by row.
+    */
+    static void RadixSort(std::vector<std::pair<uint64_t, uint32_t>>& items, unsigned width)
+    {
+        std::vector<std::pair<uint64_t, uint32_t>> buffer(items.size());
+        for (unsigned shift = 0; shift < width; shift += 8) {
+            size_t counts[256] = {};
+            for (const auto& item : items)
+                counts[(item.first >> shift) & 0xFF]++;
+            if (counts[(items[0].first >> shift) & 0xFF] == items.size())
+                continue;
+
+            size_t offset = 0;
+            for (size_t& count : counts) {
+                size_t next = offset + count;
+                count = offset;
+                offset = next;
+            }
+            for (const auto& item : items)
+                buffer[counts[(item.first >> shift) & 0xFF]++] = item;
+            items.swap(buffer);
+        }
+    }
+
+    // Sorts chunks on the shared thread pool, then merges neighbouring chunks until one run is left.
+    template<typename Iterator, typename LessFn>
+    static void ParallelSort(Iterator begin, Iterator end, LessFn less)
+    {
+        ThreadPool& pool = ThreadPool::Shared();
+        size_t count = static_cast<size_t>(end - begin);
+        unsigned chunkCount = pool.SlotCount();
+        if (count < PARALLEL_THRESHOLD || chunkCount == 1) {
+            std::sort(begin, end, less);
+            return;
+        }
+
+        std::vector<size_t> bounds(chunkCount + 1);
+        for (unsigned i = 0; i <= chunkCount; i++)
+            bounds[i] = count * i / chunkCount;
+
+        pool.ParallelFor(chunkCount, [&](unsigned, size_t i) { std::sort(begin + bounds[i], begin + bounds[i + 1], less); });
+        for (size_t width = 1; width < chunkCount; width *= 2) {
+            size_t mergeCount = (chunkCount - width + width * 2 - 1) / (width * 2);
+            pool.ParallelFor(mergeCount, [&](unsigned, size_t merge) {
+                size_t i = merge * width * 2;
+                size_t last = (std::min)(i + width * 2, static_cast<size_t>(chunkCount));
+                std::inplace_merge(begin + bounds[i], begin + bounds[i + width], begin + bounds[last], less);
+            });
+        }
+    }
+
+    std::vector<std::vector<uint64_t>> m_keys;
+    std::vector<SortKey> m_sortKeys;
+    std::vector<uint32_t> m_order;
+    std::vector<std::pair<std::vector<SortKey>, std::vector<uint32_t>>> m_cachedOrders;
+    bool m_sorted = false;
+};
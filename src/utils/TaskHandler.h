@@ -1,98 +1,141 @@
 #pragma once
-#include <Windows.h>
-#include <thread>
-#include <queue>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <functional>
+#include <thread>
+#include <vector>
+#include <utils/MpmcQueue.h>
+
+/*
+Bounded MPMC queue that can also block. Pushes and pops bump an epoch that blocked threads wait
+on, so a waiter reads the epoch, retries the lock-free operation and only sleeps if nothing
+changed in between.
+*/
+template<typename T>
+class TaskQueue
+{
+public:
+    TaskQueue(size_t capacity, const std::atomic<bool>& stopping) : m_queue(capacity), m_stopping(stopping) {
+
+    }
+
+    // Blocks while the queue is full if wait is set. Fails once the owner is stopping.
+    bool Push(T&& value, bool wait)
+    {
+        for (;;) {
+            uint32_t pops = m_pops.load(std::memory_order_acquire);
+            if (m_stopping.load(std::memory_order_acquire))
+                return false;
+            if (m_queue.TryPush(std::move(value))) {
+                m_pushes.fetch_add(1, std::memory_order_release);
+                m_pushes.notify_one();
+                return true;
+            }
+            if (!wait)
+                return false;
+            m_pops.wait(pops, std::memory_order_acquire);
+        }
+    }
+
+    // Blocks while the queue is empty if wait is set. Fails once the owner is stopping.
+    bool Pop(T* pValue, bool wait)
+    {
+        for (;;) {
+            uint32_t pushes = m_pushes.load(std::memory_order_acquire);
+            if (m_stopping.load(std::memory_order_acquire))
+                return false;
+            if (m_queue.TryPop(*pValue)) {
+                m_pops.fetch_add(1, std::memory_order_release);
+                m_pops.notify_one();
+                return true;
+            }
+            if (!wait)
+                return false;
+            m_pushes.wait(pushes, std::memory_order_acquire);
+        }
+    }
+
+    // Wakes every blocked thread so it can observe the stop flag.
+    void WakeAll()
+    {
+        m_pushes.fetch_add(1, std::memory_order_release);
+        m_pops.fetch_add(1, std::memory_order_release);
+        m_pushes.notify_all();
+        m_pops.notify_all();
+    }
+
+    size_t SizeApprox() const { return m_queue.SizeApprox(); }
 
-template<typename inType, typename outType>
-class TaskHandler {
 private:
-	std::thread thread;
-	std::queue<inType> inputQueue;
-	std::queue<outType> outputQueue;
-
-	SRWLOCK inLock;
-	CONDITION_VARIABLE inCV;
-	SRWLOCK outLock;
-	CONDITION_VARIABLE outCV;
+    MpmcQueue<T> m_queue;
+    const std::atomic<bool>& m_stopping;
+    std::atomic<uint32_t> m_pushes = 0;
+    std::atomic<uint32_t> m_pops = 0;
+};
+
+/*
+Pool of worker threads fed through a bounded input queue, with results returned through a bounded
+output queue. Messages are moved end to end. threadFunc returns true to stop the worker that ran
+it. Shutdown stops accepting work, wakes blocked threads, drops queued inputs and joins the
+workers once their current task returns; tasks can poll IsStopping to return early.
+*/
+template<typename inType, typename outType>
+class TaskHandler
+{
 public:
-	TaskHandler(std::function<bool(inType &&, TaskHandler<inType, outType>*)> threadFunc) : thread([this, threadFunc]() {
-		inType msg;
-		while (PopInput(&msg, true)) {
-			if (threadFunc(std::move(msg), this))
-				break;
-		}
-	}), inLock(SRWLOCK_INIT), inCV(CONDITION_VARIABLE_INIT), outLock(SRWLOCK_INIT), outCV(CONDITION_VARIABLE_INIT), inputQueue(), outputQueue() {
-
-	}
-
-	void Join() {
-		thread.join();
-	}
-
-	void PushInput(inType &&message) {
-		AcquireSRWLockExclusive(&inLock);
-		inputQueue.emplace(message);
-		ReleaseSRWLockExclusive(&inLock);
-		WakeAllConditionVariable(&inCV);
-	}
-
-	void PushOutput(outType&& message) {
-		AcquireSRWLockExclusive(&outLock);
-		outputQueue.emplace(message);
-		ReleaseSRWLockExclusive(&outLock);
-		WakeAllConditionVariable(&outCV);
-	}
-
-	bool PopInput(inType* in, bool wait = true) {
-		AcquireSRWLockExclusive(&inLock);
-		bool empty = inputQueue.empty();
-		if (empty && !wait) {
-			ReleaseSRWLockExclusive(&inLock);
-			return false;
-		}
-		else if (!empty) {
-			*in = inputQueue.front();
-			inputQueue.pop();
-			ReleaseSRWLockExclusive(&inLock);
-			return true;
-		}
-
-		while (empty) {
-			SleepConditionVariableSRW(&inCV, &inLock, INFINITE, !CONDITION_VARIABLE_LOCKMODE_SHARED);
-			empty = inputQueue.empty();
-			if (!empty) {
-				*in = inputQueue.front();
-				inputQueue.pop();
-			}
-			ReleaseSRWLockExclusive(&inLock);
-		}
-		return true;
-	}
-
-	bool PopOutput(outType *out, bool wait = true) {
-		AcquireSRWLockExclusive(&outLock);
-		bool empty = outputQueue.empty();
-		if (empty && !wait) {
-			ReleaseSRWLockExclusive(&outLock);
-			return false;
-		}
-		else if (!empty) {
-			*out = std::move(outputQueue.front());
-			outputQueue.pop();
-			ReleaseSRWLockExclusive(&outLock);
-			return true;
-		}
-
-		while (empty) {
-			SleepConditionVariableSRW(&outCV, &outLock, INFINITE, !CONDITION_VARIABLE_LOCKMODE_SHARED);
-			empty = outputQueue.empty();
-			if (!empty) {
-				*out = std::move(outputQueue.front());
-				outputQueue.pop();
-			}
-			ReleaseSRWLockExclusive(&outLock);
-		}
-		return true;
-	}
-};
\ No newline at end of file
+    using ThreadFunc = std::function<bool(inType&&, TaskHandler<inType, outType>*)>;
+
+    static constexpr size_t DEFAULT_CAPACITY = 1024;
+
+    TaskHandler(ThreadFunc threadFunc, unsigned workerCount = 1, size_t capacity = DEFAULT_CAPACITY)
+        : m_threadFunc(std::move(threadFunc)), m_input(capacity, m_stopping), m_output(capacity, m_stopping)
+    {
+        m_workers.reserve(workerCount);
+        for (unsigned i = 0; i < (std::max)(workerCount, 1u); i++) {
+            m_workers.emplace_back([this]() {
+                inType message;
+                while (m_input.Pop(&message, true)) {
+                    if (m_threadFunc(std::move(message), this))
+                        break;
+                }
+            });
+        }
+    }
+
+    ~TaskHandler()
+    {
+        Shutdown();
+    }
+
+    TaskHandler(const TaskHandler&) = delete;
+    TaskHandler& operator=(const TaskHandler&) = delete;
+
+    bool PushInput(inType&& message, bool wait = true) { return m_input.Push(std::move(message), wait); }
+    bool PushOutput(outType&& message, bool wait = true) { return m_output.Push(std::move(message), wait); }
+    bool PopInput(inType* pIn, bool wait = true) { return m_input.Pop(pIn, wait); }
+    bool PopOutput(outType* pOut, bool wait = true) { return m_output.Pop(pOut, wait); }
+
+    bool IsStopping() const { return m_stopping.load(std::memory_order_acquire); }
+    size_t PendingInputs() const { return m_input.SizeApprox(); }
+
+    // Safe to call more than once.
+    void Shutdown()
+    {
+        m_stopping.store(true, std::memory_order_release);
+        m_input.WakeAll();
+        m_output.WakeAll();
+        for (auto& worker : m_workers) {
+            if (worker.joinable())
+                worker.join();
+        }
+    }
+
+private:
+    ThreadFunc m_threadFunc;
+    std::atomic<bool> m_stopping = false;
+    TaskQueue<inType> m_input;
+    TaskQueue<outType> m_output;
+    std::vector<std::thread> m_workers;
+};
@@ -0,0 +1,288 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/*
+Work-stealing thread pool shared by the whole process. Every worker owns a deque: tasks posted
+from a worker go to the back of its own deque and are taken LIFO, idle workers steal from the
+front of the others. Tasks posted from other threads are spread over the deques round robin.
+Threads that wait for a TaskGroup run the group's queued tasks meanwhile, so fork-join work can
+nest. A waiting thread never picks up unrelated tasks, so long jobs do not belong on the pool:
+run them on a thread of their own and let them fork their chunks into TaskGroups.
+*/
+class ThreadPool
+{
+public:
+    using Task = std::function<void()>;
+
+    // One worker per hardware thread except the caller's, which helps while it waits.
+    explicit ThreadPool(unsigned workerCount = 0)
+    {
+        if (workerCount == 0)
+            workerCount = (std::max)(1u, std::thread::hardware_concurrency() - 1);
+        m_queues.reserve(workerCount);
+        for (unsigned i = 0; i < workerCount; i++)
+            m_queues.push_back(std::make_unique<WorkerQueue>());
+        m_workers.reserve(workerCount);
+        for (unsigned i = 0; i < workerCount; i++)
+            m_workers.emplace_back([this, i]() { WorkerLoop(i); });
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard lock(m_sleepLock);
+            m_stopping = true;
+        }
+        m_wake.notify_all();
+        for (auto& worker : m_workers)
+            worker.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    static ThreadPool& Shared()
+    {
+        static ThreadPool pool;
+        return pool;
+    }
+
+    unsigned WorkerCount() const { return static_cast<unsigned>(m_workers.size()); }
+
+    // Threads that can work on a ParallelFor at once: the workers plus the calling thread.
+    unsigned SlotCount() const { return WorkerCount() + 1; }
+
+    void Post(Task task)
+    {
+        size_t queueIndex = t_pPool == this ? t_workerIndex : m_nextQueue.fetch_add(1, std::memory_order_relaxed) % m_queues.size();
+        {
+            std::lock_guard lock(m_queues[queueIndex]->m_lock);
+            m_queues[queueIndex]->m_tasks.push_back(std::move(task));
+        }
+        m_queued.fetch_add(1);
+        if (m_sleeping.load() != 0) {
+            std::lock_guard lock(m_sleepLock);
+            m_wake.notify_one();
+        }
+    }
+
+    // Runs func() on the pool. Do not block on the future from inside a task; use a TaskGroup there.
+    template<typename Func>
+    auto Submit(Func&& func) -> std::future<std::invoke_result_t<Func>>
+    {
+        using Result = std::invoke_result_t<Func>;
+        auto pTask = std::make_shared<std::packaged_task<Result()>>(std::forward<Func>(func));
+        std::future<Result> future = pTask->get_future();
+        Post([pTask]() { (*pTask)(); });
+        return future;
+    }
+
+    /*
+    Runs func(slot, index) for every index in [0, count). The indices are pulled from a shared
+    counter by at most maxSlots concurrent runners, including the caller, and each slot number
+    in [0, maxSlots) is used by one runner only, so it can index per-slot scratch.
+    */
+    template<typename Func>
+    void ParallelFor(size_t count, Func&& func, unsigned maxSlots = UINT32_MAX);
+
+private:
+    struct alignas(64) WorkerQueue {
+        std::mutex m_lock;
+        std::deque<Task> m_tasks;
+    };
+
+    // Pops the back of the preferred deque, then steals from the front of the others.
+    bool TakeTask(size_t preferred, Task& task)
+    {
+        if (m_queued.load(std::memory_order_relaxed) == 0)
+            return false;
+        for (size_t n = 0; n < m_queues.size(); n++) {
+            size_t index = (preferred + n) % m_queues.size();
+            WorkerQueue& queue = *m_queues[index];
+            std::lock_guard lock(queue.m_lock);
+            if (queue.m_tasks.empty())
+                continue;
+            if (n == 0) {
+                task = std::move(queue.m_tasks.back());
+                queue.m_tasks.pop_back();
+            }
+            else {
+                task = std::move(queue.m_tasks.front());
+                queue.m_tasks.pop_front();
+            }
+            m_queued.fetch_sub(1);
+            return true;
+        }
+        return false;
+    }
+
+    void WorkerLoop(unsigned index)
+    {
+        t_pPool = this;
+        t_workerIndex = index;
+        Task task;
+        for (;;) {
+            if (TakeTask(index, task)) {
+                task();
+                task = nullptr;
+                continue;
+            }
+
+            std::unique_lock lock(m_sleepLock);
+            m_sleeping.fetch_add(1);
+            m_wake.wait(lock, [this]() { return m_stopping || m_queued.load() != 0; });
+            m_sleeping.fetch_sub(1);
+            if (m_stopping)
+                return;
+        }
+    }
+
+    std::vector<std::unique_ptr<WorkerQueue>> m_queues;
+    std::vector<std::thread> m_workers;
+    std::atomic<size_t> m_queued = 0;
+    std::atomic<size_t> m_nextQueue = 0;
+    std::atomic<unsigned> m_sleeping = 0;
+    std::mutex m_sleepLock;
+    std::condition_variable m_wake;
+    bool m_stopping = false;
+
+    static inline thread_local ThreadPool* t_pPool = nullptr;
+    static inline thread_local size_t t_workerIndex = 0;
+};
+
+/*
+Fork-join group of pool tasks. The tasks of a group wait in the group's own queue; every Run
+posts one pool task that runs whichever of them is still queued when a worker gets to it. Wait
+runs the group's queued tasks on the calling thread, newest first, until every task of the group
+has finished, then rethrows the first exception a task threw. It never runs tasks of other
+groups or of Submit, so a wait is bounded by the group's own work.
+*/
+class TaskGroup
+{
+public:
+    explicit TaskGroup(ThreadPool& pool = ThreadPool::Shared()) : m_pool(pool), m_pState(std::make_shared<State>()) {
+
+    }
+
+    // Joins the tasks still running; their exceptions are dropped.
+    ~TaskGroup()
+    {
+        try {
+            Wait();
+        }
+        catch (...) {
+        }
+    }
+
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    template<typename Func>
+    void Run(Func&& func)
+    {
+        {
+            std::lock_guard lock(m_pState->m_lock);
+            m_pState->m_tasks.emplace_back(std::forward<Func>(func));
+            m_pState->m_pending++;
+        }
+        // Holds the state, since the group may be gone by the time a worker gets to it.
+        m_pool.Post([pState = m_pState]() {
+            std::unique_lock lock(pState->m_lock);
+            if (pState->m_tasks.empty())
+                return; // Wait ran it already.
+            ThreadPool::Task task = std::move(pState->m_tasks.front());
+            pState->m_tasks.pop_front();
+            RunTask(*pState, lock, task);
+        });
+    }
+
+    void Wait()
+    {
+        State& state = *m_pState;
+        std::unique_lock lock(state.m_lock);
+        for (;;) {
+            if (!state.m_tasks.empty()) {
+                ThreadPool::Task task = std::move(state.m_tasks.back());
+                state.m_tasks.pop_back();
+                RunTask(state, lock, task);
+                continue;
+            }
+            if (state.m_pending == 0)
+                break;
+            // Nothing left to help with: the group's remaining tasks are running on other threads.
+            state.m_done.wait(lock);
+        }
+
+        std::exception_ptr pError;
+        std::swap(pError, state.m_pError);
+        lock.unlock();
+        if (pError)
+            std::rethrow_exception(pError);
+    }
+
+private:
+    struct State {
+        std::mutex m_lock;
+        std::deque<ThreadPool::Task> m_tasks; // Not started yet.
+        size_t m_pending = 0;                 // Queued or running.
+        std::condition_variable m_done;
+        std::exception_ptr m_pError;
+    };
+
+    // Runs a task taken from the state with the lock released, then counts it as finished.
+    static void RunTask(State& state, std::unique_lock<std::mutex>& lock, ThreadPool::Task& task)
+    {
+        lock.unlock();
+        std::exception_ptr pError;
+        try {
+            task();
+        }
+        catch (...) {
+            pError = std::current_exception();
+        }
+        task = nullptr;
+        lock.lock();
+        if (pError && !state.m_pError)
+            state.m_pError = pError;
+        if (--state.m_pending == 0)
+            state.m_done.notify_all();
+    }
+
+    ThreadPool& m_pool;
+    std::shared_ptr<State> m_pState;
+};
+
+template<typename Func>
+void ThreadPool::ParallelFor(size_t count, Func&& func, unsigned maxSlots)
+{
+    unsigned slots = static_cast<unsigned>((std::min)({ static_cast<size_t>(SlotCount()), static_cast<size_t>(maxSlots), count }));
+    if (slots <= 1) {
+        for (size_t i = 0; i < count; i++)
+            func(0u, i);
+        return;
+    }
+
+    std::atomic<size_t> next = 0;
+    auto work = [&](unsigned slot) {
+        for (size_t i = next.fetch_add(1, std::memory_order_relaxed); i < count; i = next.fetch_add(1, std::memory_order_relaxed))
+            func(slot, i);
+    };
+    TaskGroup group(*this);
+    for (unsigned slot = 1; slot < slots; slot++)
+        group.Run([&work, slot]() { work(slot); });
+    work(0);
+    group.Wait();
+}
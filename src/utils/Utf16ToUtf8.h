@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define UTF16_TO_UTF8_AVX2 1
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define UTF16_TO_UTF8_SSE2 1
+#endif
+
+/*
+Allocation free UTF-16LE to UTF-8 conversion.
+Runs of ASCII are converted 16 (AVX2) or 8 (SSE2) code units at a time; everything else goes
+through the scalar path, which also replaces unpaired surrogates with U+FFFD.
+The destination must hold Utf16ToUtf8MaxBytes(units) bytes.
+*/
+inline constexpr size_t Utf16ToUtf8MaxBytes(size_t units)
+{
+    return units * 3;
+}
+
+// Returns the number of bytes written. pSrc may be unaligned.
+inline size_t Utf16ToUtf8(const void* pSrc, size_t units, char* pDst)
+{
+    const uint8_t* pIn = static_cast<const uint8_t*>(pSrc);
+    char* p = pDst;
+    size_t i = 0;
+
+    while (i < units) {
+#ifdef UTF16_TO_UTF8_AVX2
+        while (i + 16 <= units) {
+            __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pIn + i * 2));
+            if (!_mm256_testz_si256(chunk, _mm256_set1_epi16(static_cast<short>(0xFF80))))
+                break;
+            __m256i packed = _mm256_packus_epi16(chunk, chunk); // Packs within 128 bit lanes.
+            packed = _mm256_permute4x64_epi64(packed, 0x08);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(p), _mm256_castsi256_si128(packed));
+            p += 16;
+            i += 16;
+        }
+#endif
+#ifdef UTF16_TO_UTF8_SSE2
+        while (i + 8 <= units) {
+            __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pIn + i * 2));
+            __m128i high = _mm_and_si128(chunk, _mm_set1_epi16(static_cast<short>(0xFF80)));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi16(high, _mm_setzero_si128())) != 0xFFFF)
+                break;
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(p), _mm_packus_epi16(chunk, chunk));
+            p += 8;
+            i += 8;
+        }
+#endif
+        if (i == units)
+            break;
+
+        // Scalar until the next ASCII character, so vector runs resume as soon as possible.
+        do {
+            uint32_t c = pIn[i * 2] | (static_cast<uint32_t>(pIn[i * 2 + 1]) << 8);
+            i++;
+            if (c < 0x80) {
+                *p++ = static_cast<char>(c);
+                break;
+            }
+            if (c >= 0xD800 && c <= 0xDFFF) {
+                uint32_t low = i < units ? (pIn[i * 2] | (static_cast<uint32_t>(pIn[i * 2 + 1]) << 8)) : 0;
+                if (c <= 0xDBFF && low >= 0xDC00 && low <= 0xDFFF) {
+                    c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+                    i++;
+                }
+                else {
+                    c = 0xFFFD;
+                }
+            }
+            if (c < 0x800) {
+                *p++ = static_cast<char>(0xC0 | (c >> 6));
+            }
+            else if (c < 0x10000) {
+                *p++ = static_cast<char>(0xE0 | (c >> 12));
+                *p++ = static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+            }
+            else {
+                *p++ = static_cast<char>(0xF0 | (c >> 18));
+                *p++ = static_cast<char>(0x80 | ((c >> 12) & 0x3F));
+                *p++ = static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+            }
+            *p++ = static_cast<char>(0x80 | (c & 0x3F));
+        } while (i < units);
+    }
+    return static_cast<size_t>(p - pDst);
+}
@@ -0,0 +1,223 @@
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <ETL/DecodePlan.h>
+#include "Test.h"
+
+namespace {
+
+EtlPropertyDesc Property(uint16_t inType, uint16_t length = 0, uint32_t flags = 0, uint16_t count = 1, uint16_t outType = ETL_OUTTYPE_NULL)
+{
+    return EtlPropertyDesc{ inType, outType, flags, length, count, false };
+}
+
+template<typename T>
+void Put(std::vector<uint8_t>& payload, T value)
+{
+    payload.resize(payload.size() + sizeof(T));
+    memcpy(payload.data() + payload.size() - sizeof(T), &value, sizeof(T));
+}
+
+std::vector<EtlValue> Run(const DecodePlan& plan, const std::vector<uint8_t>& payload, uint32_t* pConsumed = nullptr, uint32_t pointerSize = 8)
+{
+    std::vector<EtlValue> values;
+    uint32_t consumed = plan.Execute(payload.data(), static_cast<uint32_t>(payload.size()), pointerSize, values);
+    if (pConsumed)
+        *pConsumed = consumed;
+    return values;
+}
+
+}
+
+TEST(DecodePlanResolvesParamLengthAndCount)
+{
+    DecodePlan plan = DecodePlan::Compile({
+        Property(ETL_INTYPE_UINT16),
+        Property(ETL_INTYPE_BINARY, 0, ETL_PROPERTY_PARAM_LENGTH),
+        Property(ETL_INTYPE_UINT8),
+        Property(ETL_INTYPE_UINT32, 0, ETL_PROPERTY_PARAM_COUNT, 2),
+        Property(ETL_INTYPE_UNICODESTRING, 2, ETL_PROPERTY_PARAM_LENGTH),
+        Property(ETL_INTYPE_INT64),
+    });
+    CHECK(plan.IsValid());
+    CHECK(plan.StepCount() == 6);
+    CHECK(plan.GetStep(0).m_recordsInteger && plan.GetStep(2).m_recordsInteger);
+    CHECK(plan.GetStep(1).m_lengthRef == 0);
+    CHECK(plan.GetStep(3).m_countRef == 2 && plan.GetStep(3).m_isArray);
+    CHECK(plan.GetStep(4).m_lengthRef == 2);
+    // Offsets are fixed up to the first property whose size depends on the data.
+    CHECK(plan.GetStep(0).m_fixedOffset == 0);
+    CHECK(plan.GetStep(1).m_fixedOffset == 2);
+    CHECK(plan.GetStep(2).m_fixedOffset == DecodePlan::NO_FIXED_OFFSET);
+
+    std::vector<uint8_t> payload;
+    Put(payload, uint16_t(5));
+    for (uint8_t b = 0; b < 5; b++)
+        Put(payload, uint8_t(0xA0 + b));
+    Put(payload, uint8_t(3));
+    Put(payload, uint32_t(7));
+    Put(payload, uint32_t(8));
+    Put(payload, uint32_t(9));
+    for (char16_t c : u"abc")
+        Put(payload, static_cast<uint16_t>(c));
+    payload.resize(payload.size() - 2); // Three characters, no terminator.
+    Put(payload, int64_t(-42));
+
+    uint32_t consumed = 0;
+    std::vector<EtlValue> values = Run(plan, payload, &consumed);
+    CHECK(consumed == payload.size());
+    CHECK(values[0].m_kind == EtlValueKind::UInt && values[0].m_uint == 5);
+    CHECK(values[1].m_kind == EtlValueKind::Binary && values[1].m_size == 5 && values[1].m_pData[4] == 0xA4);
+    CHECK(plan.ResolveLength(1, values) == 5);
+    CHECK(values[3].m_kind == EtlValueKind::Array && values[3].m_uint == 3 && values[3].m_size == 12 && values[3].m_offset == 8);
+    CHECK(values[4].m_kind == EtlValueKind::UnicodeString && values[4].m_size == 6 && memcmp(values[4].m_pData, u"abc", 6) == 0);
+    CHECK(values[5].m_kind == EtlValueKind::Int && values[5].m_int == -42 && values[5].m_offset == 26);
+
+    // 32 bit references are clamped to 16 bits, the way TDH callers clamp them.
+    DecodePlan clamped = DecodePlan::Compile({ Property(ETL_INTYPE_UINT32), Property(ETL_INTYPE_BINARY, 0, ETL_PROPERTY_PARAM_LENGTH) });
+    payload.clear();
+    Put(payload, uint32_t(0x12345));
+    payload.resize(payload.size() + 0xFFFF);
+    values = Run(clamped, payload);
+    CHECK(values[1].m_kind == EtlValueKind::Binary && values[1].m_size == 0xFFFF);
+}
+
+TEST(DecodePlanReportsMissingPropertiesOfShortPayloads)
+{
+    DecodePlan plan = DecodePlan::Compile({
+        Property(ETL_INTYPE_UINT32),
+        Property(ETL_INTYPE_GUID),
+        Property(ETL_INTYPE_UINT16),
+        Property(ETL_INTYPE_UINT16, 0, ETL_PROPERTY_PARAM_COUNT, 2),
+        Property(ETL_INTYPE_POINTER),
+    });
+    CHECK(plan.IsValid());
+    std::vector<uint8_t> full;
+    Put(full, uint32_t(1));
+    full.resize(full.size() + 16, 0x11);
+    Put(full, uint16_t(2));
+    Put(full, uint16_t(10));
+    Put(full, uint16_t(20));
+    Put(full, uint64_t(0x7ff600001000));
+    const uint32_t ends[] = { 4, 20, 22, 26, 34 }; // Payload size needed by each property.
+
+    for (uint32_t size = 0; size <= full.size(); size++) {
+        std::vector<uint8_t> payload(full.begin(), full.begin() + size);
+        uint32_t consumed = 0;
+        std::vector<EtlValue> values = Run(plan, payload, &consumed);
+        CHECK(values.size() == 5);
+        bool missing = false;
+        uint32_t expectedConsumed = 0;
+        for (size_t i = 0; i < values.size(); i++) {
+            // Once one property does not fit, every later one is missing too.
+            missing = missing || size < ends[i];
+            CHECK((values[i].m_kind == EtlValueKind::Missing) == missing);
+            if (missing)
+                CHECK(values[i].m_size == 0);
+            else
+                expectedConsumed = ends[i];
+        }
+        CHECK(consumed == expectedConsumed);
+    }
+
+    // Reusing the vector of a complete event does not leave its values behind.
+    std::vector<EtlValue> reused;
+    plan.Execute(full.data(), static_cast<uint32_t>(full.size()), 8, reused);
+    CHECK(plan.Execute(full.data(), 21, 8, reused) == 20);
+    CHECK(reused[1].m_kind == EtlValueKind::Guid);
+    for (size_t i = 2; i < reused.size(); i++)
+        CHECK(reused[i].m_kind == EtlValueKind::Missing && reused[i].m_size == 0 && reused[i].m_offset == 20 && reused[i].m_inType == plan.GetStep(i).m_inType);
+
+    // A nul-terminated string cut by the end of the payload takes what is there.
+    DecodePlan strings = DecodePlan::Compile({ Property(ETL_INTYPE_ANSISTRING), Property(ETL_INTYPE_UINT8) });
+    std::vector<EtlValue> values = Run(strings, { 'a', 'b', 'c' });
+    CHECK(values[0].m_kind == EtlValueKind::AnsiString && values[0].m_size == 3);
+    CHECK(values[1].m_kind == EtlValueKind::Missing);
+
+    // A 4 byte pointer event reads 4 byte pointers.
+    values = Run(plan, full, nullptr, 4);
+    CHECK(values[4].m_kind == EtlValueKind::UInt && values[4].m_uint == 0x00001000 && values[4].m_size == 4);
+}
+
+TEST(DecodePlanReadsIpv6AddressesWithoutLength)
+{
+    std::vector<uint8_t> payload(20);
+    for (size_t i = 0; i < payload.size(); i++)
+        payload[i] = static_cast<uint8_t>(i);
+
+    // IPv6 binaries declared without any length are 16 bytes, as TDH decodes them.
+    DecodePlan plan = DecodePlan::Compile({ Property(ETL_INTYPE_BINARY, 0, 0, 1, ETL_OUTTYPE_IPV6), Property(ETL_INTYPE_UINT32) });
+    CHECK(plan.IsValid());
+    CHECK(plan.GetStep(0).m_length == 16 && plan.GetStep(0).m_elementSize == 16);
+    CHECK(plan.GetStep(1).m_fixedOffset == 16);
+    std::vector<EtlValue> values = Run(plan, payload);
+    CHECK(values[0].m_kind == EtlValueKind::Binary && values[0].m_size == 16);
+    CHECK(values[1].m_uint == 0x13121110);
+
+    // A declared length, or one taken from another property, is kept.
+    DecodePlan fixedLength = DecodePlan::Compile({ Property(ETL_INTYPE_BINARY, 4, ETL_PROPERTY_PARAM_FIXED_LENGTH, 1, ETL_OUTTYPE_IPV6) });
+    CHECK(Run(fixedLength, payload)[0].m_size == 4);
+    DecodePlan paramLength = DecodePlan::Compile({ Property(ETL_INTYPE_UINT8), Property(ETL_INTYPE_BINARY, 0, ETL_PROPERTY_PARAM_LENGTH, 1, ETL_OUTTYPE_IPV6) });
+    payload[0] = 3;
+    CHECK(Run(paramLength, payload)[1].m_size == 3);
+
+    // Other binaries without a length are empty.
+    DecodePlan plain = DecodePlan::Compile({ Property(ETL_INTYPE_BINARY), Property(ETL_INTYPE_UINT8) });
+    values = Run(plain, payload);
+    CHECK(values[0].m_kind == EtlValueKind::Binary && values[0].m_size == 0);
+    CHECK(values[1].m_uint == 3);
+}
+
+TEST(DecodePlanKeepsExplicitZeroLengthStringsEmpty)
+{
+    std::vector<uint8_t> payload;
+    Put(payload, uint16_t(0));
+    for (char16_t c : u"xy")
+        Put(payload, static_cast<uint16_t>(c));
+    Put(payload, uint16_t(0x5A5A));
+
+    // A length of zero taken from a property means an empty string, not a nul-terminated one.
+    DecodePlan plan = DecodePlan::Compile({
+        Property(ETL_INTYPE_UINT16),
+        Property(ETL_INTYPE_UNICODESTRING, 0, ETL_PROPERTY_PARAM_LENGTH),
+        Property(ETL_INTYPE_UNICODESTRING),
+        Property(ETL_INTYPE_UINT16),
+    });
+    std::vector<EtlValue> values = Run(plan, payload);
+    CHECK(values[1].m_kind == EtlValueKind::UnicodeString && values[1].m_size == 0 && values[1].m_offset == 2);
+    CHECK(values[2].m_kind == EtlValueKind::UnicodeString && values[2].m_size == 4 && values[2].m_offset == 2);
+    CHECK(values[3].m_uint == 0x5A5A);
+
+    // The same for a fixed length of zero, on ANSI strings too.
+    DecodePlan fixed = DecodePlan::Compile({ Property(ETL_INTYPE_ANSISTRING, 0, ETL_PROPERTY_PARAM_FIXED_LENGTH), Property(ETL_INTYPE_UINT8) });
+    values = Run(fixed, { 'q', 0 });
+    CHECK(values[0].m_kind == EtlValueKind::AnsiString && values[0].m_size == 0);
+    CHECK(values[1].m_uint == 'q');
+
+    // Explicit lengths drop trailing nuls, as TdhFormatProperty displays them.
+    DecodePlan padded = DecodePlan::Compile({ Property(ETL_INTYPE_ANSISTRING, 6, ETL_PROPERTY_PARAM_FIXED_LENGTH), Property(ETL_INTYPE_UINT8) });
+    values = Run(padded, { 'a', 'b', 0, 0, 0, 0, 9 });
+    CHECK(values[0].m_size == 2);
+    CHECK(values[1].m_uint == 9);
+}
+
+TEST(DecodePlanRejectsWhatItCannotDecode)
+{
+    CHECK(!DecodePlan().IsValid());
+    CHECK(DecodePlan::Compile({}).IsValid());
+    CHECK(!DecodePlan::Compile({ Property(ETL_INTYPE_UINT32), Property(ETL_INTYPE_UINT32, 0, ETL_PROPERTY_STRUCT) }).IsValid());
+    CHECK(!DecodePlan::Compile({ Property(ETL_INTYPE_RESERVED24) }).IsValid());
+    CHECK(!DecodePlan::Compile({ Property(ETL_INTYPE_UINT8), Property(999) }).IsValid());
+
+    // References must point to an earlier scalar integer.
+    CHECK(!DecodePlan::Compile({ Property(ETL_INTYPE_BINARY, 1, ETL_PROPERTY_PARAM_LENGTH), Property(ETL_INTYPE_UINT16) }).IsValid());
+    CHECK(!DecodePlan::Compile({ Property(ETL_INTYPE_BINARY, 0, ETL_PROPERTY_PARAM_LENGTH) }).IsValid());
+    CHECK(!DecodePlan::Compile({ Property(ETL_INTYPE_UINT64), Property(ETL_INTYPE_BINARY, 0, ETL_PROPERTY_PARAM_LENGTH) }).IsValid());
+    CHECK(!DecodePlan::Compile({ Property(ETL_INTYPE_ANSISTRING), Property(ETL_INTYPE_UINT8, 0, ETL_PROPERTY_PARAM_COUNT) }).IsValid());
+    CHECK(!DecodePlan::Compile({ Property(ETL_INTYPE_UINT16, 0, 0, 2), Property(ETL_INTYPE_UINT8, 0, ETL_PROPERTY_PARAM_COUNT) }).IsValid());
+    CHECK(DecodePlan::Compile({ Property(ETL_INTYPE_HEXINT32), Property(ETL_INTYPE_UINT8, 0, ETL_PROPERTY_PARAM_COUNT, 0) }).IsValid());
+
+    // NOPRINT out-types are treated as having no out-type.
+    DecodePlan plan = DecodePlan::Compile({ Property(ETL_INTYPE_UINT8, 0, 0, 1, ETL_OUTTYPE_NOPRINT) });
+    CHECK(plan.GetStep(0).m_outType == ETL_OUTTYPE_NULL);
+}
@@ -0,0 +1,262 @@
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <string>
+#include <vector>
+#include <ETL/DecodePlan.h>
+#include <ETL/EtlColumnTable.h>
+#include "Test.h"
+
+namespace {
+
+EtlValue IntValue(int64_t number)
+{
+    EtlValue value{};
+    value.m_kind = EtlValueKind::Int;
+    value.m_inType = ETL_INTYPE_INT64;
+    value.m_int = number;
+    value.m_size = 8;
+    return value;
+}
+
+EtlValue UIntValue(uint64_t number)
+{
+    EtlValue value{};
+    value.m_kind = EtlValueKind::UInt;
+    value.m_inType = ETL_INTYPE_UINT64;
+    value.m_uint = number;
+    value.m_size = 8;
+    return value;
+}
+
+EtlValue DoubleValue(double number)
+{
+    EtlValue value{};
+    value.m_kind = EtlValueKind::Double;
+    value.m_inType = ETL_INTYPE_DOUBLE;
+    value.m_double = number;
+    value.m_size = 8;
+    return value;
+}
+
+EtlValue AnsiValue(const std::string& text)
+{
+    EtlValue value{};
+    value.m_kind = EtlValueKind::AnsiString;
+    value.m_inType = ETL_INTYPE_ANSISTRING;
+    value.m_pData = reinterpret_cast<const uint8_t*>(text.data());
+    value.m_size = static_cast<uint32_t>(text.size());
+    return value;
+}
+
+EtlValue MissingValue()
+{
+    EtlValue value{};
+    value.m_kind = EtlValueKind::Missing;
+    return value;
+}
+
+// Row order the sort keys of a column give, ties kept in row order.
+std::vector<size_t> OrderByKeys(const EtlColumn& column)
+{
+    std::vector<uint64_t> keys;
+    column.GetSortKeys(keys);
+    std::vector<size_t> order(keys.size());
+    std::iota(order.begin(), order.end(), size_t(0));
+    std::stable_sort(order.begin(), order.end(), [&keys](size_t lhs, size_t rhs) { return keys[lhs] < keys[rhs]; });
+    return order;
+}
+
+}
+
+TEST(ValidityBitmapCrossesWordBoundaries)
+{
+    EtlValidityBitmap bitmap;
+    for (size_t row = 0; row < 200; row++)
+        bitmap.Append(row % 3 == 0 || row == 63 || row == 64);
+    CHECK(bitmap.Size() == 200);
+    for (size_t row = 0; row < 200; row++)
+        CHECK(bitmap.Get(row) == (row % 3 == 0 || row == 63 || row == 64));
+}
+
+TEST(ColumnTableKeepsTypedValuesAndMissingOnes)
+{
+    EtlColumnTable table({ "Int", "UInt", "Double", "Text" },
+        { EtlColumnType::Int64, EtlColumnType::UInt64, EtlColumnType::Double, EtlColumnType::String });
+    std::vector<char> scratch;
+    std::string text = "alpha";
+    table.AppendRow(10, { IntValue(-5), UIntValue(UINT64_MAX), DoubleValue(0.25), AnsiValue(text) }, scratch);
+    table.AppendRow(20, { IntValue(7), MissingValue(), MissingValue(), MissingValue() }, scratch);
+    table.AppendRow(30, { IntValue(INT64_MIN) }, scratch); // The payload ended before the other properties.
+    table.AppendRow(40, { IntValue(1), UIntValue(3), DoubleValue(-1.5), AnsiValue(text) }, scratch);
+
+    CHECK(table.RowCount() == 4);
+    CHECK(table.GetTimestamp(2) == 30);
+    const EtlColumn& ints = table.GetColumn(0);
+    const EtlColumn& uints = table.GetColumn(1);
+    const EtlColumn& doubles = table.GetColumn(2);
+    const EtlColumn& texts = table.GetColumn(3);
+    CHECK(ints.GetType() == EtlColumnType::Int64 && ints.GetInt(0) == -5 && ints.GetInt(2) == INT64_MIN);
+    CHECK(uints.GetType() == EtlColumnType::UInt64 && uints.GetUInt(0) == UINT64_MAX && uints.GetUInt(3) == 3);
+    CHECK(doubles.GetType() == EtlColumnType::Double && doubles.GetDouble(0) == 0.25 && doubles.GetDouble(3) == -1.5);
+    CHECK(texts.GetType() == EtlColumnType::String && texts.GetString(0) == "alpha");
+    for (size_t column = 1; column < 4; column++) {
+        CHECK(!table.GetColumn(column).IsValid(1));
+        CHECK(!table.GetColumn(column).IsValid(2));
+        CHECK(table.GetColumn(column).IsValid(3));
+    }
+
+    // Repeated strings share one dictionary entry; missing strings point at the empty string.
+    CHECK(texts.GetStringId(0) == texts.GetStringId(3));
+    CHECK(texts.GetStringId(1) == StringDictionary::EMPTY_ID);
+    CHECK(texts.GetDictionary().Size() == 2);
+}
+
+TEST(ColumnTableFallsBackToTextWhenValueKindsConflict)
+{
+    EtlColumnTable table({ "Value" }, { EtlColumnType::Int64 });
+    std::vector<char> scratch;
+    table.AppendRow(1, { IntValue(-12) }, scratch);
+    table.AppendRow(2, { MissingValue() }, scratch);
+    table.AppendRow(3, { IntValue(34) }, scratch);
+    CHECK(table.GetColumn(0).GetType() == EtlColumnType::Int64);
+
+    // Another schema decodes the same property as a string: earlier numbers are kept as their text.
+    std::string text = "C:\\Windows";
+    table.AppendRow(4, { AnsiValue(text) }, scratch);
+    table.AppendRow(5, { UIntValue(18446744073709551615ull) }, scratch);
+    table.AppendRow(6, { DoubleValue(2.5) }, scratch);
+    table.AppendRow(7, { MissingValue() }, scratch);
+
+    const EtlColumn& column = table.GetColumn(0);
+    CHECK(column.GetType() == EtlColumnType::String);
+    CHECK(column.Size() == 7);
+    CHECK(column.GetString(0) == "-12");
+    CHECK(!column.IsValid(1) && column.GetString(1).empty());
+    CHECK(column.GetString(2) == "34");
+    CHECK(column.GetString(3) == "C:\\Windows");
+    CHECK(column.GetString(4) == "18446744073709551615");
+    CHECK(column.GetString(5) == "2.5");
+    CHECK(!column.IsValid(6));
+
+    // Text rows turn number columns into text as well.
+    EtlColumnTable textTable({ "A", "B" }, { EtlColumnType::UInt64, EtlColumnType::Double });
+    textTable.AppendRow(1, { UIntValue(9), DoubleValue(0.5) }, scratch);
+    textTable.AppendTextRow(2, { "ten" });
+    CHECK(textTable.GetColumn(0).GetType() == EtlColumnType::String);
+    CHECK(textTable.GetColumn(0).GetString(0) == "9" && textTable.GetColumn(0).GetString(1) == "ten");
+    CHECK(textTable.GetColumn(1).GetType() == EtlColumnType::Double);
+    CHECK(textTable.GetColumn(1).GetDouble(0) == 0.5 && !textTable.GetColumn(1).IsValid(1));
+}
+
+TEST(ColumnTableAppendJoinsChunksOfEveryTypeMix)
+{
+    std::vector<char> scratch;
+    std::string red = "red";
+    std::string blue = "blue";
+
+    // Same types: strings are remapped into the receiving dictionary.
+    EtlColumnTable first({ "Number", "Text" }, { EtlColumnType::Int64, EtlColumnType::String });
+    first.AppendRow(1, { IntValue(1), AnsiValue(red) }, scratch);
+    EtlColumnTable second({ "Number", "Text" }, { EtlColumnType::Int64, EtlColumnType::String });
+    second.AppendRow(2, { IntValue(2), AnsiValue(blue) }, scratch);
+    second.AppendRow(3, { MissingValue(), AnsiValue(red) }, scratch);
+    first.Append(second);
+    CHECK(first.RowCount() == 3);
+    CHECK(first.GetTimestamps() == std::vector<int64_t>({ 1, 2, 3 }));
+    CHECK(first.GetColumn(0).GetType() == EtlColumnType::Int64);
+    CHECK(first.GetColumn(0).GetInt(1) == 2 && !first.GetColumn(0).IsValid(2));
+    const EtlColumn& texts = first.GetColumn(1);
+    CHECK(texts.GetString(1) == "blue" && texts.GetString(2) == "red");
+    CHECK(texts.GetStringId(0) == texts.GetStringId(2));
+    CHECK(texts.GetDictionary().Size() == 3);
+
+    // A number chunk joined to a text chunk, and the other way around.
+    EtlColumnTable numbers({ "Value" }, { EtlColumnType::UInt64 });
+    numbers.AppendRow(1, { UIntValue(42) }, scratch);
+    numbers.AppendRow(2, { MissingValue() }, scratch);
+    EtlColumnTable words({ "Value" }, { EtlColumnType::String });
+    words.AppendRow(3, { AnsiValue(red) }, scratch);
+
+    EtlColumnTable numbersThenWords = numbers;
+    numbersThenWords.Append(words);
+    const EtlColumn& a = numbersThenWords.GetColumn(0);
+    CHECK(a.GetType() == EtlColumnType::String);
+    CHECK(a.GetString(0) == "42" && !a.IsValid(1) && a.GetString(2) == "red");
+
+    EtlColumnTable wordsThenNumbers = words;
+    wordsThenNumbers.Append(numbers);
+    const EtlColumn& b = wordsThenNumbers.GetColumn(0);
+    CHECK(b.GetType() == EtlColumnType::String);
+    CHECK(b.GetString(0) == "red" && b.GetString(1) == "42" && !b.IsValid(2));
+
+    // Two number types meet as text.
+    EtlColumnTable signedNumbers({ "Value" }, { EtlColumnType::Int64 });
+    signedNumbers.AppendRow(4, { IntValue(-1) }, scratch);
+    signedNumbers.Append(numbers);
+    const EtlColumn& c = signedNumbers.GetColumn(0);
+    CHECK(c.GetType() == EtlColumnType::String);
+    CHECK(c.GetString(0) == "-1" && c.GetString(1) == "42" && !c.IsValid(2));
+}
+
+TEST(ColumnSortKeysOrderLikeTheValues)
+{
+    EtlColumn ints("Int", EtlColumnType::Int64);
+    for (int64_t value : { int64_t(3), INT64_MIN, int64_t(-1), int64_t(0), INT64_MAX })
+        ints.AppendInt(value);
+    ints.AppendNull();
+    CHECK(OrderByKeys(ints) == std::vector<size_t>({ 5, 1, 2, 3, 0, 4 }));
+
+    EtlColumn doubles("Double", EtlColumnType::Double);
+    for (double value : { 1.5, -std::numeric_limits<double>::infinity(), -2.0, 0.0, -0.5, std::numeric_limits<double>::infinity(), -1e-300 })
+        doubles.AppendDouble(value);
+    doubles.AppendNull();
+    CHECK(OrderByKeys(doubles) == std::vector<size_t>({ 7, 1, 2, 4, 6, 3, 0, 5 }));
+
+    EtlColumn uints("UInt", EtlColumnType::UInt64);
+    for (uint64_t value : { uint64_t(5), UINT64_MAX, uint64_t(0) })
+        uints.AppendUInt(value);
+    uints.AppendNull();
+    CHECK(OrderByKeys(uints) == std::vector<size_t>({ 3, 2, 0, 1 }));
+
+    // The smallest value stays apart from missing values; the largest shares the key of the one below it.
+    std::vector<uint64_t> keys;
+    ints.GetSortKeys(keys);
+    CHECK(keys[5] == 0 && keys[1] == 1);
+    uints.AppendUInt(UINT64_MAX - 1);
+    uints.GetSortKeys(keys);
+    CHECK(keys[3] < keys[2] && keys[1] == keys[4]);
+
+    // A missing string sorts before the empty string.
+    EtlColumn strings("Text", EtlColumnType::String);
+    for (const char* value : { "pear", "", "apple", "pear", "Zebra" })
+        strings.AppendString(value);
+    strings.AppendNull();
+    CHECK(OrderByKeys(strings) == std::vector<size_t>({ 5, 1, 4, 2, 0, 3 }));
+}
+
+TEST(StringRanksStayCurrentAsTheDictionaryGrows)
+{
+    EtlColumn column("Text", EtlColumnType::String);
+    EtlStringRanks ranks;
+    std::vector<uint64_t> keys;
+    for (const char* value : { "b", "d" })
+        column.AppendString(value);
+    column.GetSortKeys(keys, 0, ranks);
+
+    // Strings that sort after every ranked one leave the earlier keys alone.
+    for (const char* value : { "e", "f" })
+        column.AppendString(value);
+    CHECK(!ranks.Update(column.GetDictionary()));
+
+    // A string in between shifts the ranks, so every key is rebuilt even though firstRow is past them.
+    column.AppendString("c");
+    size_t firstRow = 4;
+    column.GetSortKeys(keys, firstRow, ranks);
+    std::vector<uint64_t> fresh;
+    column.GetSortKeys(fresh);
+    CHECK(keys == fresh);
+    CHECK(keys[0] < keys[4] && keys[4] < keys[1] && keys[1] < keys[2]);
+    CHECK(!ranks.Update(column.GetDictionary()));
+}
@@ -0,0 +1,393 @@
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+#include <ETL/EtlFile.h>
+#include "SyntheticEtl.h"
+#include "Test.h"
+
+namespace {
+
+constexpr EtlGuid TEST_PROVIDER = { 0x12345678, 0x1234, 0x5678, { 1, 2, 3, 4, 5, 6, 7, 8 } };
+constexpr EtlGuid TEST_ACTIVITY = { 0x87654321, 0x4321, 0x8765, { 8, 7, 6, 5, 4, 3, 2, 1 } };
+
+std::vector<uint8_t> Payload(size_t size, uint8_t seed)
+{
+    std::vector<uint8_t> payload(size);
+    for (size_t i = 0; i < size; i++)
+        payload[i] = static_cast<uint8_t>(seed + i);
+    return payload;
+}
+
+bool SamePayload(const EtlEventView& view, const std::vector<uint8_t>& payload)
+{
+    return view.m_userDataLength == payload.size() && memcmp(view.m_pUserData, payload.data(), payload.size()) == 0;
+}
+
+EtlRawEventHeader MakeEventHeader(uint8_t headerType, uint16_t id, int64_t timestamp)
+{
+    EtlRawEventHeader header = {};
+    header.HeaderType = headerType;
+    header.MarkerFlags = 0xC0;
+    header.ThreadId = 100;
+    header.ProcessId = 200;
+    header.TimeStamp = timestamp;
+    header.ProviderId = TEST_PROVIDER;
+    header.Id = id;
+    header.Version = 2;
+    header.Channel = 16;
+    header.Level = 4;
+    header.Opcode = 1;
+    header.Task = 7;
+    header.Keyword = 0x8000000000000001ull;
+    header.KernelTime = 11;
+    header.UserTime = 12;
+    header.ActivityId = TEST_ACTIVITY;
+    return header;
+}
+
+EtlRawSystemHeader MakeSystemHeader(uint8_t headerType, uint8_t group, uint8_t type, int64_t timestamp)
+{
+    EtlRawSystemHeader header = {};
+    header.Version = 3;
+    header.HeaderType = headerType;
+    header.Flags = 0xC0;
+    header.Type = type;
+    header.Group = group;
+    header.ThreadId = 300;
+    header.ProcessId = 400;
+    header.SystemTime = timestamp;
+    header.KernelTime = 21;
+    header.UserTime = 22;
+    return header;
+}
+
+/*
+Payload of the trace header event (TRACE_LOGFILE_HEADER as logged with 8 byte pointers), which
+the reader takes the session properties from.
+*/
+std::vector<uint8_t> LogFileHeaderPayload()
+{
+    std::vector<uint8_t> payload(280);
+    auto put = [&payload](size_t offset, auto value) { memcpy(payload.data() + offset, &value, sizeof(value)); };
+    put(0, uint32_t(4096));       // BufferSize
+    put(4, uint32_t(0x0A000002)); // Version
+    put(12, uint32_t(16));        // NumberOfProcessors
+    put(16, int64_t(999));        // EndTime
+    put(24, uint32_t(156250));    // TimerResolution
+    put(32, uint32_t(0x10001));   // LogFileMode
+    put(36, uint32_t(3));         // BuffersWritten
+    put(44, uint32_t(8));         // PointerSize
+    put(48, uint32_t(5));         // EventsLost
+    put(52, uint32_t(3000));      // CpuSpeedInMHz
+    put(248, int64_t(123456));    // BootTime
+    put(256, int64_t(10000000));  // PerfFreq
+    put(264, int64_t(777));       // StartTime
+    put(272, uint32_t(1));        // ReservedFlags (clock type)
+    put(276, uint32_t(2));        // BuffersLost
+    return payload;
+}
+
+std::vector<EtlEventView> ReadAll(const EtlFile& file)
+{
+    std::vector<EtlEventView> views;
+    file.ForEachEvent([&views](const EtlEventView& view) {
+        views.push_back(view);
+        return true;
+    });
+    return views;
+}
+
+}
+
+TEST(EtlFileDecodesEveryHeaderType)
+{
+    std::vector<uint8_t> event64 = Payload(13, 1);
+    std::vector<uint8_t> event32 = Payload(8, 2);
+    std::vector<uint8_t> system = Payload(6, 3);
+    std::vector<uint8_t> perfInfo = Payload(4, 4);
+    std::vector<uint8_t> full = Payload(10, 5);
+    std::vector<uint8_t> message = Payload(5, 6);
+    std::vector<uint8_t> stackData = Payload(24, 7);
+    std::vector<uint8_t> schemaData = Payload(3, 8);
+
+    SyntheticEtl etl(4096);
+    etl.BeginBuffer(2, 1000);
+    CHECK(etl.Add(SyntheticEtl::SystemRecord(MakeSystemHeader(ETL_HEADER_TYPE_SYSTEM64, 0x00, 0, 1000), LogFileHeaderPayload())));
+    CHECK(etl.Add(SyntheticEtl::EventRecord(MakeEventHeader(ETL_HEADER_TYPE_EVENT_HEADER64, 10, 1001), event64,
+        { { 0x0005, stackData }, { ETL_EXT_TYPE_EVENT_SCHEMA_TL, schemaData } })));
+    CHECK(etl.Add(SyntheticEtl::EventRecord(MakeEventHeader(ETL_HEADER_TYPE_EVENT_HEADER32, 11, 1002), event32)));
+    CHECK(etl.Add(SyntheticEtl::SystemRecord(MakeSystemHeader(ETL_HEADER_TYPE_SYSTEM32, 0x03, 1, 1003), system)));
+    CHECK(etl.Add(SyntheticEtl::SystemRecord(MakeSystemHeader(ETL_HEADER_TYPE_COMPACT32, 0x05, 2, 1004), system)));
+    CHECK(etl.Add(SyntheticEtl::SystemRecord(MakeSystemHeader(ETL_HEADER_TYPE_COMPACT64, 0x05, 3, 1005), system)));
+    for (uint8_t headerType : { ETL_HEADER_TYPE_PERFINFO32, ETL_HEADER_TYPE_PERFINFO64 }) {
+        EtlRawPerfInfoHeader header = {};
+        header.Version = 2;
+        header.HeaderType = headerType;
+        header.Type = 46;
+        header.Group = 0x0F;
+        header.SystemTime = 1006;
+        CHECK(etl.Add(SyntheticEtl::PerfInfoRecord(header, perfInfo)));
+    }
+    for (uint8_t headerType : { ETL_HEADER_TYPE_FULL_HEADER32, ETL_HEADER_TYPE_FULL_HEADER64 }) {
+        EtlRawFullHeader header = {};
+        header.HeaderType = headerType;
+        header.Type = 9;
+        header.Level = 3;
+        header.Version = 1;
+        header.ThreadId = 500;
+        header.ProcessId = 600;
+        header.TimeStamp = 1007;
+        header.Guid = TEST_PROVIDER;
+        CHECK(etl.Add(SyntheticEtl::FullRecord(header, full)));
+    }
+    CHECK(etl.Add(SyntheticEtl::MessageRecord(42, TEST_PROVIDER, 1008, 700, 800, message)));
+    for (uint8_t headerType : { ETL_HEADER_TYPE_INSTANCE32, ETL_HEADER_TYPE_INSTANCE64, ETL_HEADER_TYPE_TIMED, ETL_HEADER_TYPE_ERROR, ETL_HEADER_TYPE_WNODE_HEADER })
+        CHECK(etl.Add(SyntheticEtl::OpaqueRecord(headerType, 52)));
+    CHECK(etl.Add(SyntheticEtl::EventRecord(MakeEventHeader(ETL_HEADER_TYPE_EVENT_HEADER64, 12, 1009), event64)));
+
+    TempFile temp("every_header_type.etl");
+    etl.Write(temp.GetPath());
+    EtlFile file(temp.GetPath());
+    CHECK(file.GetBufferCount() == 1);
+
+    const EtlLogFileInfo& info = file.GetLogFileInfo();
+    CHECK(info.m_bufferSize == 4096);
+    CHECK(info.m_version == 0x0A000002);
+    CHECK(info.m_numberOfProcessors == 16);
+    CHECK(info.m_endTime == 999);
+    CHECK(info.m_timerResolution == 156250);
+    CHECK(info.m_logFileMode == 0x10001);
+    CHECK(info.m_buffersWritten == 3);
+    CHECK(info.m_pointerSize == 8);
+    CHECK(info.m_eventsLost == 5);
+    CHECK(info.m_cpuSpeedMHz == 3000);
+    CHECK(info.m_bootTime == 123456);
+    CHECK(info.m_perfFreq == 10000000);
+    CHECK(info.m_startTime == 777);
+    CHECK(info.m_clockType == 1);
+    CHECK(info.m_buffersLost == 2);
+    CHECK(info.m_startTimestamp == 1000);
+
+    // Instance, timed, error and WNODE records are skipped, the event after them is still read.
+    std::vector<EtlEventView> views = ReadAll(file);
+    CHECK(views.size() == 12);
+
+    const EtlEventView& traceHeader = views[0];
+    CHECK(EtlGuidEquals(traceHeader.m_providerId, ETL_EVENT_TRACE_GUID));
+    CHECK(traceHeader.m_headerType == ETL_HEADER_TYPE_SYSTEM64);
+    CHECK(traceHeader.m_processorIndex == 2);
+    CHECK(traceHeader.m_loggerId == 1);
+
+    const EtlEventView& extended = views[1];
+    CHECK(EtlGuidEquals(extended.m_providerId, TEST_PROVIDER));
+    CHECK(EtlGuidEquals(extended.m_activityId, TEST_ACTIVITY));
+    CHECK(extended.m_timestamp == 1001);
+    CHECK(extended.m_id == 10);
+    CHECK(extended.m_version == 2);
+    CHECK(extended.m_channel == 16);
+    CHECK(extended.m_level == 4);
+    CHECK(extended.m_opcode == 1);
+    CHECK(extended.m_task == 7);
+    CHECK(extended.m_keyword == 0x8000000000000001ull);
+    CHECK(extended.m_threadId == 100);
+    CHECK(extended.m_processId == 200);
+    CHECK(extended.m_kernelTime == 11);
+    CHECK(extended.m_userTime == 12);
+    CHECK(extended.m_flags == (ETL_HEADER_FLAG_EXTENDED_INFO | ETL_HEADER_FLAG_64_BIT_HEADER));
+    CHECK(extended.m_extendedDataCount == 2);
+    CHECK(extended.m_extendedData[0].m_extType == 0x0005);
+    CHECK(extended.m_extendedData[0].m_dataSize == stackData.size());
+    CHECK(memcmp(extended.m_extendedData[0].m_pData, stackData.data(), stackData.size()) == 0);
+    CHECK(extended.m_extendedData[1].m_extType == ETL_EXT_TYPE_EVENT_SCHEMA_TL);
+    CHECK(memcmp(extended.m_extendedData[1].m_pData, schemaData.data(), schemaData.size()) == 0);
+    CHECK(SamePayload(extended, event64));
+
+    const EtlEventView& header32 = views[2];
+    CHECK(header32.m_id == 11);
+    CHECK(header32.m_flags == ETL_HEADER_FLAG_32_BIT_HEADER);
+    CHECK(header32.m_extendedDataCount == 0);
+    CHECK(SamePayload(header32, event32));
+
+    const EtlEventView& system32 = views[3];
+    CHECK(EtlGuidEquals(system32.m_providerId, EtlFile::KernelGroupGuid(0x03)));
+    CHECK(system32.m_timestamp == 1003);
+    CHECK(system32.m_opcode == 1);
+    CHECK(system32.m_version == 3);
+    CHECK(system32.m_threadId == 300);
+    CHECK(system32.m_processId == 400);
+    CHECK(system32.m_kernelTime == 21);
+    CHECK(system32.m_userTime == 22);
+    CHECK(system32.m_flags == (ETL_HEADER_FLAG_CLASSIC_HEADER | ETL_HEADER_FLAG_32_BIT_HEADER));
+    CHECK(SamePayload(system32, system));
+
+    for (size_t i : { size_t(4), size_t(5) }) {
+        const EtlEventView& compact = views[i];
+        CHECK(EtlGuidEquals(compact.m_providerId, EtlFile::KernelGroupGuid(0x05)));
+        CHECK(compact.m_threadId == 300);
+        CHECK(compact.m_kernelTime == 0); // Compact headers end before the CPU times.
+        CHECK((compact.m_flags & ETL_HEADER_FLAG_NO_CPUTIME) != 0);
+        CHECK(SamePayload(compact, system));
+    }
+    CHECK((views[4].m_flags & ETL_HEADER_FLAG_32_BIT_HEADER) != 0);
+    CHECK((views[5].m_flags & ETL_HEADER_FLAG_64_BIT_HEADER) != 0);
+
+    for (size_t i : { size_t(6), size_t(7) }) {
+        const EtlEventView& perf = views[i];
+        CHECK(EtlGuidEquals(perf.m_providerId, EtlFile::KernelGroupGuid(0x0F)));
+        CHECK(perf.m_timestamp == 1006);
+        CHECK(perf.m_opcode == 46);
+        CHECK(perf.m_threadId == 0xFFFFFFFF);
+        CHECK(perf.m_processId == 0xFFFFFFFF);
+        CHECK(SamePayload(perf, perfInfo));
+    }
+    CHECK(views[6].m_headerType == ETL_HEADER_TYPE_PERFINFO32);
+    CHECK(views[7].m_headerType == ETL_HEADER_TYPE_PERFINFO64);
+
+    for (size_t i : { size_t(8), size_t(9) }) {
+        const EtlEventView& classic = views[i];
+        CHECK(EtlGuidEquals(classic.m_providerId, TEST_PROVIDER));
+        CHECK(classic.m_timestamp == 1007);
+        CHECK(classic.m_opcode == 9);
+        CHECK(classic.m_level == 3);
+        CHECK(classic.m_threadId == 500);
+        CHECK(classic.m_processId == 600);
+        CHECK((classic.m_flags & ETL_HEADER_FLAG_CLASSIC_HEADER) != 0);
+        CHECK(SamePayload(classic, full));
+    }
+
+    const EtlEventView& trace = views[10];
+    CHECK(trace.m_headerType == ETL_HEADER_TYPE_MESSAGE);
+    CHECK(EtlGuidEquals(trace.m_providerId, TEST_PROVIDER));
+    CHECK(trace.m_id == 42);
+    CHECK(trace.m_timestamp == 1008);
+    CHECK(trace.m_threadId == 700);
+    CHECK(trace.m_processId == 800);
+    CHECK(trace.m_flags == ETL_HEADER_FLAG_TRACE_MESSAGE);
+    CHECK(SamePayload(trace, message));
+
+    CHECK(views[11].m_id == 12);
+    CHECK(SamePayload(views[11], event64));
+
+    // Every view can be read again from the location it reports.
+    for (const EtlEventView& view : views) {
+        EtlEventView again;
+        CHECK(file.ReadEventAt(view.m_bufferIndex, view.m_bufferOffset, &again));
+        CHECK(again.m_timestamp == view.m_timestamp);
+        CHECK(again.m_pUserData == view.m_pUserData);
+    }
+    EtlEventView unused;
+    CHECK(!file.ReadEventAt(1, sizeof(EtlRawBufferHeader), &unused));
+}
+
+TEST(EtlFileIndexesBuffers)
+{
+    SyntheticEtl etl(1024);
+    for (uint8_t processor = 0; processor < 4; processor++) {
+        etl.BeginBuffer(processor, 100 * processor);
+        for (uint16_t i = 0; i <= processor; i++)
+            CHECK(etl.Add(SyntheticEtl::EventRecord(MakeEventHeader(ETL_HEADER_TYPE_EVENT_HEADER64, i, 100 * processor + i), Payload(16, 0))));
+    }
+    TempFile temp("buffers.etl");
+    etl.Write(temp.GetPath());
+
+    std::vector<EtlBufferInfo> buffers;
+    {
+        EtlFile file(temp.GetPath());
+        CHECK(file.GetBufferCount() == 4);
+        for (size_t i = 0; i < 4; i++) {
+            const EtlBufferInfo& buffer = file.GetBuffer(i);
+            CHECK(buffer.m_fileOffset == i * 1024);
+            CHECK(buffer.m_bufferSize == 1024);
+            CHECK(buffer.m_filledBytes == sizeof(EtlRawBufferHeader) + (i + 1) * 96);
+            CHECK(buffer.m_timestamp == static_cast<int64_t>(100 * i));
+            CHECK(buffer.m_processorIndex == i);
+        }
+        // Without a trace header the log file info only knows the buffer size.
+        CHECK(file.GetLogFileInfo().m_bufferSize == 1024);
+        CHECK(file.GetLogFileInfo().m_startTimestamp == 0);
+
+        size_t count = 0;
+        CHECK(file.ForEachEventInBuffer(3, [&count](const EtlEventView& view) {
+            CHECK(view.m_bufferIndex == 3);
+            CHECK(view.m_timestamp == static_cast<int64_t>(300 + count));
+            count++;
+            return true;
+        }));
+        CHECK(count == 4);
+        CHECK(ReadAll(file).size() == 10);
+
+        count = 0;
+        CHECK(!file.ForEachEvent([&count](const EtlEventView&) { return ++count < 3; }));
+        CHECK(count == 3);
+        buffers = file.GetBuffers();
+    }
+
+    // Buffers indexed before are taken as they are, unless they do not fit the file.
+    buffers.pop_back();
+    {
+        EtlFile file(temp.GetPath(), buffers);
+        CHECK(file.GetBufferCount() == 3);
+    }
+    buffers.push_back(EtlBufferInfo{ 4096, 1024, 1024, 0, 0, 0, 0 });
+    {
+        EtlFile file(temp.GetPath(), buffers);
+        CHECK(file.GetBufferCount() == 4);
+        CHECK(file.GetBuffer(3).m_fileOffset == 3072);
+    }
+}
+
+TEST(EtlFileStopsAtPaddingAndTruncatedRecords)
+{
+    SyntheticEtl etl(1024);
+    // The filled size covers the whole buffer, so the reader has to stop at the 0xFF padding.
+    etl.BeginBuffer(0, 0);
+    CHECK(etl.Add(SyntheticEtl::EventRecord(MakeEventHeader(ETL_HEADER_TYPE_EVENT_HEADER64, 1, 1), Payload(16, 0))));
+    etl.SetFilledBytes(1024);
+
+    // A record claiming more bytes than the buffer holds ends the buffer.
+    etl.BeginBuffer(1, 0);
+    CHECK(etl.Add(SyntheticEtl::EventRecord(MakeEventHeader(ETL_HEADER_TYPE_EVENT_HEADER64, 2, 2), Payload(16, 0))));
+    std::vector<uint8_t> truncated = SyntheticEtl::EventRecord(MakeEventHeader(ETL_HEADER_TYPE_EVENT_HEADER64, 3, 3), Payload(64, 0));
+    CHECK(etl.Add(truncated));
+    etl.SetFilledBytes(etl.GetFilledBytes() - 32);
+
+    // Extended data running past the record makes the record unusable, but the next one is read.
+    etl.BeginBuffer(2, 0);
+    std::vector<uint8_t> broken = SyntheticEtl::EventRecord(MakeEventHeader(ETL_HEADER_TYPE_EVENT_HEADER64, 4, 4), Payload(8, 0), { { 0x0005, Payload(8, 0) } });
+    uint16_t dataSize = 200;
+    memcpy(broken.data() + sizeof(EtlRawEventHeader) + 6, &dataSize, sizeof(dataSize));
+    CHECK(etl.Add(broken));
+    // A header type the reader does not know is skipped by its size.
+    CHECK(etl.Add(SyntheticEtl::OpaqueRecord(0x7F, 24)));
+    CHECK(etl.Add(SyntheticEtl::EventRecord(MakeEventHeader(ETL_HEADER_TYPE_EVENT_HEADER64, 5, 5), Payload(8, 0))));
+
+    TempFile temp("truncated.etl");
+    etl.Write(temp.GetPath());
+    EtlFile file(temp.GetPath());
+    std::vector<EtlEventView> views = ReadAll(file);
+    CHECK(views.size() == 3);
+    CHECK(views[0].m_id == 1);
+    CHECK(views[1].m_id == 2);
+    CHECK(views[2].m_id == 5);
+
+    EtlEventView view;
+    uint32_t next = 0;
+    CHECK(file.DecodeEventAt(2, sizeof(EtlRawBufferHeader), &view, &next) == EtlFile::DecodeResult::Skipped);
+    CHECK(next == sizeof(EtlRawBufferHeader) + broken.size());
+    CHECK(file.DecodeEventAt(2, 1024, &view, &next) == EtlFile::DecodeResult::End);
+}
+
+TEST(EtlFileRejectsFilesWithoutBuffers)
+{
+    TempFile temp("empty.etl");
+    SyntheticEtl().Write(temp.GetPath());
+    CHECK_THROWS(EtlFile file(temp.GetPath()), std::runtime_error);
+
+    // A header whose buffer size runs past the end of the file is not a buffer either.
+    SyntheticEtl etl(1024);
+    etl.BeginBuffer(0, 0);
+    std::vector<uint8_t> bytes = etl.GetBytes();
+    bytes.resize(512);
+    std::ofstream(temp.GetPath(), std::ios::binary | std::ios::trunc).write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+    CHECK_THROWS(EtlFile file(temp.GetPath()), std::runtime_error);
+}
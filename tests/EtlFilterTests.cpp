@@ -0,0 +1,334 @@
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <ETL/EtlFilter.h>
+#include "Test.h"
+
+namespace {
+
+const std::vector<std::string> PROPERTIES = { "Size", "Delta", "Ratio", "Name", "Path" };
+
+// One event: its header fields, and the property values of its payload (none when it could not be decoded).
+struct Row {
+    EtlEventView m_header;
+    std::vector<EtlValue> m_values;
+};
+
+EtlEventView Header(uint32_t processId, uint8_t level = 0, int64_t timestamp = 0)
+{
+    EtlEventView view = {};
+    view.m_processId = processId;
+    view.m_level = level;
+    view.m_timestamp = timestamp;
+    return view;
+}
+
+EtlValue Value(EtlValueKind kind)
+{
+    EtlValue value = {};
+    value.m_kind = kind;
+    value.m_size = 8;
+    return value;
+}
+
+EtlValue Unsigned(uint64_t number)
+{
+    EtlValue value = Value(EtlValueKind::UInt);
+    value.m_uint = number;
+    return value;
+}
+
+EtlValue Signed(int64_t number)
+{
+    EtlValue value = Value(EtlValueKind::Int);
+    value.m_int = number;
+    return value;
+}
+
+EtlValue Real(double number)
+{
+    EtlValue value = Value(EtlValueKind::Double);
+    value.m_double = number;
+    return value;
+}
+
+EtlValue Text(std::string_view text)
+{
+    EtlValue value = Value(EtlValueKind::AnsiString);
+    value.m_pData = reinterpret_cast<const uint8_t*>(text.data());
+    value.m_size = static_cast<uint32_t>(text.size());
+    return value;
+}
+
+// A row with one property set; the others stay missing.
+Row With(size_t property, const EtlValue& value)
+{
+    Row row = { Header(0), std::vector<EtlValue>(PROPERTIES.size(), Value(EtlValueKind::Missing)) };
+    row.m_values[property] = value;
+    return row;
+}
+
+std::vector<uint8_t> Evaluate(const EtlFilter& filter, const std::vector<Row>& rows, bool decoded)
+{
+    EtlFilterBatch batch;
+    batch.Clear(PROPERTIES.size());
+    for (const Row& row : rows) {
+        batch.AppendHeader(row.m_header);
+        if (decoded && !row.m_values.empty())
+            batch.SetValues(row.m_values);
+    }
+    std::vector<uint8_t> results;
+    filter.Evaluate(batch, decoded, results);
+    return results;
+}
+
+std::vector<uint8_t> Evaluate(std::string_view text, const std::vector<Row>& rows, bool decoded = true)
+{
+    return Evaluate(EtlFilter::Compile(text, PROPERTIES), rows, decoded);
+}
+
+// The rows of the result that matched.
+std::vector<size_t> Matches(std::string_view text, const std::vector<Row>& rows)
+{
+    std::vector<uint8_t> results = Evaluate(text, rows);
+    std::vector<size_t> matches;
+    for (size_t row = 0; row < results.size(); row++) {
+        if (results[row] == EtlFilter::MATCH)
+            matches.push_back(row);
+    }
+    return matches;
+}
+
+/*
+The UTF-16 code units of text and a terminator, little endian at an odd address of storage, the way
+strings land in payloads after an odd sized property.
+*/
+EtlValue UnalignedUtf16(std::u16string_view text, std::vector<uint8_t>& storage)
+{
+    storage.assign(1 + (text.size() + 1) * 2, 0);
+    for (size_t i = 0; i < text.size(); i++) {
+        storage[1 + i * 2] = static_cast<uint8_t>(text[i]);
+        storage[2 + i * 2] = static_cast<uint8_t>(text[i] >> 8);
+    }
+    EtlValue value = Value(EtlValueKind::UnicodeString);
+    value.m_inType = ETL_INTYPE_UNICODESTRING;
+    value.m_pData = storage.data() + 1;
+    value.m_size = static_cast<uint32_t>(storage.size() - 1);
+    return value;
+}
+
+constexpr uint8_t NO = EtlFilter::NO_MATCH;
+constexpr uint8_t MAYBE = EtlFilter::MAYBE;
+constexpr uint8_t YES = EtlFilter::MATCH;
+
+}
+
+TEST(EtlFilterParsesPrecedence)
+{
+    // pid, level
+    std::vector<Row> rows = { { Header(1, 0), {} }, { Header(2, 3), {} }, { Header(2, 0), {} }, { Header(3, 3), {} } };
+
+    // && binds tighter than ||, and ! applies to the comparison that follows it.
+    CHECK(Evaluate("pid == 1 || pid == 2 && level == 3", rows) == std::vector<uint8_t>({ YES, YES, NO, NO }));
+    CHECK(Evaluate("(pid == 1 || pid == 2) && level == 3", rows) == std::vector<uint8_t>({ NO, YES, NO, NO }));
+    CHECK(Evaluate("level == 3 && pid == 2 || pid == 1", rows) == std::vector<uint8_t>({ YES, YES, NO, NO }));
+    CHECK(Evaluate("!pid == 1 && level == 3", rows) == std::vector<uint8_t>({ NO, YES, NO, YES }));
+    CHECK(Evaluate("!(pid == 1 || level == 3)", rows) == std::vector<uint8_t>({ NO, NO, YES, NO }));
+    CHECK(Evaluate("!!(pid == 2)", rows) == std::vector<uint8_t>({ NO, YES, YES, NO }));
+    CHECK(Evaluate("pid == 1 || pid == 2 || pid == 3 && level == 0", rows) == std::vector<uint8_t>({ YES, YES, YES, NO }));
+    CHECK(Evaluate("((pid >= 2)) && (level == 0 || (pid == 3))", rows) == std::vector<uint8_t>({ NO, NO, YES, YES }));
+
+    // Names of properties and fields ignore case, and properties come first.
+    CHECK(Evaluate("PROCESSID == 1 || Level == 3", rows) == std::vector<uint8_t>({ YES, YES, NO, YES }));
+    CHECK(!EtlFilter::Compile("level == 3", PROPERTIES).NeedsProperties());
+    CHECK(EtlFilter::Compile("level == 3", { "Level" }).NeedsProperties());
+
+    for (std::string_view text : { "", "pid ==", "(pid == 1", "pid == 1)", "pid == 1 &&", "|| pid == 1", "Unknown == 1", "pid 1",
+        "pid == \"text\"", "Size contains 5", "Name < \"a\"", "Size & 1.5", "Size & -1", "pid == 0x", "pid == 1x", "Name == \"open" })
+        CHECK_THROWS(EtlFilter::Compile(text, PROPERTIES), std::runtime_error);
+}
+
+TEST(EtlFilterCombinesMaybeWithThreeValuedLogic)
+{
+    std::vector<Row> rows = { With(0, Unsigned(1)), With(0, Unsigned(2)) };
+    rows[0].m_header = Header(1);
+    rows[1].m_header = Header(2);
+
+    // Without values every property test is MAYBE; header tests settle the rows they can.
+    CHECK(Evaluate("Size == 1", rows, false) == std::vector<uint8_t>({ MAYBE, MAYBE }));
+    CHECK(Evaluate("!(Size == 1)", rows, false) == std::vector<uint8_t>({ MAYBE, MAYBE }));
+    CHECK(Evaluate("Size == 1 && pid == 2", rows, false) == std::vector<uint8_t>({ NO, MAYBE }));
+    CHECK(Evaluate("Size == 1 || pid == 2", rows, false) == std::vector<uint8_t>({ MAYBE, YES }));
+    CHECK(Evaluate("!(Size == 1 || pid == 2)", rows, false) == std::vector<uint8_t>({ MAYBE, NO }));
+    CHECK(Evaluate("!(Size == 1 && pid == 2)", rows, false) == std::vector<uint8_t>({ YES, MAYBE }));
+    CHECK(Evaluate("Size & 1 || Name contains \"x\"", rows, false) == std::vector<uint8_t>({ MAYBE, MAYBE }));
+    CHECK(Evaluate("(Size == 1 || pid == 2) && (Size == 2 || pid == 1)", rows, false) == std::vector<uint8_t>({ MAYBE, MAYBE }));
+
+    // Decoding settles every row, and agrees with the header answer wherever that was not MAYBE.
+    CHECK(Evaluate("Size == 1 && pid == 2", rows) == std::vector<uint8_t>({ NO, NO }));
+    CHECK(Evaluate("Size == 1 || pid == 2", rows) == std::vector<uint8_t>({ YES, YES }));
+    CHECK(Evaluate("!(Size == 1 || pid == 2)", rows) == std::vector<uint8_t>({ NO, NO }));
+    CHECK(Evaluate("!(Size == 1 && pid == 2)", rows) == std::vector<uint8_t>({ YES, YES }));
+    CHECK(Evaluate("Size & 1 || Name contains \"x\"", rows) == std::vector<uint8_t>({ YES, NO }));
+    CHECK(Evaluate("(Size == 1 || pid == 2) && (Size == 2 || pid == 1)", rows) == std::vector<uint8_t>({ YES, YES }));
+}
+
+TEST(EtlFilterClampsLiteralsToEachValueDomain)
+{
+    constexpr size_t SIZE = 0;
+    constexpr size_t DELTA = 1;
+    constexpr size_t RATIO = 2;
+    std::vector<Row> unsignedRows = { With(SIZE, Unsigned(0)), With(SIZE, Unsigned(2)), With(SIZE, Unsigned(3)), With(SIZE, Unsigned(UINT64_MAX)) };
+
+    // Fractional literals fall between integers.
+    CHECK(Matches("Size == 2.5", unsignedRows).empty());
+    CHECK(Matches("Size != 2.5", unsignedRows) == std::vector<size_t>({ 0, 1, 2, 3 }));
+    CHECK(Matches("Size < 2.5", unsignedRows) == std::vector<size_t>({ 0, 1 }));
+    CHECK(Matches("Size <= 2.5", unsignedRows) == std::vector<size_t>({ 0, 1 }));
+    CHECK(Matches("Size > 2.5", unsignedRows) == std::vector<size_t>({ 2, 3 }));
+    CHECK(Matches("Size >= 2.5", unsignedRows) == std::vector<size_t>({ 2, 3 }));
+    CHECK(Matches("Size >= -0.5", unsignedRows) == std::vector<size_t>({ 0, 1, 2, 3 }));
+
+    // Negative literals are below every unsigned value, and hex and huge literals beyond them clamp to the top.
+    CHECK(Matches("Size > -1", unsignedRows) == std::vector<size_t>({ 0, 1, 2, 3 }));
+    CHECK(Matches("Size < -1", unsignedRows).empty());
+    CHECK(Matches("Size == -1", unsignedRows).empty());
+    CHECK(Matches("Size == 0xFFFFFFFFFFFFFFFF", unsignedRows) == std::vector<size_t>({ 3 }));
+    CHECK(Matches("Size < 0xffffffffffffffff", unsignedRows) == std::vector<size_t>({ 0, 1, 2 }));
+    CHECK(Matches("Size >= 0x2", unsignedRows) == std::vector<size_t>({ 1, 2, 3 }));
+    CHECK(Matches("Size > 18446744073709551616", unsignedRows).empty());
+    CHECK(Matches("Size <= 1e30", unsignedRows) == std::vector<size_t>({ 0, 1, 2, 3 }));
+    CHECK(Matches("Size & 0x8000000000000000", unsignedRows) == std::vector<size_t>({ 3 }));
+
+    std::vector<Row> signedRows = { With(DELTA, Signed(INT64_MIN)), With(DELTA, Signed(-3)), With(DELTA, Signed(-2)), With(DELTA, Signed(-1)), With(DELTA, Signed(INT64_MAX)) };
+    CHECK(Matches("Delta > -2.5", signedRows) == std::vector<size_t>({ 2, 3, 4 }));
+    CHECK(Matches("Delta <= -2.5", signedRows) == std::vector<size_t>({ 0, 1 }));
+    CHECK(Matches("Delta == -2", signedRows) == std::vector<size_t>({ 2 }));
+    CHECK(Matches("Delta == -0x2", signedRows) == std::vector<size_t>({ 2 }));
+    CHECK(Matches("Delta < 0", signedRows) == std::vector<size_t>({ 0, 1, 2, 3 }));
+
+    // The bit pattern of -1 as a hex literal is not -1.
+    CHECK(Matches("Delta == 0xFFFFFFFFFFFFFFFF", signedRows).empty());
+    CHECK(Matches("Delta > 0xFFFFFFFFFFFFFFFF", signedRows).empty());
+    CHECK(Matches("Delta < 0xFFFFFFFFFFFFFFFF", signedRows) == std::vector<size_t>({ 0, 1, 2, 3, 4 }));
+    CHECK(Matches("Delta < 9223372036854775808", signedRows) == std::vector<size_t>({ 0, 1, 2, 3, 4 }));
+    CHECK(Matches("Delta >= 9223372036854775807", signedRows) == std::vector<size_t>({ 4 }));
+    CHECK(Matches("Delta >= -9223372036854775808", signedRows) == std::vector<size_t>({ 0, 1, 2, 3, 4 }));
+    CHECK(Matches("Delta < -9223372036854775808", signedRows).empty());
+    CHECK(Matches("Delta == -9223372036854775809", signedRows).empty());
+    CHECK(Matches("Delta > -1e30", signedRows) == std::vector<size_t>({ 0, 1, 2, 3, 4 }));
+
+    // Doubles compare exactly, strictly for < and >.
+    std::vector<Row> doubleRows = { With(RATIO, Real(-1.0)), With(RATIO, Real(2.0)), With(RATIO, Real(2.0000001)), With(RATIO, Real(16.0)) };
+    CHECK(Matches("Ratio > 2", doubleRows) == std::vector<size_t>({ 2, 3 }));
+    CHECK(Matches("Ratio >= 2", doubleRows) == std::vector<size_t>({ 1, 2, 3 }));
+    CHECK(Matches("Ratio < 2", doubleRows) == std::vector<size_t>({ 0 }));
+    CHECK(Matches("Ratio == 0x10", doubleRows) == std::vector<size_t>({ 3 }));
+    CHECK(Matches("Ratio == -1", doubleRows) == std::vector<size_t>({ 0 }));
+    CHECK(Matches("Ratio != 2", doubleRows) == std::vector<size_t>({ 0, 2, 3 }));
+
+    // Header fields are unsigned.
+    std::vector<Row> headerRows = { { Header(0), {} }, { Header(7), {} }, { Header(UINT32_MAX), {} } };
+    CHECK(Matches("pid > -1", headerRows) == std::vector<size_t>({ 0, 1, 2 }));
+    CHECK(Matches("pid < 0.5", headerRows) == std::vector<size_t>({ 0 }));
+    CHECK(Matches("pid == 6.5 || pid == -7", headerRows).empty());
+    CHECK(Matches("pid >= 0xFFFFFFFF", headerRows) == std::vector<size_t>({ 2 }));
+}
+
+TEST(EtlFilterComparisonsWithMissingPropertiesAreFalse)
+{
+    constexpr size_t SIZE = 0;
+    constexpr size_t NAME = 3;
+    std::string name = "Open";
+    // Present, missing, of the wrong kind, and a row that could not be decoded at all.
+    std::vector<Row> rows = { With(SIZE, Unsigned(5)), With(NAME, Text(name)), With(SIZE, Value(EtlValueKind::Guid)), { Header(0), {} } };
+    rows[0].m_values[NAME] = Text("Close");
+
+    // != is false like every other comparison with a value that is not there, but !(==) holds.
+    CHECK(Matches("Size != 5", rows).empty());
+    CHECK(Matches("Size != 6", rows) == std::vector<size_t>({ 0 }));
+    CHECK(Matches("Size == 5", rows) == std::vector<size_t>({ 0 }));
+    CHECK(Matches("!(Size == 6)", rows) == std::vector<size_t>({ 0, 1, 2, 3 }));
+    CHECK(Matches("!(Size != 6)", rows) == std::vector<size_t>({ 1, 2, 3 }));
+    CHECK(Matches("Size & 0xFF", rows) == std::vector<size_t>({ 0 }));
+    CHECK(Matches("!(Size & 0xFF)", rows) == std::vector<size_t>({ 1, 2, 3 }));
+
+    // The same for strings, which compare ignoring ASCII case.
+    CHECK(Matches("Name != \"open\"", rows) == std::vector<size_t>({ 0 }));
+    CHECK(Matches("Name != \"shut\"", rows) == std::vector<size_t>({ 0, 1 }));
+    CHECK(Matches("Name == \"OPEN\"", rows) == std::vector<size_t>({ 1 }));
+    CHECK(Matches("!(Name == \"open\")", rows) == std::vector<size_t>({ 0, 2, 3 }));
+
+    // Strings holding numbers compare as numbers.
+    rows[1].m_values[SIZE] = Text(" 0x10 ");
+    CHECK(Matches("Size == 16 && Size & 0x10", rows) == std::vector<size_t>({ 1 }));
+}
+
+TEST(EtlFilterMatchesUnalignedUtf16)
+{
+    std::vector<uint8_t> storage;
+    std::vector<Row> rows = { With(4, UnalignedUtf16(u"C:\\Windows\\System32\\KERNEL32.DLL", storage)) };
+    CHECK(reinterpret_cast<uintptr_t>(rows[0].m_values[4].m_pData) % 2 == 1);
+
+    CHECK(Evaluate(R"(Path contains "kernel32.dll")", rows) == std::vector<uint8_t>({ YES }));
+    CHECK(Evaluate(R"(Path contains "c:\\windows")", rows) == std::vector<uint8_t>({ YES }));
+    CHECK(Evaluate(R"(Path contains "system32\\kernel")", rows) == std::vector<uint8_t>({ YES }));
+    CHECK(Evaluate(R"(Path contains "L")", rows) == std::vector<uint8_t>({ YES }));
+    CHECK(Evaluate(R"(Path contains "")", rows) == std::vector<uint8_t>({ YES }));
+    CHECK(Evaluate(R"(Path contains "kernel64")", rows) == std::vector<uint8_t>({ NO }));
+    CHECK(Evaluate(R"(Path contains "kernel32.dll2")", rows) == std::vector<uint8_t>({ NO }));
+    CHECK(Evaluate(R"(Path contains "c:\\windows\\system32\\kernel32.dll and more")", rows) == std::vector<uint8_t>({ NO }));
+
+    // Equality ignores the terminator.
+    CHECK(Evaluate(R"(Path == "c:\\windows\\system32\\kernel32.dll")", rows) == std::vector<uint8_t>({ YES }));
+    CHECK(Evaluate(R"(Path == "c:\\windows\\system32\\kernel32.dl")", rows) == std::vector<uint8_t>({ NO }));
+    CHECK(Evaluate(R"(Path != "c:\\windows")", rows) == std::vector<uint8_t>({ YES }));
+
+    // UTF-8 needles are converted to UTF-16, surrogate pairs included; only ASCII letters ignore case.
+    rows[0].m_values[4] = UnalignedUtf16(u"Caf\u00E9 \U0001F600 \u00C9t\u00E9", storage);
+    CHECK(Evaluate("Path contains \"caf\xC3\xA9 \xF0\x9F\x98\x80\"", rows) == std::vector<uint8_t>({ YES }));
+    CHECK(Evaluate("Path contains \"\xF0\x9F\x98\x80 \xC3\x89T\xC3\xA9\"", rows) == std::vector<uint8_t>({ YES }));
+    CHECK(Evaluate("Path contains \"\xC3\xA9t\xC3\xA9\"", rows) == std::vector<uint8_t>({ NO }));
+    CHECK(Evaluate("Path contains \"\xF0\x9F\x98\x81\"", rows) == std::vector<uint8_t>({ NO }));
+}
+
+TEST(EtlFilterComposesTimeRestrictions)
+{
+    std::vector<Row> rows;
+    for (int64_t timestamp : { 0, 99, 100, 149, 150, 199, 200, 300 }) {
+        rows.push_back(With(0, Unsigned(1)));
+        rows.back().m_header = Header(timestamp == 150 ? 2 : 1, 0, timestamp);
+    }
+
+    // A default constructed filter only tests the range.
+    EtlFilter range;
+    CHECK(range.GetTimeBegin() == INT64_MIN && range.GetTimeEnd() == INT64_MAX);
+    range.RestrictTime(100, 200);
+    CHECK(Evaluate(range, rows, false) == std::vector<uint8_t>({ NO, NO, YES, YES, YES, YES, NO, NO }));
+
+    // Restrictions intersect, whichever way round they come.
+    EtlFilter filter = EtlFilter::Compile("pid == 1", PROPERTIES);
+    filter.RestrictTime(100, 200);
+    filter.RestrictTime(150, 300);
+    CHECK(filter.GetTimeBegin() == 150 && filter.GetTimeEnd() == 200);
+    CHECK(Evaluate(filter, rows, false) == std::vector<uint8_t>({ NO, NO, NO, NO, NO, YES, NO, NO }));
+    filter.RestrictTime(INT64_MIN, INT64_MAX);
+    CHECK(filter.GetTimeBegin() == 150 && filter.GetTimeEnd() == 200);
+    CHECK(Evaluate(filter, rows, false) == std::vector<uint8_t>({ NO, NO, NO, NO, NO, YES, NO, NO }));
+
+    // Property tests stay MAYBE inside the range only.
+    EtlFilter properties = EtlFilter::Compile("Size == 1 || pid == 2", PROPERTIES);
+    properties.RestrictTime(99, 150);
+    CHECK(Evaluate(properties, rows, false) == std::vector<uint8_t>({ NO, MAYBE, MAYBE, MAYBE, NO, NO, NO, NO }));
+    CHECK(Evaluate(properties, rows, true) == std::vector<uint8_t>({ NO, YES, YES, YES, NO, NO, NO, NO }));
+
+    // Disjoint ranges match nothing, and ranges starting before zero cover the timestamps from zero.
+    filter.RestrictTime(250, 400);
+    CHECK(filter.GetTimeBegin() >= filter.GetTimeEnd());
+    CHECK(Evaluate(filter, rows, false) == std::vector<uint8_t>({ NO, NO, NO, NO, NO, NO, NO, NO }));
+    EtlFilter early;
+    early.RestrictTime(-1000, 100);
+    CHECK(Evaluate(early, rows, false) == std::vector<uint8_t>({ YES, YES, NO, NO, NO, NO, NO, NO }));
+}
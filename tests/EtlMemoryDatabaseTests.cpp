@@ -0,0 +1,247 @@
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <ETL/EtlColumnTable.h>
+#include <ETL/EtlMemoryDatabase.h>
+#include <utils/QueryScheduler.h>
+#include "Test.h"
+
+namespace {
+
+constexpr EtlGuid TEST_PROVIDER = { 0x5ca1ab1e, 0x1, 0x2, { 3, 4, 5, 6, 7, 8, 9, 10 } };
+constexpr size_t ROW_COUNT = 2000;
+
+EtlValue Value(EtlValueKind kind)
+{
+    EtlValue value{};
+    value.m_kind = kind;
+    value.m_size = 8;
+    return value;
+}
+
+/*
+Rows at timestamps 0, 10, 20... plus timestampOffset, with a column of every type: Delta cycles
+through small signed values, Flags holds unsigned values past INT64_MAX on every tenth row and is
+missing on every seventh, Ratio counts in quarters and Name cycles through 20 texts.
+*/
+std::shared_ptr<const EtlColumnTable> MakeTable(int64_t timestampOffset)
+{
+    auto pTable = std::make_shared<EtlColumnTable>(std::vector<std::string>{ "Delta", "Flags", "Ratio", "Name" },
+        std::vector<EtlColumnType>{ EtlColumnType::Int64, EtlColumnType::UInt64, EtlColumnType::Double, EtlColumnType::String });
+    std::vector<char> scratch;
+    for (size_t row = 0; row < ROW_COUNT; row++) {
+        std::string name = "name" + std::to_string(row % 20);
+        std::vector<EtlValue> values(4);
+        values[0] = Value(EtlValueKind::Int);
+        values[0].m_int = static_cast<int64_t>(row % 50) - 25;
+        values[1] = Value(row % 7 == 0 ? EtlValueKind::Missing : EtlValueKind::UInt);
+        values[1].m_uint = row % 10 == 0 ? ~0ull - row : row % 13;
+        values[2] = Value(EtlValueKind::Double);
+        values[2].m_double = static_cast<double>(row % 200) / 4.0;
+        values[3] = Value(EtlValueKind::AnsiString);
+        values[3].m_inType = ETL_INTYPE_ANSISTRING;
+        values[3].m_pData = reinterpret_cast<const uint8_t*>(name.data());
+        values[3].m_size = static_cast<uint32_t>(name.size());
+        pTable->AppendRow(static_cast<int64_t>(row) * 10 + timestampOffset, values, scratch);
+    }
+    return pTable;
+}
+
+// Two types: events_1, and events_2 whose timestamps lie halfway between those of events_1.
+class TestDatabase
+{
+public:
+    TestDatabase() : m_token(m_generation, 0, m_stopping, nullptr), m_database([this](const EventIdentifier& id, const QueryCancelToken&) {
+        m_loads++;
+        return MakeTable(id.m_id == 1 ? 0 : 5);
+    })
+    {
+        for (uint16_t id = 1; id <= 2; id++) {
+            auto pType = std::make_shared<EtlDatabaseEventType>();
+            pType->m_id = EventIdentifier(TEST_PROVIDER, id, 0);
+            pType->m_properties = { { "Delta", "Int64" }, { "Flags", "UInt64" }, { "Ratio", "Double" }, { "Name", "AnsiString" } };
+            m_database.AddEventType(id, pType, ROW_COUNT);
+        }
+    }
+
+    EtlSqlResult Run(const std::string& sql)
+    {
+        EtlSqlResult result = m_database.Execute(sql, m_token, SIZE_MAX);
+        if (!result.m_error.empty())
+            throw TestFailure(sql + ": " + result.m_error);
+        return result;
+    }
+
+    // Runs a count(*) query and returns the count and the rows the scans selected.
+    std::pair<int64_t, uint64_t> Count(const std::string& sql)
+    {
+        EtlSqlResult result = Run(sql);
+        CHECK(result.m_rowCount == 1);
+        return { std::stoll(result.m_cells[0]), result.m_rowsScanned };
+    }
+
+    int GetLoads() const { return m_loads; }
+
+private:
+    std::atomic<uint64_t> m_generation = 0;
+    std::atomic<bool> m_stopping = false;
+    QueryCancelToken m_token;
+    int m_loads = 0;
+    EtlMemoryDatabase m_database;
+};
+
+/*
+Counts the rows of events_1 matching condition twice: as written, so its constraints are pushed
+down, and with every column reference prefixed by a unary +, which keeps SQLite from passing them
+to xBestIndex and forces a full scan. The counts must agree. Returns the rows the pushed down
+query scanned.
+*/
+uint64_t CheckPushdown(TestDatabase& database, const std::string& condition, const std::string& forcedCondition, int64_t expectedCount)
+{
+    auto [count, scanned] = database.Count("SELECT count(*) FROM events_1 WHERE " + condition);
+    auto [forcedCount, forcedScanned] = database.Count("SELECT count(*) FROM events_1 WHERE " + forcedCondition);
+    if (count != expectedCount || forcedCount != expectedCount)
+        throw TestFailure(condition + ": " + std::to_string(count) + " and " + std::to_string(forcedCount) + " rows, expected " + std::to_string(expectedCount));
+    CHECK(forcedScanned == ROW_COUNT);
+    CHECK(scanned >= static_cast<uint64_t>(count));
+    return scanned;
+}
+
+bool PlanUsesTempBTree(TestDatabase& database, const std::string& sql)
+{
+    EtlSqlResult plan = database.Run("EXPLAIN QUERY PLAN " + sql);
+    for (const std::string& cell : plan.m_cells) {
+        if (cell.find("TEMP B-TREE") != std::string::npos)
+            return true;
+    }
+    return false;
+}
+
+}
+
+TEST(MemoryDatabasePushesDownTimestampBounds)
+{
+    TestDatabase database;
+    // Strict bounds are scanned inclusively and left to SQLite.
+    CHECK(CheckPushdown(database, "timestamp >= 1000 AND timestamp < 2000", "+timestamp >= 1000 AND +timestamp < 2000", 100) == 101);
+    CHECK(CheckPushdown(database, "timestamp BETWEEN 995 AND 1005", "+timestamp BETWEEN 995 AND 1005", 1) == 1);
+    CHECK(CheckPushdown(database, "timestamp = 420", "+timestamp = 420", 1) == 1);
+    CHECK(CheckPushdown(database, "timestamp = 425", "+timestamp = 425", 0) == 0);
+    CHECK(CheckPushdown(database, "timestamp > 19950", "+timestamp > 19950", 4) == 5);
+    CHECK(CheckPushdown(database, "timestamp < 0", "+timestamp < 0", 0) == 1);
+
+    // Fractional bounds round outwards, so the scan keeps every match.
+    CHECK(CheckPushdown(database, "timestamp > 99.5 AND timestamp <= 200.5", "+timestamp > 99.5 AND +timestamp <= 200.5", 11) == 11);
+    // Bounds outside the int64 range, and NULL, which matches nothing.
+    CHECK(CheckPushdown(database, "timestamp < 1e300", "+timestamp < 1e300", ROW_COUNT) == ROW_COUNT);
+    CHECK(CheckPushdown(database, "timestamp > -1e300 AND timestamp < 30", "+timestamp > -1e300 AND +timestamp < 30", 3) == 4);
+    CHECK(CheckPushdown(database, "timestamp = NULL", "+timestamp = NULL", 0) == 0);
+    // The timestamp is preferred over a property constraint.
+    CHECK(CheckPushdown(database, "Delta = 0 AND timestamp <= 5000", "+Delta = 0 AND +timestamp <= 5000", 10) == 501);
+    CHECK(database.GetLoads() == 1); // The table is decoded once and cached.
+}
+
+TEST(MemoryDatabasePushesDownIntegerConstraints)
+{
+    TestDatabase database;
+    // Delta is row % 50 - 25: 40 rows per value.
+    CHECK(CheckPushdown(database, "Delta = 7", "+Delta = 7", 40) == 40);
+    CHECK(CheckPushdown(database, "Delta = -25", "+Delta = -25", 40) == 40);
+    CHECK(CheckPushdown(database, "Delta = 1000", "+Delta = 1000", 0) == 0);
+    CHECK(CheckPushdown(database, "Delta > 20", "+Delta > 20", 160) == 160 + 40);
+    CHECK(CheckPushdown(database, "Delta >= -25 AND Delta <= -24", "+Delta >= -25 AND +Delta <= -24", 80) == 80);
+    CHECK(CheckPushdown(database, "Delta > 2.5 AND Delta < 4.5", "+Delta > 2.5 AND +Delta < 4.5", 80) == 160);
+    CHECK(CheckPushdown(database, "Delta = 7.0", "+Delta = 7.0", 40) == 40);
+    CHECK(CheckPushdown(database, "Delta = 'x'", "+Delta = 'x'", 0) == ROW_COUNT); // Text bounds fall back to a full scan.
+
+    // Unsigned values are compared by their int64 bit pattern, as SQLite sees them; missing values never match.
+    int64_t large = 0;
+    int64_t zero = 0;
+    int64_t small = 0;
+    for (size_t row = 0; row < ROW_COUNT; row++) {
+        if (row % 7 == 0)
+            continue;
+        if (row % 10 == 0)
+            large++;
+        else if (row % 13 == 0)
+            zero++;
+        else if (row % 13 == 5)
+            small++;
+    }
+    CHECK(CheckPushdown(database, "Flags < 0", "+Flags < 0", large) == static_cast<uint64_t>(large + zero));
+    CHECK(CheckPushdown(database, "Flags = 5", "+Flags = 5", small) == static_cast<uint64_t>(small));
+    CHECK(CheckPushdown(database, "Flags = -1", "+Flags = -1", 0) == 0);
+    CHECK(CheckPushdown(database, "Flags IS NULL", "+Flags IS NULL", (ROW_COUNT + 6) / 7) == ROW_COUNT);
+}
+
+TEST(MemoryDatabasePushesDownDoubleConstraints)
+{
+    TestDatabase database;
+    // Ratio is row % 200 / 4: 10 rows per value.
+    CHECK(CheckPushdown(database, "Ratio = 12.25", "+Ratio = 12.25", 10) == 10);
+    CHECK(CheckPushdown(database, "Ratio = 12", "+Ratio = 12", 10) == 10);
+    CHECK(CheckPushdown(database, "Ratio = 12.1", "+Ratio = 12.1", 0) == 0);
+    CHECK(CheckPushdown(database, "Ratio >= 49 AND Ratio < 49.5", "+Ratio >= 49 AND +Ratio < 49.5", 20) <= 30);
+    CHECK(CheckPushdown(database, "Ratio < 0.25", "+Ratio < 0.25", 10) <= 20);
+    CHECK(CheckPushdown(database, "Ratio > -0.0 AND Ratio <= 0", "+Ratio > -0.0 AND +Ratio <= 0", 0) <= 10);
+    CHECK(CheckPushdown(database, "Ratio = 'x'", "+Ratio = 'x'", 0) == ROW_COUNT);
+}
+
+TEST(MemoryDatabasePushesDownTextEquality)
+{
+    TestDatabase database;
+    CHECK(CheckPushdown(database, "Name = 'name7'", "+Name = 'name7'", 100) == 100);
+    CHECK(CheckPushdown(database, "Name = 'missing'", "+Name = 'missing'", 0) == 0);
+    // One of two equalities is pushed down.
+    uint64_t scanned = CheckPushdown(database, "Name = 'name7' AND Delta = -18", "+Name = 'name7' AND +Delta = -18", 20);
+    CHECK(scanned == 40 || scanned == 100);
+    // Only equality with text uses the dictionary index.
+    CHECK(CheckPushdown(database, "Name > 'name7'", "+Name > 'name7'", 200) == ROW_COUNT);
+    CHECK(CheckPushdown(database, "Name = 7", "+Name = 7", 0) == ROW_COUNT);
+}
+
+TEST(MemoryDatabasePushesJoinConstraintsIntoTheInnerScan)
+{
+    TestDatabase database;
+    // events_2 is offset by half a step, so a timestamp join matches nothing; shifting it back matches every row.
+    auto [count, scanned] = database.Count("SELECT count(*) FROM events_1 a JOIN events_2 b ON b.timestamp = a.timestamp + 5");
+    auto [forcedCount, forcedScanned] = database.Count("SELECT count(*) FROM events_1 a JOIN events_2 b ON +b.timestamp = a.timestamp + 5");
+    CHECK(count == static_cast<int64_t>(ROW_COUNT) && forcedCount == count);
+    CHECK(scanned == 2 * ROW_COUNT);           // One full scan of the outer table and one row per probe.
+    CHECK(forcedScanned > ROW_COUNT * 100);    // Nested full scans, or a full scan feeding an automatic index.
+
+    // A join on a property probes the column index of the inner table.
+    auto [nameCount, nameScanned] = database.Count(
+        "SELECT count(*) FROM events_1 a JOIN events_2 b ON b.Name = a.Name WHERE a.timestamp < 200");
+    CHECK(nameCount == 20 * 100);
+    CHECK(nameScanned == 21 + 20 * 100);
+
+    auto [rangeCount, rangeScanned] = database.Count(
+        "SELECT count(*) FROM events_1 a JOIN events_2 b ON b.timestamp BETWEEN a.timestamp AND a.timestamp + 30 WHERE a.Delta = 0");
+    CHECK(rangeCount == 40 * 3);
+    CHECK(rangeScanned == 40 + 40 * 3);
+}
+
+TEST(MemoryDatabaseConsumesOrderByTimestamp)
+{
+    TestDatabase database;
+    // Every plan visits rows in timestamp order, so no sort is needed, whatever column is pushed down.
+    CHECK(!PlanUsesTempBTree(database, "SELECT * FROM events_1 ORDER BY timestamp"));
+    CHECK(!PlanUsesTempBTree(database, "SELECT * FROM events_1 WHERE timestamp > 100 ORDER BY timestamp"));
+    CHECK(!PlanUsesTempBTree(database, "SELECT * FROM events_1 WHERE Delta = 3 ORDER BY timestamp"));
+    CHECK(!PlanUsesTempBTree(database, "SELECT * FROM events_1 WHERE Name = 'name3' ORDER BY rowid"));
+    // Other orders are sorted by SQLite.
+    CHECK(PlanUsesTempBTree(database, "SELECT * FROM events_1 ORDER BY timestamp DESC"));
+    CHECK(PlanUsesTempBTree(database, "SELECT * FROM events_1 ORDER BY Delta"));
+    CHECK(PlanUsesTempBTree(database, "SELECT * FROM events_1 ORDER BY timestamp, Delta"));
+
+    // The rows of an index scan come back in timestamp order even though the index is sorted by value.
+    EtlSqlResult result = database.Run("SELECT timestamp FROM events_1 WHERE Flags >= 0 AND Flags <= 12 ORDER BY timestamp");
+    CHECK(result.m_rowCount > 100);
+    for (size_t row = 1; row < result.m_rowCount; row++)
+        CHECK(std::stoll(result.m_cells[row - 1]) < std::stoll(result.m_cells[row]));
+    result = database.Run("SELECT Delta FROM events_1 WHERE timestamp >= 100 ORDER BY timestamp LIMIT 3");
+    CHECK(result.m_cells == std::vector<std::string>({ "-15", "-14", "-13" }));
+}
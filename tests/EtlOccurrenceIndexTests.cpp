@@ -0,0 +1,249 @@
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <vector>
+#include <ETL/EtlFile.h>
+#include <ETL/EtlOccurrenceIndex.h>
+#include <ETL/EtlParallelReader.h>
+#include <utils/ThreadPool.h>
+#include "SyntheticEtl.h"
+#include "Test.h"
+
+namespace {
+
+bool SameLocation(const EtlEventLocation& a, const EtlEventLocation& b)
+{
+    return a.m_timestamp == b.m_timestamp && a.m_bufferIndex == b.m_bufferIndex && a.m_bufferOffset == b.m_bufferOffset;
+}
+
+bool SameLocations(const std::vector<EtlEventLocation>& a, const std::vector<EtlEventLocation>& b)
+{
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), SameLocation);
+}
+
+/*
+Locations that exercise every varint width: timestamps jump back and forth (negative deltas) and
+go below zero, buffer indices go down as well as up, and offsets span the whole 32 bit range.
+*/
+std::vector<EtlEventLocation> RandomLocations(size_t count, uint32_t seed)
+{
+    std::mt19937_64 random(seed);
+    std::vector<EtlEventLocation> locations(count);
+    int64_t timestamp = -1000000;
+    for (EtlEventLocation& location : locations) {
+        switch (random() % 4) {
+        case 0: timestamp += static_cast<int64_t>(random() % 16); break;
+        case 1: timestamp -= static_cast<int64_t>(random() % 100000); break;
+        case 2: timestamp += static_cast<int64_t>(random() % (int64_t(1) << 40)); break;
+        default: timestamp = -timestamp; break;
+        }
+        location.m_timestamp = timestamp;
+        location.m_bufferIndex = static_cast<uint32_t>(random() % 3 == 0 ? random() : random() % 64);
+        location.m_bufferOffset = static_cast<uint32_t>(random()) & ~7u;
+    }
+    return locations;
+}
+
+EtlPostingList MakeList(const std::vector<EtlEventLocation>& locations)
+{
+    EtlPostingList list;
+    for (const EtlEventLocation& location : locations)
+        list.Append(location);
+    return list;
+}
+
+// Entries from start on, until func has seen limit of them.
+std::vector<EtlEventLocation> ReadFrom(const EtlPostingList& list, size_t start, size_t limit, size_t* pNext)
+{
+    std::vector<EtlEventLocation> read;
+    *pNext = list.ForEachFrom(start, [&](const EtlEventLocation& location) {
+        if (read.size() == limit)
+            return false;
+        read.push_back(location);
+        return true;
+    });
+    return read;
+}
+
+}
+
+TEST(PostingListRoundTripsNegativeDeltas)
+{
+    for (size_t count : { size_t(0), size_t(1), size_t(127), size_t(128), size_t(129), size_t(1000) }) {
+        std::vector<EtlEventLocation> locations = RandomLocations(count, static_cast<uint32_t>(count));
+        EtlPostingList list = MakeList(locations);
+        CHECK(list.Size() == count);
+        CHECK(list.Empty() == (count == 0));
+        CHECK(SameLocations(list.Decode(), locations));
+        CHECK(list.GetSkipPoints().size() == (count + EtlPostingList::SKIP_INTERVAL - 1) / EtlPostingList::SKIP_INTERVAL);
+        if (count != 0)
+            CHECK(SameLocation(list.GetLast(), locations.back()));
+    }
+
+    // Extremes of every field.
+    std::vector<EtlEventLocation> extremes = {
+        { INT64_MAX / 2, UINT32_MAX, 0xFFFFFFF8u },
+        { INT64_MIN / 2, 0, 0 },
+        { 0, UINT32_MAX, 8 },
+        { -1, 0, 0xFFFFFFF8u },
+    };
+    CHECK(SameLocations(MakeList(extremes).Decode(), extremes));
+}
+
+TEST(PostingListStartsAtEveryOrdinalAroundSkipPoints)
+{
+    constexpr size_t INTERVAL = EtlPostingList::SKIP_INTERVAL;
+    std::vector<EtlEventLocation> locations = RandomLocations(5 * INTERVAL + 17, 7);
+    EtlPostingList list = MakeList(locations);
+    std::vector<size_t> starts = { 0, 1, list.Size() - 1, list.Size(), list.Size() + 5 };
+    for (size_t k = 1; k <= 5; k++) {
+        for (size_t start : { k * INTERVAL - 1, k * INTERVAL, k * INTERVAL + 1 })
+            starts.push_back(start);
+    }
+
+    for (size_t start : starts) {
+        size_t next = 0;
+        std::vector<EtlEventLocation> read = ReadFrom(list, start, SIZE_MAX, &next);
+        std::vector<EtlEventLocation> expected(locations.begin() + static_cast<ptrdiff_t>((std::min)(start, locations.size())), locations.end());
+        CHECK(SameLocations(read, expected));
+        CHECK(next == list.Size());
+
+        // Stopping early returns the ordinal of the entry that was turned down, which is where the next page starts.
+        read = ReadFrom(list, start, 3, &next);
+        size_t taken = (std::min)(size_t(3), expected.size());
+        CHECK(SameLocations(read, std::vector<EtlEventLocation>(expected.begin(), expected.begin() + static_cast<ptrdiff_t>(taken))));
+        CHECK(next == (std::min)(start + 3, list.Size()) || (start >= list.Size() && next == list.Size()));
+    }
+
+    // Paging through the list with the returned cursors visits every entry once.
+    std::vector<EtlEventLocation> paged;
+    for (size_t cursor = 0; cursor < list.Size();) {
+        size_t next = 0;
+        std::vector<EtlEventLocation> page = ReadFrom(list, cursor, 50, &next);
+        CHECK(next > cursor);
+        paged.insert(paged.end(), page.begin(), page.end());
+        cursor = next;
+    }
+    CHECK(SameLocations(paged, locations));
+}
+
+TEST(PostingListViewReadsTheSameEntries)
+{
+    std::vector<EtlEventLocation> locations = RandomLocations(3 * EtlPostingList::SKIP_INTERVAL + 5, 3);
+    EtlPostingList list = MakeList(locations);
+    std::vector<uint8_t> bytes(list.GetBytes().begin(), list.GetBytes().end());
+    std::vector<EtlPostingList::SkipPoint> skipPoints(list.GetSkipPoints().begin(), list.GetSkipPoints().end());
+    EtlPostingList view(bytes, skipPoints, list.Size(), list.GetLast());
+    CHECK(view.Size() == list.Size());
+    CHECK(view.ByteSize() == list.ByteSize());
+    CHECK(SameLocations(view.Decode(), locations));
+    size_t next = 0;
+    CHECK(SameLocations(ReadFrom(view, 200, SIZE_MAX, &next), std::vector<EtlEventLocation>(locations.begin() + 200, locations.end())));
+}
+
+TEST(PostingListViewStopsAtTheEndOfTruncatedBytes)
+{
+    std::vector<EtlEventLocation> locations = RandomLocations(2 * EtlPostingList::SKIP_INTERVAL + 9, 5);
+    EtlPostingList list = MakeList(locations);
+    std::vector<EtlPostingList::SkipPoint> skipPoints(list.GetSkipPoints().begin(), list.GetSkipPoints().end());
+
+    // Views over every prefix of the bytes, each copied to its own allocation so reading past it is caught by sanitizers.
+    for (size_t size = 0; size < list.ByteSize(); size += 13) {
+        std::vector<uint8_t> bytes(list.GetBytes().begin(), list.GetBytes().begin() + size);
+        EtlPostingList view(bytes, skipPoints, list.Size(), list.GetLast());
+        std::vector<EtlEventLocation> decoded = view.Decode();
+        CHECK(decoded.size() < locations.size());
+        CHECK(SameLocations(decoded, std::vector<EtlEventLocation>(locations.begin(), locations.begin() + decoded.size())));
+        size_t next = 0;
+        ReadFrom(view, locations.size() - 1, SIZE_MAX, &next);
+        CHECK(next == view.Size());
+    }
+
+    // Skip points past the bytes, or missing altogether, end the scan.
+    std::vector<uint8_t> bytes(list.GetBytes().begin(), list.GetBytes().end());
+    std::vector<EtlPostingList::SkipPoint> broken = skipPoints;
+    broken[1].m_byteOffset = bytes.size() + 100;
+    size_t next = 0;
+    CHECK(ReadFrom(EtlPostingList(bytes, broken, list.Size(), list.GetLast()), EtlPostingList::SKIP_INTERVAL, SIZE_MAX, &next).empty());
+    broken.resize(1);
+    CHECK(ReadFrom(EtlPostingList(bytes, broken, list.Size(), list.GetLast()), EtlPostingList::SKIP_INTERVAL, SIZE_MAX, &next).empty());
+    CHECK(SameLocations(EtlPostingList(bytes, broken, list.Size(), list.GetLast()).Decode(), locations));
+}
+
+TEST(PostingListSeeksToTimestampsThroughSkipPoints)
+{
+    constexpr size_t INTERVAL = EtlPostingList::SKIP_INTERVAL;
+    // Timestamps in order, with runs of equal ones across skip points.
+    std::vector<EtlEventLocation> locations(6 * INTERVAL + 30);
+    for (size_t i = 0; i < locations.size(); i++)
+        locations[i] = { static_cast<int64_t>(i / 3) * 10 - 500, static_cast<uint32_t>(i), 8 };
+    EtlPostingList list = MakeList(locations);
+
+    std::vector<int64_t> timestamps = { INT64_MIN, -501, INT64_MAX, locations.back().m_timestamp + 1 };
+    for (const EtlEventLocation& location : locations) {
+        timestamps.push_back(location.m_timestamp);
+        timestamps.push_back(location.m_timestamp + 5);
+    }
+    for (int64_t timestamp : timestamps) {
+        size_t first = static_cast<size_t>(std::partition_point(locations.begin(), locations.end(), [timestamp](const EtlEventLocation& location) {
+            return location.m_timestamp < timestamp;
+        }) - locations.begin());
+        size_t start = list.SeekTimestamp(timestamp);
+        CHECK(start % INTERVAL == 0);
+        CHECK(start <= first);
+        CHECK(first - start < INTERVAL || first == locations.size());
+    }
+    CHECK(list.SeekTimestamp(INT64_MIN) == 0);
+    CHECK(EtlPostingList().SeekTimestamp(0) == 0);
+    CHECK(MakeList(std::vector<EtlEventLocation>(locations.begin(), locations.begin() + INTERVAL)).SeekTimestamp(INT64_MAX) == 0);
+}
+
+TEST(OccurrenceIndexMergesPartialsIntoTimestampOrder)
+{
+    SyntheticEtl etl(1024);
+    etl.BeginBuffer(0, 0);
+    TempFile temp("occurrences.etl");
+    etl.Write(temp.GetPath());
+    EtlFile file(temp.GetPath());
+    ThreadPool pool(3);
+    EtlParallelReader reader(file, 0, pool);
+
+    // Every worker sees its buffers in file order, but the workers interleave in time.
+    const EventIdentifier a({ 1, 2, 3, { 4 } }, 10, 0);
+    const EventIdentifier b({ 1, 2, 3, { 4 } }, 11, 0);
+    const EventIdentifier c({ 9, 9, 9, { 9 } }, 10, 1);
+    std::vector<EtlOccurrenceIndex::Partial> partials(4);
+    std::vector<EtlEventLocation> expectedA;
+    std::vector<EtlEventLocation> expectedB;
+    std::mt19937 random(11);
+    for (uint32_t buffer = 0; buffer < 40; buffer++) {
+        EtlOccurrenceIndex::Partial& partial = partials[random() % partials.size()];
+        for (uint32_t i = 0; i < 20; i++) {
+            // Equal timestamps across buffers are ordered by file position.
+            EtlEventLocation location = { static_cast<int64_t>(buffer % 8) * 100 + i / 2 - 50, buffer, 64 + i * 8 };
+            if (i % 3 == 0) {
+                partial.Add(b, location);
+                expectedB.push_back(location);
+            }
+            else {
+                partial.Add(a, location);
+                expectedA.push_back(location);
+            }
+        }
+    }
+    partials[2].Add(c, { 5, 7, 16 });
+    std::sort(expectedA.begin(), expectedA.end(), EtlLocationLess);
+    std::sort(expectedB.begin(), expectedB.end(), EtlLocationLess);
+
+    EtlOccurrenceIndex index;
+    index.Build(partials, reader);
+    CHECK(partials.empty());
+    CHECK(index.GetTypeCount() == 3);
+    CHECK(index.GetEventCount() == 40 * 20 + 1);
+    CHECK(index.Find(EventIdentifier({ 1, 2, 3, { 4 } }, 12, 0)) == nullptr);
+    CHECK(SameLocations(index.Find(a)->Decode(), expectedA));
+    CHECK(SameLocations(index.Find(b)->Decode(), expectedB));
+    CHECK(index.Find(c)->Size() == 1);
+    CHECK(SameLocation(index.Find(c)->GetLast(), { 5, 7, 16 }));
+    CHECK(index.GetByteSize() == index.Find(a)->ByteSize() + index.Find(b)->ByteSize() + index.Find(c)->ByteSize());
+}
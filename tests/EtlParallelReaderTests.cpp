@@ -0,0 +1,148 @@
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+#include <ETL/EtlFile.h>
+#include <ETL/EtlParallelReader.h>
+#include <utils/ThreadPool.h>
+#include "SyntheticEtl.h"
+#include "Test.h"
+
+namespace {
+
+constexpr EtlGuid TEST_PROVIDER = { 0x0badf00d, 0x1, 0x2, { 3, 4, 5, 6, 7, 8, 9, 10 } };
+constexpr unsigned PROCESSOR_COUNT = 4;
+
+EtlRawEventHeader MakeHeader(uint16_t id, int64_t timestamp)
+{
+    EtlRawEventHeader header = {};
+    header.HeaderType = ETL_HEADER_TYPE_EVENT_HEADER64;
+    header.ProviderId = TEST_PROVIDER;
+    header.Id = id;
+    header.TimeStamp = timestamp;
+    return header;
+}
+
+/*
+Writes 32 small buffers round robin over PROCESSOR_COUNT processors. Timestamps are coarse, so
+many events share one across buffers and processors, and some repeat inside a buffer. The last
+buffer of every processor is written out of order, as clock skew leaves it. The event id is the
+event's position in the file, which tells the merged order apart from any other.
+*/
+void WriteTiedTrace(const std::filesystem::path& path)
+{
+    SyntheticEtl etl(1024);
+    uint16_t id = 0;
+    for (int buffer = 0; buffer < 32; buffer++) {
+        etl.BeginBuffer(static_cast<uint8_t>(buffer % PROCESSOR_COUNT), buffer / 8 * 10);
+        for (int i = 0; i < 8; i++) {
+            int64_t timestamp = buffer / 8 * 10 + i / 3;
+            if (buffer >= 28)
+                timestamp = 50 - i / 2;
+            CHECK(etl.Add(SyntheticEtl::EventRecord(MakeHeader(id++, timestamp), { uint8_t(i) })));
+        }
+    }
+    etl.Write(path);
+}
+
+std::vector<uint16_t> CollectIds(const EtlFile& file, const std::vector<EtlEventLocation>& locations)
+{
+    std::vector<uint16_t> ids;
+    for (const EtlEventLocation& location : locations) {
+        EtlEventView view;
+        CHECK(file.ReadEventAt(location.m_bufferIndex, location.m_bufferOffset, &view));
+        CHECK(view.m_timestamp == location.m_timestamp);
+        ids.push_back(view.m_id);
+    }
+    return ids;
+}
+
+}
+
+TEST(EtlMergeRunsBreaksTiesByFilePosition)
+{
+    std::vector<std::vector<EtlEventLocation>> runs = {
+        { { 5, 2, 16 }, { 5, 2, 32 }, { 7, 2, 48 } },
+        { { 1, 0, 16 }, { 5, 0, 32 } },
+        {},
+        { { 5, 1, 16 }, { 9, 1, 32 } },
+    };
+    std::vector<EtlEventLocation> merged;
+    EtlMergeRuns(runs, [&merged](const EtlEventLocation& location) {
+        merged.push_back(location);
+        return true;
+    });
+    CHECK(merged.size() == 7);
+    CHECK(std::is_sorted(merged.begin(), merged.end(), EtlLocationLess));
+    CHECK(merged[1].m_bufferIndex == 0 && merged[2].m_bufferIndex == 1 && merged[3].m_bufferIndex == 2 && merged[4].m_bufferIndex == 2);
+    CHECK(merged[3].m_bufferOffset == 16 && merged[4].m_bufferOffset == 32);
+
+    size_t calls = 0;
+    EtlMergeRuns(runs, [&calls](const EtlEventLocation&) { return ++calls < 3; });
+    CHECK(calls == 3);
+}
+
+TEST(CollectOrderedIsTheSameForEveryThreadCount)
+{
+    TempFile temp("tied.etl");
+    WriteTiedTrace(temp.GetPath());
+    EtlFile file(temp.GetPath());
+    CHECK(file.GetBufferCount() == 32);
+
+    // The reference order: every event sorted by timestamp, then file position.
+    std::vector<EtlEventLocation> expected;
+    file.ForEachEvent([&expected](const EtlEventView& view) {
+        expected.push_back({ view.m_timestamp, view.m_bufferIndex, view.m_bufferOffset });
+        return true;
+    });
+    std::sort(expected.begin(), expected.end(), EtlLocationLess);
+    std::vector<uint16_t> expectedIds = CollectIds(file, expected);
+
+    ThreadPool pool(4);
+    for (unsigned threadCount : { 1u, 2u, pool.SlotCount() }) {
+        EtlParallelReader reader(file, threadCount, pool);
+        CHECK(reader.GetThreadCount() == threadCount);
+        for (int round = 0; round < 10; round++) {
+            std::vector<EtlEventLocation> locations = reader.CollectOrdered([](const EtlEventView&) { return true; });
+            CHECK(CollectIds(file, locations) == expectedIds);
+        }
+
+        // A limit returns a prefix of the same order; a predicate keeps the order of what it accepts.
+        std::vector<EtlEventLocation> first = reader.CollectOrdered([](const EtlEventView&) { return true; }, 37);
+        CHECK(CollectIds(file, first) == std::vector<uint16_t>(expectedIds.begin(), expectedIds.begin() + 37));
+        std::vector<EtlEventLocation> odd = reader.CollectOrdered([](const EtlEventView& view) { return view.m_id % 2 == 1; });
+        std::vector<uint16_t> expectedOdd;
+        std::copy_if(expectedIds.begin(), expectedIds.end(), std::back_inserter(expectedOdd), [](uint16_t id) { return id % 2 == 1; });
+        CHECK(CollectIds(file, odd) == expectedOdd);
+
+        // Reading a subset of buffers merges only those.
+        std::vector<EtlEventLocation> subset = reader.CollectOrdered(std::vector<uint32_t>{ 3, 29, 30 }, [](const EtlEventView&) { return true; });
+        CHECK(subset.size() == 24);
+        CHECK(std::is_sorted(subset.begin(), subset.end(), EtlLocationLess));
+    }
+}
+
+TEST(ForEachLocationDecodesContiguousChunks)
+{
+    TempFile temp("chunks.etl");
+    WriteTiedTrace(temp.GetPath());
+    EtlFile file(temp.GetPath());
+    ThreadPool pool(3);
+    EtlParallelReader reader(file, 0, pool);
+    std::vector<EtlEventLocation> locations = reader.CollectOrdered([](const EtlEventView&) { return true; });
+    std::vector<uint16_t> expectedIds = CollectIds(file, locations);
+
+    std::vector<std::vector<uint16_t>> chunks(reader.GetThreadCount());
+    std::vector<size_t> bounds = reader.ForEachLocation(locations, [&](unsigned chunk, size_t index, const EtlEventView& view) {
+        CHECK(view.m_id == expectedIds[index]);
+        chunks[chunk].push_back(view.m_id);
+    });
+    CHECK(bounds.size() == reader.GetThreadCount() + 1);
+    CHECK(bounds.front() == 0 && bounds.back() == locations.size());
+    std::vector<uint16_t> concatenated;
+    for (size_t chunk = 0; chunk + 1 < bounds.size(); chunk++) {
+        CHECK(chunks[chunk].size() == bounds[chunk + 1] - bounds[chunk]);
+        concatenated.insert(concatenated.end(), chunks[chunk].begin(), chunks[chunk].end());
+    }
+    CHECK(concatenated == expectedIds);
+}
@@ -0,0 +1,272 @@
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <span>
+#include <string>
+#include <vector>
+#include <ETL/EtlOccurrenceIndex.h>
+#include <ETL/EtlSidecarIndex.h>
+#include <ETL/EtlTimeIndex.h>
+#include <ETL/EtlTraceSource.h>
+#include "SyntheticEtl.h"
+#include "Test.h"
+
+namespace {
+
+constexpr EtlGuid TEST_PROVIDER = { 0x51decade, 0x1, 0x2, { 3, 4, 5, 6, 7, 8, 9, 10 } };
+
+// Offsets of the header fields and the section table, as Writer lays them out.
+constexpr size_t HEADER_VERSION_OFFSET = 8;
+constexpr size_t HEADER_SECTIONS_OFFSET = 48;
+constexpr size_t SECTION_TYPES = 2;
+constexpr size_t SECTION_PROPERTIES = 3;
+constexpr size_t SECTION_SKIP_POINTS = 4;
+constexpr size_t SECTION_POSTING_BYTES = 5;
+constexpr size_t SECTION_BUFFER_RANGES = 7;
+
+EtlTraceSource MakeSource()
+{
+    EtlTraceSource source;
+    source.m_path = "trace.etl";
+    source.m_size = 123456;
+    source.m_modifiedTime = 42;
+    source.m_headerHash = 0x1234;
+    return source;
+}
+
+EtlPostingList MakeList(size_t count, int64_t step)
+{
+    EtlPostingList list;
+    for (size_t i = 0; i < count; i++)
+        list.Append({ static_cast<int64_t>(i) * step, static_cast<uint32_t>(i / 100), static_cast<uint32_t>(64 + i % 100 * 8) });
+    return list;
+}
+
+struct TestSidecar {
+    EtlPostingList m_large = MakeList(3 * EtlPostingList::SKIP_INTERVAL + 17, 1000);
+    EtlPostingList m_small = MakeList(5, 7);
+    std::vector<EtlBufferInfo> m_buffers;
+    std::vector<EtlTimeIndex::BufferRange> m_bufferRanges;
+
+    // Two types with posting lists, one of them spanning several skip points, and one without metadata.
+    bool Write(const std::filesystem::path& path)
+    {
+        for (uint32_t i = 0; i < 4; i++) {
+            m_buffers.push_back({ 4096ull * i, 4096, 1000 + i, static_cast<int64_t>(i) * 500, static_cast<uint16_t>(i % 2), 1, 0 });
+            m_bufferRanges.push_back(i == 2 ? EtlTimeIndex::EmptyRange(i) : EtlTimeIndex::BufferRange{ i * 500 + 10, i * 500 + 900, i });
+        }
+        EtlSidecarIndex::Writer writer;
+        std::array<std::string_view, ETL_SIDECAR_STRING_COUNT> strings = {};
+        strings[ETL_SIDECAR_PROVIDER_NAME] = "Synthetic-Provider";
+        strings[ETL_SIDECAR_TASK_NAME] = "Read";
+        strings[ETL_SIDECAR_OPCODE_NAME] = "Start";
+        writer.AddType(EventIdentifier(TEST_PROVIDER, 1, 0), TEST_PROVIDER, strings, { { "FileName", "UnicodeString" }, { "Size", "UInt64" } }, true, &m_large);
+        strings[ETL_SIDECAR_OPCODE_NAME] = "Stop";
+        writer.AddType(EventIdentifier(TEST_PROVIDER, 2, 1), TEST_PROVIDER, strings, { { "Status", "UInt32" } }, true, &m_small);
+        writer.AddType(EventIdentifier(TEST_PROVIDER, 3, 0), TEST_PROVIDER, {}, {}, false, nullptr);
+        return writer.Write(path, MakeSource(), m_buffers, m_bufferRanges);
+    }
+};
+
+std::vector<char> ReadBytes(const std::filesystem::path& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    return std::vector<char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+void WriteBytes(const std::filesystem::path& path, const std::vector<char>& bytes)
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+}
+
+template<typename T>
+T Get(const std::vector<char>& bytes, size_t offset)
+{
+    T value;
+    memcpy(&value, bytes.data() + offset, sizeof(value));
+    return value;
+}
+
+template<typename T>
+void Set(std::vector<char>& bytes, size_t offset, const T& value)
+{
+    memcpy(bytes.data() + offset, &value, sizeof(value));
+}
+
+uint64_t SectionOffset(const std::vector<char>& bytes, size_t section)
+{
+    return Get<uint64_t>(bytes, HEADER_SECTIONS_OFFSET + section * 16);
+}
+
+// Whether Open accepts the sidecar once corrupt has changed its bytes.
+bool OpensAfter(const std::filesystem::path& path, const std::vector<char>& original, const std::function<void(std::vector<char>&)>& corrupt)
+{
+    std::vector<char> bytes = original;
+    corrupt(bytes);
+    WriteBytes(path, bytes);
+    return EtlSidecarIndex::Open(path, MakeSource()) != nullptr;
+}
+
+}
+
+TEST(SidecarIndexRoundTrips)
+{
+    TempFile file("sidecar_roundtrip.lensidx");
+    TestSidecar sidecar;
+    CHECK(sidecar.Write(file.GetPath()));
+    CHECK(!std::filesystem::exists(std::filesystem::path(file.GetPath()).concat(".tmp")));
+
+    std::unique_ptr<EtlSidecarIndex> pIndex = EtlSidecarIndex::Open(file.GetPath(), MakeSource());
+    CHECK(pIndex != nullptr);
+    CHECK(pIndex->GetTypeCount() == 3);
+
+    const EtlSidecarType& large = pIndex->GetType(0);
+    CHECK(large.m_id.m_id == 1 && large.m_hasMetadata == 1 && large.m_eventCount == sidecar.m_large.Size());
+    CHECK(pIndex->GetString(large.m_strings[ETL_SIDECAR_PROVIDER_NAME]) == "Synthetic-Provider");
+    CHECK(pIndex->GetString(large.m_strings[ETL_SIDECAR_OPCODE_NAME]) == "Start");
+    CHECK(pIndex->GetString(large.m_strings[ETL_SIDECAR_LEVEL_NAME]).empty());
+    CHECK(pIndex->GetProperties(large).size() == 2);
+    CHECK(pIndex->GetString(pIndex->GetProperties(large)[0].m_name) == "FileName");
+    CHECK(pIndex->GetString(pIndex->GetProperties(large)[1].m_type) == "UInt64");
+
+    const EtlSidecarType& small = pIndex->GetType(1);
+    CHECK(small.m_id.m_id == 2 && small.m_id.m_version == 1);
+    CHECK(pIndex->GetString(small.m_strings[ETL_SIDECAR_OPCODE_NAME]) == "Stop");
+    CHECK(small.m_strings[ETL_SIDECAR_PROVIDER_NAME] == large.m_strings[ETL_SIDECAR_PROVIDER_NAME]); // Strings are stored once.
+
+    const EtlSidecarType& bare = pIndex->GetType(2);
+    CHECK(bare.m_hasMetadata == 0 && bare.m_eventCount == 0 && pIndex->GetProperties(bare).empty());
+    CHECK(pIndex->GetPostingList(bare).Empty());
+
+    // Posting lists are views of the mapping that decode and page like the originals.
+    for (const auto& [pType, pList] : { std::pair(&large, &sidecar.m_large), std::pair(&small, &sidecar.m_small) }) {
+        EtlPostingList view = pIndex->GetPostingList(*pType);
+        std::vector<EtlEventLocation> expected = pList->Decode();
+        std::vector<EtlEventLocation> decoded = view.Decode();
+        CHECK(decoded.size() == expected.size());
+        CHECK(memcmp(decoded.data(), expected.data(), expected.size() * sizeof(EtlEventLocation)) == 0);
+        CHECK(view.GetLast().m_timestamp == pList->GetLast().m_timestamp);
+        size_t start = view.Size() - 2;
+        std::vector<int64_t> tail;
+        view.ForEachFrom(start, [&](const EtlEventLocation& location) {
+            tail.push_back(location.m_timestamp);
+            return true;
+        });
+        CHECK(tail.size() == 2 && tail[0] == expected[start].m_timestamp);
+    }
+
+    std::span<const EtlBufferInfo> buffers = pIndex->GetBuffers();
+    CHECK(buffers.size() == sidecar.m_buffers.size());
+    CHECK(memcmp(buffers.data(), sidecar.m_buffers.data(), buffers.size_bytes()) == 0);
+    std::span<const EtlTimeIndex::BufferRange> ranges = pIndex->GetBufferRanges();
+    CHECK(ranges.size() == sidecar.m_bufferRanges.size());
+    for (size_t i = 0; i < ranges.size(); i++) {
+        CHECK(ranges[i].m_first == sidecar.m_bufferRanges[i].m_first && ranges[i].m_last == sidecar.m_bufferRanges[i].m_last);
+        CHECK(ranges[i].m_bufferIndex == i);
+    }
+    CHECK(EtlTimeIndex::Build(ranges).FindBuffers(1000, 1600) == std::vector<uint32_t>({ 1, 3 }));
+
+    // Ranges must come one per buffer.
+    EtlSidecarIndex::Writer writer;
+    CHECK(!writer.Write(std::filesystem::path(file.GetPath()).concat(".short"), MakeSource(), sidecar.m_buffers,
+        std::span<const EtlTimeIndex::BufferRange>(sidecar.m_bufferRanges).first(3)));
+
+    // A sidecar of another trace, or one that is missing, is not used.
+    EtlTraceSource other = MakeSource();
+    other.m_size++;
+    CHECK(EtlSidecarIndex::Open(file.GetPath(), other) == nullptr);
+    other = MakeSource();
+    other.m_headerHash++;
+    CHECK(EtlSidecarIndex::Open(file.GetPath(), other) == nullptr);
+    CHECK(EtlSidecarIndex::Open(std::filesystem::path(file.GetPath()).concat(".missing"), MakeSource()) == nullptr);
+}
+
+TEST(SidecarIndexRejectsCorruptedFiles)
+{
+    TempFile file("sidecar_corrupted.lensidx");
+    TestSidecar sidecar;
+    CHECK(sidecar.Write(file.GetPath()));
+    const std::vector<char> original = ReadBytes(file.GetPath());
+    CHECK(OpensAfter(file.GetPath(), original, [](std::vector<char>&) {}));
+
+    uint64_t types = SectionOffset(original, SECTION_TYPES);
+    uint64_t properties = SectionOffset(original, SECTION_PROPERTIES);
+    uint64_t skipPoints = SectionOffset(original, SECTION_SKIP_POINTS);
+    uint64_t postingBytes = Get<uint64_t>(original, HEADER_SECTIONS_OFFSET + SECTION_POSTING_BYTES * 16 + 8);
+    size_t skipOffset = offsetof(EtlPostingList::SkipPoint, m_byteOffset);
+
+    CHECK(!OpensAfter(file.GetPath(), original, [](std::vector<char>& bytes) { bytes.clear(); }));
+    CHECK(!OpensAfter(file.GetPath(), original, [](std::vector<char>& bytes) { bytes.erase(bytes.end() - 8, bytes.end()); }));
+    CHECK(!OpensAfter(file.GetPath(), original, [](std::vector<char>& bytes) { bytes.push_back(0); }));
+    CHECK(!OpensAfter(file.GetPath(), original, [](std::vector<char>& bytes) { bytes[0] ^= 1; }));
+    CHECK(!OpensAfter(file.GetPath(), original, [](std::vector<char>& bytes) { Set<uint32_t>(bytes, HEADER_VERSION_OFFSET, EtlSidecarIndex::VERSION + 1); }));
+
+    // Sections that run past the file.
+    CHECK(!OpensAfter(file.GetPath(), original, [&](std::vector<char>& bytes) {
+        Set<uint64_t>(bytes, HEADER_SECTIONS_OFFSET + SECTION_SKIP_POINTS * 16 + 8, uint64_t(1) << 40);
+    }));
+    CHECK(!OpensAfter(file.GetPath(), original, [&](std::vector<char>& bytes) {
+        Set<uint64_t>(bytes, HEADER_SECTIONS_OFFSET + SECTION_POSTING_BYTES * 16, bytes.size() + 8);
+    }));
+
+    // Records that point outside their sections.
+    CHECK(!OpensAfter(file.GetPath(), original, [&](std::vector<char>& bytes) {
+        Set<uint64_t>(bytes, types + offsetof(EtlSidecarType, m_postingOffset), postingBytes);
+    }));
+    CHECK(!OpensAfter(file.GetPath(), original, [&](std::vector<char>& bytes) {
+        Set<uint64_t>(bytes, types + offsetof(EtlSidecarType, m_eventCount), uint64_t(1) << 20);
+    }));
+    CHECK(!OpensAfter(file.GetPath(), original, [&](std::vector<char>& bytes) {
+        Set<uint32_t>(bytes, types + offsetof(EtlSidecarType, m_propertyCount), 100);
+    }));
+    CHECK(!OpensAfter(file.GetPath(), original, [&](std::vector<char>& bytes) { Set<uint32_t>(bytes, properties, 1000); }));
+
+    // Buffer ranges must come one per buffer, in buffer order.
+    uint64_t bufferRanges = SectionOffset(original, SECTION_BUFFER_RANGES);
+    CHECK(!OpensAfter(file.GetPath(), original, [&](std::vector<char>& bytes) {
+        Set<uint64_t>(bytes, HEADER_SECTIONS_OFFSET + SECTION_BUFFER_RANGES * 16 + 8, uint64_t(3));
+    }));
+    CHECK(!OpensAfter(file.GetPath(), original, [&](std::vector<char>& bytes) {
+        Set<uint32_t>(bytes, bufferRanges + sizeof(EtlTimeIndex::BufferRange) + offsetof(EtlTimeIndex::BufferRange, m_bufferIndex), 2);
+    }));
+
+    // Skip points must start inside their list's bytes, in increasing order.
+    CHECK(!OpensAfter(file.GetPath(), original, [&](std::vector<char>& bytes) {
+        Set<uint64_t>(bytes, skipPoints + sizeof(EtlPostingList::SkipPoint) + skipOffset, sidecar.m_large.ByteSize());
+    }));
+    CHECK(!OpensAfter(file.GetPath(), original, [&](std::vector<char>& bytes) {
+        Set<uint64_t>(bytes, skipPoints + 2 * sizeof(EtlPostingList::SkipPoint) + skipOffset, Get<uint64_t>(bytes, skipPoints + sizeof(EtlPostingList::SkipPoint) + skipOffset));
+    }));
+    CHECK(!OpensAfter(file.GetPath(), original, [&](std::vector<char>& bytes) {
+        Set<uint64_t>(bytes, skipPoints + sizeof(EtlPostingList::SkipPoint) + skipOffset, ~0ull);
+    }));
+}
+
+TEST(SidecarPostingListsStopAtCorruptedBytes)
+{
+    // The posting bytes are not checked when opening; decoding them must still stay inside the list.
+    TempFile file("sidecar_corrupted_postings.lensidx");
+    TestSidecar sidecar;
+    CHECK(sidecar.Write(file.GetPath()));
+    std::vector<char> bytes = ReadBytes(file.GetPath());
+    uint64_t postingBytes = SectionOffset(bytes, SECTION_POSTING_BYTES);
+    // Continuation bits everywhere: no varint ever ends.
+    memset(bytes.data() + postingBytes, 0xFF, sidecar.m_large.ByteSize() + sidecar.m_small.ByteSize());
+    WriteBytes(file.GetPath(), bytes);
+
+    std::unique_ptr<EtlSidecarIndex> pIndex = EtlSidecarIndex::Open(file.GetPath(), MakeSource());
+    CHECK(pIndex != nullptr);
+    for (size_t i = 0; i < 2; i++) {
+        EtlPostingList view = pIndex->GetPostingList(pIndex->GetType(i));
+        CHECK(view.Decode().empty());
+        size_t entries = 0;
+        CHECK(view.ForEachFrom(view.Size() - 1, [&](const EtlEventLocation&) { return ++entries != 0; }) == view.Size());
+        CHECK(entries == 0);
+    }
+}
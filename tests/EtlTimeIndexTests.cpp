@@ -0,0 +1,37 @@
+#include <cstdint>
+#include <vector>
+#include <ETL/EtlTimeIndex.h>
+#include "Test.h"
+
+TEST(TimeIndexFindsOverlappingBuffers)
+{
+    // Two processors whose buffers overlap in time, in file order, with an empty buffer between them.
+    std::vector<EtlTimeIndex::BufferRange> ranges = {
+        { 0, 100, 0 },
+        { 50, 300, 1 },
+        EtlTimeIndex::EmptyRange(2),
+        { 101, 200, 3 },
+        { 301, 400, 4 },
+        { 201, 250, 5 },
+    };
+    EtlTimeIndex index = EtlTimeIndex::Build(ranges);
+    CHECK(index.GetBufferCount() == 5);
+    CHECK(index.GetFirst() == 0 && index.GetLast() == 400);
+
+    // Buffers come in order of their first event, and a range takes every buffer it overlaps.
+    CHECK(index.FindBuffers(INT64_MIN, INT64_MAX) == std::vector<uint32_t>({ 0, 1, 3, 5, 4 }));
+    CHECK(index.FindBuffers(0, 1) == std::vector<uint32_t>({ 0 }));
+    CHECK(index.FindBuffers(100, 101) == std::vector<uint32_t>({ 0, 1 }));
+    CHECK(index.FindBuffers(210, 260) == std::vector<uint32_t>({ 1, 5 }));
+    CHECK(index.FindBuffers(300, 302) == std::vector<uint32_t>({ 1, 4 }));
+    CHECK(index.FindBuffers(401, 500).empty());
+    CHECK(index.FindBuffers(-10, 0).empty());
+
+    // Buffers starting at the same time are ordered by index.
+    EtlTimeIndex ties = EtlTimeIndex::Build(std::vector<EtlTimeIndex::BufferRange>({ { 5, 9, 2 }, { 5, 6, 1 } }));
+    CHECK(ties.FindBuffers(0, 10) == std::vector<uint32_t>({ 1, 2 }));
+
+    EtlTimeIndex empty = EtlTimeIndex::Build(std::vector<EtlTimeIndex::BufferRange>({ EtlTimeIndex::EmptyRange(0) }));
+    CHECK(empty.GetBufferCount() == 0 && empty.GetFirst() == 0 && empty.GetLast() == 0);
+    CHECK(empty.FindBuffers(INT64_MIN, INT64_MAX).empty());
+}
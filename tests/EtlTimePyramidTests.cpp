@@ -0,0 +1,175 @@
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <ETL/EtlFile.h>
+#include <ETL/EtlOccurrenceIndex.h>
+#include <ETL/EtlParallelReader.h>
+#include <ETL/EtlTimePyramid.h>
+#include <utils/ThreadPool.h>
+#include "SyntheticEtl.h"
+#include "Test.h"
+
+namespace {
+
+using Bucket = EtlTimePyramid::Bucket;
+
+bool SameBuckets(const std::vector<Bucket>& a, const std::vector<Bucket>& b)
+{
+    if (a.size() != b.size())
+        return false;
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].m_count != b[i].m_count || a[i].m_index != b[i].m_index || a[i].m_min != b[i].m_min || a[i].m_max != b[i].m_max)
+            return false;
+    }
+    return true;
+}
+
+// Level 0 bucket holding count events.
+Bucket LevelZero(uint32_t index, uint32_t count)
+{
+    return { count, index, count, count };
+}
+
+const EventIdentifier FREQUENT({ 1, 2, 3, { 4 } }, 10, 0);
+const EventIdentifier RARE({ 1, 2, 3, { 4 } }, 11, 0);
+
+}
+
+TEST(TimePyramidMergesPairsOfBuckets)
+{
+    // Buckets 0 and 1 pair up, 3 and 5 have no neighbour, 6 and 7 pair up, and 12 is alone at level 3.
+    EtlTimePyramid pyramid({ LevelZero(0, 4), LevelZero(1, 2), LevelZero(3, 5), LevelZero(5, 1), LevelZero(6, 7), LevelZero(7, 3), LevelZero(12, 9) }, 5);
+    CHECK(pyramid.GetLevelCount() == 5);
+    CHECK(SameBuckets(pyramid.GetLevel(1), { { 6, 0, 2, 4 }, { 5, 1, 0, 5 }, { 1, 2, 0, 1 }, { 10, 3, 3, 7 }, { 9, 6, 0, 9 } }));
+    CHECK(SameBuckets(pyramid.GetLevel(2), { { 11, 0, 0, 5 }, { 11, 1, 0, 7 }, { 9, 3, 0, 9 } }));
+    CHECK(SameBuckets(pyramid.GetLevel(3), { { 22, 0, 0, 7 }, { 9, 1, 0, 9 } }));
+    CHECK(SameBuckets(pyramid.GetLevel(4), { { 31, 0, 0, 9 } }));
+
+    // A full level keeps its minimum all the way up.
+    EtlTimePyramid full({ LevelZero(0, 3), LevelZero(1, 8), LevelZero(2, 5), LevelZero(3, 6) }, 3);
+    CHECK(SameBuckets(full.GetLevel(2), { { 22, 0, 3, 8 } }));
+
+    CHECK(EtlTimePyramid({}, 4).GetLevel(3).empty());
+    CHECK(EtlTimePyramid({ LevelZero(0, 1) }, 1).GetLevelCount() == 1);
+}
+
+TEST(TimePyramidSamplesDenseRanges)
+{
+    EtlTimePyramid pyramid({ LevelZero(0, 4), LevelZero(1, 2), LevelZero(3, 5), LevelZero(5, 1), LevelZero(6, 7), LevelZero(7, 3), LevelZero(12, 9) }, 5);
+    std::vector<EtlTimePyramid::Sample> samples;
+
+    // Means are per level 0 bucket; empty buckets are zeros.
+    pyramid.GetSamples(0, 2, 4, samples);
+    CHECK(samples.size() == 4);
+    CHECK(samples[0].m_mean == 0.0 && samples[0].m_max == 0);
+    CHECK(samples[1].m_mean == 5.0 && samples[1].m_min == 5 && samples[1].m_max == 5);
+    CHECK(samples[2].m_mean == 0.0);
+    CHECK(samples[3].m_mean == 1.0);
+
+    pyramid.GetSamples(1, 0, 8, samples);
+    CHECK(samples[0].m_mean == 3.0 && samples[0].m_min == 2 && samples[0].m_max == 4);
+    CHECK(samples[1].m_mean == 2.5 && samples[1].m_min == 0 && samples[1].m_max == 5);
+    CHECK(samples[3].m_mean == 5.0);
+    CHECK(samples[6].m_mean == 4.5);
+    CHECK(samples[4].m_mean == 0.0 && samples[7].m_mean == 0.0);
+
+    pyramid.GetSamples(4, 0, 2, samples);
+    CHECK(samples[0].m_mean == 31.0 / 16 && samples[1].m_mean == 0.0);
+
+    // Ranges past the stored buckets, and levels past the top, are zeros.
+    pyramid.GetSamples(0, 13, 3, samples);
+    CHECK(samples.size() == 3 && samples[0].m_mean == 0.0 && samples[2].m_mean == 0.0);
+    pyramid.GetSamples(5, 0, 2, samples);
+    CHECK(samples.size() == 2 && samples[0].m_mean == 0.0);
+}
+
+TEST(TimeDensityIndexCountsEveryTypeOverTheTraceRange)
+{
+    TempFile temp("density.etl");
+    SyntheticEtl etl(1024);
+    etl.BeginBuffer(0, 0);
+    etl.Write(temp.GetPath());
+    EtlFile file(temp.GetPath());
+    ThreadPool pool(3);
+    EtlParallelReader reader(file, 0, pool);
+
+    // One event every 4 ticks over 2^17 ticks, and a rare type in two bursts.
+    constexpr int64_t BEGIN = -1000;
+    constexpr int64_t SPAN = int64_t(1) << 17;
+    std::vector<EtlOccurrenceIndex::Partial> partials(2);
+    uint32_t offset = 0;
+    for (int64_t tick = 0; tick < SPAN; tick += 4)
+        partials[0].Add(FREQUENT, { BEGIN + tick, 0, offset += 8 });
+    for (int64_t tick : { int64_t(0), int64_t(1), int64_t(2), SPAN - 4, SPAN - 1 })
+        partials[1].Add(RARE, { BEGIN + tick, 1, offset += 8 });
+    EtlOccurrenceIndex occurrences;
+    occurrences.Build(partials, reader);
+
+    std::shared_ptr<const EtlTimeDensityIndex> pIndex = EtlTimeDensityIndex::Build(occurrences, BEGIN, BEGIN + SPAN - 1, reader);
+    // A span of 2^17 ticks takes 2^15 buckets of 4 ticks, and 16 levels to get down to one bucket.
+    CHECK(pIndex->GetBegin() == BEGIN);
+    CHECK(pIndex->GetSpan() == static_cast<double>(SPAN));
+    CHECK(pIndex->GetBucketWidth(0) == 4.0 && pIndex->GetBucketWidth(3) == 32.0);
+    CHECK(pIndex->GetLevelCount() == 16);
+    CHECK(pIndex->Find(EventIdentifier({ 9, 9, 9, { 9 } }, 1, 0)) == nullptr);
+
+    const EtlTimePyramid& frequent = *pIndex->Find(FREQUENT);
+    CHECK(frequent.GetLevel(0).size() == SPAN / 4);
+    CHECK(frequent.GetLevel(15).size() == 1 && frequent.GetLevel(15)[0].m_count == SPAN / 4);
+    CHECK(frequent.GetLevel(15)[0].m_min == 1 && frequent.GetLevel(15)[0].m_max == 1);
+    const EtlTimePyramid& rare = *pIndex->Find(RARE);
+    CHECK(SameBuckets(rare.GetLevel(0), { { 3, 0, 3, 3 }, { 2, SPAN / 4 - 1, 2, 2 } }));
+    CHECK(SameBuckets(rare.GetLevel(15), { { 5, 0, 0, 3 } }));
+    const EtlTimePyramid& total = pIndex->GetTotal();
+    CHECK(total.GetLevel(0).front().m_count == 4 && total.GetLevel(0).back().m_count == 3);
+    CHECK(total.GetLevel(15)[0].m_count == SPAN / 4 + 5);
+
+    // Events outside of the given range are left out rather than overflowing the buckets.
+    std::shared_ptr<const EtlTimeDensityIndex> pInner = EtlTimeDensityIndex::Build(occurrences, BEGIN + 2, BEGIN + SPAN - 2, reader);
+    CHECK(pInner->GetTotal().GetLevel(pInner->GetLevelCount() - 1)[0].m_count == SPAN / 4 - 1 + 1 + 1);
+
+    // A trace without events has a single empty bucket.
+    EtlOccurrenceIndex empty;
+    std::shared_ptr<const EtlTimeDensityIndex> pEmpty = EtlTimeDensityIndex::Build(empty, 0, 0, reader);
+    CHECK(pEmpty->GetLevelCount() == 1 && pEmpty->GetTotal().GetLevel(0).empty());
+}
+
+TEST(TimeDensityIndexPicksTheFinestLevelThatFits)
+{
+    TempFile temp("density_window.etl");
+    SyntheticEtl etl(1024);
+    etl.BeginBuffer(0, 0);
+    etl.Write(temp.GetPath());
+    EtlFile file(temp.GetPath());
+    EtlParallelReader reader(file);
+
+    // 1000 ticks fit in 1000 buckets of one tick and 10 levels.
+    std::vector<EtlOccurrenceIndex::Partial> partials(1);
+    partials[0].Add(FREQUENT, { 5000, 0, 8 });
+    partials[0].Add(FREQUENT, { 5999, 0, 16 });
+    EtlOccurrenceIndex occurrences;
+    occurrences.Build(partials, reader);
+    std::shared_ptr<const EtlTimeDensityIndex> pIndex = EtlTimeDensityIndex::Build(occurrences, 5000, 5999, reader);
+    CHECK(pIndex->GetSpan() == 1000.0);
+    CHECK(pIndex->GetLevelCount() == 11);
+
+    auto check = [&](double begin, double end, size_t maxBuckets, unsigned level, uint32_t first, uint32_t count) {
+        EtlTimeDensityIndex::Window window = pIndex->GetWindow(begin, end, maxBuckets);
+        return window.m_level == level && window.m_first == first && window.m_count == count;
+    };
+    CHECK(check(0, 1000, 1000, 0, 0, 1000));
+    CHECK(check(0, 1000, 999, 1, 0, 500));
+    CHECK(check(0, 1000, 100, 4, 0, 63));
+    CHECK(check(100, 200, 100, 0, 100, 100));
+    // Partial buckets at both ends count.
+    CHECK(check(100.5, 200.5, 100, 1, 50, 51));
+    CHECK(check(3, 13, 2, 3, 0, 2));
+    // Ranges are clamped to the trace, and an empty range still gets a bucket.
+    CHECK(check(-500, 2000, 1000, 0, 0, 1000));
+    CHECK(check(400, 400, 1, 0, 400, 1));
+    CHECK(check(5000, 6000, 1, 0, 999, 1));
+    // The top level is used when nothing finer fits.
+    CHECK(check(0, 1000, 1, 10, 0, 1));
+    CHECK(check(0, 1000, 0, 10, 0, 1));
+}
@@ -0,0 +1,252 @@
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <ETL/EtlFile.h>
+#include <ETL/EtlTraceDatabase.h>
+#include <ETL/EtlTraceSource.h>
+#include <utils/SqliteDatabase.h>
+#include "SyntheticEtl.h"
+#include "Test.h"
+
+namespace {
+
+constexpr EtlGuid TEST_PROVIDER = { 0x5eed0001, 0x1, 0x2, { 3, 4, 5, 6, 7, 8, 9, 10 } };
+constexpr uint16_t TYPE_COUNT = 2;
+
+// Events of TYPE_COUNT ids over small buffers; the payload is the event's sequence number.
+void WriteTrace(const std::filesystem::path& path, uint64_t eventCount)
+{
+    SyntheticEtl etl(4096);
+    etl.BeginBuffer(0, 0);
+    for (uint64_t sequence = 0; sequence < eventCount; sequence++) {
+        EtlRawEventHeader header = {};
+        header.HeaderType = ETL_HEADER_TYPE_EVENT_HEADER64;
+        header.ProviderId = TEST_PROVIDER;
+        header.Id = static_cast<uint16_t>(sequence % TYPE_COUNT);
+        header.TimeStamp = static_cast<int64_t>(1000 + sequence * 10);
+        std::vector<uint8_t> payload(sizeof(sequence));
+        memcpy(payload.data(), &sequence, sizeof(sequence));
+        std::vector<uint8_t> record = SyntheticEtl::EventRecord(header, payload);
+        if (!etl.Add(record)) {
+            etl.BeginBuffer(static_cast<uint8_t>(sequence % 4), header.TimeStamp);
+            CHECK(etl.Add(record));
+        }
+    }
+    etl.Write(path);
+}
+
+EtlValue Value(EtlValueKind kind)
+{
+    EtlValue value{};
+    value.m_kind = kind;
+    value.m_size = 8;
+    return value;
+}
+
+/*
+Column tables of the events of one id, in batches of batchRows. Columns cover every type: the
+sequence number, a signed and a floating point value derived from it, a name, and an unsigned
+value past INT64_MAX that is missing on every third row.
+*/
+std::vector<std::shared_ptr<const EtlColumnTable>> MakeBatches(const EtlFile& file, uint16_t id, size_t batchRows)
+{
+    std::vector<std::string> names = { "Sequence", "Delta", "Ratio", "Name", "Flags" };
+    std::vector<EtlColumnType> types = { EtlColumnType::UInt64, EtlColumnType::Int64, EtlColumnType::Double, EtlColumnType::String, EtlColumnType::UInt64 };
+    std::vector<std::shared_ptr<const EtlColumnTable>> batches;
+    std::shared_ptr<EtlColumnTable> pBatch;
+    std::vector<char> scratch;
+    file.ForEachEvent([&](const EtlEventView& view) {
+        if (view.m_id != id)
+            return true;
+        uint64_t sequence = 0;
+        memcpy(&sequence, view.m_pUserData, sizeof(sequence));
+        std::string name = "event " + std::to_string(sequence);
+
+        std::vector<EtlValue> values(names.size());
+        values[0] = Value(EtlValueKind::UInt);
+        values[0].m_uint = sequence;
+        values[1] = Value(EtlValueKind::Int);
+        values[1].m_int = 50 - static_cast<int64_t>(sequence);
+        values[2] = Value(EtlValueKind::Double);
+        values[2].m_double = sequence / 4.0;
+        values[3] = Value(EtlValueKind::AnsiString);
+        values[3].m_inType = ETL_INTYPE_ANSISTRING;
+        values[3].m_pData = reinterpret_cast<const uint8_t*>(name.data());
+        values[3].m_size = static_cast<uint32_t>(name.size());
+        values[4] = Value(sequence % 3 == 0 ? EtlValueKind::Missing : EtlValueKind::UInt);
+        values[4].m_uint = ~0ull - sequence;
+
+        if (!pBatch)
+            pBatch = std::make_shared<EtlColumnTable>(names, types);
+        pBatch->AppendRow(view.m_timestamp, values, scratch);
+        if (pBatch->RowCount() == batchRows)
+            batches.push_back(std::move(pBatch));
+        return true;
+    });
+    if (pBatch)
+        batches.push_back(std::move(pBatch));
+    return batches;
+}
+
+// Writes every type of the synthetic trace to the database, the way the application ingests a decoded trace.
+bool Ingest(EtlTraceDatabase& database, const EtlFile& file, size_t batchRows)
+{
+    for (uint16_t id = 0; id < TYPE_COUNT; id++) {
+        auto pType = std::make_shared<EtlDatabaseEventType>();
+        pType->m_id = EventIdentifier{ TEST_PROVIDER, id, 0 };
+        pType->m_provider = "Synthetic";
+        pType->m_task = "Task" + std::to_string(id);
+        pType->m_properties = { { "Sequence", "UInt64" }, { "Delta", "Int64" }, { "Ratio", "Double" }, { "Name", "AnsiString" }, { "Flags", "HexInt64" } };
+        uint32_t typeId = id + 1u;
+        if (!database.AddEventType(typeId, pType))
+            return false;
+        for (auto& pBatch : MakeBatches(file, id, batchRows)) {
+            if (!database.Write(typeId, std::move(pBatch)))
+                return false;
+        }
+    }
+    return database.Finish();
+}
+
+int64_t QueryInt(SqliteDatabase& database, const std::string& sql)
+{
+    SqliteStatement statement = database.Prepare(sql);
+    CHECK(statement.Step());
+    int64_t value = statement.GetInt64(0);
+    statement.Reset();
+    return value;
+}
+
+// The database with its WAL files, removed when the test ends.
+class TempDatabase
+{
+public:
+    explicit TempDatabase(const std::string& name) : m_file(name), m_wal(name + "-wal"), m_shm(name + "-shm") {
+
+    }
+
+    const std::filesystem::path& GetPath() const { return m_file.GetPath(); }
+
+private:
+    TempFile m_file;
+    TempFile m_wal;
+    TempFile m_shm;
+};
+
+}
+
+TEST(EtlTraceDatabaseIngestsAndReopensCurrent)
+{
+    TempFile etlFile("database_ingest.etl");
+    TempDatabase databaseFile("database_ingest.etl.sqlite");
+    constexpr uint64_t EVENT_COUNT = 5000;
+    WriteTrace(etlFile.GetPath(), EVENT_COUNT);
+    EtlFile file(etlFile.GetPath());
+    EtlTraceSource source = EtlTraceSource::Of(etlFile.GetPath());
+    CHECK(!EtlTraceDatabase::IsCurrent(databaseFile.GetPath(), source));
+
+    {
+        // Batches that are not a multiple of the multi-row insert exercise the single row tail.
+        EtlTraceDatabase database(databaseFile.GetPath(), source);
+        CHECK(Ingest(database, file, 1000 + 7));
+        CHECK(!database.HasFailed());
+        CHECK(database.GetRowsWritten() == EVENT_COUNT);
+    }
+    CHECK(EtlTraceDatabase::IsCurrent(databaseFile.GetPath(), source));
+    CHECK(EtlTraceDatabase::IsCurrent(databaseFile.GetPath(), EtlTraceSource::Of(etlFile.GetPath())));
+
+    SqliteDatabase database(databaseFile.GetPath(), true);
+    CHECK(QueryInt(database, "SELECT count(*) FROM event_types") == TYPE_COUNT);
+    CHECK(QueryInt(database, "SELECT count(*) FROM event_columns") == TYPE_COUNT * 5);
+    CHECK(QueryInt(database, "SELECT sum(row_count) FROM event_types") == EVENT_COUNT);
+    CHECK(QueryInt(database, "SELECT row_count FROM event_types WHERE table_name = 'events_2'") == EVENT_COUNT / 2);
+    CHECK(QueryInt(database, "SELECT count(*) FROM sqlite_master WHERE type = 'index' AND name = 'events_1_timestamp'") == 1);
+
+    // Every row round trips, timestamps and all value types included.
+    uint64_t sequenceSum = 0;
+    for (uint64_t sequence = 0; sequence < EVENT_COUNT; sequence += 2)
+        sequenceSum += sequence;
+    CHECK(QueryInt(database, "SELECT count(*) FROM events_1") == EVENT_COUNT / 2);
+    CHECK(QueryInt(database, "SELECT sum(Sequence) FROM events_1") == static_cast<int64_t>(sequenceSum));
+    CHECK(QueryInt(database, "SELECT count(*) FROM events_1 WHERE timestamp != 1000 + Sequence * 10") == 0);
+    CHECK(QueryInt(database, "SELECT count(*) FROM events_1 WHERE Delta != 50 - Sequence OR Ratio != Sequence / 4.0") == 0);
+    CHECK(QueryInt(database, "SELECT count(*) FROM events_1 WHERE Name != 'event ' || Sequence") == 0);
+    CHECK(QueryInt(database, "SELECT count(*) FROM events_2 WHERE Sequence % 2 != 1") == 0);
+
+    // Unsigned values keep their bit pattern; missing values are NULL.
+    CHECK(QueryInt(database, "SELECT count(*) FROM events_1 WHERE Flags IS NULL") == (EVENT_COUNT / 2 + 2) / 3);
+    CHECK(QueryInt(database, "SELECT count(*) FROM events_1 WHERE Flags IS NOT NULL AND Flags != -1 - Sequence") == 0);
+}
+
+TEST(EtlTraceDatabaseIsCurrentRejectsStaleDatabases)
+{
+    TempFile etlFile("database_stale.etl");
+    TempDatabase databaseFile("database_stale.etl.sqlite");
+    WriteTrace(etlFile.GetPath(), 200);
+    EtlTraceSource source = EtlTraceSource::Of(etlFile.GetPath());
+
+    {
+        // Abandoned before Finish, like a run that was closed during ingest.
+        EtlTraceDatabase database(databaseFile.GetPath(), source);
+        auto pType = std::make_shared<EtlDatabaseEventType>();
+        CHECK(database.AddEventType(1, pType));
+    }
+    CHECK(!EtlTraceDatabase::IsCurrent(databaseFile.GetPath(), source));
+
+    {
+        EtlFile file(etlFile.GetPath());
+        EtlTraceDatabase database(databaseFile.GetPath(), source);
+        CHECK(Ingest(database, file, 64));
+    }
+    CHECK(EtlTraceDatabase::IsCurrent(databaseFile.GetPath(), source));
+
+    // Any change to the identity of the source makes the database stale.
+    EtlTraceSource changed = source;
+    changed.m_path += ".moved";
+    CHECK(!EtlTraceDatabase::IsCurrent(databaseFile.GetPath(), changed));
+    changed = source;
+    changed.m_modifiedTime++;
+    CHECK(!EtlTraceDatabase::IsCurrent(databaseFile.GetPath(), changed));
+    changed = source;
+    changed.m_headerHash ^= 1;
+    CHECK(!EtlTraceDatabase::IsCurrent(databaseFile.GetPath(), changed));
+
+    // So does rewriting the trace.
+    WriteTrace(etlFile.GetPath(), 400);
+    CHECK(!EtlTraceDatabase::IsCurrent(databaseFile.GetPath(), EtlTraceSource::Of(etlFile.GetPath())));
+
+    // A file that is not a database is not current, and neither is a missing one.
+    {
+        std::ofstream garbage(databaseFile.GetPath(), std::ios::binary | std::ios::trunc);
+        garbage << "not a database";
+    }
+    CHECK(!EtlTraceDatabase::IsCurrent(databaseFile.GetPath(), source));
+    std::filesystem::remove(databaseFile.GetPath());
+    CHECK(!EtlTraceDatabase::IsCurrent(databaseFile.GetPath(), source));
+}
+
+TEST(EtlTraceDatabaseReportsWriteFailures)
+{
+    TempFile etlFile("database_failure.etl");
+    TempDatabase databaseFile("database_failure.etl.sqlite");
+    WriteTrace(etlFile.GetPath(), 100);
+    EtlTraceSource source = EtlTraceSource::Of(etlFile.GetPath());
+    EtlFile file(etlFile.GetPath());
+
+    {
+        // Rows of a type that was never registered fail the writer; the database stays unfinished.
+        EtlTraceDatabase database(databaseFile.GetPath(), source);
+        std::vector<std::shared_ptr<const EtlColumnTable>> batches = MakeBatches(file, 0, 1000);
+        CHECK(batches.size() == 1);
+        database.Write(7, batches[0]);
+        CHECK(!database.Finish());
+        CHECK(database.HasFailed());
+        CHECK(!database.GetError().empty());
+        CHECK(!database.Write(7, batches[0]));
+    }
+    CHECK(!EtlTraceDatabase::IsCurrent(databaseFile.GetPath(), source));
+}
@@ -0,0 +1,236 @@
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <ETL/EtlFile.h>
+#include <ETL/EtlParallelReader.h>
+#include <ETL/EtlTrigramIndex.h>
+#include <utils/ThreadPool.h>
+#include "SyntheticEtl.h"
+#include "Test.h"
+
+namespace {
+
+const std::filesystem::path& WriteEmptyTrace(const std::filesystem::path& path)
+{
+    SyntheticEtl etl(1024);
+    etl.BeginBuffer(0, 0);
+    etl.Write(path);
+    return path;
+}
+
+// A reader over an empty trace, whose workers run the ParallelFor of Merge and Finish.
+class MergeReader
+{
+public:
+    explicit MergeReader(const std::string& name) : m_temp(name), m_file(WriteEmptyTrace(m_temp.GetPath())), m_pool(3), m_reader(m_file, 0, m_pool) {
+
+    }
+
+    const EtlParallelReader& Get() const { return m_reader; }
+
+private:
+    TempFile m_temp;
+    EtlFile m_file;
+    ThreadPool m_pool;
+    EtlParallelReader m_reader;
+};
+
+using Document = std::vector<std::string>; // The text values of one event.
+
+/*
+Indexes the documents as one type, batchDocuments at a time, each batch split into partialCount
+consecutive ranges the way the workers split a batch into chunks.
+*/
+EtlTrigramIndex BuildIndex(const std::vector<Document>& documents, size_t batchDocuments, size_t partialCount, const EtlParallelReader& reader)
+{
+    EtlTrigramIndex index;
+    index.AddType(EventIdentifier({ 1, 2, 3, { 4 } }, 7, 0), 3);
+    uint32_t first = index.AddType(EventIdentifier({ 1, 2, 3, { 4 } }, 8, 0), documents.size());
+    std::vector<EtlTrigramIndex::Partial> partials(partialCount);
+    for (size_t begin = 0; begin < documents.size(); begin += batchDocuments) {
+        size_t end = (std::min)(begin + batchDocuments, documents.size());
+        for (size_t doc = begin; doc < end; doc++) {
+            EtlTrigramIndex::Partial& partial = partials[(doc - begin) * partialCount / (end - begin)];
+            for (const std::string& text : documents[doc])
+                partial.AddText(text);
+            partial.EndDocument(first + static_cast<uint32_t>(doc));
+        }
+        index.Merge(partials, reader);
+    }
+    index.Finish(reader);
+    return index;
+}
+
+std::string Lowered(std::string text)
+{
+    EtlLowerAscii(text.data(), text.size());
+    return text;
+}
+
+// Documents of the type built by BuildIndex that contain the needle, ignoring ASCII case, by brute force.
+std::vector<uint32_t> DocumentsContaining(const std::vector<Document>& documents, std::string_view needle, uint32_t first)
+{
+    std::vector<uint32_t> found;
+    std::string lowered = Lowered(std::string(needle));
+    for (size_t doc = 0; doc < documents.size(); doc++) {
+        for (const std::string& text : documents[doc]) {
+            if (Lowered(text).find(lowered) != std::string::npos) {
+                found.push_back(first + static_cast<uint32_t>(doc));
+                break;
+            }
+        }
+    }
+    return found;
+}
+
+std::vector<uint32_t> Candidates(const EtlTrigramIndex& index, std::string_view needle)
+{
+    std::vector<uint32_t> candidates = { 12345 };
+    CHECK(index.FindCandidates(Lowered(std::string(needle)), candidates));
+    return candidates;
+}
+
+}
+
+TEST(TrigramIndexCandidatesIncludeEveryMatch)
+{
+    MergeReader reader("trigram_candidates.etl");
+    std::mt19937 random(5);
+    std::vector<Document> documents(3000);
+    for (Document& document : documents) {
+        // Few letters, so trigrams repeat across documents and values; some values are too short for a trigram.
+        for (size_t value = random() % 4; value > 0; value--) {
+            std::string text(random() % 12, ' ');
+            for (char& c : text)
+                c = "abcABC_\\"[random() % 8];
+            document.push_back(text);
+        }
+    }
+    for (size_t partialCount : { size_t(1), size_t(4) }) {
+        EtlTrigramIndex index = BuildIndex(documents, 700, partialCount, reader.Get());
+        CHECK(index.GetTypeCount() == 2);
+        CHECK(index.GetDocumentCount() == 3 + documents.size());
+        CHECK(index.TypeOf(2) == 0 && index.TypeOf(3) == 1 && index.TypeOf(index.GetDocumentCount() - 1) == 1);
+        CHECK(index.GetTrigramCount() <= 8 * 8 * 8);
+
+        for (int i = 0; i < 300; i++) {
+            std::string needle(3 + random() % 5, ' ');
+            for (char& c : needle)
+                c = "abcABC_\\"[random() % 8];
+            std::vector<uint32_t> candidates = Candidates(index, needle);
+            CHECK(std::adjacent_find(candidates.begin(), candidates.end(), std::greater_equal<uint32_t>()) == candidates.end());
+            CHECK(candidates.empty() || (candidates.front() >= 3 && candidates.back() < index.GetDocumentCount()));
+            std::vector<uint32_t> expected = DocumentsContaining(documents, needle, 3);
+            CHECK(std::includes(candidates.begin(), candidates.end(), expected.begin(), expected.end()));
+        }
+    }
+}
+
+TEST(TrigramIndexRejectsShortNeedles)
+{
+    MergeReader reader("trigram_short.etl");
+    EtlTrigramIndex index = BuildIndex({ { "ab", "abc" }, { "xyz" } }, 10, 1, reader.Get());
+    std::vector<uint32_t> candidates = { 1, 2 };
+    for (std::string_view needle : { "", "a", "ab" }) {
+        CHECK(!index.FindCandidates(needle, candidates));
+        CHECK(candidates.empty());
+    }
+
+    // Trigrams do not span values, and an unknown trigram has no candidates.
+    CHECK(Candidates(index, "abc") == std::vector<uint32_t>({ 3 }));
+    CHECK(Candidates(index, "XYZ") == std::vector<uint32_t>({ 4 }));
+    CHECK(Candidates(index, "bab").empty());
+    CHECK(Candidates(index, "abd").empty());
+    CHECK(Candidates(index, "abcxyz").empty());
+}
+
+TEST(TrigramIndexSkipsListsPastTheSkipRatio)
+{
+    MergeReader reader("trigram_skip.etl");
+    constexpr size_t RATIO = EtlTrigramIndex::SKIP_RATIO;
+
+    /*
+    "comx" has the trigrams "com" and "omx". Two documents have "omx", but only the first has "com".
+    Intersecting with the list of "com" is skipped once it is SKIP_RATIO times longer than the two
+    candidates, leaving the second document for verification to reject.
+    */
+    for (size_t commonCount : { 2 * RATIO, 3 * RATIO - 1, 3 * RATIO, 4 * RATIO }) {
+        std::vector<Document> documents(commonCount + 1, Document{ "common" });
+        documents[7] = { "common comx" };
+        documents[commonCount] = { "omx" };
+        EtlTrigramIndex index = BuildIndex(documents, 1000, 2, reader.Get());
+        std::vector<uint32_t> candidates = Candidates(index, "comx");
+        if (commonCount / RATIO > 2)
+            CHECK(candidates == std::vector<uint32_t>({ 3 + 7, 3 + static_cast<uint32_t>(commonCount) }));
+        else
+            CHECK(candidates == std::vector<uint32_t>({ 3 + 7 }));
+        CHECK(DocumentsContaining(documents, "comx", 3) == std::vector<uint32_t>({ 3 + 7 }));
+    }
+
+    // Lists are intersected shortest first, so a rare trigram anywhere in the needle narrows the candidates.
+    std::vector<Document> documents(10 * RATIO, Document{ "aaaa" });
+    documents[3] = { "aaaaqq" };
+    EtlTrigramIndex index = BuildIndex(documents, 1000, 1, reader.Get());
+    CHECK(Candidates(index, "aaaaqq") == std::vector<uint32_t>({ 3 + 3 }));
+    CHECK(Candidates(index, "aaaa").size() == documents.size());
+}
+
+TEST(EtlFindTextAgreesWithScalarSearch)
+{
+    // Two letters, so the first and last bytes of the needle match at many positions where the rest does not.
+    std::mt19937 random(9);
+    std::string haystack(200, ' ');
+    for (char& c : haystack)
+        c = "ab"[random() % 2];
+
+    for (size_t offset : { size_t(0), size_t(1), size_t(7) }) {
+        for (size_t size = 0; size <= 70; size++) {
+            std::string_view text = std::string_view(haystack).substr(offset, size);
+            for (size_t needleSize = 1; needleSize <= 20; needleSize++) {
+                for (size_t start = 0; start + needleSize <= haystack.size(); start += 11) {
+                    std::string_view needle = std::string_view(haystack).substr(start, needleSize);
+                    CHECK(EtlFindText(text, needle) == text.find(needle));
+                }
+                std::string missing(needleSize, 'a');
+                missing.back() = 'c';
+                CHECK(EtlFindText(text, missing) == std::string_view::npos);
+            }
+        }
+    }
+    CHECK(EtlFindText("abc", "") == 0);
+    CHECK(EtlFindText("", "") == 0);
+    CHECK(EtlFindText("abc", "abcd") == std::string_view::npos);
+}
+
+TEST(EtlFindTextFindsMatchesAcrossBlocks)
+{
+    // Needles at every position around the 16 byte blocks, including ones that end in the scalar tail.
+    for (size_t textSize : { size_t(16), size_t(17), size_t(31), size_t(32), size_t(33), size_t(64) }) {
+        for (size_t needleSize : { size_t(1), size_t(2), size_t(5), size_t(16), size_t(17) }) {
+            for (size_t position = 0; position + needleSize <= textSize; position++) {
+                std::string text(textSize, 'x');
+                for (size_t i = 0; i < needleSize; i++)
+                    text[position + i] = static_cast<char>('a' + i % 26);
+                std::string needle = text.substr(position, needleSize);
+                CHECK(EtlFindText(text, needle) == position);
+                // An earlier position where only the first and last bytes match is passed over.
+                if (needleSize >= 3 && position >= needleSize) {
+                    text[0] = needle.front();
+                    text[needleSize - 1] = needle.back();
+                    CHECK(EtlFindText(text, needle) == position);
+                }
+            }
+        }
+    }
+
+    // The first of several matches in the same block, and in different blocks.
+    CHECK(EtlFindText("--ab--ab--ab--ab--ab--ab--ab--ab--ab", "ab") == 2);
+    CHECK(EtlFindText(std::string(40, '-') + "needle" + std::string(3, '-') + "needle", "needle") == 40);
+    CHECK(EtlFindText(std::string(100, 'a'), std::string(50, 'a')) == 0);
+    CHECK(EtlFindText(std::string(100, 'a') + "b", std::string(50, 'a') + "b") == 50);
+}
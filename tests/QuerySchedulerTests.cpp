@@ -0,0 +1,185 @@
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <optional>
+#include <thread>
+#include <vector>
+#include <utils/QueryScheduler.h>
+#include "Test.h"
+
+namespace {
+
+using IntScheduler = QueryScheduler<int, int>;
+
+// Polls until the condition holds; false after a generous timeout.
+bool WaitFor(const std::function<bool()>& condition)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (!condition()) {
+        if (std::chrono::steady_clock::now() > deadline)
+            return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+// Pops results until count have arrived.
+std::vector<int> PopResults(IntScheduler& scheduler, size_t count)
+{
+    std::vector<int> results;
+    WaitFor([&]() {
+        int result = 0;
+        while (results.size() < count && scheduler.PopResult(&result))
+            results.push_back(result);
+        return results.size() == count;
+    });
+    return results;
+}
+
+// Holds a query until Release or until it is cancelled, so the tests can queue work behind it.
+class Gate
+{
+public:
+    void Wait(const QueryCancelToken& token)
+    {
+        m_entered = true;
+        while (!m_open && !token.IsCancelled())
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    bool WaitEntered() { return WaitFor([this]() { return m_entered.load(); }); }
+    void Release() { m_open = true; }
+
+private:
+    std::atomic<bool> m_entered = false;
+    std::atomic<bool> m_open = false;
+};
+
+}
+
+TEST(QuerySchedulerFinalResultsWaitForSpace)
+{
+    // Final results count against the capacity like emitted ones: the worker waits instead of growing the queue.
+    std::atomic<int> finished = 0;
+    IntScheduler scheduler([&](const int& query, IntScheduler::Context&) -> std::optional<int> {
+        finished++;
+        return query;
+    }, 1, 2);
+    for (int query = 0; query < 6; query++)
+        scheduler.Submit(int(query));
+
+    CHECK(WaitFor([&]() { return finished == 3; }));
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    CHECK(finished == 3); // Two results queued, the third waiting for space.
+    CHECK(scheduler.PendingCount() == 3);
+
+    CHECK(PopResults(scheduler, 6) == std::vector<int>({ 0, 1, 2, 3, 4, 5 }));
+    CHECK(finished == 6);
+}
+
+TEST(QuerySchedulerReplacesPendingQueriesLatestWins)
+{
+    Gate gate;
+    std::vector<int> ran;
+    IntScheduler scheduler([&](const int& query, IntScheduler::Context& context) -> std::optional<int> {
+        if (query < 0)
+            gate.Wait(context);
+        ran.push_back(query);
+        return query;
+    });
+    scheduler.Submit(-1);
+    CHECK(gate.WaitEntered());
+
+    for (int query = 1; query <= 5; query++)
+        scheduler.Submit(int(query), QueryPriority::Foreground, true);
+    CHECK(scheduler.PendingCount() == 1);
+    // Replacing only drops queries of the same priority.
+    scheduler.Submit(100, QueryPriority::Background);
+    scheduler.Submit(6, QueryPriority::Foreground, true);
+    CHECK(scheduler.PendingCount() == 2);
+
+    gate.Release();
+    CHECK(PopResults(scheduler, 3) == std::vector<int>({ -1, 6, 100 }));
+    CHECK(ran == std::vector<int>({ -1, 6, 100 }));
+}
+
+TEST(QuerySchedulerPreemptsAndRequeuesBackgroundWork)
+{
+    std::atomic<int> backgroundRuns = 0;
+    std::atomic<bool> backgroundRunning = false;
+    std::atomic<int> backgroundDone = 0;
+    IntScheduler scheduler([&](const int& query, IntScheduler::Context& context) -> std::optional<int> {
+        if (query < 100)
+            return query;
+        // Background work that runs until a foreground query preempts it, or finishes on a later run.
+        if (backgroundRuns++ > 0)
+            return query;
+        backgroundRunning = true;
+        while (!context.IsCancelled())
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        backgroundDone++;
+        return std::nullopt;
+    });
+
+    scheduler.Submit(100, QueryPriority::Background);
+    scheduler.Submit(101, QueryPriority::Background);
+    CHECK(WaitFor([&]() { return backgroundRunning.load(); }));
+    scheduler.Submit(1);
+
+    // The preempted query runs again before the background query queued after it.
+    CHECK(PopResults(scheduler, 3) == std::vector<int>({ 1, 100, 101 }));
+    CHECK(backgroundDone == 1);
+    CHECK(backgroundRuns == 3);
+}
+
+TEST(QuerySchedulerDiscardsStaleGenerations)
+{
+    Gate gate;
+    std::atomic<bool> emitRefused = false;
+    IntScheduler scheduler([&](const int& query, IntScheduler::Context& context) -> std::optional<int> {
+        if (query >= 0)
+            return query;
+        if (!context.Emit(query * 10))
+            return std::nullopt;
+        gate.Wait(context);
+        // The generation changed while the query waited: emitting is refused and the final result dropped.
+        if (!context.Emit(query * 100))
+            emitRefused = true;
+        return query;
+    }, 1, 4);
+
+    uint64_t first = scheduler.GetGeneration();
+    scheduler.Submit(-1);
+    CHECK(gate.WaitEntered());
+    scheduler.Submit(7);
+    scheduler.Submit(8);
+    CHECK(scheduler.PendingCount() == 2);
+
+    uint64_t second = scheduler.NewGeneration();
+    CHECK(second == first + 1 && scheduler.GetGeneration() == second);
+    CHECK(scheduler.PendingCount() == 0); // Queued queries of the old generation are gone.
+    int result = 0;
+    CHECK(!scheduler.PopResult(&result)); // And so is what the running query emitted.
+
+    scheduler.Submit(9);
+    gate.Release();
+    CHECK(PopResults(scheduler, 1) == std::vector<int>({ 9 }));
+    CHECK(WaitFor([&]() { return emitRefused.load(); }));
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    CHECK(!scheduler.PopResult(&result));
+}
+
+TEST(QuerySchedulerShutdownReleasesBlockedWorkers)
+{
+    // A worker waiting for result space must not keep Shutdown from joining it.
+    std::atomic<int> finished = 0;
+    IntScheduler scheduler([&](const int& query, IntScheduler::Context&) -> std::optional<int> {
+        finished++;
+        return query;
+    }, 2, 1);
+    for (int query = 0; query < 4; query++)
+        scheduler.Submit(int(query));
+    CHECK(WaitFor([&]() { return finished == 3; }));
+    scheduler.Shutdown();
+    scheduler.Shutdown();
+}
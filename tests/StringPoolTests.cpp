@@ -0,0 +1,169 @@
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <utils/StringDictionary.h>
+#include <utils/StringPool.h>
+#include "Test.h"
+
+namespace {
+
+// Distinct non-empty strings of every length class the hash reads differently: 1-3, 4-16 and longer.
+std::vector<std::string> MakeStrings(size_t count)
+{
+    std::vector<std::string> strings;
+    strings.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        std::string text = std::to_string(i);
+        switch (i % 4) {
+        case 0: break;
+        case 1: text = "Provider/" + text; break;
+        case 2: text = "C:\\Windows\\System32\\drivers\\" + text + ".sys"; break;
+        default: text = std::string(40 + i % 50, 'x') + text; break;
+        }
+        strings.push_back(std::move(text));
+    }
+    return strings;
+}
+
+}
+
+TEST(HashString64SeparatesNearbyStrings)
+{
+    CHECK(HashString64("") == HashString64(std::string_view()));
+    CHECK(HashString64("abc") == HashString64(std::string("abc")));
+    CHECK(HashString64("abc") != HashString64("abd"));
+    CHECK(HashString64("abc") != HashString64("abc", 1));
+    // Strings that differ only past the first 16 byte block, or only in their length.
+    std::string longText(100, 'a');
+    std::string changed = longText;
+    changed[70] = 'b';
+    CHECK(HashString64(longText) != HashString64(changed));
+    CHECK(HashString64(std::string_view("aaaa\0", 5)) != HashString64("aaaa"));
+}
+
+TEST(StringPoolInternsEachStringOnce)
+{
+    StringPool pool;
+    CHECK(pool.Size() == 1);
+    CHECK(pool.Get(StringPool::EMPTY_ID).empty());
+    CHECK(pool.Intern("") == StringPool::EMPTY_ID);
+    CHECK(*pool.CStr(StringPool::EMPTY_ID) == '\0');
+
+    // Enough strings to grow the slot table several times.
+    std::vector<std::string> strings = MakeStrings(5000);
+    std::vector<StringPool::Id> ids;
+    for (const std::string& text : strings)
+        ids.push_back(pool.Intern(text));
+    const char* pFirst = pool.CStr(ids[1]);
+    for (size_t i = 0; i < strings.size(); i++) {
+        CHECK(ids[i] != StringPool::EMPTY_ID);
+        CHECK(pool.Intern(strings[i]) == ids[i]);
+        CHECK(pool.Get(ids[i]) == strings[i]);
+        CHECK(strcmp(pool.CStr(ids[i]), strings[i].c_str()) == 0);
+        StringPool::Id found = 0;
+        CHECK(pool.Find(strings[i], &found) && found == ids[i]);
+    }
+    CHECK(pool.Size() == strings.size() + 1);
+    CHECK(pool.CStr(ids[1]) == pFirst); // Interned text never moves.
+
+    StringPool::Id found = 0;
+    CHECK(!pool.Find("never interned", &found));
+    CHECK(pool.Size() == strings.size() + 1);
+
+    // Larger than a quarter chunk: stored in its own allocation.
+    std::string large(size_t(1) << 19, 'L');
+    StringPool::Id largeId = pool.Intern(large);
+    CHECK(pool.Get(largeId) == large);
+    CHECK(pool.Intern(large) == largeId);
+}
+
+TEST(StringPoolReportsDedupStats)
+{
+    StringPool pool;
+    for (int i = 0; i < 10; i++)
+        pool.Intern("repeated");
+    pool.Intern("once");
+    StringPool::Stats stats = pool.GetStats();
+    CHECK(stats.m_internCount == 11);
+    CHECK(stats.m_internedBytes == 10 * 8 + 4);
+    CHECK(stats.m_uniqueCount == 3);
+    CHECK(stats.m_uniqueBytes == 8 + 4);
+    CHECK(stats.BytesSaved() == 9 * 8);
+    CHECK(stats.DedupRatio() == 84.0 / 12.0);
+    CHECK(stats.m_arenaBytes >= stats.m_uniqueBytes);
+}
+
+TEST(StringPoolInternsConcurrently)
+{
+    StringPool pool;
+    std::vector<std::string> strings = MakeStrings(2000);
+    std::vector<std::vector<StringPool::Id>> ids(4);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < ids.size(); t++) {
+        threads.emplace_back([&, t]() {
+            // Every thread interns every string, starting at a different one.
+            for (size_t i = 0; i < strings.size(); i++)
+                ids[t].push_back(pool.Intern(strings[(i + t * 500) % strings.size()]));
+        });
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+
+    CHECK(pool.Size() == strings.size() + 1);
+    for (size_t t = 0; t < ids.size(); t++) {
+        for (size_t i = 0; i < strings.size(); i++)
+            CHECK(pool.Get(ids[t][i]) == strings[(i + t * 500) % strings.size()]);
+    }
+}
+
+TEST(StringDictionaryGivesDenseIdsInInsertionOrder)
+{
+    StringDictionary dictionary;
+    CHECK(dictionary.Size() == 1);
+    CHECK(dictionary.Get(StringDictionary::EMPTY_ID).empty());
+    CHECK(dictionary.Intern("") == StringDictionary::EMPTY_ID);
+    StringDictionary::Id found = 1;
+    CHECK(dictionary.Find("", &found) && found == StringDictionary::EMPTY_ID);
+    CHECK(!dictionary.Find("missing", &found));
+
+    // Crosses every growth of the 16 slot table up to 16K slots.
+    std::vector<std::string> strings = MakeStrings(6000);
+    for (size_t i = 0; i < strings.size(); i++) {
+        CHECK(dictionary.Intern(strings[i]) == i + 1);
+        CHECK(dictionary.Size() == i + 2);
+    }
+    for (size_t i = 0; i < strings.size(); i++) {
+        CHECK(dictionary.Intern(strings[i]) == i + 1);
+        CHECK(dictionary.Get(static_cast<StringDictionary::Id>(i + 1)) == strings[i]);
+        CHECK(dictionary.Find(strings[i], &found) && found == i + 1);
+    }
+    CHECK(dictionary.Size() == strings.size() + 1);
+    CHECK(dictionary.Intern("") == StringDictionary::EMPTY_ID);
+    CHECK(dictionary.Get(StringDictionary::EMPTY_ID).empty());
+
+    // Copies are independent and keep every id.
+    StringDictionary copy = dictionary;
+    copy.Intern("only in the copy");
+    CHECK(copy.Size() == dictionary.Size() + 1);
+    CHECK(!dictionary.Find("only in the copy", &found));
+    CHECK(copy.Get(1234) == dictionary.Get(1234));
+
+    size_t bytes = dictionary.ByteSize();
+    dictionary.ShrinkToFit();
+    CHECK(dictionary.ByteSize() <= bytes);
+    CHECK(dictionary.Get(77) == strings[76]);
+}
+
+TEST(StringDictionaryTellsStringsWithEqualPrefixesApart)
+{
+    // Embedded and trailing nul bytes are part of the string.
+    StringDictionary dictionary;
+    StringDictionary::Id a = dictionary.Intern(std::string_view("a\0", 2));
+    StringDictionary::Id b = dictionary.Intern("a");
+    StringDictionary::Id c = dictionary.Intern(std::string_view("\0", 1));
+    CHECK(a != b && a != c && b != c && c != StringDictionary::EMPTY_ID);
+    CHECK(dictionary.Get(a).size() == 2 && dictionary.Get(c).size() == 1);
+    CHECK(dictionary.Intern(std::string_view("a\0", 2)) == a);
+}
@@ -0,0 +1,201 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include <ETL/EtlFile.h>
+
+/*
+Builds .etl files out of hand-made WMI buffers, so the parsing layer can be tested and benchmarked
+without checked-in traces. Records are appended to the current buffer 8 byte aligned, as the kernel
+logger writes them, and the unused tail of every buffer is 0xFF like the padding of a real trace.
+*/
+class SyntheticEtl
+{
+public:
+    using ExtendedItem = std::pair<uint16_t, std::vector<uint8_t>>; // ExtType and data.
+
+    explicit SyntheticEtl(uint32_t bufferSize = 64 * 1024) : m_bufferSize(bufferSize) {
+
+    }
+
+    // Starts a buffer. Buffers are laid out in the file in the order they are started.
+    void BeginBuffer(uint8_t processor, int64_t timestamp)
+    {
+        m_current = m_bytes.size();
+        m_bytes.resize(m_bytes.size() + m_bufferSize, 0xFF);
+        EtlRawBufferHeader header = {};
+        header.BufferSize = m_bufferSize;
+        header.TimeStamp = timestamp;
+        header.ProcessorNumber = processor;
+        header.LoggerId = 1;
+        memcpy(m_bytes.data() + m_current, &header, sizeof(header));
+        SetFilledBytes(sizeof(EtlRawBufferHeader));
+    }
+
+    // Appends a record to the current buffer. Returns false if it does not fit.
+    bool Add(const std::vector<uint8_t>& record)
+    {
+        uint32_t aligned = static_cast<uint32_t>((record.size() + 7) & ~size_t(7));
+        if (m_bytes.empty() || m_bufferSize - m_filled < aligned)
+            return false;
+        uint8_t* pRecord = m_bytes.data() + m_current + m_filled;
+        memset(pRecord, 0, aligned);
+        memcpy(pRecord, record.data(), record.size());
+        SetFilledBytes(m_filled + aligned);
+        return true;
+    }
+
+    // Overrides the filled size of the current buffer, e.g. to make readers stop at the padding.
+    void SetFilledBytes(uint32_t filled)
+    {
+        m_filled = filled;
+        EtlRawBufferHeader header;
+        memcpy(&header, m_bytes.data() + m_current, sizeof(header));
+        header.SavedOffset = filled;
+        header.Offset = filled;
+        memcpy(m_bytes.data() + m_current, &header, sizeof(header));
+    }
+
+    uint32_t GetFilledBytes() const { return m_filled; }
+    const std::vector<uint8_t>& GetBytes() const { return m_bytes; }
+
+    void Write(const std::filesystem::path& path) const
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(m_bytes.data()), static_cast<std::streamsize>(m_bytes.size()));
+        if (!file)
+            throw std::runtime_error("Failed to write " + path.string());
+    }
+
+    // EVENT_HEADER record (EVENT_HEADER32/64), with the extended data items chained in front of the payload.
+    static std::vector<uint8_t> EventRecord(EtlRawEventHeader header, const std::vector<uint8_t>& payload, const std::vector<ExtendedItem>& extendedData = {})
+    {
+        std::vector<uint8_t> record(sizeof(header));
+        for (size_t i = 0; i < extendedData.size(); i++) {
+            const auto& [extType, data] = extendedData[i];
+            uint8_t item[ETL_EXTENDED_ITEM_HEADER_SIZE] = {};
+            uint16_t linkage = i + 1 < extendedData.size() ? 1 : 0;
+            uint16_t dataSize = static_cast<uint16_t>(data.size());
+            memcpy(item + 2, &extType, sizeof(extType));
+            memcpy(item + 4, &linkage, sizeof(linkage));
+            memcpy(item + 6, &dataSize, sizeof(dataSize));
+            record.insert(record.end(), item, item + sizeof(item));
+            record.insert(record.end(), data.begin(), data.end());
+            record.resize((record.size() + 7) & ~size_t(7));
+        }
+        if (!extendedData.empty())
+            header.Flags |= ETL_HEADER_FLAG_EXTENDED_INFO;
+        return Finish(record, header, payload);
+    }
+
+    // SYSTEM_TRACE_HEADER record; compact header types only keep the first 24 bytes of the header.
+    static std::vector<uint8_t> SystemRecord(EtlRawSystemHeader header, const std::vector<uint8_t>& payload)
+    {
+        bool compact = header.HeaderType == ETL_HEADER_TYPE_COMPACT32 || header.HeaderType == ETL_HEADER_TYPE_COMPACT64;
+        size_t headerSize = compact ? ETL_COMPACT_SYSTEM_HEADER_SIZE : sizeof(header);
+        header.Size = static_cast<uint16_t>(headerSize + payload.size());
+        std::vector<uint8_t> record(headerSize);
+        memcpy(record.data(), &header, headerSize);
+        record.insert(record.end(), payload.begin(), payload.end());
+        return record;
+    }
+
+    static std::vector<uint8_t> PerfInfoRecord(EtlRawPerfInfoHeader header, const std::vector<uint8_t>& payload)
+    {
+        header.Size = static_cast<uint16_t>(sizeof(header) + payload.size());
+        std::vector<uint8_t> record(sizeof(header));
+        memcpy(record.data(), &header, sizeof(header));
+        record.insert(record.end(), payload.begin(), payload.end());
+        return record;
+    }
+
+    // EVENT_TRACE_HEADER record (FULL_HEADER32/64).
+    static std::vector<uint8_t> FullRecord(EtlRawFullHeader header, const std::vector<uint8_t>& payload)
+    {
+        std::vector<uint8_t> record(sizeof(header));
+        return Finish(record, header, payload);
+    }
+
+    // MESSAGE_TRACE_HEADER record with the optional fields of TRACE_MESSAGE_SEQUENCE, GUID, TIMESTAMP and SYSTEMINFO.
+    static std::vector<uint8_t> MessageRecord(uint16_t messageNumber, const EtlGuid& guid, int64_t timestamp,
+        uint32_t threadId, uint32_t processId, const std::vector<uint8_t>& payload)
+    {
+        std::vector<uint8_t> record(8);
+        uint16_t optionFlags = 0x0001 | 0x0002 | 0x0008 | 0x0020;
+        record[2] = ETL_HEADER_TYPE_MESSAGE;
+        memcpy(record.data() + 4, &messageNumber, sizeof(messageNumber));
+        memcpy(record.data() + 6, &optionFlags, sizeof(optionFlags));
+        Append(record, uint32_t(7)); // Sequence number.
+        Append(record, guid);
+        Append(record, timestamp);
+        Append(record, threadId);
+        Append(record, processId);
+        record.insert(record.end(), payload.begin(), payload.end());
+        uint16_t size = static_cast<uint16_t>(record.size());
+        memcpy(record.data(), &size, sizeof(size));
+        return record;
+    }
+
+    // Record the reader has to skip, such as instance, timed, error and WNODE records.
+    static std::vector<uint8_t> OpaqueRecord(uint8_t headerType, uint16_t size)
+    {
+        std::vector<uint8_t> record(size, 0xAB);
+        memcpy(record.data(), &size, sizeof(size));
+        record[2] = headerType;
+        return record;
+    }
+
+    template<typename T>
+    static void Append(std::vector<uint8_t>& bytes, const T& value)
+    {
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(&value);
+        bytes.insert(bytes.end(), p, p + sizeof(T));
+    }
+
+private:
+    // Writes the header, whose first field is the record size, in front of the record and appends the payload.
+    template<typename Header>
+    static std::vector<uint8_t> Finish(std::vector<uint8_t>& record, Header& header, const std::vector<uint8_t>& payload)
+    {
+        record.insert(record.end(), payload.begin(), payload.end());
+        header.Size = static_cast<uint16_t>(record.size());
+        memcpy(record.data(), &header, sizeof(header));
+        return record;
+    }
+
+    uint32_t m_bufferSize;
+    std::vector<uint8_t> m_bytes;
+    size_t m_current = 0;
+    uint32_t m_filled = 0;
+};
+
+// File in the temporary directory, removed again when the test is done with it.
+class TempFile
+{
+public:
+    explicit TempFile(const std::string& name)
+        : m_path(std::filesystem::temp_directory_path() / ("etl_lens_" + name)) {
+
+    }
+
+    TempFile(const TempFile& other) = delete;
+
+    TempFile& operator=(const TempFile& other) = delete;
+
+    ~TempFile()
+    {
+        std::error_code error;
+        std::filesystem::remove(m_path, error);
+    }
+
+    const std::filesystem::path& GetPath() const { return m_path; }
+
+private:
+    std::filesystem::path m_path;
+};
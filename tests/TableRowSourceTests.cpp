@@ -0,0 +1,191 @@
+#include <cstdint>
+#include <cstdio>
+#include <set>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <utils/TableRowSource.h>
+#include "Test.h"
+
+namespace {
+
+/*
+Source whose rows are loaded in pages, like the event instance table: Prepare requests the pages
+of the visible rows and LoadRequested stands in for the worker delivering them. Counts what the
+renderer reads.
+*/
+class PagedRows : public TableRowSource
+{
+public:
+    static constexpr size_t PAGE_ROWS = 64;
+
+    PagedRows(size_t rowCount, size_t columnCount, bool loaded) : m_rowCount(rowCount), m_columnCount(columnCount), m_loaded(loaded) {
+
+    }
+
+    size_t RowCount() const override { return m_rowCount; }
+    size_t ColumnCount() const override { return m_columnCount; }
+
+    void Prepare(size_t firstRow, size_t endRow) override
+    {
+        m_prepared.emplace_back(firstRow, endRow);
+        for (size_t page = firstRow / PAGE_ROWS; page <= (endRow - 1) / PAGE_ROWS; page++) {
+            if (m_loadedPages.count(page) == 0)
+                m_requestedPages.insert(page);
+        }
+    }
+
+    bool IsReady(size_t row) override { return m_loaded || m_loadedPages.count(row / PAGE_ROWS) != 0; }
+
+    bool IsSelected(size_t row) const override { return row == m_selectedRow; }
+
+    const char* GetLabel(size_t row) override
+    {
+        m_labelReads++;
+        snprintf(m_label, sizeof(m_label), "%zu###%zu", row, row);
+        return m_label;
+    }
+
+    std::string_view GetCell(size_t row, size_t column) override
+    {
+        m_cellReads++;
+        int length = snprintf(m_cell, sizeof(m_cell), "r%zuc%zu", row, column);
+        return std::string_view(m_cell, static_cast<size_t>(length));
+    }
+
+    void LoadRequested()
+    {
+        m_loadedPages.insert(m_requestedPages.begin(), m_requestedPages.end());
+        m_requestedPages.clear();
+    }
+
+    size_t m_selectedRow = SIZE_MAX;
+    std::vector<std::pair<size_t, size_t>> m_prepared;
+    std::set<size_t> m_requestedPages;
+    size_t m_labelReads = 0;
+    size_t m_cellReads = 0;
+
+private:
+    size_t m_rowCount;
+    size_t m_columnCount;
+    bool m_loaded;
+    std::set<size_t> m_loadedPages;
+    char m_label[64];
+    char m_cell[64];
+};
+
+class MinimalRows : public TableRowSource
+{
+public:
+    size_t RowCount() const override { return 3; }
+    size_t ColumnCount() const override { return 1; }
+    const char* GetLabel(size_t) override { return "row"; }
+    std::string_view GetCell(size_t, size_t) override { return {}; }
+};
+
+struct FrameResult {
+    std::vector<size_t> m_rows;
+    size_t m_loadingRows = 0;
+    size_t m_selectedRows = 0;
+};
+
+// What DrawTableRows does for a visible range, without the UI calls.
+FrameResult DrawFrame(TableRowSource& source, size_t firstRow, size_t endRow)
+{
+    FrameResult result;
+    VisitTableRows(source, firstRow, endRow, [&](size_t row, bool ready) {
+        result.m_rows.push_back(row);
+        if (!ready) {
+            result.m_loadingRows++;
+            return;
+        }
+        source.GetLabel(row);
+        if (source.IsSelected(row))
+            result.m_selectedRows++;
+        for (size_t column = 1; column < source.ColumnCount(); column++)
+            source.GetCell(row, column);
+    });
+    return result;
+}
+
+}
+
+TEST(VisitTableRowsVisitsOnlyTheRequestedRange)
+{
+    PagedRows rows(1000000, 5, true);
+    rows.m_selectedRow = 120;
+    FrameResult frame = DrawFrame(rows, 100, 140);
+    CHECK(frame.m_rows.size() == 40);
+    for (size_t i = 0; i < frame.m_rows.size(); i++)
+        CHECK(frame.m_rows[i] == 100 + i);
+    CHECK(frame.m_loadingRows == 0);
+    CHECK(frame.m_selectedRows == 1);
+    CHECK(rows.m_prepared.size() == 1);
+    CHECK(rows.m_prepared[0] == std::make_pair(size_t(100), size_t(140)));
+    CHECK(rows.m_labelReads == 40);
+    CHECK(rows.m_cellReads == 40 * 4);
+}
+
+TEST(VisitTableRowsClampsToTheTable)
+{
+    PagedRows rows(10, 2, true);
+    FrameResult frame = DrawFrame(rows, 5, 50);
+    CHECK(frame.m_rows == std::vector<size_t>({ 5, 6, 7, 8, 9 }));
+    CHECK(rows.m_prepared.size() == 1);
+    CHECK(rows.m_prepared[0] == std::make_pair(size_t(5), size_t(10)));
+
+    // Ranges past the end or empty ones neither prepare nor visit anything.
+    CHECK(DrawFrame(rows, 10, 20).m_rows.empty());
+    CHECK(DrawFrame(rows, 7, 7).m_rows.empty());
+    CHECK(DrawFrame(rows, 8, 3).m_rows.empty());
+    CHECK(rows.m_prepared.size() == 1);
+
+    PagedRows empty(0, 2, true);
+    CHECK(DrawFrame(empty, 0, 30).m_rows.empty());
+    CHECK(empty.m_prepared.empty());
+}
+
+TEST(VisitTableRowsReportsRowsStillLoading)
+{
+    PagedRows rows(10000, 3, false);
+    FrameResult frame = DrawFrame(rows, 60, 100);
+    CHECK(frame.m_loadingRows == 40);
+    CHECK(rows.m_labelReads == 0);
+    CHECK(rows.m_cellReads == 0);
+    CHECK(rows.m_requestedPages == std::set<size_t>({ 0, 1 }));
+
+    rows.LoadRequested();
+    frame = DrawFrame(rows, 60, 100);
+    CHECK(frame.m_loadingRows == 0);
+    CHECK(rows.m_labelReads == 40);
+    CHECK(rows.m_requestedPages.empty());
+
+    // Scrolling half a page on only requests the page that came into view.
+    frame = DrawFrame(rows, 100, 140);
+    CHECK(frame.m_loadingRows == 12);
+    CHECK(rows.m_requestedPages == std::set<size_t>({ 2 }));
+}
+
+TEST(FrameCostDoesNotDependOnTableSize)
+{
+    PagedRows small(1000, 8, true);
+    PagedRows large(50000000, 8, true);
+    for (size_t frame = 0; frame < 100; frame++) {
+        size_t first = frame * 7;
+        DrawFrame(small, first, first + 45);
+        DrawFrame(large, first * 50000, first * 50000 + 45);
+    }
+    CHECK(small.m_labelReads == 100 * 45);
+    CHECK(large.m_labelReads == small.m_labelReads);
+    CHECK(large.m_cellReads == small.m_cellReads);
+    CHECK(large.m_prepared.size() == 100);
+}
+
+TEST(TableRowSourceDefaults)
+{
+    MinimalRows rows;
+    FrameResult frame = DrawFrame(rows, 0, 10);
+    CHECK(frame.m_rows.size() == 3);
+    CHECK(frame.m_loadingRows == 0);
+    CHECK(frame.m_selectedRows == 0);
+}
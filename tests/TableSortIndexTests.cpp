@@ -0,0 +1,356 @@
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+#include <utils/StringPool.h>
+#include <utils/TableSortIndex.h>
+#include "Test.h"
+
+namespace {
+
+// A row of the Events table: names in a pool, then the numeric tie breakers.
+struct MetadataRow {
+    StringPool::Id m_provider;
+    StringPool::Id m_task;
+    uint16_t m_eventId;
+    uint8_t m_version;
+};
+
+enum : uint32_t {
+    COLUMN_PROVIDER,
+    COLUMN_TASK,
+    COLUMN_EVENT_ID,
+    COLUMN_VERSION,
+    COLUMN_COUNT
+};
+
+std::vector<MetadataRow> MakeMetadataRows(StringPool& pool, size_t count, uint32_t seed)
+{
+    static const char* const PROVIDERS[] = { "Microsoft-Windows-Kernel-Process", "Microsoft-Windows-Kernel-File", "MSNT_SystemTrace", "", "Contoso" };
+    static const char* const TASKS[] = { "ProcessStart", "Create", "Close", "", "Read", "Write", "read" };
+    std::mt19937 random(seed);
+    std::vector<MetadataRow> rows(count);
+    for (MetadataRow& row : rows) {
+        row.m_provider = pool.Intern(PROVIDERS[random() % std::size(PROVIDERS)]);
+        row.m_task = pool.Intern(TASKS[random() % std::size(TASKS)]);
+        row.m_eventId = static_cast<uint16_t>(random() % 8);
+        row.m_version = static_cast<uint8_t>(random() % 2);
+    }
+    return rows;
+}
+
+// Rebuilds every key from the rows, the way the Events table does after rows are appended.
+void UpdateKeys(TableSortIndex& index, const std::vector<MetadataRow>& rows, const StringPool& pool)
+{
+    std::vector<StringPool::Id> providers;
+    std::vector<StringPool::Id> tasks;
+    for (const MetadataRow& row : rows) {
+        providers.push_back(row.m_provider);
+        tasks.push_back(row.m_task);
+    }
+    std::vector<uint32_t> providerRanks = CollationRanks(providers, pool);
+    std::vector<uint32_t> taskRanks = CollationRanks(tasks, pool);
+    index.GetKeys(COLUMN_PROVIDER).assign(providerRanks.begin(), providerRanks.end());
+    index.GetKeys(COLUMN_TASK).assign(taskRanks.begin(), taskRanks.end());
+    index.GetKeys(COLUMN_EVENT_ID).clear();
+    index.GetKeys(COLUMN_VERSION).clear();
+    for (const MetadataRow& row : rows) {
+        index.GetKeys(COLUMN_EVENT_ID).push_back(row.m_eventId);
+        index.GetKeys(COLUMN_VERSION).push_back(row.m_version);
+    }
+}
+
+// The order the sort keys ask for, comparing the text itself, with ties broken by row.
+std::vector<uint32_t> ReferenceOrder(const std::vector<MetadataRow>& rows, const StringPool& pool, const std::vector<TableSortIndex::SortKey>& sortKeys)
+{
+    std::vector<uint32_t> order(rows.size());
+    for (size_t i = 0; i < order.size(); i++)
+        order[i] = static_cast<uint32_t>(i);
+    auto value = [&](const MetadataRow& row, uint32_t column) {
+        switch (column) {
+        case COLUMN_PROVIDER: return std::make_tuple(pool.Get(row.m_provider), 0);
+        case COLUMN_TASK: return std::make_tuple(pool.Get(row.m_task), 0);
+        case COLUMN_EVENT_ID: return std::make_tuple(std::string_view(), static_cast<int>(row.m_eventId));
+        default: return std::make_tuple(std::string_view(), static_cast<int>(row.m_version));
+        }
+    };
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        for (const TableSortIndex::SortKey& key : sortKeys) {
+            auto lhs = value(rows[a], key.m_column);
+            auto rhs = value(rows[b], key.m_column);
+            if (lhs != rhs)
+                return (lhs < rhs) != key.m_descending;
+        }
+        return false;
+    });
+    return order;
+}
+
+// The order of the rows by the given key columns, ties broken by row.
+std::vector<uint32_t> ReferenceOrder(const std::vector<std::vector<uint64_t>>& keys, const std::vector<TableSortIndex::SortKey>& sortKeys, size_t rowCount)
+{
+    std::vector<uint32_t> order(rowCount);
+    for (size_t i = 0; i < order.size(); i++)
+        order[i] = static_cast<uint32_t>(i);
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        for (const TableSortIndex::SortKey& key : sortKeys) {
+            uint64_t lhs = keys[key.m_column][a];
+            uint64_t rhs = keys[key.m_column][b];
+            if (lhs != rhs)
+                return (lhs < rhs) != key.m_descending;
+        }
+        return false;
+    });
+    return order;
+}
+
+// A sort index over copies of the given key columns, sorted by sortKeys.
+std::vector<uint32_t> SortedOrder(const std::vector<std::vector<uint64_t>>& keys, const std::vector<TableSortIndex::SortKey>& sortKeys, size_t rowCount)
+{
+    TableSortIndex index(keys.size());
+    for (size_t column = 0; column < keys.size(); column++)
+        index.GetKeys(column) = keys[column];
+    index.AppendRows(rowCount);
+    index.Sort(sortKeys);
+    return index.GetOrder();
+}
+
+// rowCount keys spread over [base, base + range], with many duplicates when range is small.
+std::vector<uint64_t> RandomKeys(std::mt19937_64& random, size_t rowCount, uint64_t base, uint64_t range)
+{
+    std::vector<uint64_t> keys(rowCount);
+    for (uint64_t& key : keys)
+        key = base + (range == ~0ull ? random() : random() % (range + 1));
+    if (rowCount >= 2) {
+        keys[0] = base; // Pin the range, so the key width is exactly that of range.
+        keys[1] = base + range;
+    }
+    return keys;
+}
+
+}
+
+TEST(CollationRanksOrderIdsLikeTheirText)
+{
+    StringPool pool;
+    std::vector<StringPool::Id> ids;
+    for (const char* text : { "pear", "apple", "", "Pear", "pear", "apple pie", "apple", "\xC3\xA9t\xC3\xA9" })
+        ids.push_back(pool.Intern(text));
+    std::vector<uint32_t> ranks = CollationRanks(ids, pool);
+    CHECK(ranks.size() == ids.size());
+
+    // Byte order: "" < "Pear" < "apple" < "apple pie" < "pear" < UTF-8 text; duplicates share a rank and ranks are dense.
+    CHECK(ranks == std::vector<uint32_t>({ 4, 2, 0, 1, 4, 3, 2, 5 }));
+    for (size_t i = 0; i < ids.size(); i++) {
+        for (size_t j = 0; j < ids.size(); j++) {
+            CHECK((ranks[i] < ranks[j]) == (pool.Get(ids[i]) < pool.Get(ids[j])));
+            CHECK((ranks[i] == ranks[j]) == (ids[i] == ids[j]));
+        }
+    }
+
+    CHECK(CollationRanks({}, pool).empty());
+    // Pool ids are in insertion order, which says nothing about the text order.
+    StringPool::Id z = pool.Intern("zzz");
+    StringPool::Id a = pool.Intern("aaa");
+    CHECK(CollationRanks({ z, a, z }, pool) == std::vector<uint32_t>({ 1, 0, 1 }));
+}
+
+TEST(MetadataSortMatchesSortingTheText)
+{
+    StringPool pool;
+    std::vector<MetadataRow> rows = MakeMetadataRows(pool, 500, 13);
+    TableSortIndex index(COLUMN_COUNT);
+    UpdateKeys(index, rows, pool);
+    index.AppendRows(rows.size());
+    CHECK(index.RowCount() == rows.size());
+    CHECK(!index.IsSorted());
+
+    // The sort specs the table offers, followed by the tie breakers it appends.
+    std::vector<std::vector<TableSortIndex::SortKey>> specs = {
+        { { COLUMN_PROVIDER, false }, { COLUMN_TASK, false }, { COLUMN_EVENT_ID, false }, { COLUMN_VERSION, false } },
+        { { COLUMN_TASK, true }, { COLUMN_PROVIDER, false }, { COLUMN_EVENT_ID, false }, { COLUMN_VERSION, false } },
+        { { COLUMN_EVENT_ID, true }, { COLUMN_PROVIDER, true }, { COLUMN_TASK, false }, { COLUMN_VERSION, false } },
+        { { COLUMN_VERSION, false } },
+    };
+    for (const auto& sortKeys : specs) {
+        index.Sort(sortKeys);
+        CHECK(index.IsSorted());
+        CHECK(index.GetOrder() == ReferenceOrder(rows, pool, sortKeys));
+    }
+
+    // New rows bring new names; ranks of the old rows shift but keep their relative order.
+    std::vector<TableSortIndex::SortKey> byTask = specs[1];
+    index.Sort(byTask);
+    std::vector<MetadataRow> more = MakeMetadataRows(pool, 300, 14);
+    more[0].m_provider = pool.Intern("AAA first provider");
+    more[1].m_task = pool.Intern("zzz last task");
+    more[2].m_task = pool.Intern("Create2");
+    rows.insert(rows.end(), more.begin(), more.end());
+    UpdateKeys(index, rows, pool);
+    index.AppendRows(rows.size());
+    CHECK(index.RowCount() == rows.size());
+    CHECK(index.GetOrder() == ReferenceOrder(rows, pool, byTask));
+    CHECK(rows[index.GetRow(0)].m_task == pool.Intern("zzz last task"));
+}
+
+TEST(SortIndexPacksKeysUpToExactly64Bits)
+{
+    std::mt19937_64 random(5);
+    const size_t rowCount = 3000;
+
+    // Key widths of 3 + 61, 32 + 32 and a single 64 bit key fill the packed key exactly; 33 + 32 does not fit.
+    struct Case {
+        std::vector<uint64_t> m_ranges;
+        std::vector<uint64_t> m_bases;
+    };
+    std::vector<Case> cases = {
+        { { 7, (1ull << 61) - 1 }, { 100, 5 } },
+        { { 0xFFFFFFFFull, 0xFFFFFFFFull }, { 1ull << 40, 0 } },
+        { { ~0ull }, { 0 } },
+        { { (1ull << 33) - 1, 0xFFFFFFFFull }, { 0, 0 } },
+        { { 3, 0, 15 }, { 0, 42, ~0ull - 15 } }, // A constant column packs to nothing.
+    };
+    for (const Case& c : cases) {
+        std::vector<std::vector<uint64_t>> keys;
+        for (size_t column = 0; column < c.m_ranges.size(); column++)
+            keys.push_back(RandomKeys(random, rowCount, c.m_bases[column], c.m_ranges[column]));
+        for (unsigned directions = 0; directions < (1u << keys.size()); directions++) {
+            std::vector<TableSortIndex::SortKey> sortKeys;
+            for (uint32_t column = 0; column < keys.size(); column++)
+                sortKeys.push_back({ column, ((directions >> column) & 1) != 0 });
+            CHECK(SortedOrder(keys, sortKeys, rowCount) == ReferenceOrder(keys, sortKeys, rowCount));
+            std::reverse(sortKeys.begin(), sortKeys.end());
+            CHECK(SortedOrder(keys, sortKeys, rowCount) == ReferenceOrder(keys, sortKeys, rowCount));
+        }
+    }
+}
+
+TEST(SortIndexRadixSortsLargeTables)
+{
+    std::mt19937_64 random(6);
+    const size_t rowCount = TableSortIndex::RADIX_THRESHOLD + 1234;
+    std::vector<std::vector<uint64_t>> keys = {
+        RandomKeys(random, rowCount, 0, 1000),               // Many ties, broken by row.
+        RandomKeys(random, rowCount, 1ull << 63, 0xFFFFFF), // Passes over constant bytes are skipped.
+        RandomKeys(random, rowCount, 0, ~0ull),              // Too wide to pack with another key.
+    };
+    for (std::vector<TableSortIndex::SortKey> sortKeys : std::vector<std::vector<TableSortIndex::SortKey>>{
+             { { 0, false } },
+             { { 0, true } },
+             { { 1, true }, { 0, false } },
+             { { 0, false }, { 1, true } },
+             { { 2, false } },
+             { { 2, true }, { 0, false } },
+         }) {
+        CHECK(SortedOrder(keys, sortKeys, rowCount) == ReferenceOrder(keys, sortKeys, rowCount));
+    }
+}
+
+TEST(SortIndexMergesAppendedRowsIntoTheOrder)
+{
+    std::mt19937_64 random(7);
+    std::vector<std::vector<uint64_t>> keys = { RandomKeys(random, 50000, 0, 50), RandomKeys(random, 50000, 0, ~0ull) };
+    std::vector<TableSortIndex::SortKey> packed = { { 0, true }, { 1, false } };
+    std::vector<TableSortIndex::SortKey> wide = { { 1, true } };
+
+    TableSortIndex index(keys.size());
+    size_t rowCount = 0;
+    for (size_t next : { size_t(1000), size_t(1001), size_t(20000), size_t(50000) }) {
+        for (size_t column = 0; column < keys.size(); column++)
+            index.GetKeys(column).assign(keys[column].begin(), keys[column].begin() + static_cast<ptrdiff_t>(next));
+        index.AppendRows(next);
+        rowCount = next;
+        if (!index.IsSorted())
+            index.Sort(packed);
+        CHECK(index.GetOrder() == ReferenceOrder(keys, packed, rowCount));
+    }
+
+    // Appending nothing, or fewer rows than there are, changes nothing.
+    std::vector<uint32_t> before = index.GetOrder();
+    index.AppendRows(rowCount);
+    index.AppendRows(10);
+    CHECK(index.GetOrder() == before);
+
+    // Sorting by another key and appending again keeps the new key's order.
+    index.Sort(wide);
+    std::vector<uint64_t> extra = RandomKeys(random, 777, 0, ~0ull);
+    keys[0].resize(rowCount + extra.size(), 3);
+    keys[1].insert(keys[1].end(), extra.begin(), extra.end());
+    index.GetKeys(0) = keys[0];
+    index.GetKeys(1) = keys[1];
+    index.AppendRows(keys[1].size());
+    CHECK(index.GetOrder() == ReferenceOrder(keys, wide, keys[1].size()));
+}
+
+TEST(SortIndexReusesCachedOrders)
+{
+    std::mt19937_64 random(8);
+    const size_t rowCount = 2000;
+    std::vector<std::vector<uint64_t>> keys = { RandomKeys(random, rowCount, 0, 9), RandomKeys(random, rowCount, 0, 999) };
+    TableSortIndex index(keys.size());
+    index.GetKeys(0) = keys[0];
+    index.GetKeys(1) = keys[1];
+    index.AppendRows(rowCount);
+
+    std::vector<TableSortIndex::SortKey> byFirst = { { 0, false } };
+    std::vector<TableSortIndex::SortKey> bySecond = { { 1, true } };
+    index.Sort(byFirst);
+    std::vector<uint32_t> firstOrder = index.GetOrder();
+    index.Sort(bySecond);
+    CHECK(index.GetOrder() == ReferenceOrder(keys, bySecond, rowCount));
+
+    // Switching back takes the cached order instead of sorting: keys changed behind the index's back are not looked at.
+    std::reverse(index.GetKeys(0).begin(), index.GetKeys(0).end());
+    index.Sort(byFirst);
+    CHECK(index.GetOrder() == firstOrder);
+    // Sorting by the current keys again is a no-op as well.
+    index.Sort(byFirst);
+    CHECK(index.GetOrder() == firstOrder);
+
+    // Appending rows drops the cache, so the next switch sorts with the keys as they are.
+    index.GetKeys(0) = keys[0];
+    index.GetKeys(0).push_back(0);
+    index.GetKeys(1).push_back(0);
+    keys[0].push_back(0);
+    keys[1].push_back(0);
+    index.AppendRows(rowCount + 1);
+    index.Sort(bySecond);
+    CHECK(index.GetOrder() == ReferenceOrder(keys, bySecond, rowCount + 1));
+
+    // More sort specs than the cache holds: the oldest are sorted again, and every order is still right.
+    std::vector<std::vector<TableSortIndex::SortKey>> specs;
+    for (uint32_t i = 0; i < TableSortIndex::ORDER_CACHE_CAPACITY + 3; i++)
+        specs.push_back({ { i % 2, (i / 2) % 2 != 0 }, { 1 - i % 2, (i / 4) % 2 != 0 } });
+    for (int round = 0; round < 2; round++) {
+        for (const auto& sortKeys : specs) {
+            index.Sort(sortKeys);
+            CHECK(index.GetOrder() == ReferenceOrder(keys, sortKeys, rowCount + 1));
+        }
+    }
+}
+
+TEST(SortIndexMatchesStableSortOnRandomKeyMixes)
+{
+    std::mt19937_64 random(9);
+    for (int round = 0; round < 60; round++) {
+        size_t rowCount = 1 + random() % 3000;
+        size_t columnCount = 1 + random() % 4;
+        std::vector<std::vector<uint64_t>> keys;
+        for (size_t column = 0; column < columnCount; column++) {
+            unsigned width = static_cast<unsigned>(random() % 65);
+            uint64_t range = width == 64 ? ~0ull : (1ull << width) - 1;
+            uint64_t base = range == 0 ? random() : random() % (~0ull - range + 1); // Keeps base + range from wrapping.
+            keys.push_back(RandomKeys(random, rowCount, base, range));
+        }
+        std::vector<TableSortIndex::SortKey> sortKeys;
+        for (uint32_t column = 0; column < columnCount; column++) {
+            if (random() % 4 != 0)
+                sortKeys.push_back({ column, random() % 2 == 0 });
+        }
+        std::shuffle(sortKeys.begin(), sortKeys.end(), random);
+        CHECK(SortedOrder(keys, sortKeys, rowCount) == ReferenceOrder(keys, sortKeys, rowCount));
+    }
+}
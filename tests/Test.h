@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/*
+Minimal test registry, so the tests build with nothing but the compiler.
+TEST(Name) defines a test case and registers it with the runner in TestMain.cpp. CHECK throws
+TestFailure when its condition does not hold, which ends the case and is reported by the runner.
+*/
+struct TestCase {
+    const char* m_name;
+    void (*m_pFunc)();
+};
+
+inline std::vector<TestCase>& GetTestCases()
+{
+    static std::vector<TestCase> cases;
+    return cases;
+}
+
+struct TestRegistration {
+    TestRegistration(const char* name, void (*pFunc)()) {
+        GetTestCases().push_back(TestCase{ name, pFunc });
+    }
+};
+
+class TestFailure : public std::runtime_error
+{
+public:
+    using std::runtime_error::runtime_error;
+};
+
+#define TEST(name) \
+    static void name(); \
+    static TestRegistration name##Registration(#name, name); \
+    static void name()
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) \
+            throw TestFailure(std::string(__FILE__) + ":" + std::to_string(__LINE__) + ": CHECK(" #condition ") failed"); \
+    } while (0)
+
+// Checks that the statement throws an exception of the given type.
+#define CHECK_THROWS(statement, exception) \
+    do { \
+        bool thrown = false; \
+        try { statement; } catch (const exception&) { thrown = true; } \
+        if (!thrown) \
+            throw TestFailure(std::string(__FILE__) + ":" + std::to_string(__LINE__) + ": " #statement " did not throw " #exception); \
+    } while (0)
@@ -0,0 +1,31 @@
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include "Test.h"
+
+// Runs every registered test, or those whose name contains the first argument. Returns 1 if any failed.
+int main(int argc, char** argv)
+{
+    const char* filter = argc > 1 ? argv[1] : "";
+    size_t run = 0;
+    size_t failed = 0;
+    for (const TestCase& test : GetTestCases()) {
+        if (strstr(test.m_name, filter) == nullptr)
+            continue;
+        run++;
+        auto start = std::chrono::steady_clock::now();
+        try {
+            test.m_pFunc();
+        }
+        catch (const std::exception& e) {
+            failed++;
+            printf("FAILED %s\n  %s\n", test.m_name, e.what());
+            continue;
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        printf("ok     %s (%.1f ms)\n", test.m_name, ms);
+    }
+    printf("%zu tests, %zu failed\n", run, failed);
+    return failed == 0 && run > 0 ? 0 : 1;
+}
@@ -0,0 +1,178 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <utils/ThreadPool.h>
+#include "Test.h"
+
+namespace {
+
+// Sums [begin, end) by splitting it in TaskGroups down to small leaves, so groups nest deeply.
+uint64_t ForkJoinSum(ThreadPool& pool, uint64_t begin, uint64_t end)
+{
+    if (end - begin <= 64) {
+        uint64_t sum = 0;
+        for (uint64_t i = begin; i < end; i++)
+            sum += i;
+        return sum;
+    }
+    uint64_t middle = begin + (end - begin) / 2;
+    uint64_t left = 0;
+    TaskGroup group(pool);
+    group.Run([&]() { left = ForkJoinSum(pool, begin, middle); });
+    uint64_t right = ForkJoinSum(pool, middle, end);
+    group.Wait();
+    return left + right;
+}
+
+}
+
+TEST(ThreadPoolParallelForVisitsEveryIndexOnce)
+{
+    ThreadPool pool(4);
+    for (unsigned maxSlots : { 1u, 2u, 5u, UINT32_MAX }) {
+        for (size_t count : { size_t(0), size_t(1), size_t(3), size_t(10000) }) {
+            std::vector<std::atomic<uint32_t>> visits(count);
+            std::vector<std::atomic<bool>> busy(pool.SlotCount());
+            std::atomic<bool> sharedSlot = false;
+            pool.ParallelFor(count, [&](unsigned slot, size_t i) {
+                CHECK(slot < (std::min)(pool.SlotCount(), maxSlots));
+                // A slot is only ever used by one runner at a time.
+                if (busy[slot].exchange(true))
+                    sharedSlot = true;
+                visits[i]++;
+                busy[slot] = false;
+            }, maxSlots);
+            CHECK(!sharedSlot);
+            for (auto& visit : visits)
+                CHECK(visit == 1);
+        }
+    }
+}
+
+TEST(ThreadPoolStressNestedTaskGroups)
+{
+    ThreadPool pool(4);
+    for (int round = 0; round < 20; round++) {
+        uint64_t end = 20000 + round * 997;
+        CHECK(ForkJoinSum(pool, 0, end) == end * (end - 1) / 2);
+    }
+
+    // ParallelFor inside ParallelFor, as per-type decoding runs inside parallel ingest.
+    std::atomic<uint64_t> total = 0;
+    pool.ParallelFor(64, [&](unsigned, size_t outer) {
+        pool.ParallelFor(256, [&](unsigned, size_t inner) {
+            total += outer * 256 + inner;
+        });
+    });
+    CHECK(total == uint64_t(64 * 256) * (64 * 256 - 1) / 2);
+}
+
+TEST(ThreadPoolStressExternalSubmitters)
+{
+    ThreadPool pool(3);
+    constexpr int THREADS = 4;
+    constexpr int TASKS = 2000;
+    std::atomic<uint64_t> sum = 0;
+    std::vector<std::thread> submitters;
+    for (int t = 0; t < THREADS; t++) {
+        submitters.emplace_back([&pool, &sum, t]() {
+            std::vector<std::future<int>> futures;
+            for (int i = 0; i < TASKS; i++)
+                futures.push_back(pool.Submit([t, i]() { return t * TASKS + i; }));
+            TaskGroup group(pool);
+            for (int i = 0; i < TASKS; i++)
+                group.Run([&sum]() { sum += 1; });
+            for (auto& future : futures)
+                sum += static_cast<uint64_t>(future.get());
+            group.Wait();
+        });
+    }
+    for (auto& submitter : submitters)
+        submitter.join();
+    uint64_t n = THREADS * TASKS;
+    CHECK(sum == n * (n - 1) / 2 + n);
+}
+
+TEST(ThreadPoolTaskGroupRethrowsAndRecovers)
+{
+    ThreadPool pool(2);
+    for (int round = 0; round < 50; round++) {
+        std::atomic<int> ran = 0;
+        TaskGroup group(pool);
+        for (int i = 0; i < 16; i++) {
+            group.Run([&ran, i]() {
+                ran++;
+                if (i % 5 == 3)
+                    throw std::runtime_error("task failed");
+            });
+        }
+        CHECK_THROWS(group.Wait(), std::runtime_error);
+        CHECK(ran == 16);
+        // The error is reported once; the group and the pool stay usable.
+        group.Run([&ran]() { ran++; });
+        group.Wait();
+        CHECK(ran == 17);
+    }
+    std::future<int> future = pool.Submit([]() -> int { throw std::logic_error("submitted"); });
+    CHECK_THROWS(future.get(), std::logic_error);
+}
+
+TEST(ThreadPoolStressStartAndStop)
+{
+    // Pools are created and destroyed while their workers are still going to sleep.
+    for (int round = 0; round < 50; round++) {
+        auto pPool = std::make_unique<ThreadPool>(1 + round % 4);
+        std::atomic<int> ran = 0;
+        pPool->ParallelFor(100, [&ran](unsigned, size_t) { ran++; });
+        CHECK(ran == 100);
+        pPool.reset();
+    }
+}
+
+TEST(ThreadPoolTaskGroupWaitRunsOnlyItsOwnTasks)
+{
+    // The only worker is busy, so everything queued behind it is left to whoever waits.
+    ThreadPool pool(1);
+    std::atomic<bool> release = false;
+    std::future<void> blocker = pool.Submit([&release]() {
+        while (!release)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    });
+    std::atomic<bool> unrelatedRan = false;
+    std::future<void> unrelated = pool.Submit([&unrelatedRan]() { unrelatedRan = true; });
+    TaskGroup otherGroup(pool);
+    std::atomic<bool> otherGroupRan = false;
+    otherGroup.Run([&otherGroupRan]() { otherGroupRan = true; });
+
+    // Wait runs the group's tasks on this thread, including tasks they fork into nested groups.
+    std::thread::id caller = std::this_thread::get_id();
+    std::atomic<int> ran = 0;
+    std::atomic<bool> elsewhere = false;
+    TaskGroup group(pool);
+    for (int i = 0; i < 8; i++) {
+        group.Run([&, i]() {
+            if (std::this_thread::get_id() != caller)
+                elsewhere = true;
+            TaskGroup nested(pool);
+            nested.Run([&ran, i]() { ran += i; });
+            nested.Wait();
+        });
+    }
+    group.Wait();
+    CHECK(ran == 28);
+    CHECK(!elsewhere);
+    CHECK(!unrelatedRan);
+    CHECK(!otherGroupRan);
+
+    release = true;
+    blocker.get();
+    unrelated.get();
+    otherGroup.Wait();
+    CHECK(unrelatedRan && otherGroupRan);
+}
@@ -0,0 +1,164 @@
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <ETL/DecodePlan.h>
+#include <ETL/EtlValueFormatter.h>
+#include "Test.h"
+
+namespace {
+
+EtlValue MakeValue(EtlValueKind kind, uint16_t inType, uint16_t outType = ETL_OUTTYPE_NULL)
+{
+    EtlValue value{};
+    value.m_kind = kind;
+    value.m_inType = inType;
+    value.m_outType = outType;
+    return value;
+}
+
+EtlValue BytesValue(EtlValueKind kind, uint16_t inType, const std::vector<uint8_t>& bytes)
+{
+    EtlValue value = MakeValue(kind, inType);
+    value.m_pData = bytes.data();
+    value.m_size = static_cast<uint32_t>(bytes.size());
+    return value;
+}
+
+// The formatted text, or "<unsupported>" / "<too small>".
+std::string Format(const EtlValue& value)
+{
+    std::vector<char> buffer(EtlFormatBound(value));
+    size_t written = 0;
+    switch (EtlFormatValue(value, buffer.data(), buffer.size(), &written)) {
+    case EtlFormatResult::Ok: return std::string(buffer.data(), written);
+    case EtlFormatResult::Unsupported: return "<unsupported>";
+    default: return "<too small>";
+    }
+}
+
+template<typename T>
+void Put(std::vector<uint8_t>& bytes, T value)
+{
+    bytes.resize(bytes.size() + sizeof(T));
+    memcpy(bytes.data() + bytes.size() - sizeof(T), &value, sizeof(T));
+}
+
+std::string ScalarHex(const std::vector<uint8_t>& bytes)
+{
+    static const char HEX[] = "0123456789ABCDEF";
+    std::string text = "0x";
+    for (uint8_t byte : bytes) {
+        text += HEX[byte >> 4];
+        text += HEX[byte & 0xF];
+    }
+    return text;
+}
+
+}
+
+TEST(FormatterWritesGuidsInRegistryFormat)
+{
+    std::vector<uint8_t> bytes;
+    Put(bytes, uint32_t(0x9E814AAD));
+    Put(bytes, uint16_t(0x3204));
+    Put(bytes, uint16_t(0x5BCD));
+    for (uint8_t byte : { 0xA0, 0x1F, 0x01, 0x23, 0x45, 0x67, 0x89, 0xAB })
+        bytes.push_back(byte);
+    EtlValue value = BytesValue(EtlValueKind::Guid, ETL_INTYPE_GUID, bytes);
+    CHECK(Format(value) == "{9E814AAD-3204-5BCD-A01F-0123456789AB}");
+    value.m_outType = ETL_OUTTYPE_GUID;
+    CHECK(Format(value) == "{9E814AAD-3204-5BCD-A01F-0123456789AB}");
+    value.m_outType = ETL_OUTTYPE_STRING;
+    CHECK(Format(value) == "<unsupported>");
+}
+
+TEST(FormatterWritesSidsWithEverySubAuthority)
+{
+    std::vector<uint8_t> system = { 1, 1, 0, 0, 0, 0, 0, 5 };
+    Put(system, uint32_t(18));
+    CHECK(Format(BytesValue(EtlValueKind::Sid, ETL_INTYPE_SID, system)) == "S-1-5-18");
+
+    std::vector<uint8_t> user = { 1, 5, 0, 0, 0, 0, 0, 5 };
+    for (uint32_t subAuthority : { 21u, 1004336348u, 1177238915u, 4294967295u, 1001u })
+        Put(user, subAuthority);
+    CHECK(Format(BytesValue(EtlValueKind::Sid, ETL_INTYPE_SID, user)) == "S-1-5-21-1004336348-1177238915-4294967295-1001");
+
+    // The 48 bit identifier authority is big endian.
+    std::vector<uint8_t> authority = { 1, 0, 0x12, 0x34, 0x56, 0x78, 0x9A, 0xBC };
+    CHECK(Format(BytesValue(EtlValueKind::Sid, ETL_INTYPE_SID, authority)) == "S-1-20015998343868");
+}
+
+TEST(FormatterWritesFileTimesAsUtc)
+{
+    EtlValue value = MakeValue(EtlValueKind::FileTime, ETL_INTYPE_FILETIME);
+    value.m_uint = 0;
+    CHECK(Format(value) == "1601-01-01T00:00:00.0000000Z");
+    value.m_uint = 116444736000000000ull; // The Unix epoch.
+    CHECK(Format(value) == "1970-01-01T00:00:00.0000000Z");
+    value.m_uint = 116444736000000000ull + 951782400ull * 10000000 + 86399ull * 10000000 + 1234567; // 2000-02-29, a century leap day.
+    CHECK(Format(value) == "2000-02-29T23:59:59.1234567Z");
+    value.m_uint = 133500000000000000ull;
+    CHECK(Format(value) == "2024-01-17T21:20:00.0000000Z");
+
+    value.m_outType = ETL_OUTTYPE_DATETIME_UTC;
+    CHECK(Format(value) == "2024-01-17T21:20:00.0000000Z");
+    // Local time is left to TdhFormatProperty rather than written as UTC.
+    value.m_outType = ETL_OUTTYPE_DATETIME;
+    CHECK(Format(value) == "<unsupported>");
+}
+
+TEST(FormatterWritesSystemTimesAsRecorded)
+{
+    std::vector<uint8_t> bytes;
+    for (uint16_t field : { 2023, 7, 3, 4, 5, 6, 7, 89 })
+        Put(bytes, field);
+    EtlValue value = BytesValue(EtlValueKind::SystemTime, ETL_INTYPE_SYSTEMTIME, bytes);
+    CHECK(Format(value) == "2023-07-04T05:06:07.089");
+    value.m_outType = ETL_OUTTYPE_DATETIME_UTC;
+    CHECK(Format(value) == "2023-07-04T05:06:07.089");
+    value.m_outType = ETL_OUTTYPE_DATETIME;
+    CHECK(Format(value) == "<unsupported>");
+}
+
+TEST(FormatterWritesPointersAtTheirWidth)
+{
+    EtlValue value = MakeValue(EtlValueKind::UInt, ETL_INTYPE_POINTER);
+    value.m_uint = 0x1234;
+    value.m_size = 4;
+    CHECK(Format(value) == "0x00001234");
+    value.m_size = 8;
+    CHECK(Format(value) == "0x0000000000001234");
+    value.m_uint = 0xFFFFF80012345678ull;
+    CHECK(Format(value) == "0xFFFFF80012345678");
+    value.m_outType = ETL_OUTTYPE_HEXINT64;
+    CHECK(Format(value) == "0xFFFFF80012345678");
+    value.m_outType = ETL_OUTTYPE_UNSIGNEDLONG;
+    CHECK(Format(value) == "<unsupported>");
+}
+
+TEST(FormatterWritesBinaryHexAroundTheBlockSize)
+{
+    // The vector path handles 16 byte blocks and the scalar loop the rest; every mix must agree with the scalar reference.
+    for (size_t size : { 0, 1, 15, 16, 17, 31, 32, 33, 48, 63 }) {
+        std::vector<uint8_t> bytes(size);
+        for (size_t i = 0; i < size; i++)
+            bytes[i] = static_cast<uint8_t>(i * 37 + 0x9A); // Covers digits and letters in both nibbles.
+        EtlValue value = BytesValue(EtlValueKind::Binary, ETL_INTYPE_BINARY, bytes);
+        CHECK(Format(value) == ScalarHex(bytes));
+        value.m_outType = ETL_OUTTYPE_HEXBINARY;
+        CHECK(Format(value) == ScalarHex(bytes));
+    }
+
+    std::vector<uint8_t> edges = { 0x00, 0x09, 0x0A, 0x0F, 0x90, 0xA0, 0xF0, 0xFF, 0x7F, 0x80, 0x99, 0xAA, 0x19, 0x1A, 0xE9, 0xEA, 0x5C };
+    CHECK(Format(BytesValue(EtlValueKind::Binary, ETL_INTYPE_BINARY, edges)) == "0x00090A0F90A0F0FF7F8099AA191AE9EA5C");
+}
+
+TEST(FormatterReportsBuffersThatAreTooSmall)
+{
+    std::vector<uint8_t> bytes(20, 0xAB);
+    EtlValue value = BytesValue(EtlValueKind::Binary, ETL_INTYPE_BINARY, bytes);
+    std::vector<char> buffer(EtlFormatBound(value) - 1);
+    size_t written = 0;
+    CHECK(EtlFormatValue(value, buffer.data(), buffer.size(), &written) == EtlFormatResult::BufferTooSmall);
+}